@@ -0,0 +1,153 @@
+#pragma once
+
+#include "MCCITypes.h"
+#include <vector>
+#include <map>
+#include <boost/cstdint.hpp>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+
+/**
+   A set of client ids as a bitset, one bit per id.  It grows to hold the highest
+   id set, so its size is bounded by max_clients.
+
+   Sets are combined with merge (a bitwise OR, 128 bits at a time where SSE2 is
+   available) and emptied with drain, which visits the ids in order and clears
+   them as it goes -- so the same set can be reused packet after packet without
+   allocating.
+ */
+class ClientBitset
+{
+  protected:
+    vector<uint64_t> m_words;
+
+  public:
+
+    ClientBitset() { }
+
+    // room for ids below a given bound, so that merges don't have to grow the set
+    ClientBitset(unsigned int bound) : m_words((bound + 63) / 64, 0) { }
+
+    void set(MCCI_CLIENT_ID_T id)
+    {
+        unsigned int w = id / 64;
+        if (w >= this->m_words.size()) this->m_words.resize(w + 1, 0);
+        this->m_words[w] |= 1ull << (id % 64);
+    }
+
+    void reset(MCCI_CLIENT_ID_T id)
+    {
+        unsigned int w = id / 64;
+        if (w < this->m_words.size()) this->m_words[w] &= ~(1ull << (id % 64));
+    }
+
+    bool test(MCCI_CLIENT_ID_T id) const
+    {
+        unsigned int w = id / 64;
+        return w < this->m_words.size() && (this->m_words[w] >> (id % 64)) & 1;
+    }
+
+    bool empty() const
+    {
+        for (unsigned int w = 0; w < this->m_words.size(); ++w)
+            if (this->m_words[w]) return false;
+        return true;
+    }
+
+    unsigned int count() const
+    {
+        unsigned int n = 0;
+        for (unsigned int w = 0; w < this->m_words.size(); ++w)
+            n += __builtin_popcountll(this->m_words[w]);
+        return n;
+    }
+
+    // remove every id (keeping the storage)
+    void clear()
+    {
+        for (unsigned int w = 0; w < this->m_words.size(); ++w) this->m_words[w] = 0;
+    }
+
+    // add every id in another set to this one
+    void merge(const ClientBitset& other)
+    {
+        unsigned int n = other.m_words.size();
+        if (!n) return;
+        if (n > this->m_words.size()) this->m_words.resize(n, 0);
+
+        uint64_t* dst = &(this->m_words[0]);
+        const uint64_t* src = &(other.m_words[0]);
+        unsigned int i = 0;
+
+#ifdef __SSE2__
+        for (; i + 2 <= n; i += 2)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i*)(dst + i));
+            __m128i b = _mm_loadu_si128((const __m128i*)(src + i));
+            _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(a, b));
+        }
+#endif
+        for (; i < n; ++i) dst[i] |= src[i];
+    }
+
+    // call visit(id) for each id in the set, lowest first, leaving the set empty
+    template <typename Visitor> void drain(Visitor& visit)
+    {
+        for (unsigned int w = 0; w < this->m_words.size(); ++w)
+        {
+            uint64_t bits = this->m_words[w];
+            if (!bits) continue;
+            this->m_words[w] = 0;
+
+            for (; bits; bits &= bits - 1)
+                visit((MCCI_CLIENT_ID_T)(w * 64 + __builtin_ctzll(bits)));
+        }
+    }
+};
+
+
+/**
+   The subscribers to one key set: a map of client id to whatever the bank keeps
+   per subscription, with the client ids mirrored in a ClientBitset so that the
+   subscribers of several banks can be combined without walking the maps.
+
+   It has the parts of the std::map interface that the request banks use.
+ */
+template <typename Value> class SubscriberSet
+{
+  protected:
+    typedef map<MCCI_CLIENT_ID_T, Value> Map;
+
+    Map m_map;
+    ClientBitset m_clients;
+
+  public:
+    typedef typename Map::iterator iterator;
+    typedef typename Map::const_iterator const_iterator;
+
+    Value& operator[](MCCI_CLIENT_ID_T client_id)
+    {
+        this->m_clients.set(client_id);
+        return this->m_map[client_id];
+    }
+
+    void erase(MCCI_CLIENT_ID_T client_id)
+    {
+        this->m_clients.reset(client_id);
+        this->m_map.erase(client_id);
+    }
+
+    iterator find(MCCI_CLIENT_ID_T client_id) { return this->m_map.find(client_id); }
+    iterator begin() { return this->m_map.begin(); }
+    iterator end() { return this->m_map.end(); }
+
+    bool empty() const { return this->m_map.empty(); }
+    unsigned int size() const { return this->m_map.size(); }
+
+    const ClientBitset& clients() const { return this->m_clients; }
+};
@@ -0,0 +1,98 @@
+#include "ClientBitset.h"
+#include <set>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+using namespace std;
+
+
+// gathers the ids drain hands out
+struct Collect
+{
+    vector<MCCI_CLIENT_ID_T> ids;
+    void operator()(MCCI_CLIENT_ID_T id) { ids.push_back(id); }
+};
+
+
+void test_bitset_operations()
+{
+    ClientBitset a, b(100);
+
+    printf("\n\nSetting 3, 64 and 1000 in one set, 3, 65 and 99 in another");
+    a.set(3);
+    a.set(64);
+    a.set(1000);
+    b.set(3);
+    b.set(65);
+    b.set(99);
+    assert(a.test(1000) && !a.test(999) && !a.test(60000));
+    assert(3 == a.count() && 3 == b.count());
+
+    a.reset(64);
+    a.reset(60000); // never set, past the end
+    assert(!a.test(64));
+
+    a.merge(b);
+    printf("\nUnion has %d clients (expect 4)", a.count());
+    assert(4 == a.count());
+
+    Collect c;
+    a.drain(c);
+    MCCI_CLIENT_ID_T expect[] = {3, 65, 99, 1000};
+    printf("\nDrained:");
+    for (unsigned int i = 0; i < c.ids.size(); ++i) printf(" %d", c.ids[i]);
+    assert(4 == c.ids.size());
+    for (unsigned int i = 0; i < 4; ++i) assert(expect[i] == c.ids[i]);
+    assert(a.empty());
+    assert(3 == b.count());
+}
+
+
+// subscriber sets keep their bitset in step with their map
+void test_subscriber_set()
+{
+    SubscriberSet<int> s;
+    set<MCCI_CLIENT_ID_T> reference;
+
+    srand(1);
+    for (int i = 0; i < 20000; ++i)
+    {
+        MCCI_CLIENT_ID_T id = rand() % 700;
+        if (rand() % 3)
+        {
+            s[id] = i;
+            reference.insert(id);
+        }
+        else
+        {
+            s.erase(id);
+            reference.erase(id);
+        }
+    }
+
+    printf("\n\nRandomized: %d subscribers, %d in reference set", s.size(), (int)reference.size());
+    assert(s.size() == reference.size());
+    assert(s.clients().count() == reference.size());
+
+    ClientBitset copy;
+    copy.merge(s.clients());
+    Collect c;
+    copy.drain(c);
+    assert(vector<MCCI_CLIENT_ID_T>(reference.begin(), reference.end()) == c.ids);
+
+    for (SubscriberSet<int>::iterator it = s.begin(); it != s.end(); ++it)
+        assert(s.clients().test(it->first));
+}
+
+
+int main()
+{
+    test_bitset_operations();
+    test_subscriber_set();
+
+    printf("\n\n");
+
+    return 0;
+}
@@ -0,0 +1,269 @@
+#pragma once
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <new>
+#include "SlabPool.h"
+
+using namespace std;
+
+
+/**
+   An array-backed D-ary min-heap (4-ary by default) with stable node handles,
+   and the same interface as FibonacciHeap, so that RequestBank can use either.
+
+   The array holds each entry's key next to a pointer to its node, so sifting
+   compares keys without touching the nodes.  The node remembers its position in
+   the array, which is what makes handles work: decrease_key, increase_key and
+   remove find the entry directly and sift it from there.
+
+   insert, decrease_key, increase_key, remove and remove_minimum are O(log n)
+   with a shallow tree (log base D); minimum is O(1).
+ */
+template <typename Key, typename Data> class DaryHeapNode
+{
+  protected:
+    Key m_key;
+    Data m_data;
+    unsigned int m_position; // index into the heap's array
+
+  public:
+    DaryHeapNode(Key k, Data d)
+    {
+        this->m_key      = k;
+        this->m_data     = d;
+        this->m_position = 0;
+    }
+
+    void print_node(ostream& out) const { out << this->m_data << ":" << this->m_key; }
+
+    Key key() const { return this->m_key; }
+    Data data() const { return this->m_data; }
+
+    template <typename K, typename D, unsigned int A, typename Al> friend class DaryHeap;
+};
+
+
+// declare class to enable declaration of ostream operator
+template <typename Key, typename Data, unsigned int D, typename Allocator> class DaryHeap;
+template <typename Key, typename Data, unsigned int D, typename Allocator>
+    ostream& operator<<(ostream &, const DaryHeap<Key, Data, D, Allocator> &);
+
+
+template <typename Key, typename Data, unsigned int D = 4,
+          typename Allocator = SlabPool<DaryHeapNode<Key, Data> > > class DaryHeap
+{
+    typedef char arity_must_be_at_least_2[D >= 2 ? 1 : -1];
+
+  public:
+    typedef DaryHeapNode<Key, Data> Node;
+
+  protected:
+    typedef struct
+    {
+        Key key;
+        Node* node;
+    } Entry;
+
+    vector<Entry> m_heap;
+    Allocator m_allocator;
+
+    // a heap owns its nodes
+    DaryHeap(const DaryHeap &rhs);
+    DaryHeap& operator=(const DaryHeap &rhs);
+
+  public:
+
+    DaryHeap() { }
+
+    ~DaryHeap() { this->clear(); }
+
+    friend ostream& operator<< <>(ostream& output, const DaryHeap<Key, Data, D, Allocator>& v);
+
+    string summary() const
+    {
+        stringstream s;
+        this->print_roots(s);
+        return s.str();
+    }
+
+    bool empty() const { return this->m_heap.empty(); }
+    unsigned int size() const { return this->m_heap.size(); }
+
+    // free every node (the array keeps its capacity)
+    void clear()
+    {
+        for (typename vector<Entry>::iterator it = this->m_heap.begin(); it != this->m_heap.end(); ++it)
+            this->destroy_node(it->node);
+        this->m_heap.clear();
+    }
+
+    Node* minimum() const
+    {
+        if (this->m_heap.empty()) throw string("no minimum element");
+        return this->m_heap[0].node;
+    }
+
+    void remove_minimum()
+    {
+        if (this->m_heap.empty()) throw string("trying to remove from an empty heap");
+        this->remove_at(0);
+    }
+
+    // remove any node (minus_infinity is accepted for compatibility with FibonacciHeap)
+    void remove(Node* node, Key minus_infinity)
+    {
+        this->remove_at(node->m_position);
+    }
+
+    void decrease_key(Node* node, Key new_key)
+    {
+        if (new_key >= node->m_key)
+            throw string("Trying to decrease key to a greater key");
+
+        node->m_key = new_key;
+        this->m_heap[node->m_position].key = new_key;
+        this->sift_up(node->m_position);
+    }
+
+    void increase_key(Node* node, Key new_key)
+    {
+        if (new_key <= node->m_key)
+            throw string("Trying to increase key to a lesser key");
+
+        node->m_key = new_key;
+        this->m_heap[node->m_position].key = new_key;
+        this->sift_down(node->m_position);
+    }
+
+    void alter_key(Node* node, Key new_key, Key minus_infinity)
+    {
+        if (new_key < node->m_key) this->decrease_key(node, new_key);
+        else if (new_key > node->m_key) this->increase_key(node, new_key);
+    }
+
+    // remove every node with a key at or below the deadline, calling expired(data) for
+    //  each one; returns how many went
+    template <typename Callback> unsigned int expire_until(Key deadline, Callback& expired)
+    {
+        unsigned int removed = 0;
+
+        while (!this->m_heap.empty() && this->m_heap[0].key <= deadline)
+        {
+            expired(this->m_heap[0].node->m_data);
+            this->remove_at(0);
+            ++removed;
+        }
+
+        return removed;
+    }
+
+    Node* insert(Key k, Data d)
+    {
+        Node* n = new (this->m_allocator.allocate()) Node(k, d);
+
+        Entry e;
+        e.key = k;
+        e.node = n;
+        this->m_heap.push_back(e);
+        this->sift_up(this->m_heap.size() - 1);
+
+        return n;
+    }
+
+    // prints the array in heap order
+    void print_roots(ostream& out) const
+    {
+        out << "m_count=" << this->m_heap.size() << "  nodes=";
+        for (typename vector<Entry>::const_iterator it = this->m_heap.begin(); it != this->m_heap.end(); ++it)
+        {
+            it->node->print_node(out);
+            out << " ";
+        }
+    }
+
+    // node allocation statistics
+    const Allocator& allocator() const { return this->m_allocator; }
+
+
+  protected:
+
+    // put an entry where it belongs and tell its node
+    void place(unsigned int i, Entry const &e)
+    {
+        this->m_heap[i] = e;
+        e.node->m_position = i;
+    }
+
+    // move an entry toward the root until its parent isn't greater
+    void sift_up(unsigned int i)
+    {
+        Entry e = this->m_heap[i];
+
+        while (i > 0)
+        {
+            unsigned int parent = (i - 1) / D;
+            if (!(e.key < this->m_heap[parent].key)) break;
+            this->place(i, this->m_heap[parent]);
+            i = parent;
+        }
+
+        this->place(i, e);
+    }
+
+    // move an entry toward the leaves until no child is smaller
+    void sift_down(unsigned int i)
+    {
+        Entry e = this->m_heap[i];
+        unsigned int n = this->m_heap.size();
+
+        for (;;)
+        {
+            unsigned int first = D * i + 1;
+            if (first >= n) break;
+
+            unsigned int last = (first + D < n) ? first + D : n;
+            unsigned int best = first;
+            for (unsigned int c = first + 1; c < last; ++c)
+                if (this->m_heap[c].key < this->m_heap[best].key) best = c;
+
+            if (!(this->m_heap[best].key < e.key)) break;
+            this->place(i, this->m_heap[best]);
+            i = best;
+        }
+
+        this->place(i, e);
+    }
+
+    // free the node at a position and fill the gap with the last entry
+    void remove_at(unsigned int i)
+    {
+        this->destroy_node(this->m_heap[i].node);
+
+        Entry last = this->m_heap.back();
+        this->m_heap.pop_back();
+        if (i == this->m_heap.size()) return;
+
+        this->place(i, last);
+        if (i > 0 && last.key < this->m_heap[(i - 1) / D].key)
+            this->sift_up(i);
+        else
+            this->sift_down(i);
+    }
+
+    void destroy_node(Node* n)
+    {
+        n->~Node();
+        this->m_allocator.deallocate(n);
+    }
+};
+
+
+template <typename Key, typename Data, unsigned int D, typename Allocator>
+    ostream& operator<<(ostream& output, const DaryHeap<Key, Data, D, Allocator>& v)
+{
+    v.print_roots(output);
+    return output;
+}
@@ -0,0 +1,144 @@
+#include "DaryHeap.h"
+#include "FibonacciHeap.h"
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+using namespace std;
+
+
+void test_heap_operations()
+{
+    DaryHeap<unsigned int, string> h;
+
+    printf("\n\nInserting 50, 10, 40, 30, 20 and 60");
+    DaryHeapNode<unsigned int, string>* a = h.insert(50, "a");
+    DaryHeapNode<unsigned int, string>* b = h.insert(10, "b");
+    h.insert(40, "c");
+    DaryHeapNode<unsigned int, string>* d = h.insert(30, "d");
+    h.insert(20, "e");
+    h.insert(60, "f");
+    cout << "\n" << h;
+    assert(6 == h.size());
+
+    printf("\nMinimum is %d (expect 10)", h.minimum()->key());
+    assert(b == h.minimum());
+
+    h.increase_key(b, 45);
+    h.decrease_key(a, 5);
+    printf("\nAfter moving 10 to 45 and 50 to 5, minimum is %d", h.minimum()->key());
+    assert(a == h.minimum());
+
+    h.remove(d, 0);
+    h.alter_key(a, 100, 0);
+
+    unsigned int expect[] = {20, 40, 45, 60, 100};
+    for (unsigned int i = 0; i < 5; ++i)
+    {
+        printf("\nRemoving %d", h.minimum()->key());
+        assert(expect[i] == h.minimum()->key());
+        h.remove_minimum();
+    }
+    assert(h.empty());
+
+    bool thrown = false;
+    try { h.minimum(); } catch (string s) { thrown = true; }
+    assert(thrown);
+
+    thrown = false;
+    a = h.insert(7, "g");
+    try { h.increase_key(a, 3); } catch (string s) { thrown = true; }
+    assert(thrown);
+
+    h.clear();
+    assert(h.empty());
+}
+
+
+// random operations, checked against FibonacciHeap.  the data is the node's id
+void test_against_heap()
+{
+    typedef DaryHeap<unsigned int, unsigned int> Dary;
+    typedef FibonacciHeap<unsigned int, unsigned int> Heap;
+
+    Dary d;
+    Heap h;
+    vector<Dary::Node*> dn;  // NULL once removed
+    vector<Heap::Node*> hn;
+    unsigned int now = 1000;
+    unsigned int expired = 0;
+
+    srand(1);
+    for (unsigned int i = 0; i < 200000; ++i)
+    {
+        int op = rand() % 10;
+        unsigned int timeout = now + 1 + rand() % 100000;
+        unsigned int victim = rand() % (dn.size() + 1);
+        bool live = victim < dn.size() && dn[victim];
+
+        if (op < 5 || !live)
+        {
+            dn.push_back(d.insert(timeout, dn.size()));
+            hn.push_back(h.insert(timeout, hn.size()));
+        }
+        else if (op < 7)
+        {
+            d.alter_key(dn[victim], timeout, 0);
+            h.alter_key(hn[victim], timeout, 0);
+        }
+        else if (op < 8)
+        {
+            d.remove(dn[victim], 0);
+            h.remove(hn[victim], 0);
+            dn[victim] = NULL;
+        }
+        else
+        {
+            // time passes and everything due expires
+            now += rand() % 50;
+            while (!d.empty() && d.minimum()->key() <= now)
+            {
+                unsigned int id = d.minimum()->data();
+                assert(d.minimum()->key() == h.minimum()->key());
+                d.remove_minimum();
+                h.remove(hn[id], 0);
+                dn[id] = NULL;
+                ++expired;
+            }
+        }
+
+        assert(d.empty() == h.empty());
+        if (!d.empty()) assert(d.minimum()->key() == h.minimum()->key());
+    }
+
+    printf("\n\nRandomized: %d expired, %d left", expired, d.size());
+
+    while (!d.empty())
+    {
+        assert(d.minimum()->key() == h.minimum()->key());
+        h.remove(hn[d.minimum()->data()], 0);
+        d.remove_minimum();
+    }
+    assert(h.empty());
+}
+
+
+int main()
+{
+    try
+    {
+        test_heap_operations();
+        test_against_heap();
+    }
+    catch (string s)
+    {
+        printf("\n\nERROR: %s\n", s.c_str());
+        return 1;
+    }
+
+    printf("\n\n");
+
+    return 0;
+}
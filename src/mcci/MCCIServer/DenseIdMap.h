@@ -0,0 +1,313 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <boost/cstdint.hpp>
+
+using namespace std;
+
+
+/**
+   A map for keys from a 16 bit domain (variable ids, node addresses, client ids)
+   with the same interface as LinearHash.
+
+   There is no hashing: the key is the index into an array of entries, and a
+   presence bitmap says which entries exist.  A lookup is one bit test and one
+   load.  The array grows (in powers of 2, at most 65536 entries) to cover the
+   largest key seen, so memory follows the largest id rather than the number of
+   ids.  Iteration visits present keys in ascending order.
+
+   Growing moves the entries, so inserting a new key past the end of the array
+   invalidates iterators and references to stored data.
+ */
+template <typename Key, typename Data> class DenseIdMap
+{
+    // the key domain must be small enough to index directly
+    typedef char key_must_be_16_bit[sizeof(Key) <= 2 ? 1 : -1];
+
+  public:
+    typedef pair<Key, Data> Entry;
+
+  protected:
+
+    // entries, indexed by key
+    Entry* m_entry;
+
+    // one bit per entry: whether the key is present
+    uint64_t* m_present;
+
+    // the number of entries in the array (a power of 2, at least MIN_SIZE)
+    unsigned int m_size;
+
+    // the number of keys present
+    unsigned int m_count;
+
+    static const unsigned int MIN_SIZE = 64;
+
+
+  public:
+
+    DenseIdMap()
+    {
+        this->m_size = 0;
+        this->resize(1);
+    }
+
+    DenseIdMap(unsigned int size)
+    {
+        this->m_size = 0;
+        this->resize(size);
+    }
+
+    DenseIdMap(const DenseIdMap &rhs)
+    {
+        this->m_size = 0;
+        this->operator=(rhs);
+    }
+
+    DenseIdMap& operator=(const DenseIdMap &rhs)
+    {
+        if (this == &rhs) return *this;
+
+        this->resize(rhs.m_size);
+        for (unsigned int i = 0; i < rhs.m_size; ++i)
+            this->m_entry[i] = rhs.m_entry[i];
+        for (unsigned int w = 0; w < rhs.m_size / 64; ++w)
+            this->m_present[w] = rhs.m_present[w];
+        this->m_count = rhs.m_count;
+
+        return *this;
+    }
+
+    ~DenseIdMap()
+    {
+        this->release();
+    }
+
+
+    // resize, destructively, to hold keys below the given size without growing
+    void resize(unsigned int size)
+    {
+        if (!size)
+        {
+            throw string("Tried to set map size to 0");
+        }
+
+        this->release();
+        this->allocate(size);
+        this->m_count = 0;
+    }
+
+    // the name is kept for compatibility with LinearHash
+    void resize_nearest_prime(unsigned int desired_size)
+    {
+        this->resize(desired_size);
+    }
+
+
+    // return the number of entries in the array
+    unsigned int get_size() const
+    {
+        return this->m_size;
+    }
+
+    // return the number of keys in the map
+    unsigned int count() const
+    {
+        return this->m_count;
+    }
+
+    // return whether the map is empty
+    bool empty() const
+    {
+        return 0 == this->m_count;
+    }
+
+    // keys never collide
+    unsigned int max_collisions() const
+    {
+        return this->m_count ? 1 : 0;
+    }
+
+
+    // explicitly insert an element into the map
+    void insert(Key k, Data d)
+    {
+        this->operator[](k) = d;
+    }
+
+    // explicitly remove a key from the map
+    void remove(Key k)
+    {
+        if (!this->has_key(k)) return;
+
+        this->m_entry[k].second = Data();
+        this->m_present[k / 64] &= ~(1ull << (k % 64));
+        --(this->m_count);
+    }
+
+    // check existence of a key
+    bool has_key(Key k) const
+    {
+        return k < this->m_size && (this->m_present[k / 64] >> (k % 64) & 1);
+    }
+
+
+    // the value for a key, or NULL if it isn't there
+    Data* lookup(Key k) const
+    {
+        return this->has_key(k) ? &(this->m_entry[k].second) : NULL;
+    }
+
+
+    // read-only access
+    Data& operator[] (Key k) const
+    {
+        return const_cast<DenseIdMap<Key, Data>*>(this)->operator[](k);
+    }
+
+    // array-style access to the map
+    Data& operator[] (Key k)
+    {
+        if (k >= this->m_size) this->grow(k + 1);
+
+        uint64_t bit = 1ull << (k % 64);
+        if (!(this->m_present[k / 64] & bit))
+        {
+            this->m_present[k / 64] |= bit;
+            this->m_entry[k].first = k;
+            ++(this->m_count);
+        }
+
+        return this->m_entry[k].second;
+    }
+
+
+    // remove all elements from the map, keeping its size
+    void clear()
+    {
+        for (unsigned int i = this->next_present(0); i < this->m_size; i = this->next_present(i + 1))
+            this->m_entry[i].second = Data();
+
+        for (unsigned int w = 0; w < this->m_size / 64; ++w)
+            this->m_present[w] = 0;
+
+        this->m_count = 0;
+    }
+
+
+    class iterator
+    {
+        const DenseIdMap<Key, Data>* m;
+        unsigned int idx;
+
+      public:
+
+        iterator() {}
+
+        iterator(const DenseIdMap<Key, Data>* const m, unsigned int idx)
+        {
+            this->m = m;
+            this->idx = idx;
+        }
+
+        iterator& operator++()
+        {
+            this->idx = this->m->next_present(this->idx + 1);
+            return *this;
+        }
+
+        iterator operator++(int)
+        {
+            iterator tmp(*this);
+            this->operator++();
+            return tmp;
+        }
+
+        bool operator==(const iterator& rhs) const
+        {
+            return rhs.m == this->m && rhs.idx == this->idx;
+        }
+
+        bool operator!=(const iterator& rhs) const
+        {
+            return rhs.m != this->m || rhs.idx != this->idx;
+        }
+
+        Entry& operator*() const { return this->m->m_entry[this->idx]; }
+
+        Entry* operator->() const { return &(this->m->m_entry[this->idx]); }
+    };
+
+    // iteration points: begin
+    iterator begin() const
+    {
+        return iterator(this, this->next_present(0));
+    }
+
+    // iteration points: end
+    iterator end() const
+    {
+        return iterator(this, this->m_size);
+    }
+
+
+  protected:
+
+    // set up arrays for at least this many entries, all absent
+    void allocate(unsigned int size)
+    {
+        unsigned int n = MIN_SIZE;
+        while (n < size) n *= 2;
+
+        this->m_size    = n;
+        this->m_entry   = new Entry[n]();
+        this->m_present = new uint64_t[n / 64]();
+    }
+
+    void release()
+    {
+        if (!this->m_size) return;
+
+        delete[] this->m_entry;
+        delete[] this->m_present;
+        this->m_size = 0;
+    }
+
+    // enlarge the arrays to hold this many entries, keeping the contents
+    void grow(unsigned int size)
+    {
+        Entry* old_entry = this->m_entry;
+        uint64_t* old_present = this->m_present;
+        unsigned int old_size = this->m_size;
+
+        this->allocate(size);
+
+        for (unsigned int i = 0; i < old_size; ++i)
+            this->m_entry[i] = old_entry[i];
+        for (unsigned int w = 0; w < old_size / 64; ++w)
+            this->m_present[w] = old_present[w];
+
+        delete[] old_entry;
+        delete[] old_present;
+    }
+
+    // the first present key at or after idx, or m_size if there are none
+    unsigned int next_present(unsigned int idx) const
+    {
+        if (idx >= this->m_size) return this->m_size;
+
+        unsigned int w = idx / 64;
+        uint64_t bits = this->m_present[w] & (~0ull << (idx % 64));
+        unsigned int words = this->m_size / 64;
+
+        while (!bits)
+        {
+            if (++w == words) return this->m_size;
+            bits = this->m_present[w];
+        }
+
+        return w * 64 + __builtin_ctzll(bits);
+    }
+
+};
@@ -0,0 +1,108 @@
+#include "DenseIdMap.h"
+#include <string>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <boost/cstdint.hpp>
+
+using namespace std;
+
+
+void test_map_operations()
+{
+    typedef DenseIdMap<uint16_t, string> NameMap;
+    NameMap dm(10);
+
+    printf("\n\nAdding 3000, 65535, and 37 to a map sized for 10");
+    dm.insert(3000, "three thousand");
+    dm.insert(65535, "the last id");
+    dm[37] = "thirty seven";
+
+    printf("\nExpect 3 elements in map, count() = %d, size %d", dm.count(), dm.get_size());
+    assert(3 == dm.count());
+    assert(65536 == dm.get_size());
+
+    printf("\nIterating (in key order):");
+    uint16_t expect[] = {37, 3000, 65535};
+    unsigned int n = 0;
+    for (NameMap::iterator it = dm.begin(); it != dm.end(); ++it)
+    {
+        printf("\n    %d\t: '%s'", it->first, it->second.c_str());
+        assert(expect[n++] == it->first);
+    }
+    assert(3 == n);
+
+    printf("\n3001 in map? %d", dm.has_key(3001));
+    printf("\n3000 in map? %d", dm.has_key(3000));
+    assert(!dm.has_key(3001));
+    assert(dm.has_key(3000));
+    assert(string("three thousand") == dm[3000]);
+
+    dm.remove(3000);
+    printf("\nRemoved 3000.  3000 in map? %d", dm.has_key(3000));
+    assert(!dm.has_key(3000));
+    printf("\nmap[3000] = '%s'", dm[3000].c_str());
+    printf("\nauto-added null 3000 after access? %d", dm.has_key(3000));
+    assert(dm.has_key(3000));
+    assert(string("") == dm[3000]);
+    dm.remove(3000);
+    assert(2 == dm.count());
+
+    NameMap copy(dm);
+    dm.clear();
+    assert(dm.empty());
+    assert(dm.begin() == dm.end());
+    assert(2 == copy.count());
+    assert(string("the last id") == copy[65535]);
+
+    DenseIdMap<uint16_t, unsigned int> im;
+    printf("\n\nInt value of uninitialized lookup key 42 is %d (we expect 0)", im[42]);
+    assert(0 == im[42]);
+}
+
+
+// random inserts and removals, checked against std::map
+void test_against_map()
+{
+    DenseIdMap<uint16_t, uint32_t> dm;
+    map<uint16_t, uint32_t> m;
+
+    srand(1);
+    for (int i = 0; i < 200000; ++i)
+    {
+        uint16_t k = rand() % 5000;
+        if (rand() % 3)
+        {
+            dm[k] = i;
+            m[k] = i;
+        }
+        else
+        {
+            dm.remove(k);
+            m.erase(k);
+        }
+    }
+
+    printf("\n\nRandomized: %d entries, %d in reference map", dm.count(), (int)m.size());
+    assert(dm.count() == m.size());
+
+    map<uint16_t, uint32_t>::iterator mit = m.begin();
+    for (DenseIdMap<uint16_t, uint32_t>::iterator it = dm.begin(); it != dm.end(); ++it, ++mit)
+    {
+        assert(mit->first == it->first);
+        assert(mit->second == it->second);
+    }
+    assert(m.end() == mit);
+}
+
+
+int main()
+{
+    test_map_operations();
+    test_against_map();
+
+    printf("\n\n");
+
+    return 0;
+}
@@ -0,0 +1,178 @@
+#include "MCCIRequestBanks.h"
+#include "ClientBitset.h"
+#include "RoutingCache.h"
+#include "DenseIdMap.h"
+#include "MCCIBenchmark.h"
+#include "MCCITypes.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+using namespace std;
+
+/**
+   Compares the two ways of finding the subscribers to a data packet across the
+   six request banks (what CMCCIServer::process_data does): walking each bank's
+   subscriber map into a DenseIdMap, OR-ing the banks' client bitsets, and taking
+   the standing subscriptions from a RoutingCache so only the two revision banks
+   are probed.  Subscriptions don't change during the run, so the cache always hits.
+
+   Each client subscribes to 5 variables, 2 host/variable pairs and 3 upcoming
+   revisions; 1 in 10 also subscribes to everything, and 1 in 5 to a host.
+   Packets come from 8 hosts with 50 variables.
+ */
+
+
+static const unsigned int HOSTS = 8;
+static const unsigned int VARS = 50;
+
+
+typedef struct
+{
+    AllRequestBank* all;
+    HostRequestBank* host;
+    VariableRequestBank* var;
+    HostVariableRequestBank* hostvar;
+    RemoteRevisionRequestBank* remote;
+    VariableRevisionRequestBank* varrev;
+} Banks;
+
+
+struct SinkClient
+{
+    void operator()(MCCI_CLIENT_ID_T client_id) { benchmark_sink += client_id; }
+};
+
+
+// the way process_data used to do it
+template <typename Bank, typename KeySet>
+void walk(const Bank* bank, KeySet key_set, DenseIdMap<MCCI_CLIENT_ID_T, bool>& hits)
+{
+    for (typename Bank::subscriber_iterator it = bank->subscribers_begin(key_set);
+         it != bank->subscribers_end(key_set); ++it)
+        hits[*it] = true;
+}
+
+
+void bench_fanout(unsigned int clients, unsigned int packets)
+{
+    Banks b;
+    b.all     = new AllRequestBank(clients, 1);
+    b.host    = new HostRequestBank(clients, 16);
+    b.var     = new VariableRequestBank(clients, 64);
+    b.hostvar = new HostVariableRequestBank(clients, 64);
+    b.remote  = new RemoteRevisionRequestBank(clients, 16, 16);
+    b.varrev  = new VariableRevisionRequestBank(clients, 64, 16);
+
+    MCCI_TIME_T forever = 1000000000;
+    srand(1);
+    for (MCCI_CLIENT_ID_T c = 0; c < clients; ++c)
+    {
+        if (0 == rand() % 10) b.all->add(1, c, forever);
+        if (0 == rand() % 5) b.host->add(1 + rand() % HOSTS, c, forever);
+
+        for (int i = 0; i < 5; ++i) b.var->add(1 + rand() % VARS, c, forever);
+
+        for (int i = 0; i < 2; ++i)
+        {
+            HostVarPair hv = {(MCCI_NODE_ADDRESS_T)(1 + rand() % HOSTS), (MCCI_VARIABLE_T)(1 + rand() % VARS)};
+            b.hostvar->add(hv, c, forever);
+        }
+
+        for (int i = 0; i < 3; ++i)
+        {
+            VarRevPair vr = {(MCCI_VARIABLE_T)(1 + rand() % VARS), (MCCI_REVISION_T)(1 + rand() % 4)};
+            b.varrev->add(vr, c, forever);
+        }
+    }
+
+    vector<SMCCIDataPacket> traffic(packets);
+    for (unsigned int i = 0; i < packets; ++i)
+    {
+        traffic[i].node_address = 1 + rand() % HOSTS;
+        traffic[i].variable_id  = 1 + rand() % VARS;
+        traffic[i].revision     = 1 + rand() % 4;
+        traffic[i].payload      = NULL;
+    }
+
+    printf("\n %d clients", clients);
+    CMCCIStopwatch sw;
+
+    sw.start();
+    for (unsigned int i = 0; i < packets; ++i)
+    {
+        const SMCCIDataPacket* p = &traffic[i];
+        DenseIdMap<MCCI_CLIENT_ID_T, bool> hits(100);
+        HostVarPair hv = {p->node_address, p->variable_id};
+        HostVarRevTuple hvr = {p->node_address, p->variable_id, p->revision};
+        VarRevPair vr = {p->variable_id, p->revision};
+
+        walk(b.all, true, hits);
+        walk(b.host, p->node_address, hits);
+        walk(b.var, p->variable_id, hits);
+        walk(b.hostvar, hv, hits);
+        walk(b.remote, hvr, hits);
+        walk(b.varrev, vr, hits);
+
+        for (DenseIdMap<MCCI_CLIENT_ID_T, bool>::iterator it = hits.begin(); it != hits.end(); ++it)
+            benchmark_sink += it->first;
+    }
+    benchmark_report("fan-out", "map walk", packets, sw.elapsed_ns());
+
+    ClientBitset fanout(clients + 1);
+    SinkClient sink;
+    sw.start();
+    for (unsigned int i = 0; i < packets; ++i)
+    {
+        const SMCCIDataPacket* p = &traffic[i];
+        HostVarPair hv = {p->node_address, p->variable_id};
+        HostVarRevTuple hvr = {p->node_address, p->variable_id, p->revision};
+        VarRevPair vr = {p->variable_id, p->revision};
+
+        b.all->collect_subscribers(true, fanout);
+        b.host->collect_subscribers(p->node_address, fanout);
+        b.var->collect_subscribers(p->variable_id, fanout);
+        b.hostvar->collect_subscribers(hv, fanout);
+        b.remote->collect_subscribers(hvr, fanout);
+        b.varrev->collect_subscribers(vr, fanout);
+
+        fanout.drain(sink);
+    }
+    benchmark_report("fan-out", "bitset union", packets, sw.elapsed_ns());
+
+    RoutingCache routes(*b.all, *b.host, *b.var, *b.hostvar);
+    sw.start();
+    for (unsigned int i = 0; i < packets; ++i)
+    {
+        const SMCCIDataPacket* p = &traffic[i];
+        HostVarRevTuple hvr = {p->node_address, p->variable_id, p->revision};
+        VarRevPair vr = {p->variable_id, p->revision};
+
+        fanout.merge(routes.subscribers(p->node_address, p->variable_id));
+        b.remote->collect_subscribers(hvr, fanout);
+        b.varrev->collect_subscribers(vr, fanout);
+
+        fanout.drain(sink);
+    }
+    benchmark_report("fan-out", "routing cache", packets, sw.elapsed_ns());
+
+    delete b.all;
+    delete b.host;
+    delete b.var;
+    delete b.hostvar;
+    delete b.remote;
+    delete b.varrev;
+}
+
+
+int main()
+{
+    printf("\nData packet fan-out: subscriber maps vs client bitsets");
+
+    bench_fanout(10, 200000);
+    bench_fanout(100, 200000);
+    bench_fanout(1000, 200000);
+
+    printf("\n\n");
+    return 0;
+}
@@ -12,6 +12,8 @@
 #include <iostream>
 #include <sstream>
 #include <vector>
+#include <new>
+#include "SlabPool.h"
 using namespace std;
 
 typedef unsigned int uint;
@@ -28,6 +30,9 @@ template <typename Key, typename Data> class FibonacciHeapNode
     
     uint m_degree; // number of childern. used in the removeMinimum algorithm.
     bool m_mark;   // mark used in the decreaseKey algorithm.
+
+    Key m_pending_key; // a later key that hasn't been applied yet (see alter_key)
+    bool m_pending;
     
     //uint m_count; // total number of elements in tree, including this. For debug only
     
@@ -59,45 +64,59 @@ template <typename Key, typename Data> class FibonacciHeapNode
     void print_tree(ostream& out) const;
     void print_all(ostream& out) const;
 	
-    Key key() const { return m_key; }
+    // the key as far as users of the heap are concerned; the heap orders by m_key,
+    //  which is never more than this
+    Key key() const { return m_pending ? m_pending_key : m_key; }
     Data data() const { return m_data; }
 	
-    template <typename D, typename K> friend class FibonacciHeap;
+    template <typename K, typename D, typename A> friend class FibonacciHeap;
 }; // FibonacciHeapNode
 
 
 // declare class to enable declaration of ostream operator
-template <typename Key, typename Data> class FibonacciHeap;
-template <typename Key, typename Data>
-    ostream& operator<<(ostream &, const FibonacciHeap<Key, Data> &);
+template <typename Key, typename Data, typename Allocator> class FibonacciHeap;
+template <typename Key, typename Data, typename Allocator>
+    ostream& operator<<(ostream &, const FibonacciHeap<Key, Data, Allocator> &);
 
 
 
-template <typename Key, typename Data> class FibonacciHeap 
+/**
+ * Nodes come from the Allocator (see SlabPool.h); by default each heap keeps a
+ * pool of them, so inserting and removing in a steady state doesn't touch malloc.
+ */
+template <typename Key, typename Data,
+          typename Allocator = SlabPool<FibonacciHeapNode<Key, Data> > > class FibonacciHeap 
 {
     typedef FibonacciHeapNode<Key, Data>* PNodePtr;
+
+  public:
+    typedef FibonacciHeapNode<Key, Data> Node;
     
   protected:
     
     PNodePtr m_root_with_min_key; // a circular d-list of nodes
     uint m_count;      // total number of elements in heap
     uint m_max_degree;  // maximum degree (=child count) of a root in the  circular d-list
+    Allocator m_allocator; // where nodes come from
     
     PNodePtr insert_node(PNodePtr new_node);
+    void destroy_node(PNodePtr node);
     void remove_minimum_h(bool delete_node); 
+    void settle();
     
   public:
     bool m_debug, m_debug_remove_min, m_debug_decrease_key;
     
     FibonacciHeap();
     
-    ~FibonacciHeap() { while (!empty()) remove_minimum(); }; // TODO: can do this more efficiently
+    ~FibonacciHeap() { clear(); };
 
-    friend ostream& operator<< <>(ostream& output, const FibonacciHeap<Key, Data>& v);
+    friend ostream& operator<< <>(ostream& output, const FibonacciHeap<Key, Data, Allocator>& v);
     string summary() const;
     
     bool empty() const { return 0 == this->m_count; };
     bool size() const { return this->m_count; };
+    void clear();
 
     PNodePtr minimum() const;
     void remove_minimum();
@@ -105,11 +124,18 @@ template <typename Key, typename Data> class FibonacciHeap
     void decrease_key(PNodePtr node, Key new_key);
     void alter_key(PNodePtr node, Key new_key, Key minus_infinity);
 
+    // remove every node with a key at or below the deadline, consolidating once.
+    //  expired(data) is called for each one (in no particular order); returns how many went
+    template <typename Callback> uint expire_until(Key deadline, Callback& expired);
+
     PNodePtr insert(Key k, Data d);	
     void merge(const FibonacciHeap& other);
 
     void print_roots(ostream& out) const;
 
+    // node allocation statistics
+    const Allocator& allocator() const { return this->m_allocator; }
+
 };  // FibonacciHeap
 
 
@@ -125,6 +151,7 @@ template <typename Key, typename Data>
     m_data     = d;
     m_degree   = 0;
     m_mark     = false;
+    m_pending  = false;
     m_child    = NULL;
     m_parent   = NULL;
     m_previous = m_next = this; // doubly linked circular list
@@ -255,8 +282,8 @@ template <typename Key, typename Data>
 //////////////////////////////////////////// FibonacciHeap
 
 
-template <typename Key, typename Data>
-    FibonacciHeap<Key, Data>::FibonacciHeap()
+template <typename Key, typename Data, typename Allocator>
+    FibonacciHeap<Key, Data, Allocator>::FibonacciHeap()
 {
     m_root_with_min_key  = NULL;
     m_count              = 0;
@@ -267,16 +294,16 @@ template <typename Key, typename Data>
 }
 
 
-template <typename Key, typename Data>
-    ostream& operator<<(ostream& output, const FibonacciHeap<Key, Data>& v)
+template <typename Key, typename Data, typename Allocator>
+    ostream& operator<<(ostream& output, const FibonacciHeap<Key, Data, Allocator>& v)
 {
     v.print_roots(output);
     return output;
 }
 
 
-template <typename Key, typename Data>
-    string FibonacciHeap<Key, Data>::summary() const
+template <typename Key, typename Data, typename Allocator>
+    string FibonacciHeap<Key, Data, Allocator>::summary() const
 {
     stringstream s;
     print_roots(s);
@@ -284,8 +311,8 @@ template <typename Key, typename Data>
 }
 
 
-template <typename Key, typename Data>
-    FibonacciHeapNode<Key, Data>* FibonacciHeap<Key, Data>::insert_node(FibonacciHeapNode<Key, Data>* new_node) 
+template <typename Key, typename Data, typename Allocator>
+    FibonacciHeapNode<Key, Data>* FibonacciHeap<Key, Data, Allocator>::insert_node(FibonacciHeapNode<Key, Data>* new_node) 
 {
     if (m_debug) cerr << "\ninsert_node";
     if (!m_root_with_min_key) 
@@ -303,15 +330,15 @@ template <typename Key, typename Data>
         }
         m_root_with_min_key->insert(new_node);  // insert the root of new tree to the list of roots
 
-        if (new_node->key() < m_root_with_min_key->key())
+        if (new_node->m_key < m_root_with_min_key->m_key)
             m_root_with_min_key = new_node;
     }
     return new_node;
 }
 
 
-template <typename Key, typename Data>
-    FibonacciHeapNode<Key, Data>* FibonacciHeap<Key, Data>::minimum() const 
+template <typename Key, typename Data, typename Allocator>
+    FibonacciHeapNode<Key, Data>* FibonacciHeap<Key, Data, Allocator>::minimum() const 
 { 
     if (!m_root_with_min_key)
         throw string("no minimum element");
@@ -319,8 +346,8 @@ template <typename Key, typename Data>
 }
 
 
-template <typename Key, typename Data>
-    void FibonacciHeap<Key, Data>::print_roots(ostream& out) const 
+template <typename Key, typename Data, typename Allocator>
+    void FibonacciHeap<Key, Data, Allocator>::print_roots(ostream& out) const 
 {
     out << "m_max_degree=" << m_max_degree << "  m_count=" << m_count << "  roots=";
     if (m_root_with_min_key)
@@ -328,36 +355,65 @@ template <typename Key, typename Data>
 }
 
 
-template <typename Key, typename Data>
-    void FibonacciHeap<Key, Data>::merge(const FibonacciHeap& other) 
+template <typename Key, typename Data, typename Allocator>
+    void FibonacciHeap<Key, Data, Allocator>::merge(const FibonacciHeap& other) 
 {  // Fibonacci-Heap-Union
     m_root_with_min_key->insert(other.m_root_with_min_key);
     if (!m_root_with_min_key || 
         (other.m_root_with_min_key &&
-         other.m_root_with_min_key->key() < m_root_with_min_key->key()))
+         other.m_root_with_min_key->m_key < m_root_with_min_key->m_key))
         this->m_root_with_min_key = other.m_root_with_min_key;
     m_count += other.m_count;
 }
 
 
-template <typename Key, typename Data>
-    FibonacciHeapNode<Key, Data>* FibonacciHeap<Key, Data>::insert(Key k, Data d) 
+template <typename Key, typename Data, typename Allocator>
+    FibonacciHeapNode<Key, Data>* FibonacciHeap<Key, Data, Allocator>::insert(Key k, Data d) 
 {
     if (m_debug) cerr << "\ninsert new " << d << ":" << k;
     ++m_count;
     // create a new tree with a single m_key:
-    return insert_node(new FibonacciHeapNode<Key, Data>(k, d));
+    return insert_node(new (m_allocator.allocate()) FibonacciHeapNode<Key, Data>(k, d));
 }
 
 
-template <typename Key, typename Data>
-    void FibonacciHeap<Key, Data>::remove_minimum() 
+template <typename Key, typename Data, typename Allocator>
+    void FibonacciHeap<Key, Data, Allocator>::destroy_node(FibonacciHeapNode<Key, Data>* node)
+{
+    node->~FibonacciHeapNode<Key, Data>();
+    m_allocator.deallocate(node);
+}
+
+
+template <typename Key, typename Data, typename Allocator>
+    void FibonacciHeap<Key, Data, Allocator>::remove_minimum() 
 {
     remove_minimum_h(true);
+    settle();
+}
+
+
+// re-key the minimum until it has no pending increase, so minimum() is exact
+template <typename Key, typename Data, typename Allocator>
+    void FibonacciHeap<Key, Data, Allocator>::settle() 
+{
+    while (m_root_with_min_key && m_root_with_min_key->m_pending)
+    {
+        FibonacciHeapNode<Key, Data>* node = m_root_with_min_key;
+        remove_minimum_h(false);
+
+        // the node is reused as a new single-node tree; its links still point into
+        //  the old root list
+        node->m_next = node->m_previous = node;
+        node->m_key = node->m_pending_key;
+        node->m_pending = false;
+        insert_node(node);
+        ++m_count; // remove_minimum_h took it off the count
+    }
 }
     
-template <typename Key, typename Data>
-    void FibonacciHeap<Key, Data>::remove_minimum_h(bool delete_node) 
+template <typename Key, typename Data, typename Allocator>
+    void FibonacciHeap<Key, Data, Allocator>::remove_minimum_h(bool delete_node) 
 {  // Fibonacci-Heap-Extract-Min, CONSOLIDATE
 
     if (!m_root_with_min_key)
@@ -384,6 +440,7 @@ template <typename Key, typename Data>
         while (c != m_root_with_min_key->m_child);
             
         m_root_with_min_key->m_child = NULL; // removed all children
+        m_root_with_min_key->m_degree = 0;
         m_root_with_min_key->insert(c);
     }
     
@@ -402,7 +459,7 @@ template <typename Key, typename Data>
         if (m_debug_remove_min) cerr << "\n  removed the last";
         if (m_count != 0)
             throw string ("Internal error: should have 0 keys");
-        if (delete_node) delete m_root_with_min_key;
+        if (delete_node) destroy_node(m_root_with_min_key);
         m_root_with_min_key = NULL;
         if (m_debug_remove_min) cerr << "\n  removal complete";
         return;
@@ -428,12 +485,18 @@ template <typename Key, typename Data>
 
         FibonacciHeapNode<Key, Data>* current = current_pointer;
         current_pointer = current_pointer->m_next;
-        while (degree_roots[current_degree]) 
+
+        // a node cut from its parent can have a higher degree than any root had
+        //  at the last consolidation, so m_max_degree isn't a bound here
+        if (current_degree >= degree_roots.size())
+            degree_roots.resize(current_degree + 1, (FibonacciHeapNode<Key, Data>*)NULL);
+
+        while (degree_roots[current_degree])
         { // merge the two roots with the same degree:
             FibonacciHeapNode<Key, Data>* other = degree_roots[current_degree]; // another root with the same degree
-            if (current->key() > other->key())
+            if (current->m_key > other->m_key)
                 swap(other,current); 
-            // now current->key() <= other->key() - make other a child of current:
+            // now current->m_key <= other->m_key - make other a child of current:
             other->remove(); // remove from list of roots
             current->add_child(other);
             if (m_debug_remove_min)
@@ -455,7 +518,7 @@ template <typename Key, typename Data>
     while (current_pointer != m_root_with_min_key);
 
     /// Phase 3: remove the current root, and calcualte the new m_root_with_min_key:
-    if (delete_node) delete m_root_with_min_key;
+    if (delete_node) destroy_node(m_root_with_min_key);
     m_root_with_min_key = NULL;
 
     uint new_max_degree = 0;
@@ -485,32 +548,156 @@ template <typename Key, typename Data>
 
 
 
-template <typename Key, typename Data>
-    void FibonacciHeap<Key, Data>::alter_key(FibonacciHeapNode<Key, Data>* node,
+// free every node without restructuring anything: O(n)
+template <typename Key, typename Data, typename Allocator>
+    void FibonacciHeap<Key, Data, Allocator>::clear() 
+{
+    if (!m_root_with_min_key) return;
+
+    vector<FibonacciHeapNode<Key, Data>*> rings; // one node of each sibling list not freed yet
+    rings.push_back(m_root_with_min_key);
+
+    while (!rings.empty())
+    {
+        FibonacciHeapNode<Key, Data>* first = rings.back();
+        rings.pop_back();
+
+        // break the ring so the walk can free as it goes
+        first->m_previous->m_next = NULL;
+        for (FibonacciHeapNode<Key, Data>* n = first; n; )
+        {
+            FibonacciHeapNode<Key, Data>* next = n->m_next;
+            if (n->m_child) rings.push_back(n->m_child);
+            destroy_node(n);
+            n = next;
+        }
+    }
+
+    m_root_with_min_key = NULL;
+    m_count = 0;
+    m_max_degree = 0;
+}
+
+
+// the expired nodes are a top part of each tree: walk down from the roots until the
+//  keys pass the deadline, and everything that is left hanging becomes a root.  the
+//  minimum is kept until the end, with the survivors as its siblings, so that one
+//  remove_minimum_h does the consolidation for the lot
+template <typename Key, typename Data, typename Allocator>
+template <typename Callback>
+    uint FibonacciHeap<Key, Data, Allocator>::expire_until(Key deadline, Callback& expired)
+{
+    if (!m_root_with_min_key || deadline < m_root_with_min_key->m_key) return 0;
+
+    FibonacciHeapNode<Key, Data>* last = m_root_with_min_key; // never pending; see settle()
+    vector<FibonacciHeapNode<Key, Data>*> todo;      // subtrees not looked at yet
+    vector<FibonacciHeapNode<Key, Data>*> survivors; // the new roots
+
+    for (FibonacciHeapNode<Key, Data>* r = last->m_next; r != last; r = r->m_next)
+        todo.push_back(r);
+
+    if (last->m_child)
+    {
+        FibonacciHeapNode<Key, Data>* c = last->m_child;
+        do { todo.push_back(c); c = c->m_next; } while (c != last->m_child);
+        last->m_child = NULL;
+        last->m_degree = 0;
+    }
+
+    expired(last->m_data);
+    uint removed = 1;
+
+    while (!todo.empty())
+    {
+        FibonacciHeapNode<Key, Data>* node = todo.back();
+        todo.pop_back();
+
+        if (node->m_key > deadline)
+        {
+            survivors.push_back(node);
+            continue;
+        }
+
+        if (node->m_child)
+        {
+            FibonacciHeapNode<Key, Data>* c = node->m_child;
+            do { todo.push_back(c); c = c->m_next; } while (c != node->m_child);
+            node->m_child = NULL;
+            node->m_degree = 0;
+        }
+
+        // renewed past the deadline: it stays, with its real key
+        if (node->m_pending && node->m_pending_key > deadline)
+        {
+            node->m_key = node->m_pending_key;
+            node->m_pending = false;
+            survivors.push_back(node);
+            continue;
+        }
+
+        expired(node->m_data);
+        destroy_node(node);
+        --m_count;
+        ++removed;
+    }
+
+    last->m_next = last->m_previous = last;
+    for (typename vector<FibonacciHeapNode<Key, Data>*>::iterator it = survivors.begin();
+         it != survivors.end(); ++it)
+    {
+        (*it)->m_parent = NULL;
+        (*it)->m_mark = false;
+        (*it)->m_next = (*it)->m_previous = *it;
+        last->insert(*it);
+    }
+
+    m_root_with_min_key = last;
+    remove_minimum_h(true);
+    settle();
+
+    return removed;
+}
+
+
+template <typename Key, typename Data, typename Allocator>
+    void FibonacciHeap<Key, Data, Allocator>::alter_key(FibonacciHeapNode<Key, Data>* node,
                                              Key new_key,
                                              Key minus_infinity)
 {
     // decrease key if new key is less
-    if (new_key < node->m_key)
+    if (new_key < node->key())
         decrease_key(node, new_key);
 
-    // remove and re-insert if new key is more
-    if (new_key > node->m_key)
+    // increase lazily if new key is more: the old key stays in place as a lower
+    //  bound, and the node is only moved if it gets to be the minimum
+    if (new_key > node->key())
     {
-        decrease_key(node, minus_infinity);
-        remove_minimum_h(false);
-        node->m_key = new_key;
-        insert_node(node);
+        node->m_pending_key = new_key;
+        node->m_pending = true;
+        settle();
     }
 }
 
 
-template <typename Key, typename Data>
-    void FibonacciHeap<Key, Data>::decrease_key(FibonacciHeapNode<Key, Data>* node, Key new_key) 
+template <typename Key, typename Data, typename Allocator>
+    void FibonacciHeap<Key, Data, Allocator>::decrease_key(FibonacciHeapNode<Key, Data>* node, Key new_key) 
 {
-    if (new_key >= node->m_key)
+    if (new_key >= node->key())
         throw string("Trying to decrease key to a greater key");
 
+    // taking back part of a pending increase needs no restructuring
+    if (node->m_pending)
+    {
+        node->m_pending = false;
+        if (new_key == node->m_key) return;
+        if (new_key > node->m_key)
+        {
+            node->m_pending_key = new_key;
+            node->m_pending = true;
+            return;
+        }
+    }
+
     if (m_debug)
     {
         cerr << "\ndecrease key of ";
@@ -524,11 +711,11 @@ template <typename Key, typename Data>
     FibonacciHeapNode<Key, Data>* parent = node->m_parent;
     if (!parent) 
     { // root node - just make sure the minimum is correct
-        if (new_key < m_root_with_min_key->key())
+        if (new_key < m_root_with_min_key->m_key)
             m_root_with_min_key = node;
         return; // heap invariant not violated - nothing more to do
     } 
-    else if (parent->key() <= new_key) 
+    else if (parent->m_key <= new_key) 
     {
         return; // heap invariant not violated - nothing more to do
     }
@@ -567,8 +754,8 @@ template <typename Key, typename Data>
 
 
 
-template <typename Key, typename Data>
-    void FibonacciHeap<Key, Data>::remove(FibonacciHeapNode<Key, Data>* node, Key minus_infinity) 
+template <typename Key, typename Data, typename Allocator>
+    void FibonacciHeap<Key, Data, Allocator>::remove(FibonacciHeapNode<Key, Data>* node, Key minus_infinity) 
 {
     if (minus_infinity >= minimum()->key())
         throw string("2nd argument to remove must be a key that is smaller than all other keys");
@@ -0,0 +1,113 @@
+#include "FibonacciHeap.h"
+#include "MCCIBenchmark.h"
+#include "MCCITypes.h"
+
+#include <vector>
+#include <stdlib.h>
+#include <stdio.h>
+
+using namespace std;
+
+/**
+   Subscription churn, the way RequestBank drives its timeout heap: a steady
+   population of requests where every step one expires (remove_minimum), one is
+   fulfilled (remove), and both are renewed (insert).
+
+   Compares the default node pool with plain new/delete.
+
+   Renewal: clients pushing the deadline of an open request further out
+   (alter_key to a later time), with the occasional expiry in between.
+ */
+
+
+template <typename Allocator>
+void bench_churn(const char* variant, unsigned int population, unsigned int steps)
+{
+    typedef FibonacciHeap<MCCI_TIME_T, unsigned int, Allocator> Heap;
+    typedef FibonacciHeapNode<MCCI_TIME_T, unsigned int> Node;
+
+    Heap h;
+    vector<Node*> live;
+    MCCI_TIME_T now = 1;
+    CMCCIStopwatch sw;
+
+    srand(1);
+    for (unsigned int i = 0; i < population; ++i)
+        live.push_back(h.insert(now + 1 + rand() % 5000, i));
+
+
+    sw.start();
+    for (unsigned int i = 0; i < steps; ++i)
+    {
+        ++now;
+
+        // the earliest request times out, and its client renews it
+        unsigned int expired = h.minimum()->data();
+        h.remove_minimum();
+        live[expired] = h.insert(now + 1 + rand() % 5000, expired);
+
+        // another request is fulfilled, and its client asks for the next one
+        unsigned int fulfilled = rand() % population;
+        if (fulfilled == expired) continue;
+        h.remove(live[fulfilled], 0);
+        live[fulfilled] = h.insert(now + 1 + rand() % 5000, fulfilled);
+    }
+    double t = sw.elapsed_ns();
+
+    printf("\n %d live requests", population);
+    benchmark_report("churn step", variant, steps, t);
+    printf("  (pool hits %lu, misses %lu)", h.allocator().hits(), h.allocator().misses());
+}
+
+
+void bench_renewal(unsigned int population, unsigned int steps)
+{
+    typedef FibonacciHeap<MCCI_TIME_T, unsigned int> Heap;
+
+    Heap h;
+    vector<Heap::Node*> live;
+    MCCI_TIME_T now = 1;
+    CMCCIStopwatch sw;
+
+    srand(1);
+    for (unsigned int i = 0; i < population; ++i)
+        live.push_back(h.insert(now + 1000 + rand() % 5000, i));
+
+    sw.start();
+    for (unsigned int i = 0; i < steps; ++i)
+    {
+        unsigned int renewed = rand() % population;
+        h.alter_key(live[renewed], now + 5000 + rand() % 5000, 0);
+
+        // every so often time passes and the earliest request expires and comes back
+        if (0 == i % 16)
+        {
+            now = h.minimum()->key();
+            unsigned int expired = h.minimum()->data();
+            h.remove_minimum();
+            live[expired] = h.insert(now + 1000 + rand() % 5000, expired);
+        }
+    }
+    double t = sw.elapsed_ns();
+
+    printf("\n %d live requests", population);
+    benchmark_report("renewal", "FibonacciHeap", steps, t);
+}
+
+
+int main()
+{
+    printf("\nFibonacciHeap subscription churn: SlabPool vs new/delete");
+
+    bench_churn<SlabPool<FibonacciHeapNode<MCCI_TIME_T, unsigned int> > >("SlabPool", 100, 200000);
+    bench_churn<HeapAllocator<FibonacciHeapNode<MCCI_TIME_T, unsigned int> > >("new/delete", 100, 200000);
+    bench_churn<SlabPool<FibonacciHeapNode<MCCI_TIME_T, unsigned int> > >("SlabPool", 1000, 100000);
+    bench_churn<HeapAllocator<FibonacciHeapNode<MCCI_TIME_T, unsigned int> > >("new/delete", 1000, 100000);
+
+    printf("\n\nFibonacciHeap renewals");
+    bench_renewal(1000, 200000);
+    bench_renewal(100000, 200000);
+
+    printf("\n\n");
+    return 0;
+}
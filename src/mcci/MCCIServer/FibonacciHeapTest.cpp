@@ -1,5 +1,6 @@
 
 #include "FibonacciHeap.h"
+#include <assert.h>
 
 #include <iostream>
 #include <vector>
@@ -92,6 +93,27 @@ void doTest()
     cout << "\nAlter one key:\n";
     h.alter_key(nodes[1], 250, 0);
     h.print_roots(cout);
+
+    cout << "\nPush both keys later, then bring one back:\n";
+    h.alter_key(nodes[1], 600, 0);
+    h.alter_key(nodes[0], 500, 0);
+    print_min(&h);
+    assert(nodes[0] == h.minimum() && 500 == h.minimum()->key());
+    h.alter_key(nodes[1], 450, 0);
+    print_min(&h);
+    assert(nodes[1] == h.minimum() && 450 == h.minimum()->key());
+    h.remove_minimum();
+    assert(nodes[0] == h.minimum() && 500 == h.minimum()->key());
+    h.print_roots(cout);
+
+    cout << "\nClear a heap with some structure:\n";
+    for (uint i = 0; i < 100; ++i) h.insert(1000 + (i * 37) % 100, "x");
+    h.remove_minimum();
+    h.clear();
+    assert(h.empty());
+    h.insert(7, "y");
+    print_min(&h);
+    assert(7 == h.minimum()->key());
     
     cout << endl << endl;
 }
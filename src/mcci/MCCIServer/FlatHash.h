@@ -0,0 +1,374 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <stdio.h>
+#include <boost/cstdint.hpp>
+#include "HashPolicy.h"
+
+using namespace std;
+
+
+/**
+   An open-addressing hash table with the same interface as LinearHash.
+
+   All entries live in one contiguous array of slots, so a lookup is a few
+   adjacent loads instead of a walk down a tree.  Collisions are resolved with
+   robin-hood linear probing: an entry that has travelled further from its home
+   slot than the current resident takes that slot, which keeps probe sequences
+   short and lets a failed lookup stop early.
+
+   Keys are spread by the Mixer (see HashPolicy.h; multiplicative Fibonacci hashing
+   by default) over a power-of-two table.  The table grows by itself when it gets
+   7/8 full, so sizes given to the constructor or resize() are only a starting point.
+
+   Unlike LinearHash, entries move around: insert() and remove() invalidate
+   iterators and references to stored data.
+ */
+template <typename Key, typename Data, typename Mixer = HashMixFibonacci> class FlatHash
+{
+
+  public:
+    typedef pair<Key, Data> Entry;
+
+  protected:
+
+    typedef struct
+    {
+        Entry    entry;
+        uint32_t probe; // 0 for a vacant slot, otherwise distance from home + 1
+    } Slot;
+
+    // internal storage is an array of slots
+    Slot* m_slot;
+
+    // the number of slots (always a power of 2)
+    unsigned int m_size;
+
+    // the number of occupied slots
+    unsigned int m_count;
+
+    static const unsigned int MIN_SIZE = 8;
+
+
+  public:
+
+    FlatHash()
+    {
+        this->m_size = 0;
+        this->resize(1);
+    }
+
+
+    FlatHash(unsigned int size)
+    {
+        this->m_size = 0;
+        this->resize(size);
+    }
+
+    FlatHash(const FlatHash &rhs)
+    {
+        this->m_size = 0;
+        this->operator=(rhs);
+    }
+
+    FlatHash& operator=(const FlatHash &rhs)
+    {
+        if (this == &rhs) return *this;
+
+        this->resize(rhs.m_size);
+        for (unsigned int i = 0; i < rhs.m_size; ++i)
+            this->m_slot[i] = rhs.m_slot[i];
+        this->m_count = rhs.m_count;
+
+        return *this;
+    }
+
+
+    ~FlatHash()
+    {
+        if (this->m_size) delete[] this->m_slot;
+    }
+
+
+    //resize, destructively, to the next power of 2 that holds this many slots
+    void resize(unsigned int size)
+    {
+        if (!size)
+        {
+            throw string("Tried to set hash size to 0");
+        }
+
+        if (this->m_size)
+        {
+            delete[] this->m_slot;
+            this->m_size = 0;
+        }
+
+        unsigned int bits = 0;
+        while ((1u << bits) < size || (1u << bits) < MIN_SIZE) ++bits;
+
+        this->m_size  = 1u << bits;
+        this->m_count = 0;
+        this->m_slot  = new Slot[this->m_size]();
+    }
+
+
+    // resize to hold the desired number of elements without growing.
+    //  (the name is kept for compatibility with LinearHash; sizes are powers of 2)
+    void resize_nearest_prime(unsigned int desired_size)
+    {
+        this->resize(desired_size + desired_size / 7 + 1);
+    }
+
+
+    // return the size of the hash table
+    unsigned int get_size() const
+    {
+        return this->m_size;
+    }
+
+
+    // return the number of elements in the hash table
+    unsigned int count() const
+    {
+        return this->m_count;
+    }
+
+
+    // return whether the table is empty
+    bool empty() const
+    {
+        return 0 == this->m_count;
+    }
+
+    // get the longest probe sequence in the table (the open addressing equivalent of
+    //  the most keys colliding in one bucket)
+    unsigned int max_collisions() const
+    {
+        unsigned int max = 0;
+
+        for (unsigned int i = 0; i < this->m_size; ++i)
+            if (max < this->m_slot[i].probe)
+                max = this->m_slot[i].probe;
+
+        return max;
+    }
+
+
+    // explicitly insert an element into the hash
+    void insert(Key k, Data d)
+    {
+        unsigned int idx = this->find(k);
+        if (idx < this->m_size)
+            this->m_slot[idx].entry.second = d;
+        else
+            this->place(k, d);
+    }
+
+
+    // explicitly remove a key from the hash
+    void remove(Key k)
+    {
+        unsigned int idx = this->find(k);
+        if (idx == this->m_size) return;
+
+        // backward-shift deletion: pull the rest of the cluster one slot closer to home
+        unsigned int mask = this->m_size - 1;
+        for (unsigned int next = (idx + 1) & mask;
+             1 < this->m_slot[next].probe;
+             idx = next, next = (next + 1) & mask)
+        {
+            this->m_slot[idx] = this->m_slot[next];
+            --(this->m_slot[idx].probe);
+        }
+
+        this->m_slot[idx].entry = Entry();
+        this->m_slot[idx].probe = 0;
+        --(this->m_count);
+    }
+
+
+    // check existence of a hashed value
+    bool has_key(Key k) const
+    {
+        return this->find(k) < this->m_size;
+    }
+
+
+    // the value for a key, or NULL if it isn't there (one probe, never inserts)
+    Data* lookup(Key k) const
+    {
+        unsigned int idx = this->find(k);
+        return idx == this->m_size ? NULL : &(this->m_slot[idx].entry.second);
+    }
+
+
+    // read-only access
+    Data& operator[] (Key k) const
+    {
+        return const_cast<FlatHash<Key, Data, Mixer>*>(this)->operator[](k);
+    }
+
+
+    // array-style access to the hash
+    Data& operator[] (Key k)
+    {
+        unsigned int idx = this->find(k);
+        if (idx == this->m_size) idx = this->place(k, Data());
+        return this->m_slot[idx].entry.second;
+    }
+
+
+    // remove all elements from the hash
+    void clear()
+    {
+        for (unsigned int i = 0; i < this->m_size; ++i)
+        {
+            this->m_slot[i].entry = Entry();
+            this->m_slot[i].probe = 0;
+        }
+        this->m_count = 0;
+    }
+
+
+    class iterator
+    {
+        const FlatHash<Key, Data, Mixer>* h;
+        unsigned int idx;
+
+      public:
+
+        iterator() {}
+
+        iterator(const FlatHash<Key, Data, Mixer>* const h, unsigned int idx)
+        {
+            this->h = h;
+            this->idx = idx;
+        }
+
+        iterator& operator++()
+        {
+            // jump to the next occupied slot, or to the end
+            for (++(this->idx); this->idx < this->h->m_size; ++(this->idx))
+                if (this->h->m_slot[this->idx].probe) break;
+
+            return *this;
+        }
+
+        iterator operator++(int)
+        {
+            iterator tmp(*this);
+            this->operator++();
+            return tmp;
+        }
+
+        bool operator==(const iterator& rhs) const
+        {
+            return rhs.h == this->h && rhs.idx == this->idx;
+        }
+
+        bool operator!=(const iterator& rhs) const
+        {
+            return rhs.h != this->h || rhs.idx != this->idx;
+        }
+
+        Entry& operator*() const { return this->h->m_slot[this->idx].entry; }
+
+        Entry* operator->() const { return &(this->h->m_slot[this->idx].entry); }
+    };
+
+    // iteration points: begin
+    iterator begin() const
+    {
+        for (unsigned int i = 0; i < this->m_size; ++i)
+            if (this->m_slot[i].probe)
+                return iterator(this, i);
+
+        return this->end();
+    }
+
+    // iteration points: end
+    iterator end() const
+    {
+        return iterator(this, this->m_size);
+    }
+
+
+  protected:
+
+    // the slot where a key would sit if there were no collisions
+    unsigned int home(Key k) const
+    {
+        return (unsigned int)(Mixer::mix((uint64_t)k) & (this->m_size - 1));
+    }
+
+    // the slot holding a key, or m_size if it isn't there
+    unsigned int find(Key k) const
+    {
+        unsigned int mask = this->m_size - 1;
+        unsigned int idx = this->home(k);
+
+        for (uint32_t probe = 1; ; ++probe, idx = (idx + 1) & mask)
+        {
+            const Slot& s = this->m_slot[idx];
+
+            // a resident closer to home than we are means the key would have been here
+            if (s.probe < probe) return this->m_size;
+            if (s.entry.first == k) return idx;
+        }
+    }
+
+    // add a key that is known to be absent, and return the slot where it landed
+    unsigned int place(Key k, const Data& d)
+    {
+        // keep the table at most 7/8 full
+        if ((this->m_count + 1) * 8 > this->m_size * 7) this->grow();
+
+        unsigned int mask = this->m_size - 1;
+        unsigned int idx = this->home(k);
+        unsigned int landed = this->m_size;
+
+        Slot carry;
+        carry.entry = Entry(k, d);
+        carry.probe = 1;
+
+        for (;; idx = (idx + 1) & mask, ++carry.probe)
+        {
+            Slot& s = this->m_slot[idx];
+
+            if (!s.probe)
+            {
+                s = carry;
+                if (landed == this->m_size) landed = idx;
+                break;
+            }
+
+            // robin hood: take from the rich (entries near home), give to the poor
+            if (s.probe < carry.probe)
+            {
+                swap(s, carry);
+                if (landed == this->m_size) landed = idx;
+            }
+        }
+
+        ++(this->m_count);
+        return landed;
+    }
+
+    // double the table, keeping all of its contents.  the entries go into a new
+    //  table that is swapped in, so the old slots are freed only once read
+    void grow()
+    {
+        FlatHash bigger(this->m_size * 2);
+
+        for (unsigned int i = 0; i < this->m_size; ++i)
+            if (this->m_slot[i].probe)
+                bigger.place(this->m_slot[i].entry.first, this->m_slot[i].entry.second);
+
+        swap(this->m_slot, bigger.m_slot);
+        swap(this->m_size, bigger.m_size);
+        swap(this->m_count, bigger.m_count);
+    }
+
+};
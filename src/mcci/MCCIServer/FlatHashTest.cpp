@@ -0,0 +1,114 @@
+#include "FlatHash.h"
+#include <string>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <boost/cstdint.hpp>
+
+using namespace std;
+
+
+void test_hash_operations()
+{
+    typedef FlatHash<unsigned long, string> NumberHash;
+    NumberHash lh(101);
+
+    printf("\n\nAdding 3000, 1000000, and 37");
+    lh.insert(3000, "three thousand");
+    lh.insert(1000000, "one million");
+    lh[37] = "thirty seven";
+
+    printf("\nExpect 3 elements in hash, count() = %d", lh.count());
+    assert(3 == lh.count());
+
+    printf("\nIterating:");
+    for (NumberHash::iterator it = lh.begin(); it != lh.end(); ++it)
+    {
+        printf("\n    %ld\t: '%s'", it->first, it->second.c_str());
+    }
+
+    printf("\n3001 in hash? %d", lh.has_key(3001));
+    printf("\n3000 in hash? %d", lh.has_key(3000));
+    assert(!lh.has_key(3001));
+    assert(lh.has_key(3000));
+    assert(string("three thousand") == lh[3000]);
+
+    lh.remove(3000);
+    printf("\nRemoved 3000.  3000 in hash? %d", lh.has_key(3000));
+    assert(!lh.has_key(3000));
+    printf("\nhash[3000] = %s", lh[3000].c_str());
+    printf("\nauto-added null 3000 after access? %d", lh.has_key(3000));
+    assert(lh.has_key(3000));
+    lh.remove(3000);
+
+    lh[37] = "I'm not old";
+    assert(string("I'm not old") == lh[37]);
+    printf("\nExpect 2 elements in hash, count() = %d", lh.count());
+    assert(2 == lh.count());
+
+    // growing well past the initial size keeps everything
+    lh.clear();
+    assert(lh.empty());
+    for (unsigned long i = 0; i < 5000; ++i) lh.insert(i * 65536, "packed");
+    printf("\nInserted 5000 packed keys: count %d, size %d, max probe %d",
+           lh.count(), lh.get_size(), lh.max_collisions());
+    assert(5000 == lh.count());
+    for (unsigned long i = 0; i < 5000; ++i) assert(lh.has_key(i * 65536));
+
+    unsigned int n = 0;
+    for (NumberHash::iterator it = lh.begin(); it != lh.end(); ++it) ++n;
+    assert(5000 == n);
+
+    FlatHash<unsigned int, unsigned int> ilh(2);
+    printf("\n\nInt value of uninitialized lookup key 42 is %d (we expect 0)", ilh[42]);
+    assert(0 == ilh[42]);
+}
+
+
+// random inserts and removals, checked against std::map
+void test_against_map()
+{
+    FlatHash<uint32_t, uint32_t> fh(4);
+    map<uint32_t, uint32_t> m;
+
+    srand(1);
+    for (int i = 0; i < 200000; ++i)
+    {
+        uint32_t k = ((rand() % 16) << 16) + rand() % 512;
+        if (rand() % 3)
+        {
+            fh[k] = i;
+            m[k] = i;
+        }
+        else
+        {
+            fh.remove(k);
+            m.erase(k);
+        }
+    }
+
+    printf("\n\nRandomized: %d entries, %d in reference map", fh.count(), (int)m.size());
+    assert(fh.count() == m.size());
+
+    for (map<uint32_t, uint32_t>::iterator it = m.begin(); it != m.end(); ++it)
+    {
+        assert(fh.has_key(it->first));
+        assert(fh[it->first] == it->second);
+    }
+
+    FlatHash<uint32_t, uint32_t> copy(fh);
+    for (FlatHash<uint32_t, uint32_t>::iterator it = copy.begin(); it != copy.end(); ++it)
+        assert(m[it->first] == it->second);
+}
+
+
+int main()
+{
+    test_hash_operations();
+    test_against_map();
+
+    printf("\n\n");
+
+    return 0;
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <boost/cstdint.hpp>
+
+using namespace std;
+
+
+/**
+   Hash policies for LinearHash and FlatHash.
+
+   A policy is a mixer (which turns a key into a well-spread 64 bit value) plus a
+   sizing strategy (which picks table sizes and reduces a mixed value to a bucket).
+   Linear hashing splits a bucket by looking at one more bit of the mixed value, so
+   a mixer's low bits have to be as good as its high bits.
+
+   LinearHashReport prints the chain lengths that each policy gives on the key
+   shapes of the banks in MCCIRequestBanks.h.
+ */
+
+
+/* A table of prime numbers, each less than a power of 2 */
+static unsigned int LINEAR_HASH_TABLE_PRIMES[] = {
+    1,
+    2,
+    4 - 1,
+    8 - 1,
+    16 - 3,
+    32 - 1,
+    64 - 3,
+    128 - 1,
+    256 - 5,
+    512 - 3,
+    1024 - 3,
+    2048 - 9,
+    4096 - 3,
+    8192 - 1,
+    16384 - 3,
+    32768 - 19,
+    65536 - 15,
+    131072 - 1,
+    262144 - 5,
+    524288 - 1,
+    1048576 - 3,
+    2097152 - 9,
+    4194304 - 3,
+    8388608 - 15,
+    16777216 - 3,
+};
+
+static const unsigned int LINEAR_HASH_TABLE_PRIME_COUNT =
+    sizeof(LINEAR_HASH_TABLE_PRIMES) / sizeof(LINEAR_HASH_TABLE_PRIMES[0]);
+
+
+
+////////////////////////////////////////////////////////////////////////////// mixers
+
+
+// f(i) = i.  ideal for dense keys, poor for keys with structure in the high bits
+struct HashMixIdentity
+{
+    static const char* name() { return "identity"; }
+    static uint64_t mix(uint64_t k) { return k; }
+};
+
+
+// multiplicative (Fibonacci) hashing: multiply by 2^64 / phi and keep the middle
+//  of the product, where every bit of the key has had a say
+struct HashMixFibonacci
+{
+    static const char* name() { return "fibonacci"; }
+    static uint64_t mix(uint64_t k) { return (k * 11400714819323198485ull) >> 32; }
+};
+
+
+// the 64 bit finalizer from MurmurHash3: every input bit affects every output bit
+struct HashMixMurmur
+{
+    static const char* name() { return "murmur64"; }
+    static uint64_t mix(uint64_t k)
+    {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdull;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53ull;
+        k ^= k >> 33;
+        return k;
+    }
+};
+
+
+////////////////////////////////////////////////////////////////////////////// sizing
+
+
+// table sizes are primes (or a prime times a power of 2), buckets are found by modulo
+struct HashSizePrime
+{
+    static const char* name() { return "prime"; }
+
+    // the largest prime size that doesn't exceed the desired size
+    static unsigned int nearest(unsigned int desired_size)
+    {
+        unsigned int i;
+        if (desired_size < 2) return 1;
+
+        for (i = 1;
+             i < LINEAR_HASH_TABLE_PRIME_COUNT && LINEAR_HASH_TABLE_PRIMES[i] <= desired_size;
+             ++i);
+
+        return LINEAR_HASH_TABLE_PRIMES[i - 1];
+    }
+
+    // any size is allowed
+    static unsigned int round(unsigned int size) { return size; }
+
+    static unsigned int reduce(uint64_t h, uint64_t size) { return h % size; }
+};
+
+
+// table sizes are powers of 2, buckets are found by masking (no division)
+struct HashSizePowerOfTwo
+{
+    static const char* name() { return "pow2"; }
+
+    // the largest power of 2 that doesn't exceed the desired size
+    static unsigned int nearest(unsigned int desired_size)
+    {
+        unsigned int size = 1;
+        while (size * 2 <= desired_size) size *= 2;
+        return size;
+    }
+
+    // the smallest power of 2 that holds the size
+    static unsigned int round(unsigned int size)
+    {
+        unsigned int ret = 1;
+        while (ret < size) ret *= 2;
+        return ret;
+    }
+
+    static unsigned int reduce(uint64_t h, uint64_t size) { return h & (size - 1); }
+};
+
+
+////////////////////////////////////////////////////////////////////////////// policies
+
+
+template <typename Mixer, typename Sizing>
+struct HashPolicy
+{
+    typedef Mixer  mixer;
+    typedef Sizing sizing;
+};
+
+// f(i) = i over prime sizes: the original LinearHash behavior
+typedef HashPolicy<HashMixIdentity, HashSizePrime> HashPolicyDefault;
+
+// for dense keys such as variable ids and revision windows
+typedef HashPolicy<HashMixIdentity, HashSizePowerOfTwo> HashPolicyDense;
+
+// for packed keys such as (host << 16) + var
+typedef HashPolicy<HashMixFibonacci, HashSizePowerOfTwo> HashPolicyFibonacci;
+
+typedef HashPolicy<HashMixMurmur, HashSizePowerOfTwo> HashPolicyMurmur;
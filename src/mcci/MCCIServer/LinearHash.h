@@ -4,43 +4,34 @@
 #include <string>
 #include <map>
 #include <stdio.h>
+#include <string.h>
+#include <boost/cstdint.hpp>
+#include "HashPolicy.h"
 
 using namespace std;
 
 
-/* A table of prime numbers, each less than a power of 2 */
-static unsigned int LINEAR_HASH_TABLE_PRIMES[] = {
-    1,
-    2,
-    4 - 1,
-    8 - 1,
-    16 - 3,
-    32 - 1,
-    64 - 3,
-    128 - 1,
-    256 - 5,
-    512 - 3,
-    1024 - 3,
-    2048 - 9,
-    4096 - 3,
-    8192 - 1,
-    16384 - 3,
-    32768 - 19,
-    65536 - 15,
-};
-
-
-
-
 /**
    A simple hash table that uses f(i) = i for the hash function (so does Sun's hash table implementation)
 
    This hash table is designed for speed and for integer keys (key should be some variant of int/long/etc)
 
-   It is assumed that contiguous blocks of integer keys will be hashed.
+   It is assumed that contiguous blocks of integer keys will be hashed.  For keys that
+   aren't, pick a different Policy (see HashPolicy.h) to change the hash function and
+   the bucket sizing.
+
+   The table grows and shrinks online by linear hashing (Litwin, 1980): the size given
+   to resize() is the base number of buckets N, and buckets are split one at a time, in
+   order, as the load rises.  At level L with split pointer s there are N * 2^L + s
+   buckets; a key goes to bucket h % (N * 2^L), or to h % (N * 2^(L+1)) if that first
+   bucket has already been split.  Each insert or remove moves at most one bucket's
+   worth of keys, so there is never a full rehash.  Inserts and removes may move
+   entries between buckets, so they invalidate iterators and references.
+
+   A bitmap marks the non-empty buckets, so iteration skips empty ones 64 at a time.
    
  */
-template <typename Key, typename Data> class LinearHash
+template <typename Key, typename Data, typename Policy = HashPolicyDefault> class LinearHash
 {
 
   public:
@@ -48,6 +39,11 @@ template <typename Key, typename Data> class LinearHash
     typedef map<Key, Data> Container;
     typedef typename Container::iterator ContainerIterator;
 
+    // default growth limits: split when the average chain passes 2 keys or any one
+    //  chain passes 8; merge when the average drops below a quarter of the limit
+    static const unsigned int DEFAULT_MAX_LOAD  = 2;
+    static const unsigned int DEFAULT_MAX_CHAIN = 8;
+
     
   protected:
     
@@ -57,42 +53,90 @@ template <typename Key, typename Data> class LinearHash
     // the number of trees in our hash
     unsigned int m_size;
 
+    // the number of trees allocated (at least m_size)
+    unsigned int m_capacity;
+
+    // linear hashing state: base size, level and split pointer
+    unsigned int m_base;
+    unsigned int m_level;
+    unsigned int m_split;
+
+    // the number of elements in all the trees
+    unsigned int m_count;
+
+    // one bit per tree, set when the tree is not empty (m_capacity bits)
+    uint64_t* m_occupied;
+
+    // online growth limits; m_max_load == 0 means a fixed size
+    unsigned int m_max_load;
+    unsigned int m_max_chain;
+
     
   public:
 
     LinearHash()
     {
-        this->m_size = 0;
+        this->init();
         this->resize(1);
     }
     
 
     LinearHash(unsigned int size)
     {
-        this->m_size = 0;
+        this->init();
         this->resize(size);
     }
 
     LinearHash(const LinearHash &rhs)
     {
-        this->m_size = 0;
-        this->resize(rhs.m_size);
+        this->init();
+        this->operator=(rhs);
+    }
+
+    LinearHash& operator=(const LinearHash &rhs)
+    {
+        if (this == &rhs) return *this;
+
+        this->resize(rhs.m_base);
+        this->m_max_load  = rhs.m_max_load;
+        this->m_max_chain = rhs.m_max_chain;
 
         for (iterator it = rhs.begin(); it != rhs.end(); ++it)
         {
             this->insert(it->first, it->second);
         }
-        
+
+        return *this;
     }
 
     
     ~LinearHash()
     {
-        if (this->m_size) delete[] this->m_container;
+        if (this->m_capacity)
+        {
+            delete[] this->m_container;
+            delete[] this->m_occupied;
+        }
+    }
+
+
+    // exchange contents with another hash in constant time
+    void swap(LinearHash &rhs)
+    {
+        std::swap(this->m_container, rhs.m_container);
+        std::swap(this->m_size,      rhs.m_size);
+        std::swap(this->m_capacity,  rhs.m_capacity);
+        std::swap(this->m_base,      rhs.m_base);
+        std::swap(this->m_level,     rhs.m_level);
+        std::swap(this->m_split,     rhs.m_split);
+        std::swap(this->m_count,     rhs.m_count);
+        std::swap(this->m_occupied,  rhs.m_occupied);
+        std::swap(this->m_max_load,  rhs.m_max_load);
+        std::swap(this->m_max_chain, rhs.m_max_chain);
     }
 
 
-    //resize, destructively, to exact size
+    //resize, destructively, to exact (base) size, or the next size the policy allows
     void resize(unsigned int size)
     {
         if (!size)
@@ -100,32 +144,40 @@ template <typename Key, typename Data> class LinearHash
             throw string("Tried to set hash size to 0");
         }
 
-        if (this->m_size)
+        size = Policy::sizing::round(size);
+
+        if (this->m_capacity)
         {
             delete[] this->m_container;
-            this->m_size = 0;
+            delete[] this->m_occupied;
+            this->m_capacity = 0;
         }
 
-        this->m_size = size;
-        this->m_container = new Container[this->m_size]();
+        this->m_size     = size;
+        this->m_capacity = size;
+        this->m_base     = size;
+        this->m_level    = 0;
+        this->m_split    = 0;
+        this->m_count    = 0;
+        this->m_container = new Container[this->m_capacity]();
+        this->m_occupied  = new uint64_t[bitmap_words(this->m_capacity)]();
         
     }
 
 
     // resize to a prime number size according to desired storage
+    //  (or to whatever size the policy prefers, e.g. a power of 2)
     void resize_nearest_prime(unsigned int desired_size)
     {
-        unsigned int i;
-        if (desired_size < 2)
-        {
-            this->resize(1);
-        }
-        else
-        {
-            for (i = 1; i < 16 && LINEAR_HASH_TABLE_PRIMES[i] <= desired_size; ++i);
-        
-            this->resize(LINEAR_HASH_TABLE_PRIMES[i - 1]);
-        }
+        this->resize(Policy::sizing::nearest(desired_size));
+    }
+
+
+    // set the online growth limits (see DEFAULT_MAX_LOAD).  max_load = 0 fixes the size
+    void set_growth_limits(unsigned int max_load, unsigned int max_chain)
+    {
+        this->m_max_load  = max_load;
+        this->m_max_chain = max_chain;
     }
     
     
@@ -136,15 +188,26 @@ template <typename Key, typename Data> class LinearHash
     }
 
 
+    // return the size the hash table started at (and will never shrink below)
+    unsigned int get_base_size() const
+    {
+        return this->m_base;
+    }
+
+
     // return the number of elements in the hash table
     unsigned int count() const
     {
-        unsigned int sum = 0;
+        return this->m_count;
+    }
 
-        // TODO: track it differently so its O(1)
-        for (unsigned int i = 0; i < this->m_size; ++i)
-            sum += this->m_container[i].size();
 
+    // return the number of trees that hold at least one element
+    unsigned int occupied_buckets() const
+    {
+        unsigned int sum = 0;
+        for (unsigned int w = 0; w < bitmap_words(this->m_size); ++w)
+            sum += __builtin_popcountll(this->m_occupied[w]);
         return sum;
     }
 
@@ -171,50 +234,98 @@ template <typename Key, typename Data> class LinearHash
     // explicitly insert an element into the hash
     void insert(Key k, Data d)
     {
-        this->m_container[k % this->m_size][k] = d;
+        (*this)[k] = d;
     }
 
     
     // explicitly remove a key from the hash
     void remove(Key k)
     {
-        this->m_container[k % this->m_size].erase(k);
+        unsigned int idx = this->bucket_of(k);
+        if (!this->m_container[idx].erase(k)) return;
+
+        --(this->m_count);
+        if (this->m_container[idx].empty()) this->clear_occupied(idx);
+
+        // shrink when the average chain falls to a quarter of the limit.  two merges
+        //  per removal, so the table is back at its base size by the time it's empty
+        for (int i = 0;
+             i < 2 && this->m_max_load
+                 && this->m_base < this->m_size
+                 && this->m_count * 4 < this->m_size * this->m_max_load;
+             ++i)
+        {
+            this->merge_one();
+        }
     }
 
     
     // check existence of a hashed value
     bool has_key(Key k) const
     {
-        unsigned int idx = k % this->m_size;
+        unsigned int idx = this->bucket_of(k);
         return this->m_container[idx].end() != this->m_container[idx].find(k);
     }
 
 
+    // the value for a key, or NULL if it isn't there (one probe, never inserts)
+    Data* lookup(Key k) const
+    {
+        unsigned int idx = this->bucket_of(k);
+        ContainerIterator it = this->m_container[idx].find(k);
+        return this->m_container[idx].end() == it ? NULL : &(it->second);
+    }
+
+
     // read-only access
     Data& operator[] (Key k) const
     {
-        return this->m_container[k % this->m_size][k];
+        return const_cast<LinearHash<Key, Data, Policy>*>(this)->operator[](k);
     }
     
     
     // array-style access to the hash
     Data& operator[] (Key k)
     {
-        return this->m_container[k % this->m_size][k];
+        unsigned int idx = this->bucket_of(k);
+        ContainerIterator it = this->m_container[idx].find(k);
+        if (this->m_container[idx].end() != it) return it->second;
+
+        // a new key: grow first, so the reference we return stays put.  long chains
+        //  only force a split while there are fewer buckets than keys, so keys that
+        //  can't be told apart don't make the table grow without bound
+        if (this->m_max_load
+            && (this->m_count >= this->m_size * this->m_max_load
+                || (this->m_container[idx].size() >= this->m_max_chain
+                    && this->m_size < this->m_count)))
+        {
+            this->split_one();
+            idx = this->bucket_of(k);
+        }
+
+        ++(this->m_count);
+        this->set_occupied(idx);
+        return this->m_container[idx][k];
     }
 
 
-    // remove all elements from the hash
+    // remove all elements from the hash, returning it to its base size
     void clear()
     {
-        for (int i = 0; i < this->m_size; ++i)
+        for (unsigned int i = this->next_occupied(0); i < this->m_size; i = this->next_occupied(i + 1))
             this->m_container[i].clear();
+        memset(this->m_occupied, 0, bitmap_words(this->m_capacity) * sizeof(uint64_t));
+
+        this->m_size  = this->m_base;
+        this->m_level = 0;
+        this->m_split = 0;
+        this->m_count = 0;
     }
 
 
     class iterator : public std::iterator<std::input_iterator_tag, pair<Key, Data> >
     {
-        const LinearHash<Key, Data>* h;
+        const LinearHash<Key, Data, Policy>* h;
         unsigned int idx;
         ContainerIterator ci;
 
@@ -222,7 +333,7 @@ template <typename Key, typename Data> class LinearHash
 
         iterator() {}
         
-        iterator(const LinearHash<Key, Data>* const h, unsigned int idx, const ContainerIterator ci)
+        iterator(const LinearHash<Key, Data, Policy>* const h, unsigned int idx, const ContainerIterator ci)
         {
             this->h = h;
             this->idx = idx;
@@ -248,14 +359,11 @@ template <typename Key, typename Data> class LinearHash
             // increment individual tree pointer, or jump to next un-vacant tree
             if (this->h->m_container[this->idx].end() != ++(this->ci)) return *this;
 
-            for (++(this->idx); this->idx < this->h->m_size; ++(this->idx))
+            this->idx = this->h->next_occupied(this->idx + 1);
+            if (this->idx < this->h->m_size)
             {
-                //fprintf(stderr, "\ntrying tree %d of %d", this->idx, this->h->m_size - 1);
-                if (!this->h->m_container[this->idx].empty())
-                {
-                    this->ci = this->h->m_container[this->idx].begin();
-                    return *this;
-                }
+                this->ci = this->h->m_container[this->idx].begin();
+                return *this;
             }
 
             // point to end if we don't find anything
@@ -290,9 +398,8 @@ template <typename Key, typename Data> class LinearHash
     // iteration points: begin
     iterator begin() const
     {
-        for (unsigned int i = 0; i < this->m_size; ++i)
-            if (!this->m_container[i].empty())
-                return iterator(this, i, this->m_container[i].begin());
+        unsigned int i = this->next_occupied(0);
+        if (i < this->m_size) return iterator(this, i, this->m_container[i].begin());
 
         return this->end();
     }
@@ -305,4 +412,143 @@ template <typename Key, typename Data> class LinearHash
     }
 
 
+  protected:
+
+    static unsigned int bitmap_words(unsigned int bits) { return (bits + 63) / 64; }
+
+    void set_occupied(unsigned int idx)   { this->m_occupied[idx / 64] |=  (1ull << (idx % 64)); }
+    void clear_occupied(unsigned int idx) { this->m_occupied[idx / 64] &= ~(1ull << (idx % 64)); }
+
+    // the first non-empty tree at or after idx, or m_size if there is none.
+    //  skips 64 empty trees per step
+    unsigned int next_occupied(unsigned int idx) const
+    {
+        if (idx >= this->m_size) return this->m_size;
+
+        unsigned int w = idx / 64;
+        uint64_t bits = this->m_occupied[w] & (~0ull << (idx % 64));
+        unsigned int words = bitmap_words(this->m_size);
+
+        while (!bits)
+        {
+            if (++w == words) return this->m_size;
+            bits = this->m_occupied[w];
+        }
+
+        idx = w * 64 + __builtin_ctzll(bits);
+        return idx < this->m_size ? idx : this->m_size;
+    }
+
+    // an empty table with default growth limits, before resize()
+    void init()
+    {
+        this->m_capacity  = 0;
+        this->m_max_load  = DEFAULT_MAX_LOAD;
+        this->m_max_chain = DEFAULT_MAX_CHAIN;
+    }
+
+    // the bucket a key belongs in, given the current level and split pointer
+    unsigned int bucket_of(Key k) const
+    {
+        uint64_t h = Policy::mixer::mix((uint64_t)k);
+        uint64_t low = (uint64_t)this->m_base << this->m_level;
+        unsigned int idx = Policy::sizing::reduce(h, low);
+
+        if (idx < this->m_split) idx = Policy::sizing::reduce(h, low << 1);
+        return idx;
+    }
+
+    // make room for at least n trees, moving (not copying) the existing ones
+    void reserve(unsigned int n)
+    {
+        if (n <= this->m_capacity) return;
+
+        unsigned int capacity = this->m_capacity * 2 < n ? n : this->m_capacity * 2;
+        Container* bigger = new Container[capacity]();
+        for (unsigned int i = 0; i < this->m_size; ++i)
+            bigger[i].swap(this->m_container[i]);
+
+        uint64_t* occupied = new uint64_t[bitmap_words(capacity)]();
+        memcpy(occupied, this->m_occupied, bitmap_words(this->m_capacity) * sizeof(uint64_t));
+
+        delete[] this->m_container;
+        delete[] this->m_occupied;
+        this->m_container = bigger;
+        this->m_occupied  = occupied;
+        this->m_capacity  = capacity;
+    }
+
+    // move an entry from one tree to another without copying its data
+    static void move_entry(ContainerIterator from, Container& to)
+    {
+        using std::swap;
+        swap(to[from->first], from->second);
+    }
+
+    // split the bucket at the split pointer into itself and a new bucket at the end
+    void split_one()
+    {
+        unsigned int low = this->m_base << this->m_level;
+        unsigned int src = this->m_split;
+
+        this->reserve(low + src + 1);
+
+        Container& from = this->m_container[src];
+        Container& to   = this->m_container[low + src];
+        for (ContainerIterator it = from.begin(); it != from.end(); )
+        {
+            uint64_t h = Policy::mixer::mix((uint64_t)it->first);
+            if (Policy::sizing::reduce(h, (uint64_t)low << 1) == src)
+            {
+                ++it;
+            }
+            else
+            {
+                move_entry(it, to);
+                from.erase(it++);
+            }
+        }
+
+        if (from.empty()) this->clear_occupied(src);
+        if (!to.empty())  this->set_occupied(low + src);
+
+        ++(this->m_size);
+        if (++(this->m_split) == low)
+        {
+            ++(this->m_level);
+            this->m_split = 0;
+        }
+    }
+
+    // undo the most recent split, folding the last bucket back into its partner
+    void merge_one()
+    {
+        if (!this->m_split)
+        {
+            --(this->m_level);
+            this->m_split = this->m_base << this->m_level;
+        }
+        --(this->m_split);
+
+        unsigned int low = this->m_base << this->m_level;
+        Container& from = this->m_container[low + this->m_split];
+        Container& to   = this->m_container[this->m_split];
+        for (ContainerIterator it = from.begin(); it != from.end(); ++it)
+            move_entry(it, to);
+        from.clear();
+
+        this->clear_occupied(low + this->m_split);
+        if (!to.empty()) this->set_occupied(this->m_split);
+
+        --(this->m_size);
+    }
+
 };
+
+
+// constant-time swap, so that tables of tables can move their entries cheaply
+template <typename Key, typename Data, typename Policy>
+void swap(LinearHash<Key, Data, Policy>& lhs, LinearHash<Key, Data, Policy>& rhs)
+{
+    lhs.swap(rhs);
+}
@@ -0,0 +1,154 @@
+#include "LinearHash.h"
+#include "FlatHash.h"
+#include "DenseIdMap.h"
+#include "MCCIBenchmark.h"
+#include "MCCITypes.h"
+
+#include <vector>
+#include <stdio.h>
+
+using namespace std;
+
+/**
+   Compares the hash table engines on the key shapes that MCCI actually uses:
+   dense MCCI_VARIABLE_T ids (schema ordinality, revision cache, VariableRequestBank)
+   and packed (host << 16) + var keys (HostVariableRequestBank, RemoteRevisionRequestBank).
+   DenseIdMap only takes 16 bit keys, so it only runs on the dense shapes.
+ */
+
+
+// dense variable ids, as assigned by the schema
+vector<uint32_t> dense_keys(unsigned int n)
+{
+    vector<uint32_t> ret;
+    for (unsigned int v = 1; v <= n; ++v) ret.push_back(v);
+    return ret;
+}
+
+// every variable of every host
+vector<uint32_t> packed_keys(unsigned int hosts, unsigned int vars)
+{
+    vector<uint32_t> ret;
+    for (unsigned int h = 1; h <= hosts; ++h)
+        for (unsigned int v = 1; v <= vars; ++v)
+            ret.push_back((h << 16) + v);
+    return ret;
+}
+
+
+template <typename Hash>
+void bench_engine(const char* variant, const char* shape, const vector<uint32_t>& keys, unsigned int size)
+{
+    const unsigned int rounds = 20;
+    const unsigned int n = keys.size();
+    CMCCIStopwatch sw;
+    double t_insert = 0, t_hit = 0, t_miss = 0, t_remove = 0, t_iterate = 0;
+
+    for (unsigned int r = 0; r < rounds; ++r)
+    {
+        Hash h;
+        h.resize_nearest_prime(size);
+
+        sw.start();
+        for (unsigned int i = 0; i < n; ++i) h[keys[i]] = i;
+        t_insert += sw.elapsed_ns();
+
+        sw.start();
+        for (unsigned int j = 0; j < 4; ++j)
+            for (unsigned int i = 0; i < n; ++i)
+                if (h.has_key(keys[i])) benchmark_sink += h[keys[i]];
+        t_hit += sw.elapsed_ns();
+
+        sw.start();
+        for (unsigned int j = 0; j < 4; ++j)
+            for (unsigned int i = 0; i < n; ++i)
+                benchmark_sink += h.has_key(keys[i] + 0x8000);
+        t_miss += sw.elapsed_ns();
+
+        sw.start();
+        for (typename Hash::iterator it = h.begin(); it != h.end(); ++it)
+            benchmark_sink += it->second;
+        t_iterate += sw.elapsed_ns();
+
+        sw.start();
+        for (unsigned int i = 0; i < n; ++i) h.remove(keys[i]);
+        t_remove += sw.elapsed_ns();
+    }
+
+    printf("\n %s keys, %d entries, initial size %d", shape, n, size);
+    benchmark_report("insert", variant, n * rounds, t_insert);
+    benchmark_report("lookup (hit)", variant, n * rounds * 4, t_hit);
+    benchmark_report("lookup (miss)", variant, n * rounds * 4, t_miss);
+    benchmark_report("iterate", variant, n * rounds, t_iterate);
+    benchmark_report("remove", variant, n * rounds, t_remove);
+}
+
+
+void bench_shape(const char* shape, const vector<uint32_t>& keys, unsigned int size)
+{
+    bench_engine<LinearHash<uint32_t, unsigned int> >("LinearHash", shape, keys, size);
+    bench_engine<FlatHash<uint32_t, unsigned int> >("FlatHash", shape, keys, size);
+}
+
+// 16 bit ids can skip hashing altogether
+void bench_dense_shape(const char* shape, const vector<uint32_t>& keys, unsigned int size)
+{
+    bench_shape(shape, keys, size);
+    bench_engine<DenseIdMap<uint16_t, unsigned int> >("DenseIdMap", shape, keys, size);
+}
+
+
+// a few keys in a big table, the way RequestBankTwoKeys sees its inner tables after
+//  most requests have been fulfilled or timed out
+void bench_sparse(unsigned int size, unsigned int n)
+{
+    const unsigned int rounds = 200;
+    CMCCIStopwatch sw;
+    double t_iterate = 0, t_remove = 0;
+    LinearHash<uint32_t, unsigned int> h;
+    h.resize_nearest_prime(size);
+
+    for (unsigned int r = 0; r < rounds; ++r)
+    {
+        for (unsigned int i = 0; i < n; ++i) h[i * 977] = i;
+
+        sw.start();
+        for (LinearHash<uint32_t, unsigned int>::iterator it = h.begin(); it != h.end(); ++it)
+            benchmark_sink += it->second;
+        t_iterate += sw.elapsed_ns();
+
+        // remove_by_fq checks empty() after every removal
+        sw.start();
+        for (unsigned int i = 0; i < n; ++i)
+        {
+            h.remove(i * 977);
+            benchmark_sink += h.empty();
+        }
+        t_remove += sw.elapsed_ns();
+    }
+
+    printf("\n sparse LinearHash, %d entries, size %d", n, h.get_size());
+    benchmark_report("iterate (per entry)", "LinearHash", n * rounds, t_iterate);
+    benchmark_report("remove + empty()", "LinearHash", n * rounds, t_remove);
+}
+
+
+int main()
+{
+    printf("\nLinearHash (map per bucket) vs FlatHash (robin hood open addressing)");
+
+    // sized the way MCCIServerMain sizes its banks, and sized for the contents
+    bench_dense_shape("dense var", dense_keys(100), 100);
+    bench_dense_shape("dense var", dense_keys(2000), 20);
+    bench_dense_shape("dense var", dense_keys(2000), 2000);
+    bench_shape("packed host<<16+var", packed_keys(4, 25), 30);
+    bench_shape("packed host<<16+var", packed_keys(16, 128), 30);
+    bench_shape("packed host<<16+var", packed_keys(16, 128), 2048);
+
+    bench_sparse(65521, 10);
+    bench_sparse(65521, 100);
+    bench_sparse(1021, 10);
+
+    printf("\n\n");
+    return 0;
+}
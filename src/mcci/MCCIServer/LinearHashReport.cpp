@@ -0,0 +1,111 @@
+#include "LinearHash.h"
+#include "FlatHash.h"
+#include "HashPolicy.h"
+
+#include <vector>
+#include <string>
+#include <stdio.h>
+
+using namespace std;
+
+/**
+   Distribution report: for the key shape of each bank in MCCIRequestBanks.h, print
+   the chains that each hash policy produces.
+
+   LinearHash rows are measured twice: at the fixed size from MCCIServerMain (which
+   shows the raw spread of the hash), and with online growth (which shows how many
+   buckets each policy needs to keep chains short).  FlatHash rows show the longest
+   probe sequence for each mixer.
+ */
+
+
+vector<uint32_t> range(uint32_t first, uint32_t n)
+{
+    vector<uint32_t> ret;
+    for (uint32_t i = 0; i < n; ++i) ret.push_back(first + i);
+    return ret;
+}
+
+vector<uint32_t> packed(unsigned int hosts, unsigned int vars)
+{
+    vector<uint32_t> ret;
+    for (uint32_t h = 1; h <= hosts; ++h)
+        for (uint32_t v = 1; v <= vars; ++v)
+            ret.push_back((h << 16) + v);
+    return ret;
+}
+
+
+template <typename Policy>
+void report_linear(const vector<uint32_t>& keys, unsigned int size)
+{
+    string policy = string(Policy::mixer::name()) + "/" + Policy::sizing::name();
+
+    LinearHash<uint32_t, bool, Policy> fixed;
+    fixed.resize_nearest_prime(size);
+    fixed.set_growth_limits(0, 0);
+
+    LinearHash<uint32_t, bool, Policy> grown;
+    grown.resize_nearest_prime(size);
+
+    for (unsigned int i = 0; i < keys.size(); ++i)
+    {
+        fixed[keys[i]] = true;
+        grown[keys[i]] = true;
+    }
+
+    printf("\n    LinearHash %-20s fixed: %6d buckets, %6d used, max chain %5d, mean chain %6.2f"
+           "   grown: %6d buckets, max chain %3d",
+           policy.c_str(),
+           fixed.get_size(), fixed.occupied_buckets(), fixed.max_collisions(),
+           (double)fixed.count() / fixed.occupied_buckets(),
+           grown.get_size(), grown.max_collisions());
+}
+
+
+template <typename Mixer>
+void report_flat(const vector<uint32_t>& keys, unsigned int size)
+{
+    FlatHash<uint32_t, bool, Mixer> h;
+    h.resize_nearest_prime(size);
+
+    for (unsigned int i = 0; i < keys.size(); ++i) h[keys[i]] = true;
+
+    printf("\n    FlatHash   %-20s       %6d slots, longest probe %d",
+           Mixer::name(), h.get_size(), h.max_collisions());
+}
+
+
+void report(const char* bank, const char* shape, const vector<uint32_t>& keys, unsigned int size)
+{
+    printf("\n\n%s: %s (%d keys, configured size %d)", bank, shape, (int)keys.size(), size);
+
+    report_linear<HashPolicyDefault>(keys, size);
+    report_linear<HashPolicy<HashMixFibonacci, HashSizePrime> >(keys, size);
+    report_linear<HashPolicy<HashMixMurmur, HashSizePrime> >(keys, size);
+    report_linear<HashPolicyDense>(keys, size);
+    report_linear<HashPolicyFibonacci>(keys, size);
+    report_linear<HashPolicyMurmur>(keys, size);
+
+    report_flat<HashMixIdentity>(keys, size);
+    report_flat<HashMixFibonacci>(keys, size);
+    report_flat<HashMixMurmur>(keys, size);
+}
+
+
+int main()
+{
+    printf("\nHash distribution report for the banks in MCCIRequestBanks.h");
+
+    // sizes are the ones MCCIServerMain configures
+    report("HostRequestBank", "node addresses", range(1, 64), 20);
+    report("VariableRequestBank", "variable ids", range(1, 500), 20);
+    report("HostVariableRequestBank", "(host << 16) + var", packed(16, 64), 30);
+    report("VariableRevisionRequestBank (outer)", "variable ids", range(1, 500), 100);
+    report("VariableRevisionRequestBank (inner)", "a window of revisions", range(5000, 200), 20);
+    report("RemoteRevisionRequestBank (outer)", "(host << 16) + var", packed(16, 64), 20);
+    report("RemoteRevisionRequestBank (inner)", "a window of revisions", range(5000, 200), 20);
+
+    printf("\n\n");
+    return 0;
+}
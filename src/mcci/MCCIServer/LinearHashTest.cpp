@@ -3,6 +3,7 @@
 #include <string>
 #include <stdio.h>
 #include <boost/cstdint.hpp>
+#include <assert.h>
 
 using namespace std;
 
@@ -154,6 +155,95 @@ void test_short_hash()
     m_ordinality[var_id] = i;
 }
 
+void test_online_growth()
+{
+    LinearHash<uint32_t, uint32_t> lh(7);
+
+    printf("\n\nOnline growth from %d buckets", lh.get_size());
+    for (uint32_t i = 0; i < 100000; ++i)
+    {
+        lh[(i % 16 << 16) + i / 16] = i;   // packed (host << 16) + var keys
+    }
+
+    printf("\nAfter 100000 inserts: count %d, size %d, max_collisions %d",
+           lh.count(), lh.get_size(), lh.max_collisions());
+    assert(100000 == lh.count());
+    typedef LinearHash<uint32_t, uint32_t> IntHash;
+    assert(100000 / IntHash::DEFAULT_MAX_LOAD <= lh.get_size());
+
+    for (uint32_t i = 0; i < 100000; ++i)
+    {
+        assert(lh.has_key((i % 16 << 16) + i / 16));
+        assert(i == lh[(i % 16 << 16) + i / 16]);
+    }
+
+    unsigned int n = 0;
+    for (LinearHash<uint32_t, uint32_t>::iterator it = lh.begin(); it != lh.end(); ++it) ++n;
+    assert(100000 == n);
+
+    for (uint32_t i = 0; i < 100000; ++i)
+    {
+        lh.remove((i % 16 << 16) + i / 16);
+    }
+    printf("\nAfter removing them all: count %d, size %d", lh.count(), lh.get_size());
+    assert(lh.empty());
+    assert(7 == lh.get_size());
+
+    // keys that no modulus can separate must not make the table run away
+    LinearHash<uint32_t, uint32_t> bad(1);
+    for (uint32_t i = 0; i < 1000; ++i) bad[i << 24] = i;
+    printf("\n1000 keys that are multiples of 2^24: size %d", bad.get_size());
+    assert(bad.get_size() <= 1000);
+
+    // tables of tables move their entries by swapping
+    LinearHash<uint32_t, LinearHash<uint32_t, uint32_t> > nested(1);
+    for (uint32_t i = 0; i < 1000; ++i)
+    {
+        nested[i].resize_nearest_prime(5);
+        nested[i][i] = i;
+    }
+    for (uint32_t i = 0; i < 1000; ++i) assert(i == nested[i][i]);
+    printf("\nNested tables survive growth: outer size %d", nested.get_size());
+
+    LinearHash<uint32_t, uint32_t> fixed(7);
+    fixed.set_growth_limits(0, 0);
+    for (uint32_t i = 0; i < 1000; ++i) fixed[i] = i;
+    assert(7 == fixed.get_size());
+}
+
+template <typename Policy>
+void try_policy()
+{
+    LinearHash<uint32_t, uint32_t, Policy> lh;
+    lh.resize_nearest_prime(30);
+    unsigned int base = lh.get_size();
+
+    for (uint32_t i = 0; i < 20000; ++i) lh[(i % 16 << 16) + i / 16] = i;
+    printf("\n%s/%s: base size %d, grown to %d, max_collisions %d",
+           Policy::mixer::name(), Policy::sizing::name(),
+           base, lh.get_size(), lh.max_collisions());
+
+    for (uint32_t i = 0; i < 20000; ++i) assert(i == lh[(i % 16 << 16) + i / 16]);
+    for (uint32_t i = 0; i < 20000; ++i) lh.remove((i % 16 << 16) + i / 16);
+    assert(lh.empty());
+    assert(base == lh.get_size());
+}
+
+void test_policies()
+{
+    printf("\n\nHash policies on packed keys");
+    try_policy<HashPolicyDefault>();
+    try_policy<HashPolicyDense>();
+    try_policy<HashPolicyFibonacci>();
+    try_policy<HashPolicyMurmur>();
+
+    // power of two sizing rounds every size
+    LinearHash<uint32_t, uint32_t, HashPolicyFibonacci> p2(100);
+    assert(128 == p2.get_size());
+    p2.resize_nearest_prime(100);
+    assert(64 == p2.get_size());
+}
+
 int main()
 {
     
@@ -161,6 +251,8 @@ int main()
     test_hash_operations();
     test_multidim_hash();
     test_short_hash();
+    test_online_growth();
+    test_policies();
     
     printf("\n\n");
     
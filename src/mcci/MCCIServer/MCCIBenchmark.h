@@ -0,0 +1,44 @@
+#pragma once
+
+#include <time.h>
+#include <stdio.h>
+
+/**
+   Small helpers shared by the *Bench.cpp programs.
+
+   Each benchmark is a standalone program (like the *Test.cpp programs) that prints
+   one line per measurement, so results can be compared between builds with diff.
+ */
+
+
+// results are folded into this so the optimizer can't drop the work being timed
+static volatile unsigned long benchmark_sink = 0;
+
+
+// wall-clock stopwatch with nanosecond resolution
+class CMCCIStopwatch
+{
+  protected:
+    struct timespec m_start;
+
+  public:
+    CMCCIStopwatch() { this->start(); }
+
+    void start() { clock_gettime(CLOCK_MONOTONIC, &this->m_start); }
+
+    // nanoseconds since start()
+    double elapsed_ns() const
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (now.tv_sec - this->m_start.tv_sec) * 1e9 + (now.tv_nsec - this->m_start.tv_nsec);
+    }
+};
+
+
+// print a measurement as time per operation and operations per second
+inline void benchmark_report(const char* name, const char* variant, unsigned long ops, double ns)
+{
+    printf("\n  %-36s %-22s %10lu ops %10.1f ns/op %12.0f ops/s",
+           name, variant, ops, ns / ops, ops / (ns / 1e9));
+}
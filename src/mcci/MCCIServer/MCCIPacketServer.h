@@ -0,0 +1,42 @@
+#pragma once
+
+#include "MCCITypes.h"
+
+
+/**
+   What networking hands packets to: a CMCCIServer, or a CMCCIShardedServer that
+   routes them on threads of its own.
+ */
+class CMCCIPacketServer
+{
+  public:
+    virtual ~CMCCIPacketServer() {}
+
+    // accept a request packet, responding in place
+    virtual void process_request(MCCI_CLIENT_ID_T requestor_id,
+                                 const SMCCIRequestPacket* input,
+                                 SMCCIResponsePacket* response) = 0;
+
+    // accept a data packet; references to its payload are taken as needed
+    virtual void process_data(MCCI_CLIENT_ID_T provider_id,
+                              const SMCCIDataPacket* input) = 0;
+
+    // accept a production packet, filling in its acceptance
+    virtual void process_production(MCCI_CLIENT_ID_T provider_id,
+                                    const SMCCIProductionPacket* input,
+                                    SMCCIAcceptancePacket* output) = 0;
+
+    // remove all expired requests
+    virtual void enforce_timeouts() = 0;
+
+    // remove every request of a client, e.g. once it has disconnected
+    virtual void drop_client(MCCI_CLIENT_ID_T client_id) = 0;
+
+    // the earliest timeout of any request, if there are requests.  they expire once
+    //  the time is past it
+    virtual bool next_timeout(MCCI_TIME_T* deadline) const = 0;
+
+    // whether the networking is called from threads other than the one handing
+    //  over the packets
+    virtual bool sends_from_threads() const { return false; }
+};
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <string>
+#include <string.h>
+#include <stdlib.h>
+#include <new>
+#include <pthread.h>
+
+using namespace std;
+
+
+class CMCCIPayloadPool;
+
+
+/**
+   The contents of a data packet: an immutable buffer with a length and a
+   reference count, so that one copy can be shared by the working set, every
+   client it's being sent to and anything queued between threads.
+
+   A payload is made with one reference, which belongs to whoever made it.
+   Anything that keeps the pointer beyond the call it was given in takes a
+   reference with retain() and gives it up with release(); the last release
+   returns the buffer to its pool.  The count is atomic, so references may be
+   taken and dropped on any thread.
+
+   The header and the bytes are one block, allocated by CMCCIPayloadPool.
+ */
+class CMCCIPayload
+{
+  protected:
+    CMCCIPayloadPool* m_pool;
+    volatile unsigned int m_references;
+    unsigned int m_length;
+    int m_size_class;     // which of the pool's free lists the block goes back to
+
+    // only the pool makes and unmakes payloads
+    CMCCIPayload() {}
+    ~CMCCIPayload() {}
+    CMCCIPayload(const CMCCIPayload &rhs);
+    CMCCIPayload& operator=(const CMCCIPayload &rhs);
+
+    char* bytes() { return (char*)(this + 1); }
+
+    friend class CMCCIPayloadPool;
+
+  public:
+
+    // a payload holding a copy of some bytes, from the given pool (or the shared one)
+    static CMCCIPayload* create(const char* data, unsigned int length, CMCCIPayloadPool* pool = NULL);
+
+    const char* data() const { return (const char*)(this + 1); }
+    unsigned int length() const { return this->m_length; }
+    unsigned int references() const { return this->m_references; }
+
+    void retain() { __sync_fetch_and_add(&this->m_references, 1); }
+    inline void release();
+};
+
+
+// retain and release a payload pointer, which may be NULL
+inline void mcci_payload_retain(CMCCIPayload* p) { if (p) p->retain(); }
+inline void mcci_payload_release(CMCCIPayload* p) { if (p) p->release(); }
+
+
+/**
+   Storage for payloads, in size classes of powers of 2 (header included) from
+   64 bytes to 2 MB.  Released blocks go onto a free list for their class and are
+   handed out again, as long as the free lists together hold no more than
+   max_free_bytes; past that, and for anything bigger than the largest class,
+   blocks go straight back to malloc.
+
+   The free lists are shared by every thread under one lock, which is only held
+   to push or pop a block.
+
+   hits() counts payloads made from a free list, misses() those that needed malloc.
+ */
+class CMCCIPayloadPool
+{
+  protected:
+    static const int MIN_CLASS = 6;   // 64 bytes
+    static const int MAX_CLASS = 21;  // 2 MB
+    static const int CLASSES = MAX_CLASS - MIN_CLASS + 1;
+
+    // a free block holds the link to the next
+    typedef struct FreeBlock
+    {
+        struct FreeBlock* next;
+    } FreeBlock;
+
+    FreeBlock* m_free[CLASSES];
+    unsigned long m_free_bytes;       // in all the free lists
+    unsigned long m_max_free_bytes;
+
+    pthread_mutex_t m_lock;
+
+    unsigned long m_hits;
+    unsigned long m_misses;
+
+    // a pool owns its storage; copying it makes no sense
+    CMCCIPayloadPool(const CMCCIPayloadPool &rhs);
+    CMCCIPayloadPool& operator=(const CMCCIPayloadPool &rhs);
+
+    // the class of a block of this many bytes, or -1 if it's too big for any
+    static int size_class(unsigned int block)
+    {
+        int c = MIN_CLASS;
+        while (c <= MAX_CLASS && (1u << c) < block) ++c;
+        return c <= MAX_CLASS ? c - MIN_CLASS : -1;
+    }
+
+  public:
+
+    CMCCIPayloadPool(unsigned long max_free_bytes = 16 << 20)
+    {
+        for (int c = 0; c < CLASSES; ++c) this->m_free[c] = NULL;
+        this->m_free_bytes = 0;
+        this->m_max_free_bytes = max_free_bytes;
+        this->m_hits = 0;
+        this->m_misses = 0;
+        pthread_mutex_init(&this->m_lock, NULL);
+    }
+
+    // payloads still referenced when the pool goes must not be released after it
+    ~CMCCIPayloadPool()
+    {
+        for (int c = 0; c < CLASSES; ++c)
+        {
+            while (this->m_free[c])
+            {
+                FreeBlock* b = this->m_free[c];
+                this->m_free[c] = b->next;
+                free(b);
+            }
+        }
+        pthread_mutex_destroy(&this->m_lock);
+    }
+
+    // the pool used when none is given.  it's never destroyed, so payloads can be
+    //  released at any time
+    static CMCCIPayloadPool* shared()
+    {
+        static CMCCIPayloadPool* pool = new CMCCIPayloadPool();
+        return pool;
+    }
+
+    CMCCIPayload* allocate(unsigned int length)
+    {
+        unsigned int block = sizeof(CMCCIPayload) + length;
+        int c = size_class(block);
+        void* storage = NULL;
+
+        pthread_mutex_lock(&this->m_lock);
+        if (0 <= c && this->m_free[c])
+        {
+            FreeBlock* b = this->m_free[c];
+            this->m_free[c] = b->next;
+            this->m_free_bytes -= 1u << (c + MIN_CLASS);
+            storage = b;
+            ++(this->m_hits);
+        }
+        else
+        {
+            ++(this->m_misses);
+        }
+        pthread_mutex_unlock(&this->m_lock);
+
+        if (!storage)
+        {
+            storage = malloc(0 <= c ? 1u << (c + MIN_CLASS) : block);
+            if (!storage) throw string("Couldn't allocate a payload");
+        }
+
+        CMCCIPayload* p = new (storage) CMCCIPayload();
+        p->m_pool = this;
+        p->m_references = 1;
+        p->m_length = length;
+        p->m_size_class = c;
+        return p;
+    }
+
+    void deallocate(CMCCIPayload* p)
+    {
+        int c = p->m_size_class;
+        p->~CMCCIPayload();
+
+        FreeBlock* b = (FreeBlock*)p;
+        if (0 <= c)
+        {
+            pthread_mutex_lock(&this->m_lock);
+            bool keep = this->m_free_bytes + (1u << (c + MIN_CLASS)) <= this->m_max_free_bytes;
+            if (keep)
+            {
+                b->next = this->m_free[c];
+                this->m_free[c] = b;
+                this->m_free_bytes += 1u << (c + MIN_CLASS);
+            }
+            pthread_mutex_unlock(&this->m_lock);
+            if (keep) return;
+        }
+
+        free(b);
+    }
+
+    unsigned long hits() const { return this->m_hits; }
+    unsigned long misses() const { return this->m_misses; }
+};
+
+
+inline CMCCIPayload* CMCCIPayload::create(const char* data, unsigned int length, CMCCIPayloadPool* pool)
+{
+    if (!pool) pool = CMCCIPayloadPool::shared();
+
+    CMCCIPayload* p = pool->allocate(length);
+    memcpy(p->bytes(), data, length);
+    return p;
+}
+
+inline void CMCCIPayload::release()
+{
+    if (0 == __sync_sub_and_fetch(&this->m_references, 1)) this->m_pool->deallocate(this);
+}
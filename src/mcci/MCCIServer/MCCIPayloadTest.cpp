@@ -0,0 +1,167 @@
+#include "MCCIPayload.h"
+#include "MCCIBenchmark.h"
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+
+using namespace std;
+
+
+void test_references()
+{
+    CMCCIPayloadPool pool;
+
+    printf("\n\nMaking a payload of 11 bytes");
+    CMCCIPayload* p = CMCCIPayload::create("hello world", 11, &pool);
+    assert(11 == p->length());
+    assert(0 == memcmp("hello world", p->data(), 11));
+    assert(1 == p->references());
+
+    p->retain();
+    mcci_payload_retain(p);
+    assert(3 == p->references());
+    mcci_payload_release(NULL);
+
+    p->release();
+    p->release();
+    printf("\nDown to %u reference", p->references());
+    assert(1 == p->references());
+    p->release();
+
+    printf("\nA new payload of the same class comes off the free list");
+    CMCCIPayload* q = CMCCIPayload::create("again", 5, &pool);
+    assert(q == p);
+    assert(1 == pool.hits() && 1 == pool.misses());
+
+    CMCCIPayload* empty = CMCCIPayload::create(NULL, 0, &pool);
+    assert(0 == empty->length());
+    assert(empty != q);
+
+    q->release();
+    empty->release();
+}
+
+
+void test_size_classes()
+{
+    CMCCIPayloadPool pool;
+    vector<CMCCIPayload*> made;
+
+    printf("\n\nMaking payloads of 1 byte to 4 MB");
+    for (unsigned int len = 1; len <= (4u << 20); len *= 2)
+    {
+        string bytes(len, (char)('a' + made.size() % 26));
+        CMCCIPayload* p = CMCCIPayload::create(bytes.data(), len, &pool);
+        assert(len == p->length());
+        assert(0 == memcmp(bytes.data(), p->data(), len));
+        made.push_back(p);
+    }
+
+    for (unsigned int i = 0; i < made.size(); ++i) made[i]->release();
+    unsigned long misses = pool.misses();
+    assert(made.size() == misses);
+    made.clear();
+
+    printf("\nMaking them again: all but the biggest (beyond 2 MB) are reused");
+    unsigned int oversize = 0;
+    for (unsigned int len = 1; len <= (4u << 20); len *= 2)
+    {
+        made.push_back(pool.allocate(len));
+        if (len > (2u << 20) - 64) ++oversize;
+    }
+    for (unsigned int i = 0; i < made.size(); ++i) made[i]->release();
+
+    printf("\n%lu hits, %lu misses", pool.hits(), pool.misses());
+    assert(made.size() - oversize == pool.hits());
+    assert(misses + oversize == pool.misses());
+}
+
+
+void test_free_limit()
+{
+    CMCCIPayloadPool pool(128);
+    CMCCIPayload* p[4];
+
+    printf("\n\nKeeping at most 128 bytes of free blocks: two of 64");
+    for (int i = 0; i < 4; ++i) p[i] = pool.allocate(10);
+    for (int i = 0; i < 4; ++i) p[i]->release();
+    for (int i = 0; i < 4; ++i) p[i] = pool.allocate(10);
+    for (int i = 0; i < 4; ++i) p[i]->release();
+
+    assert(2 == pool.hits());
+    assert(6 == pool.misses());
+
+    // a bigger block doesn't fit in what's left, whatever its class
+    pool.allocate(1000)->release();
+    pool.allocate(1000)->release();
+    assert(2 == pool.hits());
+    assert(8 == pool.misses());
+}
+
+
+// references taken on one thread and dropped on others
+CMCCIPayload* shared_payload = NULL;
+
+void* drop_references(void* arg)
+{
+    for (int i = 0; i < 100000; ++i) shared_payload->release();
+    return NULL;
+}
+
+void test_threads()
+{
+    printf("\n\nDropping 400000 references on 4 threads");
+    shared_payload = CMCCIPayload::create("x", 1);
+    for (int i = 0; i < 400000; ++i) shared_payload->retain();
+
+    pthread_t t[4];
+    for (int i = 0; i < 4; ++i) pthread_create(&t[i], NULL, drop_references, NULL);
+    for (int i = 0; i < 4; ++i) pthread_join(t[i], NULL);
+
+    assert(1 == shared_payload->references());
+    shared_payload->release();
+}
+
+
+void bench_create()
+{
+    const unsigned int N = 1000000;
+    char bytes[200];
+    memset(bytes, 'z', sizeof(bytes));
+    CMCCIPayloadPool pool;
+
+    CMCCIStopwatch sw;
+    for (unsigned int i = 0; i < N; ++i)
+    {
+        CMCCIPayload* p = CMCCIPayload::create(bytes, 1 + i % sizeof(bytes), &pool);
+        benchmark_sink += p->length();
+        p->release();
+    }
+    benchmark_report("payload create and release", "pooled", N, sw.elapsed_ns());
+
+    sw.start();
+    for (unsigned int i = 0; i < N; ++i)
+    {
+        string* s = new string(bytes, 1 + i % sizeof(bytes));
+        benchmark_sink += s->size();
+        delete s;
+    }
+    benchmark_report("payload create and release", "new string", N, sw.elapsed_ns());
+}
+
+
+int main(int argc, char* argv[])
+{
+    test_references();
+    test_size_classes();
+    test_free_limit();
+    test_threads();
+    bench_create();
+
+    printf("\n\n");
+    return 0;
+}
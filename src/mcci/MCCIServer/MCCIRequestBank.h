@@ -3,17 +3,47 @@
 
 #include "MCCITypes.h"
 #include "LinearHash.h"
+#include "FlatHash.h"
 #include "FibonacciHeap.h"
+#include "TimingWheel.h"
+#include "ClientBitset.h"
 #include <map>
 #include <list>
+#include <vector>
 #include <ostream>
 
 using namespace std;
 
-// declare class to enable declaration of ostream operator
-template <typename KeySet> class RequestBank;
+// convenience struct to hold the fully-qualifying lookup information of a request
+template <typename KeySet> struct RequestLookupSet
+{
+    KeySet key_set;
+    MCCI_CLIENT_ID_T client_id;
+};
+
 template <typename KeySet>
-ostream& operator<<(ostream &, const RequestBank<KeySet>&);
+std::ostream& operator<<(std::ostream &out, RequestLookupSet<KeySet> const &rhs)
+{ return out << "(key_set " << rhs.key_set << ", client_id " << rhs.client_id << ")"; }
+
+
+// something that needs to know when the subscribers to a key set change (e.g. a cache)
+template <typename KeySet> class SubscriptionListener
+{
+  public:
+    virtual ~SubscriptionListener() {}
+
+    // a subscriber was added to or removed from a key set
+    virtual void subscribers_changed(KeySet const key_set) = 0;
+
+    // every key set lost all its subscribers
+    virtual void subscribers_cleared() = 0;
+};
+
+
+// declare class to enable declaration of ostream operator
+template <typename KeySet, typename TimeoutIndex> class RequestBank;
+template <typename KeySet, typename TimeoutIndex>
+ostream& operator<<(ostream &, const RequestBank<KeySet, TimeoutIndex>&);
 
 
 /**
@@ -21,26 +51,22 @@ ostream& operator<<(ostream &, const RequestBank<KeySet>&);
    given key (key set, implementation depending), and removed both by the key 
    and by the passing of time.  the number of open requests per subscriber is
    tracked.
+
+   The TimeoutIndex holds the time-sensitive view of the data.  Anything with the
+   node-handle interface of FibonacciHeap will do (e.g. TimingWheel).
  */
-template<typename KeySet>
+template<typename KeySet,
+         typename TimeoutIndex = FibonacciHeap<MCCI_TIME_T, RequestLookupSet<KeySet> > >
 class RequestBank
 {
   public:
-    // convenience struct to hold the fully-qualifying lookup information
-    typedef struct
-    {
-        KeySet key_set;
-        MCCI_CLIENT_ID_T client_id;
-    } LookupSet;
-
-    friend std::ostream& operator<<(std::ostream &out, LookupSet const &rhs)
-    { return out << "(key_set " << rhs.key_set << ", client_id " << rhs.client_id << ")"; }
+    typedef RequestLookupSet<KeySet> LookupSet;
 
     // holds the time-sensitive view of the data
-    typedef FibonacciHeapNode<MCCI_TIME_T, LookupSet> HeapNode;
+    typedef typename TimeoutIndex::Node HeapNode;
 
     // holds the subscription information
-    typedef map<MCCI_CLIENT_ID_T, HeapNode*> SubscriptionMap;
+    typedef SubscriberSet<HeapNode*> SubscriptionMap;
 
     // for iterating over subscriber information
     typedef typename SubscriptionMap::iterator SubscriptionMapIterator;
@@ -48,22 +74,42 @@ class RequestBank
   private:
     unsigned int* m_outstanding_requests; // FIXME -- convert to vector
     unsigned int m_max_client_id;
-    FibonacciHeap<MCCI_TIME_T, LookupSet> m_timeouts;
+    TimeoutIndex m_timeouts;
+    vector<LookupSet> m_expired; // reused by expire_until
+    vector<HeapNode*> m_dropped; // reused by remove_client
+    SubscriptionListener<KeySet>* m_listener;
+
+    // gathers what the timeout index expires
+    struct ExpiryCollector
+    {
+        vector<LookupSet>* out;
+        void operator()(LookupSet const &l) { out->push_back(l); }
+    };
+
+    // for expire_until without a callback
+    struct IgnoreExpired
+    {
+        void operator()(vector<LookupSet> const &) {}
+    };
 
 
   public:
     RequestBank(unsigned int max_client_id)
     {
-        this->m_outstanding_requests = new unsigned int[max_client_id]();
+        this->m_outstanding_requests = new unsigned int[max_client_id + 1]();
         this->m_max_client_id = max_client_id;
+        this->m_listener = NULL;
         //this->m_timeouts.m_debug_remove_min = true;
         //this->m_timeouts.m_debug = true;
     }
     
     virtual ~RequestBank() { delete[] this->m_outstanding_requests; }
 
-    friend std::ostream& operator<<(ostream &out, RequestBank<KeySet> const &rhs)
+    friend std::ostream& operator<<(ostream &out, RequestBank<KeySet, TimeoutIndex> const &rhs)
     { return out << rhs.m_timeouts; }
+
+    // who to tell when subscribers come and go (NULL for nobody)
+    void set_listener(SubscriptionListener<KeySet>* listener) { this->m_listener = listener; }
     
     
     // developer tool to check sanity of a RequestBank
@@ -89,6 +135,7 @@ class RequestBank
             this->add_by_fq(key_set, client_id, n);
             
             this->m_outstanding_requests[client_id] += 1; // add what wasn't there
+            if (this->m_listener) this->m_listener->subscribers_changed(key_set);
 
             return;
         }
@@ -105,11 +152,20 @@ class RequestBank
     bool empty() const { return this->m_timeouts.empty(); }
 
     // number of requests
-    bool size() const { return this->m_timeouts.size(); }
+    unsigned int size() const { return this->m_timeouts.size(); }
     
     // get the timeout of the node that will expire first
     MCCI_TIME_T minimum_timeout() const { return this->m_timeouts.minimum()->key(); }
 
+    // remove every request
+    void clear()
+    {
+        this->m_timeouts.clear();
+        this->remove_all();
+        if (this->m_listener) this->m_listener->subscribers_cleared();
+        for (unsigned int i = 0; i <= this->m_max_client_id; ++i) this->m_outstanding_requests[i] = 0;
+    }
+
     // remove the request that's expiring first
     void remove_minimum()
     {
@@ -118,6 +174,36 @@ class RequestBank
         this->remove_by_fq(l.key_set, l.client_id);
         this->m_outstanding_requests[l.client_id] -= 1;
         this->m_timeouts.remove_minimum();
+        if (this->m_listener) this->m_listener->subscribers_changed(l.key_set);
+    }
+
+    // remove every request with a timeout at or before the deadline, in one pass
+    //  over the timeout index.  expired(vector<LookupSet>) then gets the whole batch.
+    //  returns the number of requests removed
+    template <typename Callback> unsigned int expire_until(MCCI_TIME_T deadline, Callback& expired)
+    {
+        ExpiryCollector collect;
+        collect.out = &(this->m_expired);
+        this->m_expired.clear();
+
+        if (!this->m_timeouts.expire_until(deadline, collect)) return 0;
+
+        for (typename vector<LookupSet>::iterator it = this->m_expired.begin();
+             it != this->m_expired.end(); ++it)
+        {
+            this->remove_by_fq(it->key_set, it->client_id);
+            this->m_outstanding_requests[it->client_id] -= 1;
+            if (this->m_listener) this->m_listener->subscribers_changed(it->key_set);
+        }
+
+        expired(this->m_expired);
+        return this->m_expired.size();
+    }
+
+    unsigned int expire_until(MCCI_TIME_T deadline)
+    {
+        IgnoreExpired ignore;
+        return this->expire_until(deadline, ignore);
     }
 
     
@@ -138,20 +224,59 @@ class RequestBank
 
         // remove all custom structure nodes in one shot
         this->remove_by_pq(key_set);
+        if (this->m_listener) this->m_listener->subscribers_changed(key_set);
     }
     
+    // remove every request of a client (e.g. one that disconnected); returns how many went
+    unsigned int remove_client(MCCI_CLIENT_ID_T client_id)
+    {
+        if (client_id > this->m_max_client_id || !this->m_outstanding_requests[client_id]) return 0;
+
+        this->m_dropped.clear();
+        this->collect_client(client_id, this->m_dropped);
+
+        for (typename vector<HeapNode*>::iterator it = this->m_dropped.begin();
+             it != this->m_dropped.end(); ++it)
+        {
+            LookupSet l = (*it)->data();
+            this->remove_by_fq(l.key_set, client_id);
+            this->m_timeouts.remove(*it, 0);
+            this->m_outstanding_requests[client_id] -= 1;
+            if (this->m_listener) this->m_listener->subscribers_changed(l.key_set);
+        }
+
+        return this->m_dropped.size();
+    }
+
     // does this structure contain the given node?
     bool contains(KeySet const key_set, MCCI_CLIENT_ID_T client_id) const
     {
         return this->get_by_fq(key_set, client_id);
     }
 
+    // the timeout of a client's request for a key set, if it has one
+    bool get_timeout(KeySet const key_set, MCCI_CLIENT_ID_T client_id, MCCI_TIME_T* timeout) const
+    {
+        HeapNode* n = this->get_by_fq(key_set, client_id);
+        if (!n) return false;
+
+        *timeout = n->key();
+        return true;
+    }
+
     // does this structure contain the given key set?
     bool contains(KeySet const key_set) const
     {
         return this->get_by_pq(key_set);
     }
     
+    // add the clients subscribed to a key set to a client set
+    void collect_subscribers(KeySet const key_set, ClientBitset& clients) const
+    {
+        SubscriptionMap* sm = this->get_by_pq(key_set);
+        if (sm) clients.merge(sm->clients());
+    }
+
     // number of open requests for a given client
     unsigned int get_outstanding_request_count(MCCI_CLIENT_ID_T client_id) const
     {
@@ -209,6 +334,12 @@ class RequestBank
     // remove a partially-qualified set of nodes from the custom container (don't delete HeapNodes)
     virtual void remove_by_pq(KeySet const key_set) = 0;
 
+    // empty the custom container (don't delete HeapNodes)
+    virtual void remove_all() = 0;
+
+    // add the heap nodes of every request a client has to a vector
+    virtual void collect_client(MCCI_CLIENT_ID_T client_id, vector<HeapNode*>& nodes) const = 0;
+
 };
 
 
@@ -218,18 +349,22 @@ class RequestBank
 
 
 
-// class that stores requests using a single key into a linear hash
-template<typename KeySet, typename Key>
-    class RequestBankOneKey : public RequestBank<KeySet>
+// class that stores requests using a single key into a hash table.
+//  any table with the LinearHash interface will do (e.g. FlatHash)
+template<typename KeySet,
+         typename Key,
+         typename TimeoutIndex = FibonacciHeap<MCCI_TIME_T, RequestLookupSet<KeySet> >,
+         typename Hash = LinearHash<Key, typename RequestBank<KeySet, TimeoutIndex>::SubscriptionMap*> >
+    class RequestBankOneKey : public RequestBank<KeySet, TimeoutIndex>
 {
 
   public:
-    typedef typename RequestBank<KeySet>::HeapNode HeapNode;
-    typedef typename RequestBank<KeySet>::SubscriptionMap SubscriptionMap;
-    typedef typename RequestBank<KeySet>::subscriber_iterator subscriber_iterator;
+    typedef typename RequestBank<KeySet, TimeoutIndex>::HeapNode HeapNode;
+    typedef typename RequestBank<KeySet, TimeoutIndex>::SubscriptionMap SubscriptionMap;
+    typedef typename RequestBank<KeySet, TimeoutIndex>::subscriber_iterator subscriber_iterator;
         
   protected:
-    typedef LinearHash<Key, SubscriptionMap*> LinearHashBank;
+    typedef Hash LinearHashBank;
     typedef typename LinearHashBank::iterator LinearHashBankIterator;
     
     LinearHashBank m_bank;
@@ -239,19 +374,12 @@ template<typename KeySet, typename Key>
     virtual Key get_key(KeySet const key_set) const = 0; //{ return (Key)key_set; };
     
     RequestBankOneKey(unsigned int max_clients, unsigned int size)
-      : RequestBank<KeySet>(max_clients)
+      : RequestBank<KeySet, TimeoutIndex>(max_clients)
     {
         this->m_bank.resize_nearest_prime(size);
     }
     
-    virtual ~RequestBankOneKey()
-    {
-        // free all map objects that exist in LinearHashBank.
-        LinearHashBankIterator it;
-        for (it = this->m_bank.begin(); it != this->m_bank.end(); ++it)
-            if (NULL != it->second)
-                delete it->second;
-    }
+    virtual ~RequestBankOneKey() { this->free_maps(); }
 
     // assume that this entry is unique and add it to the structure
     virtual void add_by_fq(KeySet const key_set,
@@ -276,26 +404,26 @@ template<typename KeySet, typename Key>
     virtual HeapNode* get_by_fq(KeySet const key_set, MCCI_CLIENT_ID_T client_id) const
     {
         Key k = this->get_key(key_set);
+        SubscriptionMap** sm = this->m_bank.lookup(k);
 
-        if (!this->m_bank.has_key(k)) return NULL;
+        if (!sm) return NULL;
 
-        if (NULL == this->m_bank[k])
+        if (NULL == *sm)
         {
             stringstream s;
             s << "Improper cleanup is happening, key = " << k;
             throw string(s.str());
         }
 
-        if (this->m_bank[k]->find(client_id) == this->m_bank[k]->end()) return NULL;
-
-        return (*(this->m_bank[k]))[client_id];
+        typename SubscriptionMap::iterator it = (*sm)->find(client_id);
+        return it == (*sm)->end() ? NULL : it->second;
     }
 
     // return a pointer to a client_id -> heapnode map based on the partially-qualified info
     virtual SubscriptionMap* get_by_pq(KeySet const key_set) const
     {
-        Key k = this->get_key(key_set);
-        return this->m_bank.has_key(k) ? this->m_bank[k] : NULL;
+        SubscriptionMap** sm = this->m_bank.lookup(this->get_key(key_set));
+        return sm ? *sm : NULL;
     }
 
     // remove a node from the custom container (not the heap) based on its key
@@ -317,23 +445,56 @@ template<typename KeySet, typename Key>
         this->m_bank[k] = NULL;
         this->m_bank.remove(k);
     }
+
+    // empty the custom container (don't delete HeapNodes)
+    virtual void remove_all()
+    {
+        this->free_maps();
+        this->m_bank.clear();
+    }
+
+    // add the heap nodes of every request a client has to a vector
+    virtual void collect_client(MCCI_CLIENT_ID_T client_id, vector<HeapNode*>& nodes) const
+    {
+        for (LinearHashBankIterator it = this->m_bank.begin(); it != this->m_bank.end(); ++it)
+        {
+            if (!it->second) continue;
+
+            typename SubscriptionMap::iterator found = it->second->find(client_id);
+            if (found != it->second->end()) nodes.push_back(found->second);
+        }
+    }
+
+  protected:
+    // free all map objects that exist in LinearHashBank.
+    void free_maps()
+    {
+        LinearHashBankIterator it;
+        for (it = this->m_bank.begin(); it != this->m_bank.end(); ++it)
+            if (NULL != it->second)
+                delete it->second;
+    }
 };
 
 
 ////////////////////////////////////////////////////////////////////////////////
 
 
-template<typename KeySet, typename Key1, typename Key2>
-    class RequestBankTwoKeys : public RequestBank<KeySet>
+// class that stores requests using two keys in nested hash tables.
+//  the Policy (see HashPolicy.h) is used at both levels
+template<typename KeySet, typename Key1, typename Key2,
+         typename Policy = HashPolicyDefault,
+         typename TimeoutIndex = FibonacciHeap<MCCI_TIME_T, RequestLookupSet<KeySet> > >
+    class RequestBankTwoKeys : public RequestBank<KeySet, TimeoutIndex>
 {
   public:
-    typedef typename RequestBank<KeySet>::HeapNode HeapNode;
-    typedef typename RequestBank<KeySet>::SubscriptionMap SubscriptionMap;
-    typedef typename RequestBank<KeySet>::subscriber_iterator subscriber_iterator;
+    typedef typename RequestBank<KeySet, TimeoutIndex>::HeapNode HeapNode;
+    typedef typename RequestBank<KeySet, TimeoutIndex>::SubscriptionMap SubscriptionMap;
+    typedef typename RequestBank<KeySet, TimeoutIndex>::subscriber_iterator subscriber_iterator;
 
   protected:
-    typedef LinearHash<Key2, SubscriptionMap*> LinearHashKey2;
-    typedef LinearHash<Key1, LinearHashKey2> LinearHashKey1;
+    typedef LinearHash<Key2, SubscriptionMap*, Policy> LinearHashKey2;
+    typedef LinearHash<Key1, LinearHashKey2, Policy> LinearHashKey1;
 
     typedef typename LinearHashKey2::iterator LinearHashKey2Iterator;
     typedef typename LinearHashKey1::iterator LinearHashKey1Iterator;
@@ -344,7 +505,7 @@ template<typename KeySet, typename Key1, typename Key2>
 
   public:
     RequestBankTwoKeys(unsigned int max_clients, unsigned int num_key1, unsigned int num_key2)
-        : RequestBank<KeySet>(max_clients)
+        : RequestBank<KeySet, TimeoutIndex>(max_clients)
     {
         this->m_size_key1 = num_key1;
         this->m_size_key2 = num_key2;
@@ -354,18 +515,7 @@ template<typename KeySet, typename Key1, typename Key2>
     virtual Key1 get_key_1(KeySet const key_set) const = 0;
     virtual Key2 get_key_2(KeySet const key_set) const = 0;
 
-    virtual ~RequestBankTwoKeys()
-    {
-        LinearHashKey1Iterator it1;
-        LinearHashKey2Iterator it2;
-        
-        // free all map objects that exist in LinearHash.
-        for (it1 = this->m_bank.begin(); it1 != this->m_bank.end(); ++it1)
-            // TODO: it1->second == m_bank[it1->first] ?
-            for (it2 = this->m_bank[it1->first].begin(); it2 != this->m_bank[it1->first].end(); ++it2)
-                if (NULL != it2->second)
-                    delete it2->second;
-    }
+    virtual ~RequestBankTwoKeys() { this->free_maps(); }
 
     // assume that this entry is unique and add it to the structure
     virtual void add_by_fq(KeySet const key_set,
@@ -386,24 +536,19 @@ template<typename KeySet, typename Key1, typename Key2>
     // (fully-qualified information means key set and client id)
     virtual HeapNode* get_by_fq(KeySet const key_set, MCCI_CLIENT_ID_T client_id) const 
     {
-        Key1 k1 = this->get_key_1(key_set);
-        Key2 k2 = this->get_key_2(key_set);
-        if (!this->m_bank.has_key(k1)) return NULL;
-        if (!this->m_bank[k1].has_key(k2)) return NULL;
-        if (NULL == this->m_bank[k1][k2]) throw string("k1 and k2 point to NULL");
-        if (this->m_bank[k1][k2]->find(client_id) == this->m_bank[k1][k2]->end()) return NULL;
-        return (*(this->m_bank[k1][k2]))[client_id];
+        SubscriptionMap** sm = this->lookup(key_set);
+        if (!sm) return NULL;
+        if (NULL == *sm) throw string("k1 and k2 point to NULL");
+
+        typename SubscriptionMap::iterator it = (*sm)->find(client_id);
+        return it == (*sm)->end() ? NULL : it->second;
     }
 
     // return a pointer to a client_id -> heapnode map based on the partially-qualified info
     virtual SubscriptionMap* get_by_pq(KeySet const key_set) const
     {
-        Key1 k1 = this->get_key_1(key_set);
-        Key2 k2 = this->get_key_2(key_set);
-
-        if (!this->m_bank.has_key(k1)) return NULL;
-        if (!this->m_bank[k1].has_key(k2)) return NULL;
-        return this->m_bank[k1][k2];
+        SubscriptionMap** sm = this->lookup(key_set);
+        return sm ? *sm : NULL;
     }
 
     // remove a node from the custom container (not the heap) based on its key
@@ -437,6 +582,49 @@ template<typename KeySet, typename Key1, typename Key2>
         delete this->m_bank[k1][k2];
         this->m_bank[k1][k2] = NULL;
     }
+
+    // empty the custom container (don't delete HeapNodes)
+    virtual void remove_all()
+    {
+        this->free_maps();
+        this->m_bank.clear();
+    }
+
+    // add the heap nodes of every request a client has to a vector
+    virtual void collect_client(MCCI_CLIENT_ID_T client_id, vector<HeapNode*>& nodes) const
+    {
+        for (LinearHashKey1Iterator it1 = this->m_bank.begin(); it1 != this->m_bank.end(); ++it1)
+        {
+            for (LinearHashKey2Iterator it2 = it1->second.begin(); it2 != it1->second.end(); ++it2)
+            {
+                if (!it2->second) continue;
+
+                typename SubscriptionMap::iterator found = it2->second->find(client_id);
+                if (found != it2->second->end()) nodes.push_back(found->second);
+            }
+        }
+    }
+
+  protected:
+    // the slot of a key set's subscribers, NULL if neither key is there.  one probe per level
+    SubscriptionMap** lookup(KeySet const key_set) const
+    {
+        LinearHashKey2* inner = this->m_bank.lookup(this->get_key_1(key_set));
+        return inner ? inner->lookup(this->get_key_2(key_set)) : NULL;
+    }
+
+    // free all map objects that exist in LinearHash.
+    void free_maps()
+    {
+        LinearHashKey1Iterator it1;
+        LinearHashKey2Iterator it2;
+        
+        for (it1 = this->m_bank.begin(); it1 != this->m_bank.end(); ++it1)
+            // TODO: it1->second == m_bank[it1->first] ?
+            for (it2 = this->m_bank[it1->first].begin(); it2 != this->m_bank[it1->first].end(); ++it2)
+                if (NULL != it2->second)
+                    delete it2->second;
+    }
 };
 
 
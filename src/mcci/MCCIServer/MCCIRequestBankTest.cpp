@@ -2,7 +2,9 @@
 #include "MCCIRequestBank.h"
 #include "MCCIRequestBanks.h"
 #include <string>
+#include <vector>
 #include <stdio.h>
+#include <stdlib.h>
 
 using namespace std;
 
@@ -17,6 +19,17 @@ class TestRequestBank : public RequestBankOneKey<int, int>
 };
 
 
+class TestWheelRequestBank
+: public RequestBankOneKey<int, int, TimingWheel<MCCI_TIME_T, RequestLookupSet<int> > >
+{
+  public:
+    TestWheelRequestBank(unsigned int max_clients, unsigned int size) :
+    RequestBankOneKey<int, int, TimingWheel<MCCI_TIME_T, RequestLookupSet<int> > >(max_clients, size) { }
+
+    virtual int get_key(int const key_set) const { return key_set; }
+};
+
+
 typedef struct {short key1; long key2;} KeyPair;
 
 KeyPair new_kp(short key1, long key2)
@@ -190,6 +203,147 @@ void test3()
     VariableRevisionRequestBank m_bank_varrev(mxc, 100, 20);
 }
 
+// the same requests in a heap-backed and a wheel-backed bank expire in the same order
+void test4()
+{
+    TestRequestBank heap(501, 100);
+    TestWheelRequestBank wheel(501, 100);
+    MCCI_TIME_T now = 100;
+
+    printf("\n\nHeap-backed vs wheel-backed request banks");
+    srand(1);
+    for (int i = 0; i < 20000; ++i)
+    {
+        int key = rand() % 50;
+        MCCI_CLIENT_ID_T client = rand() % 500;
+        MCCI_TIME_T timeout = now + 1 + rand() % 3000;
+
+        switch (rand() % 4)
+        {
+            case 0:
+            case 1:
+                heap.add(key, client, timeout);
+                wheel.add(key, client, timeout);
+                break;
+            case 2:
+                if (heap.contains(key))
+                {
+                    heap.remove_by_key(key);
+                    wheel.remove_by_key(key);
+                }
+                break;
+            case 3:
+                now += rand() % 20;
+                while (!heap.empty() && heap.minimum_timeout() < now)
+                {
+                    if (heap.minimum_timeout() != wheel.minimum_timeout())
+                        throw string("Heap and wheel disagree on the next timeout");
+                    heap.remove_minimum();
+                    wheel.remove_minimum();
+                }
+                break;
+        }
+
+        if (heap.empty() != wheel.empty())
+            throw string("Heap and wheel disagree on emptiness");
+        if (heap.contains(key, client) != wheel.contains(key, client))
+            throw string("Heap and wheel disagree on contents");
+    }
+    printf("\nThey agree");
+}
+
+// counts what expire_until hands back
+struct CountExpired
+{
+    unsigned int batches, requests;
+    void operator()(vector<RequestLookupSet<int> > const &expired)
+    {
+        ++batches;
+        requests += expired.size();
+    }
+};
+
+// expiring in bulk leaves a bank the same as expiring one request at a time
+void test5()
+{
+    TestRequestBank single(501, 100);
+    TestRequestBank bulk(501, 100);
+    TestWheelRequestBank wheel(501, 100);
+    CountExpired counted = {0, 0};
+    unsigned int expired_singly = 0;
+    MCCI_TIME_T now = 100;
+
+    printf("\n\nBulk expiry vs one at a time");
+    srand(2);
+    for (int i = 0; i < 20000; ++i)
+    {
+        int key = rand() % 50;
+        MCCI_CLIENT_ID_T client = rand() % 500;
+        MCCI_TIME_T timeout = now + 1 + rand() % 3000;
+
+        if (rand() % 3)
+        {
+            single.add(key, client, timeout);
+            bulk.add(key, client, timeout);
+            wheel.add(key, client, timeout);
+        }
+        else
+        {
+            now += rand() % 100;
+            while (!single.empty() && single.minimum_timeout() <= now)
+            {
+                single.remove_minimum();
+                ++expired_singly;
+            }
+            bulk.expire_until(now, counted);
+            wheel.expire_until(now);
+        }
+
+        if (single.empty() != bulk.empty() || single.empty() != wheel.empty())
+            throw string("Bulk expiry disagrees on emptiness");
+        if (!single.empty() && single.minimum_timeout() != bulk.minimum_timeout())
+            throw string("Bulk expiry disagrees on the next timeout");
+        if (single.contains(key, client) != bulk.contains(key, client) ||
+            single.contains(key, client) != wheel.contains(key, client))
+            throw string("Bulk expiry disagrees on contents");
+        if (single.get_outstanding_request_count(client) != bulk.get_outstanding_request_count(client))
+            throw string("Bulk expiry disagrees on outstanding requests");
+    }
+
+    printf("\n%d expired one at a time, %d in %d batches", expired_singly, counted.requests, counted.batches);
+    if (expired_singly != counted.requests)
+        throw string("Bulk expiry removed a different number of requests");
+}
+
+// a cleared bank is empty and usable again
+void test6()
+{
+    TestRequestBank heap(501, 100);
+    Test2KeyRequestBank two(501, 10, 10);
+
+    printf("\n\nClearing request banks");
+    for (int i = 0; i < 5000; ++i)
+    {
+        heap.add(i % 300, i % 500, 100 + i);
+        two.add(new_kp(i % 7, i % 300), i % 500, 100 + i);
+    }
+    heap.remove_minimum(); // give the heap some structure
+
+    heap.clear();
+    two.clear();
+    if (!heap.empty() || !two.empty()) throw string("Cleared bank isn't empty");
+    if (heap.contains(5) || heap.contains(5, 5) || two.contains(new_kp(5, 5), 5))
+        throw string("Cleared bank still has requests");
+    if (heap.get_outstanding_request_count(5) || two.get_outstanding_request_count(5))
+        throw string("Cleared bank still has outstanding requests");
+
+    heap.add(5, 5, 200);
+    two.add(new_kp(5, 5), 5, 200);
+    if (!heap.contains(5, 5) || 200 != heap.minimum_timeout() || !two.contains(new_kp(5, 5), 5))
+        throw string("Cleared bank doesn't take new requests");
+    printf("\nCleared and reused");
+}
+
 int main()
 {
     try
@@ -197,6 +351,9 @@ int main()
         test1();
         test2();
         test3();
+        test4();
+        test5();
+        test6();
     }
     catch (string s)
     {
@@ -2,6 +2,7 @@
 #pragma once
 
 #include "MCCIRequestBank.h"
+#include "DaryHeap.h"
 
 
 /**
@@ -11,18 +12,44 @@
  */
 
 
+// the timeout index of each bank: see TimeoutIndexBench for the comparison.
+//  the timing wheel wins from thousands of open requests up; small banks (a few
+//  requests per client) do better with the 4-ary heap, which has no empty slots
+//  to scan
+template<typename KeySet, bool Small = false>
+struct BankTimeouts
+{
+    typedef TimingWheel<MCCI_TIME_T, RequestLookupSet<KeySet> > Index;
+    typedef typename RequestBank<KeySet, Index>::SubscriptionMap SubscriptionMap;
+};
+
 template<typename KeySet>
-class SinglePassthruKeyRequestBank : public RequestBankOneKey<KeySet, KeySet>
+struct BankTimeouts<KeySet, true>
+{
+    typedef DaryHeap<MCCI_TIME_T, RequestLookupSet<KeySet> > Index;
+    typedef typename RequestBank<KeySet, Index>::SubscriptionMap SubscriptionMap;
+};
+
+
+// single-key banks are flat: see LinearHashBench for the comparison.
+//  FlatHash mixes keys with Fibonacci hashing, see LinearHashReport
+template<typename KeySet, bool Small = false>
+class SinglePassthruKeyRequestBank
+: public RequestBankOneKey<KeySet, KeySet, typename BankTimeouts<KeySet, Small>::Index,
+                           FlatHash<KeySet, typename BankTimeouts<KeySet, Small>::SubscriptionMap*> >
 {
   public:
     SinglePassthruKeyRequestBank(unsigned int max_clients, unsigned int size) :
-    RequestBankOneKey<KeySet, KeySet>(max_clients, size) { }
+    RequestBankOneKey<KeySet, KeySet, typename BankTimeouts<KeySet, Small>::Index,
+                      FlatHash<KeySet, typename BankTimeouts<KeySet, Small>::SubscriptionMap*> >
+        (max_clients, size) { }
 
     virtual KeySet get_key(KeySet const key_set) const { return key_set; }
 };
 
-typedef SinglePassthruKeyRequestBank<bool>                AllRequestBank;
-typedef SinglePassthruKeyRequestBank<MCCI_NODE_ADDRESS_T> HostRequestBank;
+// at most one request per client (per host)
+typedef SinglePassthruKeyRequestBank<bool, true>                AllRequestBank;
+typedef SinglePassthruKeyRequestBank<MCCI_NODE_ADDRESS_T, true> HostRequestBank;
 typedef SinglePassthruKeyRequestBank<MCCI_VARIABLE_T>     VariableRequestBank;
 
 
@@ -33,11 +60,15 @@ inline std::ostream& operator<<(std::ostream &out, HostVarPair const &rhs)
 { return out << "(Host " << rhs.host << ", Var " << rhs.var << ")"; }
   
 
-class HostVariableRequestBank : public RequestBankOneKey<HostVarPair, uint32_t>
+class HostVariableRequestBank
+: public RequestBankOneKey<HostVarPair, uint32_t, BankTimeouts<HostVarPair>::Index,
+                           FlatHash<uint32_t, BankTimeouts<HostVarPair>::SubscriptionMap*> >
 {
   public:
     HostVariableRequestBank(unsigned int max_clients, unsigned int size) :
-    RequestBankOneKey<HostVarPair, uint32_t>(max_clients, size) { }
+    RequestBankOneKey<HostVarPair, uint32_t, BankTimeouts<HostVarPair>::Index,
+                      FlatHash<uint32_t, BankTimeouts<HostVarPair>::SubscriptionMap*> >
+        (max_clients, size) { }
 
     virtual uint32_t get_key(HostVarPair const key_set) const
     {
@@ -53,12 +84,16 @@ inline std::ostream& operator<<(std::ostream &out, VarRevPair const &rhs)
 { return out << "(Var " << rhs.var << ", Rev " << rhs.rev << ")"; }
   
 
+// variable ids and revision windows are both dense: no mixing, just a mask
 class VariableRevisionRequestBank
-: public RequestBankTwoKeys<VarRevPair, MCCI_VARIABLE_T, MCCI_REVISION_T>
+: public RequestBankTwoKeys<VarRevPair, MCCI_VARIABLE_T, MCCI_REVISION_T, HashPolicyDense,
+                            BankTimeouts<VarRevPair>::Index>
 {
   public:
   VariableRevisionRequestBank(unsigned int max_clients, unsigned int size1, unsigned int size2) :
-    RequestBankTwoKeys<VarRevPair, MCCI_VARIABLE_T, MCCI_REVISION_T> (max_clients, size1, size2) { }
+    RequestBankTwoKeys<VarRevPair, MCCI_VARIABLE_T, MCCI_REVISION_T, HashPolicyDense,
+                       BankTimeouts<VarRevPair>::Index>
+        (max_clients, size1, size2) { }
 
     virtual MCCI_VARIABLE_T get_key_1(VarRevPair const key_set) const
     {
@@ -78,12 +113,16 @@ inline std::ostream& operator<<(std::ostream &out, HostVarRevTuple const &rhs)
 
 
 
+// packed (host << 16) + var keys pile up in a few buckets unless they are mixed
 class RemoteRevisionRequestBank
-: public RequestBankTwoKeys<HostVarRevTuple, uint32_t, MCCI_REVISION_T>
+: public RequestBankTwoKeys<HostVarRevTuple, uint32_t, MCCI_REVISION_T, HashPolicyFibonacci,
+                            BankTimeouts<HostVarRevTuple>::Index>
 {
   public:
   RemoteRevisionRequestBank(unsigned int max_clients, unsigned int size1, unsigned int size2) :
-    RequestBankTwoKeys<HostVarRevTuple, uint32_t, MCCI_REVISION_T> (max_clients, size1, size2) { }
+    RequestBankTwoKeys<HostVarRevTuple, uint32_t, MCCI_REVISION_T, HashPolicyFibonacci,
+                       BankTimeouts<HostVarRevTuple>::Index>
+        (max_clients, size1, size2) { }
 
     virtual uint32_t get_key_1(HostVarRevTuple const key_set) const
     {
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "MCCISchema.h"
+#include "MCCITypes.h"
+#include <vector>
+
+using namespace std;
+
+
+/**
+   The last few revisions produced for each variable, so a request for a past
+   revision of one of ours can be answered at once instead of forwarded.
+
+   Each variable (by ordinal) has a ring of packets whose size is given by the
+   schema's history column, or a default where the schema doesn't say.  Revision
+   r goes in slot r % size, so a lookup is one probe; the slot remembers which
+   revision it holds, since revisions need not arrive one after another.  A ring
+   is only allocated when its variable is first recorded, and each packet in a
+   ring holds a reference to its payload.
+
+   hits() and misses() count the lookups that found their revision and those
+   that didn't.
+ */
+class CMCCIRevisionHistory
+{
+  protected:
+
+    typedef struct
+    {
+        SMCCIDataPacket* slots;  // NULL until the variable is first recorded
+        unsigned int size;       // 0 keeps no history
+    } Ring;
+
+    vector<Ring> m_rings;  // by ordinal
+
+    unsigned long m_hits;
+    unsigned long m_misses;
+
+    // the rings hold references; copying them makes no sense
+    CMCCIRevisionHistory(const CMCCIRevisionHistory &rhs);
+    CMCCIRevisionHistory& operator=(const CMCCIRevisionHistory &rhs);
+
+  public:
+
+    CMCCIRevisionHistory(CMCCISchema* schema, unsigned int default_size)
+    {
+        this->m_rings.resize(schema->get_cardinality());
+        for (unsigned int i = 0; i < this->m_rings.size(); ++i)
+        {
+            MCCI_VARIABLE_T var = schema->variable_of_ordinal(i);
+            this->m_rings[i].slots = NULL;
+            this->m_rings[i].size = schema->history_of_variable(var, default_size);
+        }
+        this->m_hits = 0;
+        this->m_misses = 0;
+    }
+
+    ~CMCCIRevisionHistory()
+    {
+        for (unsigned int i = 0; i < this->m_rings.size(); ++i)
+        {
+            Ring& ring = this->m_rings[i];
+            if (!ring.slots) continue;
+
+            for (unsigned int s = 0; s < ring.size; ++s) mcci_payload_release(ring.slots[s].payload);
+            delete[] ring.slots;
+        }
+    }
+
+    // how many revisions are kept for a variable
+    unsigned int size(unsigned int ordinal) const { return this->m_rings.at(ordinal).size; }
+
+    // keep a packet, pushing out whatever held its slot
+    void record(unsigned int ordinal, const SMCCIDataPacket& packet)
+    {
+        Ring& ring = this->m_rings.at(ordinal);
+        if (!ring.size) return;
+
+        if (!ring.slots)
+        {
+            // value-initialized: revision 0 and no payload mark an empty slot
+            ring.slots = new SMCCIDataPacket[ring.size]();
+        }
+
+        SMCCIDataPacket& slot = ring.slots[packet.revision % ring.size];
+        mcci_payload_retain(packet.payload);
+        mcci_payload_release(slot.payload);
+        slot = packet;
+    }
+
+    // the packet of a revision, or NULL if it isn't kept
+    const SMCCIDataPacket* find(unsigned int ordinal, MCCI_REVISION_T revision)
+    {
+        const Ring& ring = this->m_rings.at(ordinal);
+        if (ring.slots && revision)
+        {
+            const SMCCIDataPacket& slot = ring.slots[revision % ring.size];
+            if (revision == slot.revision)
+            {
+                ++(this->m_hits);
+                return &slot;
+            }
+        }
+
+        ++(this->m_misses);
+        return NULL;
+    }
+
+    unsigned long hits() const { return this->m_hits; }
+    unsigned long misses() const { return this->m_misses; }
+};
@@ -2,7 +2,9 @@
 
 #include <string>
 #include <sqlite3.h>
-#include "LinearHash.h"
+#include "DenseIdMap.h"
+#include "MCCIRevisionStore.h"
+#include "MCCIRevisionStoreSQLite.h"
 #include "MCCITypes.h"
 
 using namespace std;
@@ -15,54 +17,78 @@ using namespace std;
    increase appropriately (for uniqueness) including across database crashes or restarts.
 
    Note that the revision set must be aware of changes to the schema between runs!
+
+   The revisions are kept in a CMCCIRevisionStore: the revision DB, unless another
+   store is given.
+
+   Writing every revision to the DB caps production at SQLite's statement rate, so
+   revisions can be leased in blocks: the store holds a high-water mark up to
+   lease - 1 revisions ahead of the last one handed out, and revisions come from
+   memory until it's reached.  After a crash the next revision follows the
+   high-water mark, so some revisions are skipped but none repeat.  On a clean
+   shutdown the last revision handed out is given back, and nothing is skipped.
+   A lease of 1 stores every revision.
+
+   With write-behind on (in the revision DB), the writes go to a
+   CMCCIRevisionWriter thread instead of being made here, and a lease is renewed
+   once half of it is used, so the new mark is normally committed before any
+   revision reaches it.  If it isn't, the revision waits for it: a revision is
+   never handed out above the mark the store has made durable, which is kept
+   per variable so the store is only asked when that's passed.  flush() waits
+   for the store to make everything durable.
  */
 class CMCCIRevisionSet
 {
   protected:
 
-    sqlite3* m_db;
-    sqlite3_stmt* m_insert;
-    sqlite3_stmt* m_read;
-    sqlite3_stmt* m_update;
+    CMCCIRevisionStore* m_store;
+    CMCCIRevisionStoreSQLite* m_sqlite; // the same store, if it's the revision DB
+    bool m_owns_store;
     
-    LinearHash<MCCI_VARIABLE_T, MCCI_REVISION_T> m_cache; // the max current sequence number "in the wild"
-    
-    bool m_strict; // whether to bail if schema signatures don't match (default yes)
+    DenseIdMap<MCCI_VARIABLE_T, MCCI_REVISION_T> m_cache; // the max current sequence number "in the wild"
+    DenseIdMap<MCCI_VARIABLE_T, MCCI_REVISION_T> m_leased; // the high-water mark in the store
+    DenseIdMap<MCCI_VARIABLE_T, MCCI_REVISION_T> m_durable; // as much of it as is durable
 
-    long m_signature_id; // signature ID to use
+    unsigned int m_lease; // revisions handed out per store write
 
   public:
     CMCCIRevisionSet(sqlite3* revision_db, unsigned int schema_cardinality, string schema_signature);
+    CMCCIRevisionSet(CMCCIRevisionStore* store, unsigned int schema_cardinality);
     CMCCIRevisionSet(const CMCCIRevisionSet &rhs);
     ~CMCCIRevisionSet();
 
     // output operator
     friend ostream& operator<<(ostream &out, CMCCIRevisionSet const &rhs);
     
-    void load(sqlite3* revision_db);
-
     // return current value of revision
     MCCI_REVISION_T get_revision(MCCI_VARIABLE_T variable_id);
     
     // increment revision and return value
     MCCI_REVISION_T inc_revision(MCCI_VARIABLE_T variable_id);  
 
+    // load the revisions of many variables at once (all of the schema's, at startup),
+    //  so the first revision of each doesn't wait on the store
+    void preload(const vector<MCCI_VARIABLE_T>& variable_ids);
+
     // the signature of the schema we're using
-    string get_signature() const;
+    string get_signature() const { return m_store->get_signature(); };
+
+    // how many revisions each store write leases (at least 1, the default)
+    unsigned int get_lease() const { return m_lease; };
+    void set_lease(unsigned int v) { m_lease = v ? v : 1; };
 
-    // put a signature in the DB if it's not there already and retain its id
-    void set_signature(string signature);
+    // give back the unused part of each lease
+    void release_leases();
 
-    // if false, disregards mismatches in schema signatures.
-    //      this should ONLY be used for debugging.
-    bool get_strict() const { return m_strict; };    
-    void set_strict(bool v) { m_strict = v; };
+    // hand DB writes to a thread that commits them every interval or batch of updates.
+    //  the store must be the revision DB, in a file
+    void set_write_behind(unsigned int interval_ms, unsigned int batch);
+
+    // wait until the store has made everything durable
+    void flush() { m_store->flush(); };
     
   protected:
-    // put a variable in the DB if it's not there already
+    // load a variable's revision from the store if it's not cached already
     void check_revision(MCCI_VARIABLE_T variable_id);
-
-    // DB query for signature id, returns 0 if none exists
-    int lookup_signature_id(string signature);
     
 };
@@ -2,8 +2,12 @@
 #include "MCCIRevisionSet.h"
 
 #include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
 #include <sqlite3.h>
 #include <iostream>
+#include <vector>
 #include <assert.h>
 
 using namespace std;
@@ -16,8 +20,37 @@ CMCCIRevisionSet* rs = NULL;
 void cleanup()
 {
     delete rs;
+    rs = NULL;
     
     sqlite3_close(rs_db);
+    rs_db = NULL;
+}
+
+
+// a revision set that dies without writing back its leases, as in a crash
+class CCrashingRevisionSet : public CMCCIRevisionSet
+{
+  public:
+    CCrashingRevisionSet(sqlite3* revision_db, unsigned int schema_cardinality, string schema_signature) :
+        CMCCIRevisionSet(revision_db, schema_cardinality, schema_signature) {}
+
+    void crash() { m_cache.clear(); }
+};
+
+
+// what the DB holds for a variable, bypassing the revision set
+MCCI_REVISION_T db_revision(MCCI_VARIABLE_T variable_id)
+{
+    sqlite3_stmt* s;
+    MCCI_REVISION_T ret = 0;
+
+    sqlite3_prepare_v2(rs_db, "select revision from revision natural join signature "
+                       "where var_id=? and signature='test_signature'", -1, &s, NULL);
+    sqlite3_bind_int(s, 1, variable_id);
+    if (SQLITE_ROW == sqlite3_step(s)) ret = sqlite3_column_int(s, 0);
+    sqlite3_finalize(s);
+
+    return ret;
 }
 
 
@@ -143,6 +176,187 @@ int test_incrementing()
 }
 
 
+// revisions leased 10 at a time: a crash skips the rest of the lease, a clean shutdown doesn't
+int test_leasing()
+{
+    CCrashingRevisionSet* crashing = new CCrashingRevisionSet(rs_db, 5, "test_signature");
+    crashing->set_lease(10);
+
+    MCCI_REVISION_T start = crashing->get_revision(2);
+    cerr << "\nstart = " << start;
+    for (MCCI_REVISION_T i = 1; i <= 3; ++i) assert(start + i == crashing->inc_revision(2));
+
+    cerr << "\nAfter 3 revisions the DB holds " << db_revision(2);
+    assert(start + 10 == db_revision(2));
+
+    cerr << "\nCrashing and reloading";
+    crashing->crash();
+    delete crashing;
+
+    CMCCIRevisionSet* reloaded = new CMCCIRevisionSet(rs_db, 5, "test_signature");
+    reloaded->set_lease(10);
+    cerr << "\nget_revision(2) == " << reloaded->get_revision(2);
+    assert(start + 10 == reloaded->get_revision(2));
+    assert(start + 11 == reloaded->inc_revision(2));
+    assert(start + 20 == db_revision(2));
+
+    cerr << "\nShutting down cleanly and reloading";
+    delete reloaded;
+    assert(start + 11 == db_revision(2));
+
+    reloaded = new CMCCIRevisionSet(rs_db, 5, "test_signature");
+    assert(start + 11 == reloaded->get_revision(2));
+
+    cerr << "\nA lease of 1 writes every revision";
+    assert(1 == reloaded->get_lease());
+    assert(start + 12 == reloaded->inc_revision(2));
+    assert(start + 12 == db_revision(2));
+    delete reloaded;
+
+    return 0;
+}
+
+// writes handed to the writer thread: nothing is lost, and the DB only moves forward
+int test_write_behind()
+{
+    CMCCIRevisionSet* behind = new CMCCIRevisionSet(rs_db, 5, "test_signature");
+    behind->set_lease(8);
+    behind->set_write_behind(50, 16);
+
+    MCCI_REVISION_T start = behind->get_revision(3);
+    cerr << "\nstart = " << start;
+
+    MCCI_REVISION_T last = start;
+    MCCI_REVISION_T seen = 0;
+    for (int i = 0; i < 1000; ++i)
+    {
+        MCCI_REVISION_T rev = behind->inc_revision(3);
+        assert(last + 1 == rev);
+        last = rev;
+
+        // whatever the writer has committed so far, it never goes backward
+        MCCI_REVISION_T db = db_revision(3);
+        assert(db >= seen);
+        seen = db;
+    }
+
+    behind->flush();
+    cerr << "\nAfter a flush, the DB holds " << db_revision(3) << " for revision " << last;
+    assert(db_revision(3) >= last);
+    assert(db_revision(3) < last + 8);
+
+    cerr << "\nShutting down cleanly writes back the last revision";
+    delete behind;
+    assert(last == db_revision(3));
+
+    behind = new CMCCIRevisionSet(rs_db, 5, "test_signature");
+    assert(last == behind->get_revision(3));
+    delete behind;
+
+    return 0;
+}
+
+// a producer killed between the writer's commits: nothing it handed out was above
+//  what the DB held, so no revision repeats
+int test_write_behind_crash()
+{
+    int fds[2];
+    assert(0 == pipe(fds));
+
+    MCCI_REVISION_T start = db_revision(4);
+    cerr << "\nProducing 1000 revisions with an interval of 10 s, then SIGKILL";
+    pid_t child = fork();
+    if (0 == child)
+    {
+        // a connection of its own, not the one inherited from the parent
+        sqlite3* db = NULL;
+        if (SQLITE_OK != sqlite3_open_v2("../../../revisions.sqlite3", &db, SQLITE_OPEN_READWRITE, NULL)) _exit(1);
+
+        CMCCIRevisionSet* behind = new CMCCIRevisionSet(db, 5, "test_signature");
+        behind->set_lease(8);
+        behind->set_write_behind(10000, 1000000);
+
+        MCCI_REVISION_T last = 0;
+        for (int i = 0; i < 1000; ++i) last = behind->inc_revision(4);
+
+        // tell the parent the last revision out, then die without any cleanup
+        if (sizeof(last) != write(fds[1], &last, sizeof(last))) _exit(1);
+        kill(getpid(), SIGKILL);
+        _exit(1);
+    }
+
+    MCCI_REVISION_T last = 0;
+    assert(sizeof(last) == read(fds[0], &last, sizeof(last)));
+    int status;
+    waitpid(child, &status, 0);
+    assert(WIFSIGNALED(status) && SIGKILL == WTERMSIG(status));
+    close(fds[0]);
+    close(fds[1]);
+
+    cerr << "\nThe child's last revision was " << last << "; the DB holds " << db_revision(4);
+    assert(start + 1000 == last);
+    assert(last <= db_revision(4));
+
+    CMCCIRevisionSet* reloaded = new CMCCIRevisionSet(rs_db, 5, "test_signature");
+    assert(last < reloaded->inc_revision(4));
+    delete reloaded;
+
+    return 0;
+}
+
+// counts the statements run on the DB
+int statements = 0;
+
+int count_statement(unsigned type, void* context, void* p, void* x)
+{
+    ++statements;
+    return 0;
+}
+
+
+// preloading reads every row in one query and adds the missing ones in one transaction
+int test_preload()
+{
+    vector<MCCI_VARIABLE_T> vars;
+    for (MCCI_VARIABLE_T v = 1; v <= 5; ++v) vars.push_back(v);
+    vars.push_back(40);
+    vars.push_back(41);
+
+    // the tests before this one put some of them in the DB
+    sqlite3_stmt* s;
+    sqlite3_prepare_v2(rs_db, "select count(*) from revision natural join signature "
+                       "where signature='test_signature' and var_id in (1, 2, 3, 4, 5, 40, 41)",
+                       -1, &s, NULL);
+    sqlite3_step(s);
+    int missing = vars.size() - sqlite3_column_int(s, 0);
+    sqlite3_finalize(s);
+
+    CMCCIRevisionSet* loaded = new CMCCIRevisionSet(rs_db, 5, "test_signature");
+    sqlite3_trace_v2(rs_db, SQLITE_TRACE_STMT, count_statement, NULL);
+
+    cerr << "\nPreloading " << vars.size() << " variables, " << missing << " of them new";
+    loaded->preload(vars);
+    cerr << " took " << statements << " statements";
+    assert(1 + (missing ? 2 + missing : 0) == statements); // select; begin, inserts, commit
+
+    statements = 0;
+    for (unsigned int i = 0; i < vars.size(); ++i) loaded->get_revision(vars[i]);
+    assert(0 == statements);
+    assert(0 == loaded->get_revision(41));
+
+    cerr << "\nPreloading again finds everything";
+    loaded->preload(vars);
+    assert(1 == statements);
+
+    sqlite3_trace_v2(rs_db, 0, NULL, NULL);
+    MCCI_REVISION_T rev = loaded->get_revision(40) + 1;
+    assert(rev == loaded->inc_revision(40));
+    delete loaded;
+    assert(rev == db_revision(40));
+
+    return 0;
+}
+
 
 int main(int argc, char* argv[])
 {
@@ -159,6 +373,10 @@ int main(int argc, char* argv[])
 
 
     do_test("test_incrementing", test_incrementing);
+    do_test("test_leasing", test_leasing);
+    do_test("test_write_behind", test_write_behind);
+    do_test("test_write_behind_crash", test_write_behind_crash);
+    do_test("test_preload", test_preload);
 
     cleanup();
     cerr << "\n\n";
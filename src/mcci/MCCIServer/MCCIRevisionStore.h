@@ -0,0 +1,56 @@
+#pragma once
+
+#include "MCCITypes.h"
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+/**
+   Where a CMCCIRevisionSet keeps its revisions between runs: one counter per
+   variable, for one schema signature.
+
+   The revision set only ever moves a counter forward, by leasing blocks with
+   advance(), except on a clean shutdown, when give_back() returns the unused
+   part of the last lease.  Errors are thrown as strings, except from
+   give_back(), which the revision set calls from its destructor.
+ */
+class CMCCIRevisionStore
+{
+  public:
+    CMCCIRevisionStore() {}
+    virtual ~CMCCIRevisionStore() {}
+
+    // the signature of the schema whose revisions these are
+    virtual string get_signature() const = 0;
+
+    // the stored revision of a variable; a variable not seen before starts at 0
+    virtual MCCI_REVISION_T get(MCCI_VARIABLE_T variable_id) = 0;
+
+    // get the revisions of many variables ready at once, so get() is quick for them
+    virtual void preload(const vector<MCCI_VARIABLE_T>& variable_ids)
+    {
+        for (unsigned int i = 0; i < variable_ids.size(); ++i) this->get(variable_ids[i]);
+    }
+
+    // add to the stored revision of a variable, returning the new value
+    virtual MCCI_REVISION_T advance(MCCI_VARIABLE_T variable_id, MCCI_REVISION_T count) = 0;
+
+    // put a stored revision back from one value to a lower one, if it still holds
+    //  the first; returns whether it did
+    virtual bool give_back(MCCI_VARIABLE_T variable_id, MCCI_REVISION_T from, MCCI_REVISION_T to) = 0;
+
+    // make everything stored so far durable
+    virtual void flush() = 0;
+
+    // whether advance() returns before its revision is durable
+    virtual bool writes_behind() const { return false; }
+
+    // wait until a variable's stored revision is durable up to at least the given
+    //  one, returning how far it is.  a store that doesn't write behind already is
+    virtual MCCI_REVISION_T wait_durable(MCCI_VARIABLE_T variable_id, MCCI_REVISION_T revision)
+    {
+        return revision;
+    }
+};
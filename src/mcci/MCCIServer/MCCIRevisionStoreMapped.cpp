@@ -0,0 +1,173 @@
+#include "MCCIRevisionStoreMapped.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char MAPPED_MAGIC[8] = {'M', 'C', 'C', 'I', 'R', 'E', 'V', '1'};
+
+
+CMCCIRevisionStoreMapped::CMCCIRevisionStoreMapped(string directory, string signature, unsigned int sync_every)
+{
+    m_path = path_of(directory, signature);
+    m_signature = signature;
+    m_sync_every = sync_every;
+    m_advances = 0;
+    m_map = NULL;
+    m_map_size = HEADER_SIZE + SLOTS * sizeof(MCCI_REVISION_T);
+
+    if (signature.size() > sizeof(m_header->signature))
+        throw string("Signature too long for a revision file: ") + signature;
+
+    m_fd = open(m_path.c_str(), O_RDWR | O_CLOEXEC);
+    if (0 > m_fd && ENOENT == errno)
+    {
+        this->create(directory);
+        m_fd = open(m_path.c_str(), O_RDWR | O_CLOEXEC);
+    }
+    if (0 > m_fd) throw string("Couldn't open ") + m_path + ": " + strerror(errno);
+
+    struct stat st;
+    if (fstat(m_fd, &st))
+    {
+        string err = string("Couldn't stat ") + m_path + ": " + strerror(errno);
+        this->close();
+        throw err;
+    }
+    if ((size_t)st.st_size != m_map_size)
+    {
+        this->close();
+        throw string("Revision file ") + m_path + " has the wrong size";
+    }
+
+    m_map = mmap(NULL, m_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (MAP_FAILED == m_map)
+    {
+        m_map = NULL;
+        string err = string("Couldn't map ") + m_path + ": " + strerror(errno);
+        this->close();
+        throw err;
+    }
+    m_header = (Header*)m_map;
+    m_slots = (MCCI_REVISION_T*)((char*)m_map + HEADER_SIZE);
+
+    if (memcmp(m_header->magic, MAPPED_MAGIC, sizeof(MAPPED_MAGIC)) || SLOTS != m_header->slots)
+    {
+        this->close();
+        throw string("Not a revision file: ") + m_path;
+    }
+    if (string(m_header->signature, m_header->signature_length) != signature)
+    {
+        string err = string("Revision file ") + m_path + " is for signature " +
+                     string(m_header->signature, m_header->signature_length);
+        this->close();
+        throw err;
+    }
+}
+
+
+CMCCIRevisionStoreMapped::~CMCCIRevisionStoreMapped()
+{
+    if (m_map) msync(m_map, m_map_size, MS_SYNC);
+    this->close();
+}
+
+
+void CMCCIRevisionStoreMapped::create(string directory)
+{
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".tmp.%d", (int)getpid());
+    string temp = m_path + suffix;
+
+    // one left by a process that had this pid and died making it
+    unlink(temp.c_str());
+
+    int fd = open(temp.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (0 > fd) throw string("Couldn't create ") + temp + ": " + strerror(errno);
+
+    // ftruncate fills it with zeroes, which is every revision at 0
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAPPED_MAGIC, sizeof(MAPPED_MAGIC));
+    header.slots = SLOTS;
+    header.signature_length = m_signature.size();
+    memcpy(header.signature, m_signature.data(), m_signature.size());
+
+    string err;
+    if (ftruncate(fd, m_map_size))
+        err = string("Couldn't size ") + temp + ": " + strerror(errno);
+    else if ((ssize_t)sizeof(header) != pwrite(fd, &header, sizeof(header), 0))
+        err = string("Couldn't write ") + temp + ": " + strerror(errno);
+    else if (fsync(fd))
+        err = string("Couldn't sync ") + temp + ": " + strerror(errno);
+    else if (link(temp.c_str(), m_path.c_str()) && EEXIST != errno)
+        err = string("Couldn't link ") + m_path + ": " + strerror(errno);
+
+    // EEXIST: another process got there first, and its file will do
+    ::close(fd);
+    unlink(temp.c_str());
+    if (!err.empty()) throw err;
+
+    // the new name survives the machine crashing once the directory is synced
+    int dir = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (0 <= dir)
+    {
+        fsync(dir);
+        ::close(dir);
+    }
+}
+
+
+string CMCCIRevisionStoreMapped::path_of(string directory, string signature)
+{
+    // signatures are base64, whose '/' can't go in a file name
+    for (unsigned int i = 0; i < signature.size(); ++i)
+        if ('/' == signature[i]) signature[i] = '_';
+
+    return directory + "/" + signature + ".revisions";
+}
+
+
+MCCI_REVISION_T CMCCIRevisionStoreMapped::get(MCCI_VARIABLE_T variable_id)
+{
+    return __atomic_load_n(&m_slots[variable_id], __ATOMIC_ACQUIRE);
+}
+
+
+MCCI_REVISION_T CMCCIRevisionStoreMapped::advance(MCCI_VARIABLE_T variable_id, MCCI_REVISION_T count)
+{
+    MCCI_REVISION_T revision = __atomic_add_fetch(&m_slots[variable_id], count, __ATOMIC_ACQ_REL);
+
+    if (m_sync_every && 0 == ++m_advances % m_sync_every) this->flush();
+    return revision;
+}
+
+
+bool CMCCIRevisionStoreMapped::give_back(MCCI_VARIABLE_T variable_id,
+                                         MCCI_REVISION_T from,
+                                         MCCI_REVISION_T to)
+{
+    // only if nobody sharing the file has advanced it since
+    return __atomic_compare_exchange_n(&m_slots[variable_id], &from, to, false,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+
+void CMCCIRevisionStoreMapped::flush()
+{
+    if (msync(m_map, m_map_size, MS_SYNC))
+        throw string("Couldn't msync ") + m_path + ": " + strerror(errno);
+}
+
+
+void CMCCIRevisionStoreMapped::close()
+{
+    if (m_map) munmap(m_map, m_map_size);
+    m_map = NULL;
+
+    if (0 <= m_fd) ::close(m_fd);
+    m_fd = -1;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "MCCIRevisionStore.h"
+#include "MCCITypes.h"
+#include <string>
+#include <stdint.h>
+
+using namespace std;
+
+
+/**
+   Revisions kept in a memory-mapped file: an array with a slot for every
+   possible variable id (65536 revisions, 256 KB), one file per schema
+   signature, so a signature's revisions need no lookup, statement or lock.
+
+   The file starts with a page holding a magic string and the signature, which
+   is checked when the file is opened.  A new file is written full of zeroes
+   behind its header under a temporary name, synced and linked into place, so
+   a file at the real name is always whole; of processes creating it at once,
+   those that link too late use the winner's.  Its name is the signature with
+   '/' made '_', in a given directory.
+
+   Slots are advanced with atomic adds on the shared mapping, so once advance()
+   returns, the new revision survives the process crashing: the kernel has the
+   page.  Surviving the machine crashing takes an msync, which is made every
+   sync_every advances (0: only on flush() and close) and by flush().
+ */
+class CMCCIRevisionStoreMapped : public CMCCIRevisionStore
+{
+  public:
+    static const unsigned int SLOTS = 65536;       // one per variable id
+    static const unsigned int HEADER_SIZE = 4096;  // the first page
+
+  protected:
+
+    // the first page of the file
+    typedef struct
+    {
+        char magic[8];          // "MCCIREV1"
+        uint32_t slots;         // SLOTS
+        uint32_t signature_length;
+        char signature[HEADER_SIZE - 16];
+    } Header;
+
+    string m_path;
+    string m_signature;
+    int m_fd;
+
+    void* m_map;              // the whole file
+    size_t m_map_size;
+    Header* m_header;
+    MCCI_REVISION_T* m_slots;
+
+    unsigned int m_sync_every;  // advances between msyncs (0: none)
+    unsigned long m_advances;
+
+    // the mapping is ours alone; copying it makes no sense
+    CMCCIRevisionStoreMapped(const CMCCIRevisionStoreMapped &rhs);
+    CMCCIRevisionStoreMapped& operator=(const CMCCIRevisionStoreMapped &rhs);
+
+  public:
+    // open (or create) the file for a signature in a directory
+    CMCCIRevisionStoreMapped(string directory, string signature, unsigned int sync_every = 0);
+    virtual ~CMCCIRevisionStoreMapped();
+
+    // where the file for a signature goes
+    static string path_of(string directory, string signature);
+
+    virtual string get_signature() const { return m_signature; }
+
+    virtual MCCI_REVISION_T get(MCCI_VARIABLE_T variable_id);
+
+    virtual MCCI_REVISION_T advance(MCCI_VARIABLE_T variable_id, MCCI_REVISION_T count);
+
+    virtual bool give_back(MCCI_VARIABLE_T variable_id, MCCI_REVISION_T from, MCCI_REVISION_T to);
+
+    // msync the file
+    virtual void flush();
+
+    string get_path() const { return m_path; }
+
+  protected:
+    // write a new file under a temporary name and link it into place
+    void create(string directory);
+
+    // unmap and close, if open
+    void close();
+};
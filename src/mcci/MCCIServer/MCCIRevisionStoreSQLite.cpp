@@ -0,0 +1,327 @@
+#include "MCCIRevisionStoreSQLite.h"
+#include <stdio.h>
+
+CMCCIRevisionStoreSQLite::CMCCIRevisionStoreSQLite(sqlite3* revision_db, unsigned int schema_cardinality,
+                                                   string schema_signature)
+{
+    m_stored.resize_nearest_prime(schema_cardinality);
+    load(revision_db);
+    m_signature_id = 0;
+    set_signature(schema_signature);
+    m_strict = true;
+    m_writer = NULL;
+}
+
+
+CMCCIRevisionStoreSQLite::~CMCCIRevisionStoreSQLite()
+{
+    if (m_writer)
+    {
+        try { m_writer->flush(); } catch (string s) {} // the marks in the DB are still safe
+        delete m_writer;
+    }
+
+    sqlite3_finalize(m_insert);
+    sqlite3_finalize(m_read);
+    sqlite3_finalize(m_update);
+}
+
+
+string CMCCIRevisionStoreSQLite::get_signature() const
+{
+    sqlite3_stmt* s;
+    int result;
+    string sig;
+
+    sqlite3_prepare_v2(m_db, "select signature from signature where signature_id=?",
+                       -1, &s, NULL);
+    sqlite3_bind_int(s, 1, m_signature_id);
+    result = sqlite3_step(s);
+
+    switch (result)
+    {
+        case SQLITE_ROW:
+            sig = reinterpret_cast<const char*>(sqlite3_column_text(s, 0));
+            break;
+        case SQLITE_DONE:
+            sig = "";
+            break;
+        default:
+            char buffer[33];
+            snprintf(buffer, 32, "Error in get_signature: %d", sqlite3_errcode(m_db));
+            throw string(buffer);
+    }
+    
+    sqlite3_finalize(s);
+
+    return sig;
+}
+
+
+void CMCCIRevisionStoreSQLite::set_signature(string signature)
+{
+    string currentsig;
+
+    
+    // early exits for errors or no-ops
+    if (m_signature_id)
+    {
+        currentsig = get_signature();
+        if (currentsig != signature && m_strict)
+        {
+            throw string("Tried to change signature from " + currentsig + " to " + signature);
+        }
+
+        if (currentsig == signature) return;
+    }
+
+    m_signature_id = lookup_signature_id(signature);
+
+    if (m_signature_id) return; // if it exists, we're done
+
+    //fprintf(stderr, "\ninserting '%s' signature", signature.c_str());
+    sqlite3_stmt* s;
+    sqlite3_prepare(m_db, "insert or ignore into signature(signature) values(?)",
+                    -1, &s, NULL);
+    sqlite3_bind_text(s, 1, signature.c_str(), -1, SQLITE_TRANSIENT);
+    int result = sqlite3_step(s);
+    if (SQLITE_DONE != result)
+    {
+        string err = string("Error in set_signature insert: ") + string(sqlite3_errmsg(m_db));
+        sqlite3_finalize(s);
+        throw err;
+    }
+    sqlite3_finalize(s);
+
+    m_signature_id = lookup_signature_id(signature);
+
+}
+
+int CMCCIRevisionStoreSQLite::lookup_signature_id(string signature)
+{
+    int ret;
+    sqlite3_stmt* s;
+
+    sqlite3_prepare(m_db, "select signature_id from signature where signature=?",
+                    -1, &s, NULL);
+    sqlite3_bind_text(s, 1, signature.c_str(), -1, SQLITE_TRANSIENT);
+    int result = sqlite3_step(s);
+    switch (result)
+    {
+        case SQLITE_ROW:  // already exists
+            ret = sqlite3_column_int(s, 0); 
+            break;
+        case SQLITE_DONE:
+            ret = 0;
+            break;
+        default:
+            sqlite3_finalize(s);
+            string err = string("Error in lookup_signature_id: ") + string(sqlite3_errmsg(m_db));
+            throw err;
+    }
+    sqlite3_finalize(s);
+    return ret;
+}
+
+
+void CMCCIRevisionStoreSQLite::load(sqlite3* revision_db)
+{
+    m_db = revision_db;
+
+    // this optimization is OK because it only fails if the computer crashes
+    // which is already a system failure requiring intervention
+    sqlite3_exec(m_db, "PRAGMA synchronous = OFF", NULL, NULL, NULL);
+
+    // this optimization is NOT OK because it can corrupt the database if
+    // the PROGRAM crashes.
+    // sqlite3_exec(db, "PRAGMA journal_mode = MEMORY", NULL, NULL, NULL); // don't want this
+
+    // prepare the statements that we will be using
+    sqlite3_prepare_v2(m_db, "insert into revision(var_id, signature_id, revision) "
+                       "values(?, ?, 0)",
+                       -1, &m_insert, NULL);
+    sqlite3_prepare_v2(m_db, "select revision from revision where var_id=? and signature_id=?",
+                       -1, &m_read, NULL);
+    sqlite3_prepare_v2(m_db, "update revision set revision=? where var_id=? and signature_id=?",
+                       -1, &m_update, NULL);
+
+
+}
+
+
+MCCI_REVISION_T CMCCIRevisionStoreSQLite::get(MCCI_VARIABLE_T variable_id)
+{
+    if (m_stored.has_key(variable_id)) return m_stored[variable_id];
+
+    //fprintf(stderr, "\nget loading variable into cache");
+    // bind placeholder #1 of the read statement to our new var id
+    sqlite3_bind_int(m_read, 1, variable_id);
+    sqlite3_bind_int(m_read, 2, m_signature_id);
+    int result = sqlite3_step(m_read);  // look for the variable
+
+    if (SQLITE_ROW == result)  // already exists; after a crash, it's the high-water mark
+        m_stored[variable_id] = sqlite3_column_int(m_read, 0);
+
+    // record any error
+    string err = string("Error in get: ") + string(sqlite3_errmsg(m_db));
+    // clean up from read
+    sqlite3_clear_bindings(m_read);
+    sqlite3_reset(m_read);
+
+    if (SQLITE_ROW   == result) return m_stored[variable_id]; // we retrieved the value and are done
+    if (SQLITE_DONE != result) throw err; // "does not exist" is the only non-error case
+
+    //fprintf(stderr, "\nget inserting variable into DB");
+    // getting here means we need to INSERT a new record
+    sqlite3_bind_int(m_insert, 1, variable_id);
+    sqlite3_bind_int(m_insert, 2, m_signature_id);
+    result = sqlite3_step(m_insert);
+    sqlite3_clear_bindings(m_insert);
+    sqlite3_reset(m_insert);
+
+    m_stored[variable_id] = 0; // matching the prepared statement
+    return 0;
+}
+
+
+void CMCCIRevisionStoreSQLite::preload(const vector<MCCI_VARIABLE_T>& variable_ids)
+{
+    sqlite3_stmt* s;
+    int result;
+
+    sqlite3_prepare_v2(m_db, "select var_id, revision from revision where signature_id=?",
+                       -1, &s, NULL);
+    sqlite3_bind_int(s, 1, m_signature_id);
+    while (SQLITE_ROW == (result = sqlite3_step(s)))
+    {
+        // what we've cached is what the DB holds, or will once the writer catches up
+        MCCI_VARIABLE_T var = sqlite3_column_int(s, 0);
+        if (!m_stored.has_key(var)) m_stored[var] = sqlite3_column_int(s, 1);
+    }
+    sqlite3_finalize(s);
+
+    if (SQLITE_DONE != result)
+        throw string("Error in preload select: ") + string(sqlite3_errmsg(m_db));
+
+    // the variables the DB doesn't have yet go in together
+    bool begun = false;
+    for (unsigned int i = 0; i < variable_ids.size(); ++i)
+    {
+        if (m_stored.has_key(variable_ids[i])) continue;
+
+        if (!begun && SQLITE_OK != sqlite3_exec(m_db, "begin", NULL, NULL, NULL))
+            throw string("Error in preload begin: ") + string(sqlite3_errmsg(m_db));
+        begun = true;
+
+        sqlite3_bind_int(m_insert, 1, variable_ids[i]);
+        sqlite3_bind_int(m_insert, 2, m_signature_id);
+        result = sqlite3_step(m_insert);
+        sqlite3_clear_bindings(m_insert);
+        sqlite3_reset(m_insert);
+
+        if (SQLITE_DONE != result)
+        {
+            string err = string("Error in preload insert: ") + string(sqlite3_errmsg(m_db));
+            sqlite3_exec(m_db, "rollback", NULL, NULL, NULL);
+            throw err;
+        }
+    }
+
+    if (begun && SQLITE_OK != sqlite3_exec(m_db, "commit", NULL, NULL, NULL))
+    {
+        string err = string("Error in preload commit: ") + string(sqlite3_errmsg(m_db));
+        sqlite3_exec(m_db, "rollback", NULL, NULL, NULL);
+        throw err;
+    }
+
+    // only now that they're committed are they ours
+    for (unsigned int i = 0; i < variable_ids.size(); ++i)
+        if (!m_stored.has_key(variable_ids[i])) m_stored[variable_ids[i]] = 0; // matching the prepared statement
+}
+
+
+MCCI_REVISION_T CMCCIRevisionStoreSQLite::advance(MCCI_VARIABLE_T variable_id, MCCI_REVISION_T count)
+{
+    MCCI_REVISION_T revision = get(variable_id) + count;
+
+    // scheduled effect: db (delayed write, not synchronous)
+    int result = write_revision(variable_id, revision);
+    switch (result)
+    {
+        case SQLITE_ROW:
+            throw string("advance somehow got a row back from an update operation");
+            break;
+        case SQLITE_DONE: // this is the good case
+            break;
+        default:
+            string err = string("Error in advance: ") + string(sqlite3_errmsg(m_db));
+            throw err;
+    }
+
+    m_stored[variable_id] = revision;
+    return revision;
+}
+
+
+bool CMCCIRevisionStoreSQLite::give_back(MCCI_VARIABLE_T variable_id,
+                                         MCCI_REVISION_T from,
+                                         MCCI_REVISION_T to)
+{
+    if (!m_stored.has_key(variable_id) || from != m_stored[variable_id]) return false;
+    if (SQLITE_DONE != write_revision(variable_id, to)) return false;
+
+    m_stored[variable_id] = to;
+    return true;
+}
+
+
+void CMCCIRevisionStoreSQLite::flush()
+{
+    if (m_writer) m_writer->flush();
+}
+
+
+MCCI_REVISION_T CMCCIRevisionStoreSQLite::wait_durable(MCCI_VARIABLE_T variable_id,
+                                                       MCCI_REVISION_T revision)
+{
+    if (!m_writer) return get(variable_id);
+    return m_writer->wait_for(variable_id, revision);
+}
+
+
+void CMCCIRevisionStoreSQLite::set_write_behind(unsigned int interval_ms, unsigned int batch)
+{
+    const char* filename = sqlite3_db_filename(m_db, "main");
+    if (!filename || !*filename) throw string("Write-behind needs the revision DB in a file");
+
+    if (m_writer)
+    {
+        m_writer->flush();
+        delete m_writer;
+    }
+    m_writer = new CMCCIRevisionWriter(filename, m_signature_id, interval_ms, batch);
+
+    // the writer's transactions can briefly hold off our inserts of new variables
+    sqlite3_busy_timeout(m_db, 1000);
+}
+
+
+int CMCCIRevisionStoreSQLite::write_revision(MCCI_VARIABLE_T variable_id, MCCI_REVISION_T revision)
+{
+    if (m_writer)
+    {
+        m_writer->write(variable_id, revision);
+        return SQLITE_DONE;
+    }
+
+    // UPDATE existing revision.
+    sqlite3_bind_int(m_update, 1, revision);
+    sqlite3_bind_int(m_update, 2, variable_id);
+    sqlite3_bind_int(m_update, 3, m_signature_id);
+    int result = sqlite3_step(m_update);
+
+    sqlite3_clear_bindings(m_update);
+    sqlite3_reset(m_update);
+
+    return result;
+}
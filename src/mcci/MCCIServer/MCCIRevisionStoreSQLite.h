@@ -0,0 +1,88 @@
+#pragma once
+
+#include "MCCIRevisionStore.h"
+#include "MCCIRevisionWriter.h"
+#include "DenseIdMap.h"
+#include "MCCITypes.h"
+#include <string>
+#include <sqlite3.h>
+
+using namespace std;
+
+
+/**
+   Revisions kept in the revision DB (src/sql/revisions.sql): a row per variable
+   and signature in the revision table, and the signatures in their own table.
+
+   The stored revisions are cached, so only advance() and give_back() reach the
+   DB, with an UPDATE each.  With write-behind on, those go to a
+   CMCCIRevisionWriter thread instead, and flush() waits for it to commit them.
+ */
+class CMCCIRevisionStoreSQLite : public CMCCIRevisionStore
+{
+  protected:
+
+    sqlite3* m_db;
+    sqlite3_stmt* m_insert;
+    sqlite3_stmt* m_read;
+    sqlite3_stmt* m_update;
+
+    DenseIdMap<MCCI_VARIABLE_T, MCCI_REVISION_T> m_stored; // what the DB holds (or will)
+
+    CMCCIRevisionWriter* m_writer; // NULL: writes are made here
+
+    bool m_strict; // whether to bail if schema signatures don't match (default yes)
+
+    long m_signature_id; // signature ID to use
+
+    // the statements and writer are ours alone; copying them makes no sense
+    CMCCIRevisionStoreSQLite(const CMCCIRevisionStoreSQLite &rhs);
+    CMCCIRevisionStoreSQLite& operator=(const CMCCIRevisionStoreSQLite &rhs);
+
+  public:
+    CMCCIRevisionStoreSQLite(sqlite3* revision_db, unsigned int schema_cardinality, string schema_signature);
+    virtual ~CMCCIRevisionStoreSQLite();
+
+    void load(sqlite3* revision_db);
+
+    // the signature of the schema we're using
+    virtual string get_signature() const;
+
+    // put a signature in the DB if it's not there already and retain its id
+    void set_signature(string signature);
+
+    // if false, disregards mismatches in schema signatures.
+    //      this should ONLY be used for debugging.
+    bool get_strict() const { return m_strict; };
+    void set_strict(bool v) { m_strict = v; };
+
+    // the stored revision, putting the variable in the DB if it's not there already
+    virtual MCCI_REVISION_T get(MCCI_VARIABLE_T variable_id);
+
+    // read every revision of our signature in one query, and put the variables
+    //  that have none in the DB in one transaction
+    virtual void preload(const vector<MCCI_VARIABLE_T>& variable_ids);
+
+    virtual MCCI_REVISION_T advance(MCCI_VARIABLE_T variable_id, MCCI_REVISION_T count);
+
+    virtual bool give_back(MCCI_VARIABLE_T variable_id, MCCI_REVISION_T from, MCCI_REVISION_T to);
+
+    // wait until every write so far is committed (at once without write-behind)
+    virtual void flush();
+
+    virtual bool writes_behind() const { return NULL != m_writer; }
+
+    // waits for the writer to commit the variable that far
+    virtual MCCI_REVISION_T wait_durable(MCCI_VARIABLE_T variable_id, MCCI_REVISION_T revision);
+
+    // hand DB writes to a thread that commits them every interval or batch of updates.
+    //  the DB must be a file
+    void set_write_behind(unsigned int interval_ms, unsigned int batch);
+
+  protected:
+    // UPDATE a variable's revision in the DB (or queue it), returning the sqlite result
+    int write_revision(MCCI_VARIABLE_T variable_id, MCCI_REVISION_T revision);
+
+    // DB query for signature id, returns 0 if none exists
+    int lookup_signature_id(string signature);
+};
@@ -0,0 +1,470 @@
+#include "MCCIRevisionStoreShared.h"
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <algorithm>
+
+static const char SHARED_MAGIC[8] = {'M', 'C', 'C', 'I', 'S', 'H', 'M', '2'};
+
+
+// sleep for some microseconds, or until woken, unless a word in shared memory has
+//  changed from a value
+static void futex_wait(uint32_t* word, uint32_t value, unsigned int us)
+{
+    struct timespec t;
+    t.tv_sec = us / 1000000;
+    t.tv_nsec = (us % 1000000) * 1000;
+    syscall(SYS_futex, word, FUTEX_WAIT, value, &t, NULL, 0);
+}
+
+static void futex_wake(uint32_t* word)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+
+CMCCIRevisionStoreShared::CMCCIRevisionStoreShared(string signature,
+                                                   const vector<MCCI_VARIABLE_T>& variable_ids,
+                                                   CMCCIRevisionStore* backing,
+                                                   unsigned int lease,
+                                                   unsigned int interval_us,
+                                                   unsigned int wait_ms)
+{
+    m_name = name_of(signature);
+    m_signature = signature;
+    m_variables = variable_ids;
+    for (unsigned int i = 0; i < m_variables.size(); ++i) m_ordinal[m_variables[i]] = i;
+
+    m_fd = -1;
+    m_map = NULL;
+    m_attached = false;
+    m_pid_entry = 0;
+    m_map_size = HEADER_SIZE + m_variables.size() * sizeof(Slot);
+    m_backing = backing;
+    m_stopping = false;
+    m_lease = lease ? lease : 1;
+    m_interval_us = interval_us;
+    m_waits = 0;
+    m_passes = 0;
+
+    if (signature.size() > sizeof(m_header->signature))
+        throw string("Signature too long for shared revisions: ") + signature;
+
+    pthread_mutex_init(&m_backing_lock, NULL);
+
+    if (!m_backing)
+    {
+        open_existing(wait_ms);
+        return;
+    }
+
+    create();
+    if (pthread_create(&m_thread, NULL, CMCCIRevisionStoreShared::run, this))
+    {
+        this->close();
+        throw string("Couldn't start the shared revision thread");
+    }
+}
+
+
+CMCCIRevisionStoreShared::~CMCCIRevisionStoreShared()
+{
+    if (m_backing)
+    {
+        __atomic_store_n(&m_stopping, true, __ATOMIC_RELEASE);
+        __atomic_store_n(&m_header->wanted, 1, __ATOMIC_RELEASE);
+        futex_wake(&m_header->wanted);
+        pthread_join(m_thread, NULL);
+    }
+
+    this->close();
+    pthread_mutex_destroy(&m_backing_lock);
+}
+
+
+string CMCCIRevisionStoreShared::name_of(string signature)
+{
+    // signatures are base64, whose '/' can't go in a shared memory name
+    for (unsigned int i = 0; i < signature.size(); ++i)
+        if ('/' == signature[i]) signature[i] = '_';
+
+    return "/mcci-revisions-" + signature;
+}
+
+
+CMCCIRevisionStoreShared::Slot& CMCCIRevisionStoreShared::slot_of(MCCI_VARIABLE_T variable_id)
+{
+    unsigned int* ordinal = m_ordinal.lookup(variable_id);
+    if (!ordinal) throw string("Variable isn't in the shared revisions");
+
+    return m_slots[*ordinal];
+}
+
+
+MCCI_REVISION_T CMCCIRevisionStoreShared::get(MCCI_VARIABLE_T variable_id)
+{
+    return __atomic_load_n(&slot_of(variable_id).next, __ATOMIC_ACQUIRE);
+}
+
+
+MCCI_REVISION_T CMCCIRevisionStoreShared::advance(MCCI_VARIABLE_T variable_id, MCCI_REVISION_T count)
+{
+    Slot& slot = slot_of(variable_id);
+    MCCI_REVISION_T revision = __atomic_add_fetch(&slot.next, count, __ATOMIC_ACQ_REL);
+
+    if (revision <= __atomic_load_n(&slot.durable, __ATOMIC_ACQUIRE)) return revision;
+
+    // past the mark: wake the persisting process, and wait for it to move it
+    ++m_waits;
+    if (!__atomic_exchange_n(&m_header->wanted, 1, __ATOMIC_ACQ_REL)) futex_wake(&m_header->wanted);
+    for (unsigned int spins = 0; spins < WAIT_SPINS; ++spins)
+    {
+        if (revision <= __atomic_load_n(&slot.durable, __ATOMIC_ACQUIRE)) return revision;
+        sched_yield();
+    }
+
+    // then sleep until marks are published, checking on the owner now and then.
+    //  (a sleeper is counted before it looks, so a publish it misses wakes it)
+    for (;;)
+    {
+        __atomic_add_fetch(&m_header->sleepers, 1, __ATOMIC_SEQ_CST);
+        uint32_t seen = __atomic_load_n(&m_header->published, __ATOMIC_SEQ_CST);
+        bool covered = revision <= __atomic_load_n(&slot.durable, __ATOMIC_SEQ_CST);
+        if (!covered) futex_wait(&m_header->published, seen, WAIT_US);
+        __atomic_sub_fetch(&m_header->sleepers, 1, __ATOMIC_SEQ_CST);
+
+        if (covered || revision <= __atomic_load_n(&slot.durable, __ATOMIC_ACQUIRE)) return revision;
+        if (!owner_alive()) throw string("The process persisting revisions is gone");
+        if (!__atomic_exchange_n(&m_header->wanted, 1, __ATOMIC_ACQ_REL)) futex_wake(&m_header->wanted);
+    }
+}
+
+
+bool CMCCIRevisionStoreShared::give_back(MCCI_VARIABLE_T variable_id,
+                                         MCCI_REVISION_T from,
+                                         MCCI_REVISION_T to)
+{
+    if (!m_ordinal.has_key(variable_id)) return false;
+
+    // only if no process has taken a revision since
+    return __atomic_compare_exchange_n(&slot_of(variable_id).next, &from, to, false,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+
+void CMCCIRevisionStoreShared::flush()
+{
+    if (!m_backing) return;
+
+    pthread_mutex_lock(&m_backing_lock);
+    try
+    {
+        m_backing->flush();
+    }
+    catch (string s)
+    {
+        pthread_mutex_unlock(&m_backing_lock);
+        throw;
+    }
+    pthread_mutex_unlock(&m_backing_lock);
+}
+
+
+bool CMCCIRevisionStoreShared::owner_alive()
+{
+    if (m_backing) return true;
+
+    // the owner's exclusive lock keeps us from taking a shared one
+    if (flock(m_fd, LOCK_SH | LOCK_NB)) return EWOULDBLOCK == errno || EINTR == errno;
+    flock(m_fd, LOCK_UN);
+    return false;
+}
+
+
+void CMCCIRevisionStoreShared::create()
+{
+    int fd = shm_open(m_name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (0 > fd) throw string("Couldn't open shared memory ") + m_name + ": " + strerror(errno);
+
+    // held until we close the segment (or die), which is how the others tell we're there
+    if (flock(fd, LOCK_EX | LOCK_NB))
+    {
+        ::close(fd);
+        throw string("Another process persists the revisions in ") + m_name;
+    }
+
+    struct stat st;
+    bool fresh = !fstat(fd, &st) && 0 == st.st_size;
+    if ((fresh && ftruncate(fd, m_map_size)) || (!fresh && (size_t)st.st_size != m_map_size))
+    {
+        ::close(fd);
+        throw string("Couldn't size shared memory ") + m_name;
+    }
+
+    m_map = mmap(NULL, m_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == m_map)
+    {
+        ::close(fd);
+        m_map = NULL;
+        throw string("Couldn't map shared memory ") + m_name + ": " + strerror(errno);
+    }
+    m_fd = fd;
+    m_header = (Header*)m_map;
+    m_slots = (Slot*)((char*)m_map + HEADER_SIZE);
+
+    // a segment left by an earlier persisting process keeps its counters, but not
+    //  the count of processes that went with it
+    if (__atomic_load_n(&m_header->ready, __ATOMIC_ACQUIRE))
+    {
+        if (memcmp(m_header->magic, SHARED_MAGIC, sizeof(SHARED_MAGIC)) ||
+            m_signature != string(m_header->signature, m_header->signature_length) ||
+            m_variables.size() != m_header->slots)
+        {
+            this->close();
+            throw string("Shared memory ") + m_name + " is for another schema";
+        }
+        forget_dead();
+    }
+    else
+    {
+        memcpy(m_header->magic, SHARED_MAGIC, sizeof(SHARED_MAGIC));
+        m_header->slots = m_variables.size();
+        m_header->signature_length = m_signature.size();
+        memcpy(m_header->signature, m_signature.data(), m_signature.size());
+    }
+
+    // the store must be at least as far along as the segment, and the segment as the store
+    try
+    {
+        m_backing->preload(m_variables);
+        for (unsigned int i = 0; i < m_variables.size(); ++i)
+        {
+            Slot& slot = m_slots[i];
+            MCCI_REVISION_T stored = m_backing->get(m_variables[i]);
+
+            if (stored < slot.durable) stored = m_backing->advance(m_variables[i], slot.durable - stored);
+            __atomic_store_n(&slot.durable, stored, __ATOMIC_RELEASE);
+
+            MCCI_REVISION_T next = __atomic_load_n(&slot.next, __ATOMIC_ACQUIRE);
+            while (next < stored &&
+                   !__atomic_compare_exchange_n(&slot.next, &next, stored, false,
+                                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+        }
+        m_backing->flush();
+    }
+    catch (string s)
+    {
+        this->close();
+        throw;
+    }
+
+    m_header->owner = getpid();
+    try
+    {
+        attach();
+    }
+    catch (string s)
+    {
+        this->close();
+        throw;
+    }
+    __atomic_store_n(&m_header->ready, 1, __ATOMIC_RELEASE);
+}
+
+
+void CMCCIRevisionStoreShared::open_existing(unsigned int wait_ms)
+{
+    for (unsigned int waited = 0; ; ++waited)
+    {
+        int fd = shm_open(m_name.c_str(), O_RDWR | O_CLOEXEC, 0);
+        struct stat st;
+        if (0 <= fd && !fstat(fd, &st) && (size_t)st.st_size == m_map_size)
+        {
+            m_map = mmap(NULL, m_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (MAP_FAILED == m_map) m_map = NULL;
+        }
+
+        if (m_map)
+        {
+            m_header = (Header*)m_map;
+            m_slots = (Slot*)((char*)m_map + HEADER_SIZE);
+            if (__atomic_load_n(&m_header->ready, __ATOMIC_ACQUIRE))
+            {
+                m_fd = fd;  // kept, to look for the owner's lock
+                break;
+            }
+
+            munmap(m_map, m_map_size);
+            m_map = NULL;
+        }
+        if (0 <= fd) ::close(fd);
+
+        if (waited >= wait_ms) throw string("No process has set up shared revisions ") + m_name;
+        usleep(1000);
+    }
+
+    if (memcmp(m_header->magic, SHARED_MAGIC, sizeof(SHARED_MAGIC)) ||
+        m_signature != string(m_header->signature, m_header->signature_length) ||
+        m_variables.size() != m_header->slots)
+    {
+        this->close();
+        throw string("Shared memory ") + m_name + " is for another schema";
+    }
+
+    try
+    {
+        attach();
+    }
+    catch (string s)
+    {
+        this->close();
+        throw;
+    }
+}
+
+
+void CMCCIRevisionStoreShared::attach()
+{
+    // counted before listed: a crash in between leaves the count too high, which
+    //  only keeps the segment around, rather than too low
+    __atomic_add_fetch(&m_header->attached, 1, __ATOMIC_ACQ_REL);
+
+    pid_t me = getpid();
+    for (unsigned int i = 0; i < MAX_ATTACHED; ++i)
+    {
+        pid_t none = 0;
+        if (__atomic_compare_exchange_n(&m_header->pids[i], &none, me, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            m_pid_entry = i;
+            m_attached = true;
+            return;
+        }
+    }
+
+    __atomic_sub_fetch(&m_header->attached, 1, __ATOMIC_ACQ_REL);
+    throw string("Too many processes attached to shared memory ") + m_name;
+}
+
+
+unsigned int CMCCIRevisionStoreShared::forget_dead()
+{
+    unsigned int forgotten = 0;
+    for (unsigned int i = 0; i < MAX_ATTACHED; ++i)
+    {
+        pid_t pid = __atomic_load_n(&m_header->pids[i], __ATOMIC_ACQUIRE);
+        if (!pid || !kill(pid, 0) || ESRCH != errno) continue;
+
+        // whoever clears the entry takes it out of the count
+        if (__atomic_compare_exchange_n(&m_header->pids[i], &pid, 0, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            __atomic_sub_fetch(&m_header->attached, 1, __ATOMIC_ACQ_REL);
+            ++forgotten;
+        }
+    }
+
+    return forgotten;
+}
+
+
+unsigned int CMCCIRevisionStoreShared::persist()
+{
+    vector<pair<unsigned int, MCCI_REVISION_T> >& moved = m_moved;
+    moved.clear();
+
+    // a mark within half a lease of next (or behind it) moves a lease past next
+    for (unsigned int i = 0; i < m_variables.size(); ++i)
+    {
+        MCCI_REVISION_T next = __atomic_load_n(&m_slots[i].next, __ATOMIC_ACQUIRE);
+        MCCI_REVISION_T durable = m_slots[i].durable;
+        if (next + m_lease / 2 < durable) continue;
+
+        MCCI_REVISION_T mark = m_backing->advance(m_variables[i], next + m_lease - durable);
+        moved.push_back(make_pair(i, mark));
+    }
+    if (moved.empty()) return 0;
+
+    // only what the store has made durable is published
+    m_backing->flush();
+    for (unsigned int i = 0; i < moved.size(); ++i)
+        __atomic_store_n(&m_slots[moved[i].first].durable, moved[i].second, __ATOMIC_SEQ_CST);
+
+    // and the advances asleep on it are woken
+    __atomic_add_fetch(&m_header->published, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&m_header->sleepers, __ATOMIC_SEQ_CST)) futex_wake(&m_header->published);
+
+    return moved.size();
+}
+
+
+void* CMCCIRevisionStoreShared::run(void* store)
+{
+    CMCCIRevisionStoreShared* self = (CMCCIRevisionStoreShared*)store;
+    unsigned int idle_max = self->m_interval_us > IDLE_US ? self->m_interval_us : IDLE_US;
+    unsigned int sleep_us = self->m_interval_us;
+
+    while (!__atomic_load_n(&self->m_stopping, __ATOMIC_ACQUIRE))
+    {
+        unsigned int moved = 0;
+        pthread_mutex_lock(&self->m_backing_lock);
+        try
+        {
+            moved = self->persist();
+            __atomic_add_fetch(&self->m_passes, 1, __ATOMIC_RELAXED);
+        }
+        catch (string s)
+        {
+            // the marks stay where they were, and the next pass tries again
+        }
+        pthread_mutex_unlock(&self->m_backing_lock);
+
+        // the longer nothing moves, the longer the sleep, until an advance wakes us
+        sleep_us = moved ? self->m_interval_us : min(2 * sleep_us + 1, idle_max);
+        if (!__atomic_exchange_n(&self->m_header->wanted, 0, __ATOMIC_ACQ_REL))
+            futex_wait(&self->m_header->wanted, 0, sleep_us);
+    }
+
+    return NULL;
+}
+
+
+void CMCCIRevisionStoreShared::close()
+{
+    if (!m_map) return;
+
+    // listed after counted, so unlisted before uncounted
+    if (m_attached) __atomic_store_n(&m_header->pids[m_pid_entry], 0, __ATOMIC_RELEASE);
+    bool last = m_attached && 0 == __atomic_sub_fetch(&m_header->attached, 1, __ATOMIC_ACQ_REL);
+    m_attached = false;
+    if (m_backing && last)
+    {
+        // nobody else can take revisions: the store gets back what wasn't used
+        for (unsigned int i = 0; i < m_variables.size(); ++i)
+        {
+            MCCI_REVISION_T next = m_slots[i].next;
+            if (next < m_slots[i].durable)
+                m_backing->give_back(m_variables[i], m_slots[i].durable, next);
+        }
+        try { m_backing->flush(); } catch (string s) {} // the marks in the store are still safe
+
+        shm_unlink(m_name.c_str());
+    }
+
+    munmap(m_map, m_map_size);
+    m_map = NULL;
+
+    // which lets go of the lock, if we persisted
+    ::close(m_fd);
+    m_fd = -1;
+}
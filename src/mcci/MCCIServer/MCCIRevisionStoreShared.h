@@ -0,0 +1,175 @@
+#pragma once
+
+#include "MCCIRevisionStore.h"
+#include "DenseIdMap.h"
+#include "MCCITypes.h"
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+using namespace std;
+
+
+/**
+   Revisions shared by every server process on a node, in a POSIX shared memory
+   segment named after the schema signature, so processes serving different
+   clients still hand out unique, increasing revisions of the same variables.
+
+   The segment has a slot per variable ordinal, each on its own cache line, so
+   processes producing different variables don't fight over a line.  A slot
+   holds two counters:
+
+     next     the last revision handed out; every process takes revisions
+              with an atomic fetch-and-add on it
+     durable  the high-water mark in the backing store; nobody hands out a
+              revision above it
+
+   One process persists: it's given the backing store (the revision DB, or a
+   revision file), creates the segment from it, and runs a thread that keeps each
+   durable mark a lease ahead of next, writing the mark to the store and
+   flushing it before publishing it.  A revision taken above the mark waits for
+   the thread to catch up, so after the node crashes the store is ahead of every
+   revision any process handed out.  The others open the segment once it's ready,
+   and give up waiting on the mark if the persisting process is gone.
+
+   A revision above the mark spins briefly, then sleeps on a futex that the
+   thread bumps and wakes each time it publishes marks.  The persisting process
+   holds an exclusive flock on the segment for as long as it has it open, so a
+   waiter knows it's gone when it can take a shared one; unlike its pid, that
+   can't be mistaken for another process.
+
+   While no mark needs moving the thread sleeps longer each pass, up to
+   IDLE_US; an advance that has to wait sets a word in the header and wakes it
+   with a futex, which works across processes.
+
+   When the persisting process closes the store as the last one attached, it
+   gives the unused leases back to the backing store and removes the segment, so
+   the next start reads the store again.  The attached processes are listed by
+   pid in the header, so one persisting process rejoining a segment left by
+   another takes the ones that died without detaching out of the count.  It should be the last to stop: until
+   it starts again, the others can only hand out what's left of their leases.
+ */
+class CMCCIRevisionStoreShared : public CMCCIRevisionStore
+{
+  public:
+    static const unsigned int HEADER_SIZE = 4096;  // the first page
+    static const unsigned int IDLE_US = 10000;     // the longest the thread sleeps
+    static const unsigned int MAX_ATTACHED = 512;  // processes with the segment open
+    static const unsigned int WAIT_SPINS = 100;    // yields before sleeping on a mark
+    static const unsigned int WAIT_US = 10000;     // sleeps between checks on the owner
+
+  protected:
+
+    // the first page of the segment
+    typedef struct
+    {
+        char magic[8];            // "MCCISHM2"
+        uint32_t ready;           // atomic; set once the persisting process has filled the slots
+        uint32_t slots;           // variables (the schema's cardinality)
+        uint32_t signature_length;
+        pid_t owner;              // the persisting process
+        uint32_t attached;        // processes with the segment open (atomic)
+        uint32_t wanted;          // atomic; set by an advance waiting on a durable mark
+        uint32_t published;       // atomic; bumped each time durable marks move
+        uint32_t sleepers;        // atomic; advances asleep on published
+        char signature[256];
+        pid_t pids[MAX_ATTACHED]; // the processes counted in attached, 0 for none (atomic)
+    } Header;
+
+    // a variable's counters, alone on a cache line
+    typedef struct
+    {
+        MCCI_REVISION_T next;     // atomic
+        MCCI_REVISION_T durable;  // atomic; written by the persisting process
+        char pad[64 - 2 * sizeof(MCCI_REVISION_T)];
+    } Slot;
+
+    string m_name;
+    string m_signature;
+    vector<MCCI_VARIABLE_T> m_variables;         // by ordinal
+    DenseIdMap<MCCI_VARIABLE_T, unsigned int> m_ordinal;
+
+    int m_fd;         // the segment, flocked exclusively if we persist
+    void* m_map;
+    size_t m_map_size;
+    bool m_attached;  // counted in the header's attached
+    unsigned int m_pid_entry;  // where in the header's pids, if so
+    Header* m_header;
+    Slot* m_slots;
+
+    CMCCIRevisionStore* m_backing;  // NULL unless we persist
+    pthread_mutex_t m_backing_lock;
+    pthread_t m_thread;
+    bool m_stopping;                // atomic
+    MCCI_REVISION_T m_lease;        // how far the durable marks run ahead
+    unsigned int m_interval_us;     // between the thread's passes, while they move marks
+    vector<pair<unsigned int, MCCI_REVISION_T> > m_moved; // reused by persist
+
+    unsigned long m_waits;          // advances that waited for the durable mark
+    unsigned long m_passes;         // atomic: the thread's passes over the slots
+
+    // the mapping and thread are ours alone; copying them makes no sense
+    CMCCIRevisionStoreShared(const CMCCIRevisionStoreShared &rhs);
+    CMCCIRevisionStoreShared& operator=(const CMCCIRevisionStoreShared &rhs);
+
+  public:
+    // attach to the segment of a signature, whose variables are given in ordinal
+    //  order.  with a backing store, this process persists (and creates the
+    //  segment); without, it waits up to wait_ms for the segment to be ready
+    CMCCIRevisionStoreShared(string signature,
+                             const vector<MCCI_VARIABLE_T>& variable_ids,
+                             CMCCIRevisionStore* backing,
+                             unsigned int lease = 1024,
+                             unsigned int interval_us = 100,
+                             unsigned int wait_ms = 5000);
+    virtual ~CMCCIRevisionStoreShared();
+
+    // the shared memory name for a signature
+    static string name_of(string signature);
+
+    virtual string get_signature() const { return m_signature; }
+
+    virtual MCCI_REVISION_T get(MCCI_VARIABLE_T variable_id);
+
+    // take revisions, waiting for the durable mark to cover them
+    virtual MCCI_REVISION_T advance(MCCI_VARIABLE_T variable_id, MCCI_REVISION_T count);
+
+    virtual bool give_back(MCCI_VARIABLE_T variable_id, MCCI_REVISION_T from, MCCI_REVISION_T to);
+
+    // flush the backing store, if we persist (the marks are durable already)
+    virtual void flush();
+
+    // whether this process persists
+    bool is_persisting() const { return NULL != m_backing; }
+
+    unsigned long waits() const { return m_waits; }
+    unsigned long passes() const { return __atomic_load_n(&m_passes, __ATOMIC_RELAXED); }
+
+  protected:
+    Slot& slot_of(MCCI_VARIABLE_T variable_id);
+
+    // create (or rejoin) the segment and fill it from the backing store
+    void create();
+
+    // open the segment another process made, once it's ready
+    void open_existing(unsigned int wait_ms);
+
+    // count this process as attached, under a free entry of the header's pids
+    void attach();
+
+    // take the processes that are gone out of the attached count; returns how many
+    unsigned int forget_dead();
+
+    // whether the persisting process still has the segment
+    bool owner_alive();
+
+    // move the durable marks that need it; returns how many did
+    unsigned int persist();
+
+    static void* run(void* store);
+
+    // unmap and detach
+    void close();
+};
@@ -0,0 +1,434 @@
+#include "MCCIRevisionStoreMapped.h"
+#include "MCCIRevisionStoreShared.h"
+#include "MCCIRevisionSet.h"
+
+#include <set>
+#include <vector>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <assert.h>
+
+using namespace std;
+
+static const char* SIGNATURE = "test/signature+1";
+
+
+void test_mapped()
+{
+    string path = CMCCIRevisionStoreMapped::path_of(".", SIGNATURE);
+    unlink(path.c_str());
+
+    printf("\n\nA new revision file: %s", path.c_str());
+    assert(string::npos == path.find('/', 2));
+
+    CMCCIRevisionStoreMapped* store = new CMCCIRevisionStoreMapped(".", SIGNATURE);
+    assert(SIGNATURE == store->get_signature());
+    assert(0 == store->get(5) && 0 == store->get(65535));
+
+    assert(3 == store->advance(5, 3));
+    assert(10 == store->advance(5, 7));
+    assert(1 == store->advance(65535, 1));
+
+    printf("\nGiving back only works from the value the slot holds");
+    assert(!store->give_back(5, 9, 4));
+    assert(store->give_back(5, 10, 4));
+    assert(4 == store->get(5));
+    store->flush();
+    delete store;
+
+    printf("\nReopening it");
+    store = new CMCCIRevisionStoreMapped(".", SIGNATURE, 2);
+    assert(4 == store->get(5) && 1 == store->get(65535) && 0 == store->get(6));
+    assert(5 == store->advance(5, 1));
+    delete store;
+
+    printf("\nA file with another signature in it is refused");
+    string other = CMCCIRevisionStoreMapped::path_of(".", "other");
+    rename(path.c_str(), other.c_str());
+    bool thrown = false;
+    try { CMCCIRevisionStoreMapped wrong(".", "other"); } catch (string s) { thrown = true; }
+    assert(thrown);
+    unlink(other.c_str());
+}
+
+
+// processes creating the file at once: all of them use the one that wins, and
+//  neither the race nor a temporary file left by a crash shows
+void test_mapped_create()
+{
+    const int CHILDREN = 8;
+    string path = CMCCIRevisionStoreMapped::path_of(".", SIGNATURE);
+    unlink(path.c_str());
+
+    printf("\n\nA temporary file left by a crash is not the revision file");
+    char stale[32];
+    snprintf(stale, sizeof(stale), ".tmp.%d", (int)getpid());
+    int fd = open((path + stale).c_str(), O_RDWR | O_CREAT, 0644);
+    assert(0 <= fd && 0 == ftruncate(fd, 100));
+    close(fd);
+
+    CMCCIRevisionStoreMapped* store = new CMCCIRevisionStoreMapped(".", SIGNATURE);
+    assert(0 == store->get(7));
+    delete store;
+    assert(0 > access((path + stale).c_str(), F_OK));
+    unlink(path.c_str());
+
+    printf("\n%d processes creating the file at once", CHILDREN);
+    int fds[2];
+    assert(0 == pipe(fds));
+
+    pid_t children[CHILDREN];
+    for (int c = 0; c < CHILDREN; ++c)
+    {
+        children[c] = fork();
+        if (0 == children[c])
+        {
+            // all go when the parent closes the pipe
+            char go;
+            close(fds[1]);
+            if (0 != read(fds[0], &go, 1)) _exit(1);
+
+            try
+            {
+                CMCCIRevisionStoreMapped mine(".", SIGNATURE);
+                mine.advance(7, 1);
+            }
+            catch (string s)
+            {
+                fprintf(stderr, "\nChild %d: %s", c, s.c_str());
+                _exit(1);
+            }
+            _exit(0);
+        }
+    }
+    close(fds[0]);
+    close(fds[1]);
+
+    for (int c = 0; c < CHILDREN; ++c)
+    {
+        int status;
+        waitpid(children[c], &status, 0);
+        assert(WIFEXITED(status) && 0 == WEXITSTATUS(status));
+    }
+
+    store = new CMCCIRevisionStoreMapped(".", SIGNATURE);
+    assert(CHILDREN == store->get(7));
+    delete store;
+
+    unlink(path.c_str());
+}
+
+
+// a producer killed mid-run: no revision it handed out may be handed out again
+void test_crash_recovery()
+{
+    const int PRODUCED = 1000;
+    string path = CMCCIRevisionStoreMapped::path_of(".", SIGNATURE);
+    unlink(path.c_str());
+
+    int fds[2];
+    assert(0 == pipe(fds));
+
+    printf("\n\nProducing %d revisions, leased 8 at a time, then SIGKILL", PRODUCED);
+    pid_t child = fork();
+    if (0 == child)
+    {
+        CMCCIRevisionStoreMapped* store = new CMCCIRevisionStoreMapped(".", SIGNATURE);
+        CMCCIRevisionSet* rs = new CMCCIRevisionSet(store, 10);
+        rs->set_lease(8);
+
+        MCCI_REVISION_T last = 0;
+        for (int i = 0; i < PRODUCED; ++i) last = rs->inc_revision(7);
+        last = rs->inc_revision(7);
+
+        // tell the parent the last revision out, then die without any cleanup
+        if (sizeof(last) != write(fds[1], &last, sizeof(last))) _exit(1);
+        kill(getpid(), SIGKILL);
+        _exit(1);
+    }
+
+    MCCI_REVISION_T last = 0;
+    assert(sizeof(last) == read(fds[0], &last, sizeof(last)));
+    int status;
+    waitpid(child, &status, 0);
+    assert(WIFSIGNALED(status) && SIGKILL == WTERMSIG(status));
+    close(fds[0]);
+    close(fds[1]);
+
+    CMCCIRevisionStoreMapped* store = new CMCCIRevisionStoreMapped(".", SIGNATURE);
+    CMCCIRevisionSet* rs = new CMCCIRevisionSet(store, 10);
+    printf("\nThe child's last revision was %u; the file holds %u", last, rs->get_revision(7));
+    assert(last <= rs->get_revision(7));
+    assert(last + 8 > rs->get_revision(7));
+    assert(last < rs->inc_revision(7));
+
+    printf("\nA clean shutdown gives back the rest of the lease");
+    rs->set_lease(8);
+    MCCI_REVISION_T clean = rs->inc_revision(7);
+    delete rs;
+    assert(clean == store->get(7));
+
+    rs = new CMCCIRevisionSet(store, 10);
+    bool thrown = false;
+    try { rs->set_write_behind(10, 10); } catch (string s) { thrown = true; }
+    assert(thrown);
+    delete rs;
+    delete store;
+
+    unlink(path.c_str());
+}
+
+
+// several processes taking revisions of one variable through shared memory
+void test_shared()
+{
+    const int CHILDREN = 4;
+    const int PRODUCED = 5000;
+    string path = CMCCIRevisionStoreMapped::path_of(".", SIGNATURE);
+    unlink(path.c_str());
+    shm_unlink(CMCCIRevisionStoreShared::name_of(SIGNATURE).c_str());
+
+    vector<MCCI_VARIABLE_T> vars;
+    vars.push_back(3);
+    vars.push_back(9);
+    vars.push_back(200);
+
+    printf("\n\nA persisting process, leasing 4 at a time to a revision file");
+    CMCCIRevisionStoreMapped* backing = new CMCCIRevisionStoreMapped(".", SIGNATURE);
+    CMCCIRevisionStoreShared* owner = new CMCCIRevisionStoreShared(SIGNATURE, vars, backing, 4, 50);
+    assert(owner->is_persisting());
+
+    printf("\n%d processes take %d revisions each of the same variable", CHILDREN, PRODUCED);
+    pid_t children[CHILDREN];
+    for (int c = 0; c < CHILDREN; ++c)
+    {
+        children[c] = fork();
+        if (children[c]) continue;
+
+        char name[32];
+        snprintf(name, sizeof(name), "shared.%d", c);
+        FILE* out = fopen(name, "w");
+
+        CMCCIRevisionStoreShared* store = new CMCCIRevisionStoreShared(SIGNATURE, vars, NULL);
+        CMCCIRevisionSet* rs = new CMCCIRevisionSet(store, 3);
+        for (int i = 0; i < PRODUCED; ++i) fprintf(out, "%u\n", rs->inc_revision(3));
+        rs->inc_revision(9);
+        delete rs;
+        delete store;
+
+        fclose(out);
+        _exit(0);
+    }
+
+    for (int c = 0; c < CHILDREN; ++c)
+    {
+        int status;
+        waitpid(children[c], &status, 0);
+        assert(WIFEXITED(status) && 0 == WEXITSTATUS(status));
+    }
+
+    printf("\nEvery revision was handed out once, in order within each process");
+    set<MCCI_REVISION_T> seen;
+    for (int c = 0; c < CHILDREN; ++c)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "shared.%d", c);
+        FILE* in = fopen(name, "r");
+
+        MCCI_REVISION_T rev, last = 0;
+        int count = 0;
+        while (1 == fscanf(in, "%u", &rev))
+        {
+            assert(rev > last);
+            assert(seen.insert(rev).second);
+            last = rev;
+            ++count;
+        }
+        assert(PRODUCED == count);
+
+        fclose(in);
+        unlink(name);
+    }
+    assert(CHILDREN * PRODUCED == *seen.rbegin());
+    assert(CHILDREN * PRODUCED == owner->get(3));
+    assert(CHILDREN == owner->get(9));
+    printf("\nThe file is ahead of them: %u", backing->get(3));
+    assert(CHILDREN * PRODUCED <= backing->get(3));
+
+    printf("\nIdle, the thread backs off instead of passing every 50 us");
+    unsigned long passes = owner->passes();
+    usleep(200000);
+    printf(" (%lu passes in 200 ms)", owner->passes() - passes);
+    assert(owner->passes() - passes < 200);
+
+    printf("\nAn advance past the mark wakes it");
+    MCCI_REVISION_T mark = backing->get(3);
+    assert(mark + 1 == owner->advance(3, mark + 1 - owner->get(3)));
+    assert(mark < backing->get(3));
+    assert(owner->give_back(3, mark + 1, CHILDREN * PRODUCED));
+
+    printf("\nThe persisting process stops last, giving back the leases");
+    delete owner;
+    assert(CHILDREN * PRODUCED == backing->get(3));
+    assert(CHILDREN == backing->get(9) && 0 == backing->get(200));
+
+    printf("\nWithout it, nobody else can start");
+    bool thrown = false;
+    try { CMCCIRevisionStoreShared orphan(SIGNATURE, vars, NULL, 4, 50, 20); } catch (string s) { thrown = true; }
+    assert(thrown);
+
+    delete backing;
+    unlink(path.c_str());
+}
+
+
+// a persisting process killed mid-run: the next one takes over its segment, and
+//  isn't kept from removing it by the count of processes the dead one left
+void test_shared_rejoin()
+{
+    string path = CMCCIRevisionStoreMapped::path_of(".", SIGNATURE);
+    string name = CMCCIRevisionStoreShared::name_of(SIGNATURE);
+    unlink(path.c_str());
+    shm_unlink(name.c_str());
+
+    vector<MCCI_VARIABLE_T> vars;
+    vars.push_back(3);
+
+    int fds[2];
+    assert(0 == pipe(fds));
+
+    printf("\n\nA persisting process taking 10 revisions, then SIGKILL");
+    pid_t child = fork();
+    if (0 == child)
+    {
+        CMCCIRevisionStoreMapped* backing = new CMCCIRevisionStoreMapped(".", SIGNATURE);
+        CMCCIRevisionStoreShared* owner = new CMCCIRevisionStoreShared(SIGNATURE, vars, backing, 4, 50);
+
+        MCCI_REVISION_T last = 0;
+        for (int i = 0; i < 10; ++i) last = owner->advance(3, 1);
+
+        if (sizeof(last) != write(fds[1], &last, sizeof(last))) _exit(1);
+        kill(getpid(), SIGKILL);
+        _exit(1);
+    }
+
+    MCCI_REVISION_T last = 0;
+    assert(sizeof(last) == read(fds[0], &last, sizeof(last)));
+    int status;
+    waitpid(child, &status, 0);
+    assert(WIFSIGNALED(status) && SIGKILL == WTERMSIG(status));
+    close(fds[0]);
+    close(fds[1]);
+
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    assert(0 <= fd);
+    close(fd);
+
+    printf("\nAnother takes over where it left off");
+    CMCCIRevisionStoreMapped* backing = new CMCCIRevisionStoreMapped(".", SIGNATURE);
+    CMCCIRevisionStoreShared* owner = new CMCCIRevisionStoreShared(SIGNATURE, vars, backing, 4, 50);
+    assert(last == owner->get(3));
+    assert(last + 1 == owner->advance(3, 1));
+
+    printf("\nAnd, the only one attached, removes the segment as it stops");
+    delete owner;
+    assert(0 > shm_open(name.c_str(), O_RDWR, 0) && ENOENT == errno);
+    assert(last + 1 == backing->get(3));
+
+    delete backing;
+    unlink(path.c_str());
+}
+
+
+// kills a process after a while
+void* kill_later(void* pid)
+{
+    usleep(300000);
+    kill(*(pid_t*)pid, SIGKILL);
+    return NULL;
+}
+
+// an advance past the mark of a stalled persisting process sleeps rather than
+//  spins, and gives up once the process is gone
+void test_shared_stall()
+{
+    string path = CMCCIRevisionStoreMapped::path_of(".", SIGNATURE);
+    string name = CMCCIRevisionStoreShared::name_of(SIGNATURE);
+    unlink(path.c_str());
+    shm_unlink(name.c_str());
+
+    vector<MCCI_VARIABLE_T> vars;
+    vars.push_back(3);
+
+    int fds[2];
+    assert(0 == pipe(fds));
+
+    printf("\n\nA persisting process, stopped once it's set up");
+    pid_t child = fork();
+    if (0 == child)
+    {
+        CMCCIRevisionStoreMapped* backing = new CMCCIRevisionStoreMapped(".", SIGNATURE);
+        new CMCCIRevisionStoreShared(SIGNATURE, vars, backing, 4, 50);
+
+        char ready = 1;
+        if (1 != write(fds[1], &ready, 1)) _exit(1);
+        for (;;) pause();
+    }
+
+    char ready;
+    assert(1 == read(fds[0], &ready, 1));
+    close(fds[0]);
+    close(fds[1]);
+    CMCCIRevisionStoreShared* store = new CMCCIRevisionStoreShared(SIGNATURE, vars, NULL);
+    kill(child, SIGSTOP);
+
+    printf("\nWaiting past its mark until it's killed, 300 ms later");
+    pthread_t killer;
+    pthread_create(&killer, NULL, kill_later, &child);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+    bool thrown = false;
+    try { store->advance(3, 100); } catch (string s) { thrown = true; }
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+    pthread_join(killer, NULL);
+    waitpid(child, NULL, 0);
+
+    long cpu_ms = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000;
+    printf(" (%ld ms of CPU)", cpu_ms);
+    assert(thrown);
+    assert(cpu_ms < 100);
+
+    delete store;
+    shm_unlink(name.c_str());
+    unlink(path.c_str());
+}
+
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        test_mapped();
+        test_mapped_create();
+        test_crash_recovery();
+        test_shared();
+        test_shared_rejoin();
+        test_shared_stall();
+    }
+    catch (string s)
+    {
+        fprintf(stderr, "\n\nGot error: %s\n\n", s.c_str());
+        assert(false);
+    }
+
+    printf("\n\n");
+    return 0;
+}
@@ -0,0 +1,224 @@
+#include "MCCIRevisionWriter.h"
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+// milliseconds on the monotonic clock
+static unsigned long long monotonic_ms()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (unsigned long long)t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
+
+CMCCIRevisionWriter::CMCCIRevisionWriter(const char* filename, long signature_id,
+                                         unsigned int interval_ms, unsigned int batch,
+                                         unsigned long queue_size) :
+    m_queue(queue_size)
+{
+    m_signature_id = signature_id;
+    m_interval_ms = interval_ms;
+    m_batch = batch ? batch : 1;
+
+    m_pushed = 0;
+    m_taken = 0;
+    m_committed = 0;
+    m_commits = 0;
+    __atomic_store_n(&m_flush_wanted, false, __ATOMIC_RELAXED);
+    m_stopping = false;
+
+    if (SQLITE_OK != sqlite3_open_v2(filename, &m_db, SQLITE_OPEN_READWRITE, NULL))
+    {
+        string err = string("Error opening revision writer DB: ") + string(sqlite3_errmsg(m_db));
+        sqlite3_close(m_db);
+        throw err;
+    }
+
+    // WAL keeps our transactions out of the way of the revision set's reads, and
+    //  with it NORMAL only risks the last commits on a power loss, not corruption
+    sqlite3_exec(m_db, "PRAGMA journal_mode = WAL", NULL, NULL, NULL);
+    sqlite3_exec(m_db, "PRAGMA synchronous = NORMAL", NULL, NULL, NULL);
+    sqlite3_busy_timeout(m_db, 1000);
+
+    sqlite3_prepare_v2(m_db, "update revision set revision=? where var_id=? and signature_id=?",
+                       -1, &m_update, NULL);
+
+    pthread_mutex_init(&m_lock, NULL);
+    pthread_cond_init(&m_progress, NULL);
+
+    if (pthread_create(&m_thread, NULL, CMCCIRevisionWriter::run, this))
+    {
+        sqlite3_finalize(m_update);
+        sqlite3_close(m_db);
+        throw string("Couldn't start the revision writer thread");
+    }
+}
+
+
+CMCCIRevisionWriter::~CMCCIRevisionWriter()
+{
+    // the thread commits what's queued before it returns
+    __atomic_store_n(&m_stopping, true, __ATOMIC_RELEASE);
+    pthread_join(m_thread, NULL);
+
+    pthread_cond_destroy(&m_progress);
+    pthread_mutex_destroy(&m_lock);
+
+    sqlite3_finalize(m_update);
+    sqlite3_close(m_db);
+}
+
+
+void CMCCIRevisionWriter::write(MCCI_VARIABLE_T variable_id, MCCI_REVISION_T revision)
+{
+    Update u;
+    u.variable_id = variable_id;
+    u.revision = revision;
+
+    // a full queue means the DB is behind; wait for it rather than drop anything
+    while (!m_queue.push(u)) sched_yield();
+    ++m_pushed;
+}
+
+
+void CMCCIRevisionWriter::flush()
+{
+    unsigned long target = m_pushed;
+    string err;
+
+    pthread_mutex_lock(&m_lock);
+    __atomic_store_n(&m_flush_wanted, true, __ATOMIC_RELAXED);
+    while (m_committed < target && m_error.empty()) pthread_cond_wait(&m_progress, &m_lock);
+    __atomic_store_n(&m_flush_wanted, false, __ATOMIC_RELAXED);
+    if (m_committed < target) err = m_error;
+    pthread_mutex_unlock(&m_lock);
+
+    if (!err.empty()) throw err;
+}
+
+
+MCCI_REVISION_T CMCCIRevisionWriter::wait_for(MCCI_VARIABLE_T variable_id, MCCI_REVISION_T revision)
+{
+    MCCI_REVISION_T mark = 0;
+    string err;
+
+    pthread_mutex_lock(&m_lock);
+    for (;;)
+    {
+        MCCI_REVISION_T* committed = m_marks.lookup(variable_id);
+        mark = committed ? *committed : 0;
+        if (mark >= revision || !m_error.empty()) break;
+
+        __atomic_store_n(&m_flush_wanted, true, __ATOMIC_RELAXED);
+        pthread_cond_wait(&m_progress, &m_lock);
+    }
+    __atomic_store_n(&m_flush_wanted, false, __ATOMIC_RELAXED);
+    if (mark < revision) err = m_error;
+    pthread_mutex_unlock(&m_lock);
+
+    if (!err.empty()) throw err;
+    return mark;
+}
+
+
+unsigned long CMCCIRevisionWriter::commits()
+{
+    pthread_mutex_lock(&m_lock);
+    unsigned long ret = m_commits;
+    pthread_mutex_unlock(&m_lock);
+    return ret;
+}
+
+
+void* CMCCIRevisionWriter::run(void* writer)
+{
+    ((CMCCIRevisionWriter*)writer)->loop();
+    return NULL;
+}
+
+
+void CMCCIRevisionWriter::loop()
+{
+    unsigned long long last_commit = monotonic_ms();
+    Update u;
+
+    for (;;)
+    {
+        // read before draining, so nothing queued before the stop is left behind
+        bool stopping = __atomic_load_n(&m_stopping, __ATOMIC_ACQUIRE);
+
+        while (m_taken - m_committed < m_batch && m_queue.pop(u))
+        {
+            m_pending[u.variable_id] = u.revision;
+            ++m_taken;
+        }
+
+        unsigned long long now = monotonic_ms();
+        if (!m_pending.empty() &&
+            (m_taken - m_committed >= m_batch || now - last_commit >= m_interval_ms ||
+             __atomic_load_n(&m_flush_wanted, __ATOMIC_RELAXED) || stopping))
+        {
+            bool ok = commit();
+            last_commit = now;
+
+            // a failed commit is retried after the interval, unless we're done
+            if (ok) continue;
+            if (stopping) break;
+            usleep(1000 * (m_interval_ms ? m_interval_ms : 1));
+            continue;
+        }
+        else if (stopping && m_queue.empty())
+        {
+            break;
+        }
+
+        if (m_queue.empty()) usleep(1000);
+    }
+}
+
+
+bool CMCCIRevisionWriter::commit()
+{
+    string err;
+
+    if (SQLITE_OK != sqlite3_exec(m_db, "begin", NULL, NULL, NULL))
+    {
+        err = string("Error in revision writer begin: ") + string(sqlite3_errmsg(m_db));
+    }
+    else
+    {
+        FlatHash<MCCI_VARIABLE_T, MCCI_REVISION_T>::iterator it;
+        for (it = m_pending.begin(); it != m_pending.end() && err.empty(); ++it)
+        {
+            sqlite3_bind_int(m_update, 1, it->second);
+            sqlite3_bind_int(m_update, 2, it->first);
+            sqlite3_bind_int(m_update, 3, m_signature_id);
+            if (SQLITE_DONE != sqlite3_step(m_update))
+                err = string("Error in revision writer update: ") + string(sqlite3_errmsg(m_db));
+            sqlite3_clear_bindings(m_update);
+            sqlite3_reset(m_update);
+        }
+
+        if (err.empty() && SQLITE_OK != sqlite3_exec(m_db, "commit", NULL, NULL, NULL))
+            err = string("Error in revision writer commit: ") + string(sqlite3_errmsg(m_db));
+        if (!err.empty()) sqlite3_exec(m_db, "rollback", NULL, NULL, NULL);
+    }
+
+    pthread_mutex_lock(&m_lock);
+    m_error = err;
+    if (err.empty())
+    {
+        m_committed = m_taken;
+        ++m_commits;
+
+        FlatHash<MCCI_VARIABLE_T, MCCI_REVISION_T>::iterator it;
+        for (it = m_pending.begin(); it != m_pending.end(); ++it) m_marks[it->first] = it->second;
+    }
+    pthread_cond_broadcast(&m_progress);
+    pthread_mutex_unlock(&m_lock);
+
+    // on an error the pending revisions stay, for the next try
+    if (err.empty()) m_pending.clear();
+    return err.empty();
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "SPSCQueue.h"
+#include "FlatHash.h"
+#include "MCCITypes.h"
+#include <string>
+#include <sqlite3.h>
+#include <pthread.h>
+
+using namespace std;
+
+
+/**
+   Writes revisions to the revision DB on a thread of its own, so the thread
+   handing them out never waits on sqlite3_step.
+
+   The revision set's thread (the only producer) puts (variable, revision)
+   updates on a lock-free queue; if the queue is full it yields until there's
+   room.  The writer thread takes them off, keeping only the latest revision of
+   each variable, and writes those in one transaction once a batch of updates
+   has come in, once the interval has passed since the last commit, or when a
+   flush is waiting.  Updates from one producer come in order, so the latest is
+   the one to keep and the DB only moves the way the revision set moved it.
+
+   The writer has its own connection to the DB file, in WAL mode, so its
+   transactions don't block readers on the revision set's connection.
+
+   flush() is the barrier: it returns once everything written before it has
+   been committed, or throws the writer's error if a commit failed.  The
+   revision committed for each variable is kept too, and wait_for() waits only
+   until one variable's has caught up, hurrying the writer along meanwhile.
+   The destructor commits whatever is left and stops the thread.
+ */
+class CMCCIRevisionWriter
+{
+  protected:
+
+    typedef struct
+    {
+        MCCI_VARIABLE_T variable_id;
+        MCCI_REVISION_T revision;
+    } Update;
+
+    SPSCQueue<Update> m_queue;
+    FlatHash<MCCI_VARIABLE_T, MCCI_REVISION_T> m_pending; // writer thread: latest revision by variable
+    FlatHash<MCCI_VARIABLE_T, MCCI_REVISION_T> m_marks;   // committed revision by variable (under m_lock)
+
+    sqlite3* m_db;
+    sqlite3_stmt* m_update;
+    long m_signature_id;
+
+    unsigned int m_interval_ms;  // longest an update waits to be committed
+    unsigned int m_batch;        // updates that make a commit happen sooner
+
+    pthread_t m_thread;
+    pthread_mutex_t m_lock;
+    pthread_cond_t m_progress;   // signalled after each commit attempt
+
+    unsigned long m_pushed;      // producer: updates written
+    unsigned long m_taken;       // writer thread: updates taken off the queue
+    unsigned long m_committed;   // updates committed (under m_lock)
+    unsigned long m_commits;     // transactions (under m_lock)
+    string m_error;              // from the last failed commit (under m_lock)
+
+    bool m_flush_wanted;         // atomic: read by the writer thread as a hint
+    bool m_stopping;             // atomic
+
+    // the thread and connection are ours alone; copying them makes no sense
+    CMCCIRevisionWriter(const CMCCIRevisionWriter &rhs);
+    CMCCIRevisionWriter& operator=(const CMCCIRevisionWriter &rhs);
+
+  public:
+    CMCCIRevisionWriter(const char* filename, long signature_id,
+                        unsigned int interval_ms, unsigned int batch,
+                        unsigned long queue_size = 4096);
+    ~CMCCIRevisionWriter();
+
+    // producer: queue a variable's revision for the DB
+    void write(MCCI_VARIABLE_T variable_id, MCCI_REVISION_T revision);
+
+    // producer: wait until everything written so far is committed
+    void flush();
+
+    // producer: wait until the revision committed for a variable is at least the
+    //  given one (which has to have been written), returning it
+    MCCI_REVISION_T wait_for(MCCI_VARIABLE_T variable_id, MCCI_REVISION_T revision);
+
+    // transactions committed so far
+    unsigned long commits();
+
+  protected:
+    static void* run(void* writer);
+
+    // the writer thread's loop, until stopped with nothing left to write
+    void loop();
+
+    // write the pending revisions in one transaction; returns false on error
+    bool commit();
+};
@@ -14,6 +14,7 @@ void CMCCISchema::load(sqlite3* schema_db)
     m_ordinality.resize_nearest_prime(cardinality);
     m_name.resize(cardinality);
     m_variable.resize(cardinality);
+    m_history.resize(cardinality);
 
     // variables for calculating hash value
     unsigned char md[SHA_DIGEST_LENGTH];    
@@ -34,10 +35,17 @@ void CMCCISchema::load(sqlite3* schema_db)
     long var_unit;
     
     result = sqlite3_prepare_v2(schema_db,
-                                "select var_id, name, protobuf_id, unit "
+                                "select var_id, name, protobuf_id, unit, history "
                                 "from var where enabled <> 0",
                                 -1, &stmt, 0);
 
+    // schemas from before the history column
+    if (result)
+        result = sqlite3_prepare_v2(schema_db,
+                                    "select var_id, name, protobuf_id, unit, null "
+                                    "from var where enabled <> 0",
+                                    -1, &stmt, 0);
+
     if (result) throw string("Loading of data failed FIXME: result");
 
 
@@ -59,6 +67,7 @@ void CMCCISchema::load(sqlite3* schema_db)
         m_ordinality[var_id] = i;
         m_variable[i] = var_id;
         m_name[i] = var_name;
+        m_history[i] = SQLITE_NULL == sqlite3_column_type(stmt, 4) ? -1 : sqlite3_column_int(stmt, 4);
 
         // update hash
         datalen = snprintf(data, 512, "%d\t%s\t%ld\t%ld\n",
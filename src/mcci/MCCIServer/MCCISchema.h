@@ -2,7 +2,7 @@
 
 #include <string>
 #include <sqlite3.h>
-#include "LinearHash.h"
+#include "DenseIdMap.h"
 #include "MCCITypes.h"
 #include <vector>
 
@@ -27,9 +27,10 @@ class CMCCISchema
 
   protected:
 
-    LinearHash<MCCI_VARIABLE_T, unsigned int> m_ordinality; // ordinality - variable ot ordinal
+    DenseIdMap<MCCI_VARIABLE_T, unsigned int> m_ordinality; // ordinality - variable ot ordinal
     vector<MCCI_VARIABLE_T>                   m_variable;   // ordinal to variable
     vector<string>                            m_name;       // the name of a variable, ordinal idx
+    vector<int>                               m_history;    // revisions to keep, ordinal idx; -1 if not given
 
     string m_hashval; // the hashed contents of the schema
     
@@ -62,6 +63,14 @@ class CMCCISchema
     string name_of_variable(MCCI_VARIABLE_T variable_id)
     { return m_name.at(ordinality_of_variable(variable_id)); }
 
+    // how many past revisions of a variable the server should keep, or otherwise if
+    //  the schema doesn't say
+    unsigned int history_of_variable(MCCI_VARIABLE_T variable_id, unsigned int otherwise)
+    {
+        int history = m_history.at(ordinality_of_variable(variable_id));
+        return history < 0 ? otherwise : history;
+    }
+
                             
     static void b64_encode(unsigned char* in,
                            char* out,
@@ -1,5 +1,6 @@
 
 #include "MCCIServer.h"
+#include <algorithm>
 
 using namespace std;
 
@@ -7,21 +8,30 @@ using namespace std;
 //default constructor
 CMCCIServer::CMCCIServer(CMCCITime* time,
                          CMCCIServerNetworking* networking,
-                         SMCCIServerSettings settings) :
+                         SMCCIServerSettings settings,
+                         bool preload) :
     m_settings(settings),
     m_working_set(settings.schema->get_cardinality(), NULL),
-    m_bank_all(100, 1),
+    m_history(settings.schema, settings.history_size),
+    m_bank_all(settings.max_clients, 1),
     m_bank_host(settings.max_clients, settings.bank_size_host),
     m_bank_var(settings.max_clients, settings.bank_size_var),
     m_bank_hostvar(settings.max_clients, settings.bank_size_hostvar),
-    m_bank_remote(settings.max_clients, settings.bank_size_remote_hostvar, settings.bank_size_remote_rev),
-    m_bank_varrev(settings.max_clients, settings.bank_size_varrev_var, settings.bank_size_varrev_rev),
+    m_bank_remote(settings.max_clients, settings.bank_size_remote_hostvar),
+    m_bank_varrev(settings.max_clients, settings.bank_size_varrev_var),
+    m_routes(m_bank_all, m_bank_host, m_bank_var, m_bank_hostvar),
+    m_fanout(settings.max_clients + 1),
+    m_outbox(settings.max_clients + 1),
+    m_recipients(settings.max_clients + 1),
     m_networking(networking)
 {
 
     if (m_settings.revisionset->get_signature() != m_settings.schema->get_hash())
         throw string("RevisionSet signature does not match Schema hash");
 
+    // every variable's revision is loaded now, not on its first use in routing
+    if (preload) CMCCIServer::preload(m_settings);
+
     m_time = time;
 
     m_external_time = (NULL != m_time);
@@ -32,20 +42,29 @@ CMCCIServer::CMCCIServer(CMCCITime* time,
 
 }
 
+void CMCCIServer::preload(SMCCIServerSettings const &settings)
+{
+    vector<MCCI_VARIABLE_T> variables;
+    for (unsigned int i = 0; i < settings.schema->get_cardinality(); ++i)
+        variables.push_back(settings.schema->variable_of_ordinal(i));
+    settings.revisionset->preload(variables);
+}
+
 //copy constructor
 CMCCIServer::CMCCIServer(const CMCCIServer& rhs) :
     m_settings(rhs.m_settings),
     m_working_set(rhs.m_settings.schema->get_cardinality(), NULL),
-    m_bank_all(100, 1),
+    m_history(rhs.m_settings.schema, rhs.m_settings.history_size),
+    m_bank_all(rhs.m_settings.max_clients, 1),
     m_bank_host(rhs.m_settings.max_clients, rhs.m_settings.bank_size_host),
     m_bank_var(rhs.m_settings.max_clients, rhs.m_settings.bank_size_var),
     m_bank_hostvar(rhs.m_settings.max_clients, rhs.m_settings.bank_size_hostvar),
-    m_bank_remote(rhs.m_settings.max_clients,
-                  rhs.m_settings.bank_size_remote_hostvar,
-                  rhs.m_settings.bank_size_remote_rev),
-    m_bank_varrev(rhs.m_settings.max_clients,
-                  rhs.m_settings.bank_size_varrev_var,
-                  rhs.m_settings.bank_size_varrev_rev),
+    m_bank_remote(rhs.m_settings.max_clients, rhs.m_settings.bank_size_remote_hostvar),
+    m_bank_varrev(rhs.m_settings.max_clients, rhs.m_settings.bank_size_varrev_var),
+    m_routes(m_bank_all, m_bank_host, m_bank_var, m_bank_hostvar),
+    m_fanout(rhs.m_settings.max_clients + 1),
+    m_outbox(rhs.m_settings.max_clients + 1),
+    m_recipients(rhs.m_settings.max_clients + 1),
     m_networking(rhs.m_networking),
     m_time(rhs.m_time),
     m_external_time(rhs.m_external_time)
@@ -60,6 +79,7 @@ CMCCIServer::~CMCCIServer()
     vector<SMCCIDataPacket*>::iterator it;
     for (it = m_working_set.begin(); it!= m_working_set.end(); ++it)
     {
+        if (*it) mcci_payload_release((*it)->payload);
         delete (*it);
     }
 
@@ -83,6 +103,7 @@ ostream& operator<<(ostream& out, const SMCCIServerSettings& rhs)
         << "\n\tBank size for var/rev's rev:\t" << rhs.bank_size_varrev_rev
         << "\n\tBank size for remote's host+var:\t" << rhs.bank_size_remote_hostvar
         << "\n\tBank size for remote's rev:\t" << rhs.bank_size_remote_rev
+        << "\n\tRevisions kept per variable:\t" << rhs.history_size
         ;
 
 }
@@ -101,16 +122,12 @@ ostream& operator<<(ostream& out, const CMCCIServer& rhs)
         << "\n\t\t VarRev:  " << rhs.m_bank_varrev
                ;
 
-    LinearHash<MCCI_CLIENT_ID_T, bool> hits(100);
+    ClientBitset hits;
 
     
     out << "\n\tClients (with more than 1 open request):";
     // check promiscuous request bank for client matches
-    for (AllRequestBank::subscriber_iterator it = rhs.m_bank_all.subscribers_begin(1);
-         it != rhs.m_bank_all.subscribers_end(1); ++it)
-    {
-        hits[*it] = true;
-    }
+    rhs.m_bank_all.collect_subscribers(1, hits);
 
     // make output
     for (unsigned int i = 0; i < rhs.m_settings.max_clients; ++i)
@@ -119,12 +136,12 @@ ostream& operator<<(ostream& out, const CMCCIServer& rhs)
         int req_loc = rhs.m_settings.max_local_requests - rhs.client_free_requests_local(i);
         int req_rem = rhs.m_settings.max_remote_requests - rhs.client_free_requests_remote(i);
 
-        if (req_loc || req_rem || hits[i])
+        if (req_loc || req_rem || hits.test(i))
         {
             out << "\n\t\t" << i << ":\t"
                 << req_loc << " local requests, "
                 << req_rem << " remote requests, "
-                << (int)hits[i] << " promiscuous";
+                << (int)hits.test(i) << " promiscuous";
         }
     }
     
@@ -288,40 +305,59 @@ void CMCCIServer::process_forwardable_request(MCCI_CLIENT_ID_T requestor_id,
     }
     MCCI_REVISION_T lastrev = firstrev + limit - 1;
 
-    
-    // expand subscription range and add to various queues
-    for (MCCI_REVISION_T r = firstrev; r <= lastrev; r++)
+    // subscribe to the range, less the revisions we can deliver now
+    if (!is_for_me)
     {
-        if (!is_for_me)
-        {
-            // all remote requests are forwarded
-            subscribe_specific_remote(requestor_id,
-                                      input->timeout,
-                                      input->node_address,
-                                      input->variable_id, r);
-        }
-        else
+        // all remote requests are forwarded
+        subscribe_specific_remote(requestor_id,
+                                  input->timeout,
+                                  input->node_address,
+                                  input->variable_id,
+                                  firstrev, lastrev);
+    }
+    else if (firstrev <= lastrev)
+    {
+        // past revisions are delivered if we have them, and asked for in runs if not
+        if (firstrev <= maxrevision)
         {
-            if (maxrevision < r)
-            {
-                // don't forward requests for future revisions
-                subscribe_specific(requestor_id, input->timeout, input->variable_id, r);
-            }
-            else if (is_in_working_set(input->variable_id)
-                     && r == get_working_variable(input->variable_id)->revision)
+            MCCI_REVISION_T past = min(lastrev, maxrevision);
+            MCCI_REVISION_T run = firstrev;  // the first of the missing revisions so far
+            for (MCCI_REVISION_T r = firstrev; r <= past; r++)
             {
+                const SMCCIDataPacket* have;
+                if (is_in_working_set(input->variable_id)
+                    && r == get_working_variable(input->variable_id)->revision)
+                    have = get_working_variable(input->variable_id);
+                else
+                    have = find_past_revision(input->variable_id, r);  // still recent enough?
+
+                if (!have) continue;
+
+                if (run < r)
+                {
+                    do_forward = true;
+                    subscribe_specific(requestor_id, input->timeout, input->variable_id, run, r - 1);
+                }
+
                 // just deliver it
-                m_networking->send_data_to_client(requestor_id,
-                                                  get_working_variable(input->variable_id));
+                m_networking->send_data_to_client(requestor_id, have);
+                run = r + 1;
             }
-            else
+
+            if (run <= past)
             {
-                // if we don't have this value, must ask for it
+                // if we don't have these values, must ask for them
                 do_forward = true;
-                subscribe_specific(requestor_id, input->timeout, input->variable_id, r);
+                subscribe_specific(requestor_id, input->timeout, input->variable_id, run, past);
             }
         }
 
+        // don't forward requests for future revisions
+        if (maxrevision < lastrev)
+        {
+            subscribe_specific(requestor_id, input->timeout, input->variable_id,
+                               max(firstrev, maxrevision + 1), lastrev);
+        }
     }
 
 
@@ -386,25 +422,20 @@ void CMCCIServer::subscribe_specific_remote(MCCI_CLIENT_ID_T client_id,
                                             MCCI_TIME_T timeout,
                                             MCCI_NODE_ADDRESS_T node_address,
                                             MCCI_VARIABLE_T variable_id,
-                                            MCCI_REVISION_T revision)
+                                            MCCI_REVISION_T first,
+                                            MCCI_REVISION_T last)
 {
-    HostVarRevTuple hvr;
-    hvr.host = node_address;
-    hvr.var = variable_id;
-    hvr.rev = revision;
-    m_bank_remote.add(hvr, client_id, timeout);
+    m_bank_remote.add(remote_key(node_address, variable_id), first, last, client_id, timeout);
 }
 
 
 void CMCCIServer::subscribe_specific(MCCI_CLIENT_ID_T client_id,
                                      MCCI_TIME_T timeout,
                                      MCCI_VARIABLE_T variable_id,
-                                     MCCI_REVISION_T revision)
+                                     MCCI_REVISION_T first,
+                                     MCCI_REVISION_T last)
 {
-    VarRevPair vr;
-    vr.var = variable_id;
-    vr.rev = revision;
-    m_bank_varrev.add(vr, client_id, timeout);
+    m_bank_varrev.add(variable_id, first, last, client_id, timeout);
 }
 
 
@@ -438,10 +469,7 @@ bool CMCCIServer::bank_contains_specific(MCCI_CLIENT_ID_T client_id,
                                          MCCI_VARIABLE_T variable_id,
                                          MCCI_REVISION_T revision) const
 {
-    VarRevPair vr;
-    vr.var = variable_id;
-    vr.rev = revision;
-    return m_bank_varrev.contains(vr, client_id);
+    return m_bank_varrev.contains(variable_id, revision, client_id);
 }
 
 bool CMCCIServer::bank_contains_specific_remote(MCCI_CLIENT_ID_T client_id,
@@ -449,12 +477,7 @@ bool CMCCIServer::bank_contains_specific_remote(MCCI_CLIENT_ID_T client_id,
                                                 MCCI_VARIABLE_T variable_id,
                                                 MCCI_REVISION_T revision) const
 {
-    HostVarRevTuple hvr;
-    hvr.host = node_address;
-    hvr.var = variable_id;
-    hvr.rev = revision;
-    return m_bank_remote.contains(hvr, client_id);
-
+    return m_bank_remote.contains(remote_key(node_address, variable_id), revision, client_id);
 }
     
 
@@ -463,96 +486,212 @@ void CMCCIServer::process_production(MCCI_CLIENT_ID_T provider_id,
                                      SMCCIAcceptancePacket* output)
 {
     // hit the revisionset for the revision id
-    MCCI_REVISION_T rev = m_settings.revisionset->inc_revision(input->variable_id);
-    
-    // fill in the fields of the data and acceptance packets
-    SMCCIDataPacket* dp = new SMCCIDataPacket();
+    output->response_id = input->response_id;
+    output->revision    = m_settings.revisionset->inc_revision(input->variable_id);
+
+    publish(provider_id, input, output);
+}
+
+
+void CMCCIServer::publish(MCCI_CLIENT_ID_T provider_id,
+                          const SMCCIProductionPacket* input,
+                          const SMCCIAcceptancePacket* acceptance)
+{
+    // fill in the fields of the data packet.  the working set holds one packet per
+    //  variable, which each new revision overwrites, and a reference to its payload
+    SMCCIDataPacket* dp = get_working_variable(input->variable_id);
+    if (!dp)
+    {
+        dp = new SMCCIDataPacket();
+        set_working_variable(input->variable_id, dp);
+    }
+    mcci_payload_retain(input->payload);
+    mcci_payload_release(dp->payload);
+
     dp->node_address = m_settings.my_node_address;
     dp->variable_id  = input->variable_id;
-    dp->revision     = rev;
+    dp->revision     = acceptance->revision;
     dp->payload      = input->payload;
-
-    output->response_id = input->response_id;
-    output->revision    = rev;
-    
-    // add the packet to the working set (will free anything that was there)
-    set_working_variable(input->variable_id, dp);
+    record_revision(dp);
 
     // call process_data with the new packet
     process_data(provider_id, dp);
 
-    if (output->response_id)
+    if (acceptance->response_id)
     {
-        this->m_networking->send_production_response(provider_id, output);
+        this->m_networking->send_production_response(provider_id, acceptance);
     }
 }
 
 
+// sends one data packet to each client it is given
+struct DataSender
+{
+    CMCCIServerNetworking* networking;
+    const SMCCIDataPacket* packet;
+
+    DataSender(CMCCIServerNetworking* n, const SMCCIDataPacket* p) : networking(n), packet(p) {}
+    void operator()(MCCI_CLIENT_ID_T client_id) { networking->send_data_to_client(client_id, packet); }
+};
+
+
 void CMCCIServer::process_data(MCCI_CLIENT_ID_T provider_id, const SMCCIDataPacket* input)
 {
 
-    // create linear hash
-    LinearHash<MCCI_CLIENT_ID_T, bool> hits(100);
+    // the union of the subscribers of all request banks that match: the standing
+    //  subscriptions come from the routing cache, the revision-specific ones from their banks
+    m_fanout.merge(m_routes.subscribers(input->node_address, input->variable_id));
 
-    // check all request banks for client matches
-    for (AllRequestBank::subscriber_iterator it = m_bank_all.subscribers_begin(1);
-         it != m_bank_all.subscribers_end(1); ++it)
-    {
-        hits[*it] = true;
-    }
+    m_bank_remote.collect_subscribers(remote_key(input->node_address, input->variable_id),
+                                      input->revision, m_fanout);
+    m_bank_varrev.collect_subscribers(input->variable_id, input->revision, m_fanout);
+
+    
+    // send data to each client once, leaving the set empty for the next packet
+    DataSender send(m_networking, input);
+    m_fanout.drain(send);
+
+
+    //FIXME: send ack to provider_id?
+    enforce_fulfillment(input);
+
+}
 
-    for (HostRequestBank::subscriber_iterator it = m_bank_host.subscribers_begin(input->node_address);
-         it != m_bank_host.subscribers_end(input->node_address); ++it)
-    {
-        hits[*it] = true;
-    }
 
-    for (VariableRequestBank::subscriber_iterator it = m_bank_var.subscribers_begin(input->variable_id);
-         it != m_bank_var.subscribers_end(input->variable_id); ++it)
+// batches are routed in key order, revisions ascending
+static bool packet_key_less(const SMCCIDataPacket* a, const SMCCIDataPacket* b)
+{
+    if (a->node_address != b->node_address) return a->node_address < b->node_address;
+    if (a->variable_id != b->variable_id) return a->variable_id < b->variable_id;
+    return a->revision < b->revision;
+}
+
+
+// puts one data packet in the outbox of each client it is given
+struct OutboxFiller
+{
+    vector<vector<const SMCCIDataPacket*> >* outbox;
+    ClientBitset* recipients;
+    const SMCCIDataPacket* packet;
+
+    OutboxFiller(vector<vector<const SMCCIDataPacket*> >* o, ClientBitset* r) : outbox(o), recipients(r), packet(NULL) {}
+    void operator()(MCCI_CLIENT_ID_T client_id)
     {
-        hits[*it] = true;
+        (*outbox)[client_id].push_back(packet);
+        recipients->set(client_id);
     }
+};
 
-    HostVarPair hv;
-    hv.host = input->node_address;
-    hv.var  = input->variable_id;
-    for (HostVariableRequestBank::subscriber_iterator it = m_bank_hostvar.subscribers_begin(hv);
-         it != m_bank_hostvar.subscribers_end(hv); ++it)
+
+// sends each client it is given the contents of its outbox, emptying it
+struct OutboxSender
+{
+    vector<vector<const SMCCIDataPacket*> >* outbox;
+    CMCCIServerNetworking* networking;
+
+    OutboxSender(vector<vector<const SMCCIDataPacket*> >* o, CMCCIServerNetworking* n) : outbox(o), networking(n) {}
+    void operator()(MCCI_CLIENT_ID_T client_id)
     {
-        hits[*it] = true;
+        vector<const SMCCIDataPacket*>& packets = (*outbox)[client_id];
+        networking->send_data_batch_to_client(client_id, &packets[0], packets.size());
+        packets.clear();
     }
+};
+
+
+void CMCCIServer::process_data_batch(MCCI_CLIENT_ID_T provider_id,
+                                     const SMCCIDataPacket* input,
+                                     unsigned int count)
+{
+    m_batch_order.clear();
+    for (unsigned int i = 0; i < count; ++i) m_batch_order.push_back(&input[i]);
 
-    HostVarRevTuple hvr;
-    hvr.host = input->node_address;
-    hvr.var  = input->variable_id;
-    hvr.rev  = input->revision;
-    for (RemoteRevisionRequestBank::subscriber_iterator it = m_bank_remote.subscribers_begin(hvr);
-         it != m_bank_remote.subscribers_end(hvr); ++it)
+    route_batch();
+}
+
+
+void CMCCIServer::process_production_batch(MCCI_CLIENT_ID_T provider_id,
+                                           const SMCCIProductionPacket* input,
+                                           unsigned int count,
+                                           SMCCIAcceptancePacket* output)
+{
+    // the working set only keeps the latest packet of each variable, so the batch
+    //  keeps its own copies until they have been sent
+    m_batch_data.resize(count);
+    m_batch_order.clear();
+
+    for (unsigned int i = 0; i < count; ++i)
     {
-        hits[*it] = true;
+        MCCI_REVISION_T rev = m_settings.revisionset->inc_revision(input[i].variable_id);
+
+        SMCCIDataPacket* dp = &m_batch_data[i];
+        dp->node_address = m_settings.my_node_address;
+        dp->variable_id  = input[i].variable_id;
+        dp->revision     = rev;
+        dp->payload      = input[i].payload;
+        m_batch_order.push_back(dp);
+
+        SMCCIDataPacket* working = get_working_variable(input[i].variable_id);
+        if (!working)
+        {
+            working = new SMCCIDataPacket();
+            set_working_variable(input[i].variable_id, working);
+        }
+        mcci_payload_retain(dp->payload);
+        mcci_payload_release(working->payload);
+        *working = *dp;
+        record_revision(dp);
+
+        output[i].response_id = input[i].response_id;
+        output[i].revision    = rev;
     }
 
-    VarRevPair vr;
-    vr.var = input->variable_id;
-    vr.rev = input->revision;
-    for (VariableRevisionRequestBank::subscriber_iterator it = m_bank_varrev.subscribers_begin(vr);
-         it != m_bank_varrev.subscribers_end(vr); ++it)
+    route_batch();
+
+    for (unsigned int i = 0; i < count; ++i)
     {
-        hits[*it] = true;
+        if (output[i].response_id)
+        {
+            this->m_networking->send_production_response(provider_id, &output[i]);
+        }
     }
+}
 
-    
-    // iterate over linear hash and send data to clients
-    for (LinearHash<MCCI_CLIENT_ID_T, bool>::iterator it = hits.begin();
-         it != hits.end(); ++it)
+
+void CMCCIServer::route_batch()
+{
+    sort(m_batch_order.begin(), m_batch_order.end(), packet_key_less);
+
+    OutboxFiller fill(&m_outbox, &m_recipients);
+
+    const ClientBitset* standing = NULL;
+    for (unsigned int i = 0; i < m_batch_order.size(); ++i)
     {
-        m_networking->send_data_to_client(it->first, input);
-    }
+        const SMCCIDataPacket* p = m_batch_order[i];
 
+        // packets from the same host and variable are adjacent, and share a route
+        if (!standing
+            || p->node_address != m_batch_order[i - 1]->node_address
+            || p->variable_id != m_batch_order[i - 1]->variable_id)
+        {
+            standing = &m_routes.subscribers(p->node_address, p->variable_id);
+        }
+        m_fanout.merge(*standing);
 
-    //FIXME: send ack to provider_id?
-    enforce_fulfillment(input);
+        m_bank_remote.collect_subscribers(remote_key(p->node_address, p->variable_id),
+                                          p->revision, m_fanout);
+        m_bank_varrev.collect_subscribers(p->variable_id, p->revision, m_fanout);
+
+        fill.packet = p;
+        m_fanout.drain(fill);
+
+        // in order, as if the packets had come one at a time: a request fulfilled by
+        //  one packet doesn't get its duplicate
+        enforce_fulfillment(p);
+    }
 
+    OutboxSender send(&m_outbox, m_networking);
+    m_recipients.drain(send);
 }
 
 
@@ -579,49 +718,66 @@ unsigned int CMCCIServer::client_free_requests_remote(MCCI_CLIENT_ID_T client_id
 
 void CMCCIServer::enforce_fulfillment(const SMCCIDataPacket* delivered)
 {
+    // the revision comes out of every range that wanted it
     if (is_my_address(delivered->node_address))
     {
-        VarRevPair vr;
-        vr.var = delivered->variable_id;
-        vr.rev = delivered->revision;
-
-        if (m_bank_varrev.get_by_pq(vr)) m_bank_varrev.remove_by_key(vr);
+        m_bank_varrev.fulfill(delivered->variable_id, delivered->revision);
     }
     else
     {
-        HostVarRevTuple hvr;
-        hvr.host = delivered->node_address;
-        hvr.var = delivered->variable_id;
-        hvr.rev = delivered->revision;
-        
-        if (m_bank_remote.get_by_pq(hvr)) m_bank_remote.remove_by_key(hvr);
+        m_bank_remote.fulfill(remote_key(delivered->node_address, delivered->variable_id),
+                              delivered->revision);
     }
 }
 
 void CMCCIServer::enforce_timeouts()
 {
-    MCCI_TIME_T now = m_time->now();
+    enforce_timeouts(m_time->now());
+}
 
-    //TODO: if we have a lot of removals, defer some of them until later?
-    // in other words take only n of k removals if n < k, but for every deferal
-    // if k > last_n then take more than n.
-    
-    while (!m_bank_all.empty() && now > m_bank_all.minimum_timeout())
-        m_bank_all.remove_minimum();
+void CMCCIServer::enforce_timeouts(MCCI_TIME_T now)
+{
+    // requests expire once the time is past their timeout
+    if (0 == now) return;
+
+    m_bank_all.expire_until(now - 1);
+    m_bank_host.expire_until(now - 1);
+    m_bank_var.expire_until(now - 1);
+    m_bank_hostvar.expire_until(now - 1);
+    m_bank_remote.expire_until(now - 1);
+    m_bank_varrev.expire_until(now - 1);
+}
 
-    while (!m_bank_host.empty() && now > m_bank_host.minimum_timeout())
-        m_bank_host.remove_minimum();
+void CMCCIServer::drop_client(MCCI_CLIENT_ID_T client_id)
+{
+    m_bank_all.remove_client(client_id);
+    m_bank_host.remove_client(client_id);
+    m_bank_var.remove_client(client_id);
+    m_bank_hostvar.remove_client(client_id);
+    m_bank_remote.remove_client(client_id);
+    m_bank_varrev.remove_client(client_id);
+}
 
-    while (!m_bank_var.empty() && now > m_bank_var.minimum_timeout())
-        m_bank_var.remove_minimum();
+// the earliest timeout in one bank, folded into the earliest so far
+template <typename Bank>
+static void earliest_timeout(const Bank& bank, bool* found, MCCI_TIME_T* deadline)
+{
+    if (bank.empty()) return;
 
-    while (!m_bank_hostvar.empty() && now > m_bank_hostvar.minimum_timeout())
-        m_bank_hostvar.remove_minimum();
+    MCCI_TIME_T t = bank.minimum_timeout();
+    if (!*found || t < *deadline) *deadline = t;
+    *found = true;
+}
 
-    while (!m_bank_remote.empty() && now > m_bank_remote.minimum_timeout())
-        m_bank_remote.remove_minimum();
-    
-    while (!m_bank_varrev.empty() && now > m_bank_varrev.minimum_timeout())
-        m_bank_varrev.remove_minimum();
+bool CMCCIServer::next_timeout(MCCI_TIME_T* deadline) const
+{
+    bool found = false;
+    earliest_timeout(m_bank_all, &found, deadline);
+    earliest_timeout(m_bank_host, &found, deadline);
+    earliest_timeout(m_bank_var, &found, deadline);
+    earliest_timeout(m_bank_hostvar, &found, deadline);
+    earliest_timeout(m_bank_remote, &found, deadline);
+    earliest_timeout(m_bank_varrev, &found, deadline);
+    return found;
 }
 
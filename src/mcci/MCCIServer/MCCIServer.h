@@ -2,9 +2,13 @@
 
 #include "FibonacciHeap.h"
 #include "MCCIRequestBanks.h"
+#include "RangeRequestBank.h"
+#include "RoutingCache.h"
 #include "MCCISchema.h"
 #include "MCCIServerNetworking.h"
+#include "MCCIPacketServer.h"
 #include "MCCIRevisionSet.h"
+#include "MCCIRevisionHistory.h"
 #include "MCCITime.h"
 #include "MCCITypes.h"
 #include <map>
@@ -23,6 +27,9 @@ typedef struct
     unsigned int max_remote_requests;
     unsigned int max_clients;
 
+    // initial sizes of the request bank hash tables (they grow online).  revisions
+    //  are held as ranges per variable (or host and variable), so the _rev sizes
+    //  are no longer used
     unsigned int bank_size_host;
     unsigned int bank_size_var;
     unsigned int bank_size_hostvar;
@@ -30,6 +37,9 @@ typedef struct
     unsigned int bank_size_varrev_rev;
     unsigned int bank_size_remote_hostvar;
     unsigned int bank_size_remote_rev;
+
+    // past revisions kept per variable, where the schema doesn't say
+    unsigned int history_size;
     
     CMCCISchema* schema;
     CMCCIRevisionSet* revisionset;
@@ -42,29 +52,41 @@ ostream& operator<<(ostream &out, SMCCIServerSettings const &rhs);
 /**
    This class is the logical component of the MCCI system's packet request & delivery system.
  */
-class CMCCIServer
+class CMCCIServer : public CMCCIPacketServer
 {
     
   protected:
     SMCCIServerSettings m_settings;
     
     vector<SMCCIDataPacket*> m_working_set; // current values of stuff
+    CMCCIRevisionHistory m_history;         // and recent ones
 
     AllRequestBank              m_bank_all;
     HostRequestBank             m_bank_host;
     VariableRequestBank         m_bank_var;
     HostVariableRequestBank     m_bank_hostvar;
-    RemoteRevisionRequestBank   m_bank_remote;
-    VariableRevisionRequestBank m_bank_varrev;
+    RangeRequestBank            m_bank_remote; // by (host << 16) + var
+    RangeRequestBank            m_bank_varrev; // by var
+
+    RoutingCache m_routes; // standing subscribers by (host, variable)
+    ClientBitset m_fanout; // subscribers to the packet in process_data
+
+    // reused by the batch entry points
+    vector<SMCCIDataPacket> m_batch_data;              // packets made from a batch of productions
+    vector<const SMCCIDataPacket*> m_batch_order;      // a batch of packets, sorted by key
+    vector<vector<const SMCCIDataPacket*> > m_outbox;  // what a batch sends each client
+    ClientBitset m_recipients;                         // the clients with something in their outbox
 
     CMCCIServerNetworking* m_networking;
     CMCCITime* m_time;
     bool m_external_time;
     
   public:
-    CMCCIServer(CMCCITime* time, CMCCIServerNetworking* networking, SMCCIServerSettings settings);
+    // (a shard of a CMCCIShardedServer leaves the preloading to it)
+    CMCCIServer(CMCCITime* time, CMCCIServerNetworking* networking, SMCCIServerSettings settings,
+                bool preload = true);
     CMCCIServer(const CMCCIServer&);
-    ~CMCCIServer();
+    virtual ~CMCCIServer();
 
     // output operator
     friend ostream& operator<<(ostream &out, CMCCIServer const &rhs);
@@ -75,31 +97,59 @@ class CMCCIServer
     // number of open requests
     int request_count() const;
     
+    // load the revision of every variable in the schema into the revision set
+    static void preload(SMCCIServerSettings const &settings);
+
     // accept a request packet, and put its contents in the appropriate structures, responding accordingly
-    void process_request(MCCI_CLIENT_ID_T requestor_id,
+    virtual void process_request(MCCI_CLIENT_ID_T requestor_id,
                          const SMCCIRequestPacket* input,
                          SMCCIResponsePacket* response);
 
     // accept a data packet, giving a reference to its contents to all necessary subscriber
-    void process_data(MCCI_CLIENT_ID_T provider_id,
+    virtual void process_data(MCCI_CLIENT_ID_T provider_id,
                       const SMCCIDataPacket* input);
 
+    // accept an array of data packets: each subscriber gets everything for it in one send
+    void process_data_batch(MCCI_CLIENT_ID_T provider_id,
+                            const SMCCIDataPacket* input,
+                            unsigned int count);
+
     // accept a production packet
-    void process_production(MCCI_CLIENT_ID_T provider_id,
+    virtual void process_production(MCCI_CLIENT_ID_T provider_id,
                             const SMCCIProductionPacket* input,
                             SMCCIAcceptancePacket* output);
 
+    // accept an array of production packets, filling in an acceptance packet for each
+    void process_production_batch(MCCI_CLIENT_ID_T provider_id,
+                                  const SMCCIProductionPacket* input,
+                                  unsigned int count,
+                                  SMCCIAcceptancePacket* output);
+
     // tell the client how many requests it is allowed to make
-    unsigned int client_free_requests_local(MCCI_CLIENT_ID_T client_id) const;
+    virtual unsigned int client_free_requests_local(MCCI_CLIENT_ID_T client_id) const;
     
-    unsigned int client_free_requests_remote(MCCI_CLIENT_ID_T client_id) const;
+    virtual unsigned int client_free_requests_remote(MCCI_CLIENT_ID_T client_id) const;
 
     // remove all expired requests and update the outstanding_requests counters appropriately
-    void enforce_timeouts();
+    virtual void enforce_timeouts();
+
+    // the same, as of a given time
+    void enforce_timeouts(MCCI_TIME_T now);
+
+    // remove every request of a client, so its id can go to another
+    virtual void drop_client(MCCI_CLIENT_ID_T client_id);
+
+    // the earliest timeout of any request, if there are requests.  they expire once
+    //  the time is past it
+    virtual bool next_timeout(MCCI_TIME_T* deadline) const;
 
     // remove all requests forz a specific packet that was delivered
     void enforce_fulfillment(const SMCCIDataPacket* delivered);
     
+    // requests for past revisions answered from the history, and those that weren't
+    unsigned long history_hits() const { return m_history.hits(); }
+    unsigned long history_misses() const { return m_history.misses(); }
+
     // return the settings
     SMCCIServerSettings get_settings() const { return m_settings; }
     
@@ -131,13 +181,38 @@ class CMCCIServer
     void set_working_variable(MCCI_VARIABLE_T variable_id, SMCCIDataPacket* v)
     {
         unsigned int idx = m_settings.schema->ordinality_of_variable(variable_id);
-        if (m_working_set[idx]) delete m_working_set[idx];
+        if (m_working_set[idx])
+        {
+            mcci_payload_release(m_working_set[idx]->payload);
+            delete m_working_set[idx];
+        }
         m_working_set[idx] = v;
     }
     
+    // keep a packet we produced in the history of its variable
+    void record_revision(const SMCCIDataPacket* packet)
+    {
+        m_history.record(m_settings.schema->ordinality_of_variable(packet->variable_id), *packet);
+    }
+
+    // a past revision of one of our variables, or NULL if it's no longer kept
+    const SMCCIDataPacket* find_past_revision(MCCI_VARIABLE_T variable_id, MCCI_REVISION_T revision)
+    {
+        return m_history.find(m_settings.schema->ordinality_of_variable(variable_id), revision);
+    }
+
     // whether a request has one of the 4 possible input combinations that makes it wrong
     bool is_rejectable_request(const SMCCIRequestPacket* input) const;
 
+    // put a produced packet (whose revision is in the acceptance) in the working set,
+    //  deliver it and answer the producer
+    void publish(MCCI_CLIENT_ID_T provider_id,
+                 const SMCCIProductionPacket* input,
+                 const SMCCIAcceptancePacket* acceptance);
+
+    // route the packets in m_batch_order to the outboxes and send them
+    void route_batch();
+
     // slave to process_request, for the cases that involve forwarding
     void process_forwardable_request(MCCI_CLIENT_ID_T requestor_id,
                                      const SMCCIRequestPacket* input,
@@ -161,18 +236,24 @@ class CMCCIServer
                                MCCI_NODE_ADDRESS_T node_address,
                                MCCI_VARIABLE_T variable_id);
 
-    //add a client to the list of receipents for a specific packet from this host
+    //add a client to the list of receipents for a range of packets from this host
     void subscribe_specific(MCCI_CLIENT_ID_T client_id,
                             MCCI_TIME_T timeout,
                             MCCI_VARIABLE_T variable_id,
-                            MCCI_REVISION_T revision);
+                            MCCI_REVISION_T first,
+                            MCCI_REVISION_T last);
     
-    // add a client to the list of recipients for a specific packet from a remote host
+    // add a client to the list of recipients for a range of packets from a remote host
     void subscribe_specific_remote(MCCI_CLIENT_ID_T client_id,
                                    MCCI_TIME_T timeout,
                                    MCCI_NODE_ADDRESS_T node_address,
                                    MCCI_VARIABLE_T variable_id,
-                                   MCCI_REVISION_T revision);
+                                   MCCI_REVISION_T first,
+                                   MCCI_REVISION_T last);
+
+    // the key of a host and variable in m_bank_remote
+    static uint32_t remote_key(MCCI_NODE_ADDRESS_T node_address, MCCI_VARIABLE_T variable_id)
+    { return (node_address << 16) + variable_id; }
 
     
     // check client subscription to variable
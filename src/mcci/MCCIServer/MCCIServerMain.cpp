@@ -1,17 +1,24 @@
 
 #include "MCCIServer.h"
+#include "MCCIShardedServer.h"
+#include "MCCIServerNetworkingSocket.h"
 #include "MCCIRevisionSet.h"
+#include "MCCIRevisionStoreSQLite.h"
+#include "MCCIRevisionStoreShared.h"
 #include "MCCISchema.h"
 
 #include <string.h>
 #include <sqlite3.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
 
 using namespace std;
 
-CMCCIServer* myServer;
-CMCCIServerNetworkingFake fake_networking(cerr); // FIXME: replace with real thing
-CMCCITimeFake fake_time;
+CMCCIServer* myServer = NULL;
+CMCCIShardedServer* myShardedServer = NULL;
+CMCCIServerNetworkingSocket* networking = NULL;
+CMCCITimeReal real_time;
 
 
 sqlite3* schema_db = NULL;
@@ -25,6 +32,13 @@ void cleanup()
 }
 
 
+// SIGINT and SIGTERM end the main loop
+void stop_server(int sig)
+{
+    if (networking) networking->stop();
+}
+
+
 bool try_open_db(string file, sqlite3** db, int flags)
 {
     int result;
@@ -38,10 +52,21 @@ bool try_open_db(string file, sqlite3** db, int flags)
 }
 
 
+// usage: MCCIServer [unix socket path] [tcp port] [alone|owner|shared] [shards]
+//  with owner or shared, revisions are shared with the other server processes
+//  on the node; one of them must be the owner, which persists them.  with more
+//  than 0 shards, variables are routed on that many threads
 int main(int argc, char* argv[])
 {
+    string socket_path = argc > 1 ? argv[1] : "mcci.sock";
+    unsigned short tcp_port = argc > 2 ? atoi(argv[2]) : 7720;
+    string sharing = argc > 3 ? argv[3] : "alone";
+    unsigned int shards = argc > 4 ? atoi(argv[4]) : 0;
+
     CMCCISchema* schema = NULL;
     CMCCIRevisionSet* rs = NULL;
+    CMCCIRevisionStoreSQLite* rs_store = NULL;
+    CMCCIRevisionStoreShared* rs_shared = NULL;
     
     if (!try_open_db("db.sqlite3", &schema_db, SQLITE_OPEN_READONLY))
     {
@@ -57,16 +82,37 @@ int main(int argc, char* argv[])
     try
     {
         schema = new CMCCISchema(schema_db);
-        rs     = new CMCCIRevisionSet(rs_db, schema->get_cardinality(), schema->get_hash());
+        if ("alone" == sharing)
+        {
+            rs = new CMCCIRevisionSet(rs_db, schema->get_cardinality(), schema->get_hash());
+            rs->set_lease(1024); // one DB write per 1024 revisions of a variable
+            rs->set_write_behind(100, 256); // made on a thread of its own
+        }
+        else
+        {
+            vector<MCCI_VARIABLE_T> variables;
+            for (unsigned int i = 0; i < schema->get_cardinality(); ++i)
+                variables.push_back(schema->variable_of_ordinal(i));
+
+            // the owner's thread leases 1024 revisions of a variable per DB write
+            if ("owner" == sharing)
+                rs_store = new CMCCIRevisionStoreSQLite(rs_db, schema->get_cardinality(), schema->get_hash());
+            else if ("shared" != sharing)
+                throw string("Revisions are kept 'alone', or shared as 'owner' or 'shared', not ") + sharing;
+
+            rs_shared = new CMCCIRevisionStoreShared(schema->get_hash(), variables, rs_store);
+            rs = new CMCCIRevisionSet(rs_shared, schema->get_cardinality());
+        }
         
         // build settings struct
         SMCCIServerSettings settings;
         
-        // these should be prime numbers because they become hash table sizes
+        settings.my_node_address = 1;
         settings.max_local_requests = 101;
         settings.max_remote_requests = 199;
         settings.max_clients = 100;
 
+        // initial hash table sizes; the tables grow and shrink with the load
         settings.bank_size_host = 20;
         settings.bank_size_var = 20;
         settings.bank_size_hostvar = 30;
@@ -74,17 +120,38 @@ int main(int argc, char* argv[])
         settings.bank_size_varrev_rev = 20;
         settings.bank_size_remote_hostvar = 20;
         settings.bank_size_remote_rev = 20;
+        settings.history_size = 16;
         
         // assign other objects
         settings.schema = schema;
         settings.revisionset = rs;
 
-        
-        myServer = new CMCCIServer((CMCCITime*)&fake_time,
-                                   (CMCCIServerNetworking*)&fake_networking,
-                                   settings);
-        
-        cleanup();
+
+        networking = new CMCCIServerNetworkingSocket(settings.max_clients);
+        if (shards)
+        {
+            myShardedServer = new CMCCIShardedServer((CMCCITime*)&real_time,
+                                                     (CMCCIServerNetworking*)networking,
+                                                     settings,
+                                                     shards);
+            networking->set_server(myShardedServer);
+        }
+        else
+        {
+            myServer = new CMCCIServer((CMCCITime*)&real_time,
+                                       (CMCCIServerNetworking*)networking,
+                                       settings);
+            networking->set_server(myServer);
+        }
+
+        networking->listen_unix(socket_path);
+        tcp_port = networking->listen_tcp(tcp_port);
+        printf("\nListening on %s and 127.0.0.1:%d\n", socket_path.c_str(), tcp_port);
+
+        // MAIN SERVER LOOP
+        signal(SIGINT, stop_server);
+        signal(SIGTERM, stop_server);
+        networking->run();
     }
     catch (std::bad_alloc ba)
     {
@@ -100,9 +167,16 @@ int main(int argc, char* argv[])
     }
 
 
-    // MAIN SERVER LOOP GOES HERE
+    delete myServer;
+    delete myShardedServer;
+    delete networking;
+    networking = NULL;
+    delete rs;
+    delete rs_shared;
+    delete rs_store;
+    delete schema;
+    cleanup();
 
-    
     return 0;
     
 }
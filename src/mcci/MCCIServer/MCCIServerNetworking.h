@@ -19,6 +19,14 @@ class CMCCIServerNetworking
     // send data
     virtual void send_data_to_client(MCCI_CLIENT_ID_T client,
                                      const SMCCIDataPacket *p) = 0;
+
+    // send several data packets to one client.  unless overridden, one at a time
+    virtual void send_data_batch_to_client(MCCI_CLIENT_ID_T client,
+                                           const SMCCIDataPacket* const* p,
+                                           unsigned int count)
+    {
+        for (unsigned int i = 0; i < count; ++i) this->send_data_to_client(client, p[i]);
+    }
     
 
     // send a request to be delivered to all clients
@@ -52,6 +60,14 @@ class CMCCIServerNetworkingFake : public CMCCIServerNetworking
     {
         out() << "\nFAKENET Giving client(" << client << ") some data: " << *p;
     }    
+
+    virtual void send_data_batch_to_client(MCCI_CLIENT_ID_T client,
+                                           const SMCCIDataPacket* const* p,
+                                           unsigned int count)
+    {
+        out() << "\nFAKENET Giving client(" << client << ") " << count << " packets:";
+        for (unsigned int i = 0; i < count; ++i) out() << "\n\t" << *p[i];
+    }
     
     virtual void forward_request(MCCI_CLIENT_ID_T requestor_id,
                                  const SMCCIRequestPacket* request)
@@ -0,0 +1,756 @@
+#include "MCCIServerNetworkingSocket.h"
+
+#include <iostream>
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+using namespace std;
+
+
+CMCCIServerNetworkingSocket::CMCCIServerNetworkingSocket(unsigned int max_clients,
+                                                         unsigned int max_backlog,
+                                                         CMCCIPayloadPool* pool) :
+    CMCCIServerNetworking(),
+    m_server(NULL),
+    m_by_client(max_clients + 1, (SMCCIConnection*)NULL),
+    m_next_client(1),
+    m_pool(pool ? pool : CMCCIPayloadPool::shared()),
+    m_max_backlog(max_backlog),
+    m_timer_armed(false),
+    m_timer_deadline(0),
+    m_timer_expirations(0),
+    m_stopping(false),
+    m_threaded(false),
+    m_held(false),
+    m_out_of_fds(false)
+{
+    pthread_mutex_init(&m_lock, NULL);
+    m_loop = pthread_self();
+
+    m_epoll  = epoll_create1(EPOLL_CLOEXEC);
+    m_timer  = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    m_wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    m_spare  = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    if (m_epoll < 0 || m_timer < 0 || m_wakeup < 0 || m_spare < 0)
+    {
+        if (0 <= m_epoll) close(m_epoll);
+        if (0 <= m_timer) close(m_timer);
+        if (0 <= m_wakeup) close(m_wakeup);
+        if (0 <= m_spare) close(m_spare);
+        throw string("Couldn't set up the event loop");
+    }
+
+    watch(m_timer, EPOLLIN, true);
+    watch(m_wakeup, EPOLLIN, true);
+}
+
+
+CMCCIServerNetworkingSocket::~CMCCIServerNetworkingSocket()
+{
+    for (unsigned int i = 0; i < m_by_client.size(); ++i)
+    {
+        if (m_by_client[i]) close_client(m_by_client[i]);
+    }
+
+    for (unsigned int i = 0; i < m_listeners.size(); ++i) close(m_listeners[i]);
+    for (unsigned int i = 0; i < m_paths.size(); ++i) unlink(m_paths[i].c_str());
+
+    if (0 <= m_spare) close(m_spare);
+    close(m_wakeup);
+    close(m_timer);
+    close(m_epoll);
+    pthread_mutex_destroy(&m_lock);
+}
+
+
+void CMCCIServerNetworkingSocket::watch(int fd, unsigned int events, bool add)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+
+    if (epoll_ctl(m_epoll, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &ev))
+        throw string("Couldn't watch a socket: ") + strerror(errno);
+}
+
+
+void CMCCIServerNetworkingSocket::add_listener(int fd)
+{
+    if (listen(fd, 128))
+    {
+        close(fd);
+        throw string("Couldn't listen: ") + strerror(errno);
+    }
+
+    m_listeners.push_back(fd);
+    watch(fd, EPOLLIN, true);
+}
+
+
+void CMCCIServerNetworkingSocket::listen_unix(string path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) throw string("Socket path too long: ") + path;
+    strcpy(addr.sun_path, path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) throw string("Couldn't make a socket: ") + strerror(errno);
+
+    // a socket left by a server that didn't shut down cleanly
+    unlink(path.c_str());
+
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)))
+    {
+        close(fd);
+        throw string("Couldn't bind ") + path + ": " + strerror(errno);
+    }
+
+    m_paths.push_back(path);
+    add_listener(fd);
+}
+
+
+unsigned short CMCCIServerNetworkingSocket::listen_tcp(unsigned short port)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) throw string("Couldn't make a socket: ") + strerror(errno);
+
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    socklen_t len = sizeof(addr);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr))
+        || getsockname(fd, (struct sockaddr*)&addr, &len))
+    {
+        close(fd);
+        throw string("Couldn't bind a TCP port: ") + strerror(errno);
+    }
+
+    add_listener(fd);
+    return ntohs(addr.sin_port);
+}
+
+
+void CMCCIServerNetworkingSocket::run()
+{
+    if (!m_server) throw string("Networking has no server to run");
+    m_loop = pthread_self();
+
+    struct epoll_event events[64];
+
+    while (!__atomic_load_n(&m_stopping, __ATOMIC_ACQUIRE))
+    {
+        int n = epoll_wait(m_epoll, events, 64, -1);
+        if (n < 0)
+        {
+            if (EINTR == errno) continue;
+            throw string("epoll_wait failed: ") + strerror(errno);
+        }
+
+        hold();
+        try
+        {
+            handle_events(events, n);
+            flush_clients();
+        }
+        catch (...)
+        {
+            if (m_held) let_go();
+            throw;
+        }
+        let_go();
+
+        // ids aren't handed out again until the next round, by which time their
+        //  requests are gone
+        for (unsigned int i = 0; i < m_closed.size(); ++i) m_server->drop_client(m_closed[i]);
+        m_closed.clear();
+
+        schedule_timeouts();
+    }
+}
+
+
+void CMCCIServerNetworkingSocket::handle_events(struct epoll_event* events, int n)
+{
+    for (int i = 0; i < n; ++i)
+    {
+        int fd = events[i].data.fd;
+
+        if (fd == m_wakeup)
+        {
+            uint64_t count;
+            while (0 < read(m_wakeup, &count, sizeof(count)));
+            continue;
+        }
+
+        if (fd == m_timer)
+        {
+            uint64_t count;
+            if (0 < read(m_timer, &count, sizeof(count)))
+            {
+                ++m_timer_expirations;
+                m_timer_armed = false;
+
+                let_go();
+                m_server->enforce_timeouts();
+                hold();
+            }
+            continue;
+        }
+
+        bool listener = false;
+        for (unsigned int l = 0; l < m_listeners.size(); ++l) listener |= (fd == m_listeners[l]);
+        if (listener)
+        {
+            accept_clients(fd);
+            continue;
+        }
+
+        // a connection closed earlier in this round has no entry
+        SMCCIConnection* c = (unsigned int)fd < m_by_fd.size() ? m_by_fd[fd] : NULL;
+        if (!c || c->closing) continue;
+
+        if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) read_client(c);
+
+        if ((events[i].events & EPOLLOUT) && !c->closing && !write_client(c))
+        {
+            c->closing = true;
+            if (!c->dirty)
+            {
+                c->dirty = true;
+                m_dirty.push_back(c->client_id);
+            }
+        }
+    }
+}
+
+
+void CMCCIServerNetworkingSocket::stop()
+{
+    __atomic_store_n(&m_stopping, true, __ATOMIC_RELEASE);
+    wake();
+}
+
+
+void CMCCIServerNetworkingSocket::wake()
+{
+    uint64_t one = 1;
+    if (write(m_wakeup, &one, sizeof(one))) {}
+}
+
+
+unsigned int CMCCIServerNetworkingSocket::client_count() const
+{
+    unsigned int n = 0;
+    for (unsigned int i = 0; i < m_by_client.size(); ++i) n += (NULL != m_by_client[i]);
+    return n;
+}
+
+
+void CMCCIServerNetworkingSocket::accept_clients(int listener)
+{
+    for (;;)
+    {
+        int fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (EINTR == errno || ECONNABORTED == errno) continue;
+            if ((EMFILE == errno || ENFILE == errno) && !refuse(listener))
+            {
+                // no room even to refuse: stop listening until a client goes
+                watch(listener, 0, false);
+                m_paused.push_back(listener);
+            }
+            return; // EAGAIN, refused, or a listener set aside
+        }
+        m_out_of_fds = false;
+
+        // the next free client id, round-robin
+        MCCI_CLIENT_ID_T id = 0;
+        unsigned int max = m_by_client.size() - 1;
+        for (unsigned int tries = 0; tries < max && !id; ++tries)
+        {
+            MCCI_CLIENT_ID_T candidate = m_next_client;
+            m_next_client = (m_next_client % max) + 1;
+            if (!m_by_client[candidate]) id = candidate;
+        }
+
+        if (!id)
+        {
+            cerr << "\nRefusing a connection: all " << max << " client ids are in use";
+            close(fd);
+            continue;
+        }
+
+        // small frames go out at once (this fails harmlessly on UNIX-domain sockets)
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        SMCCIConnection* c = new SMCCIConnection();
+        c->fd = fd;
+        c->client_id = id;
+        c->out_start = 0;
+        c->payload_next = 0;
+        c->payload_start = 0;
+        c->payload_bytes = 0;
+        c->waiting = false;
+        c->dirty = false;
+        c->closing = false;
+
+        if ((unsigned int)fd >= m_by_fd.size()) m_by_fd.resize(fd + 1, NULL);
+        m_by_fd[fd] = c;
+        m_by_client[id] = c;
+
+        watch(fd, EPOLLIN, true);
+    }
+}
+
+
+bool CMCCIServerNetworkingSocket::refuse(int listener)
+{
+    if (!m_out_of_fds)
+    {
+        cerr << "\nRefusing connections: out of file descriptors";
+        m_out_of_fds = true;
+    }
+
+    // the listener stays ready until its connections are taken off it, so the
+    //  spare descriptor makes room to take them and close them
+    if (m_spare < 0) return false;
+    close(m_spare);
+
+    int fd;
+    while (0 <= (fd = accept4(listener, NULL, NULL, SOCK_CLOEXEC)) || EINTR == errno || ECONNABORTED == errno)
+    {
+        if (0 <= fd) close(fd);
+    }
+    bool drained = EAGAIN == errno || EWOULDBLOCK == errno;
+    m_spare = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    return drained;
+}
+
+
+void CMCCIServerNetworkingSocket::read_client(SMCCIConnection* c)
+{
+    char buf[65536];
+
+    // epoll will say there's more, so a busy client can't keep the others waiting
+    for (int chunks = 0; chunks < 16 && !c->closing; ++chunks)
+    {
+        ssize_t n = read(c->fd, buf, sizeof(buf));
+        if (n < 0 && EINTR == errno) continue;
+        if (n < 0 && (EAGAIN == errno || EWOULDBLOCK == errno)) break;
+
+        if (n <= 0)
+        {
+            // closed by the client, or broken
+            c->closing = true;
+            break;
+        }
+
+        c->in.append(buf, n);
+
+        // hand over each complete frame
+        unsigned int pos = 0;
+        while (!c->closing)
+        {
+            int size = mcci_wire_frame_size(c->in.data() + pos, c->in.size() - pos);
+            if (size < 0) c->closing = true;
+            if (size <= 0) break;
+
+            handle_frame(c, c->in.data() + pos, size);
+            pos += size;
+        }
+        c->in.erase(0, pos);
+    }
+
+    if (!c->dirty)
+    {
+        c->dirty = true;
+        m_dirty.push_back(c->client_id);
+    }
+}
+
+
+void CMCCIServerNetworkingSocket::handle_frame(SMCCIConnection* c, const char* frame, unsigned int size)
+{
+    const char* payload;
+    unsigned int payload_len;
+    bool ok = false;
+
+    // the server may send from its own threads meanwhile
+    let_go();
+    try
+    {
+        switch (mcci_wire_type(frame))
+        {
+        case MCCI_FRAME_REQUEST:
+        {
+            SMCCIRequestPacket request;
+            SMCCIResponsePacket response;
+            if (!(ok = mcci_wire_read(frame, size, &request))) break;
+
+            m_server->process_request(c->client_id, &request, &response);
+            send_response(c->client_id, &response);
+            break;
+        }
+
+        case MCCI_FRAME_DATA:
+        {
+            SMCCIDataPacket data;
+            if (!(ok = mcci_wire_read(frame, size, &data, &payload, &payload_len))) break;
+
+            // the server takes references to whatever it keeps or sends
+            data.payload = payload_len ? CMCCIPayload::create(payload, payload_len, m_pool) : NULL;
+            try
+            {
+                m_server->process_data(c->client_id, &data);
+            }
+            catch (...)
+            {
+                mcci_payload_release(data.payload);
+                throw;
+            }
+            mcci_payload_release(data.payload);
+            break;
+        }
+
+        case MCCI_FRAME_PRODUCTION:
+        {
+            SMCCIProductionPacket production;
+            SMCCIAcceptancePacket acceptance;
+            if (!(ok = mcci_wire_read(frame, size, &production, &payload, &payload_len))) break;
+
+            production.payload = payload_len ? CMCCIPayload::create(payload, payload_len, m_pool) : NULL;
+            try
+            {
+                m_server->process_production(c->client_id, &production, &acceptance);
+            }
+            catch (...)
+            {
+                mcci_payload_release(production.payload);
+                throw;
+            }
+            mcci_payload_release(production.payload);
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+    catch (string e)
+    {
+        // the server turned the packet down; the connection is fine
+        hold();
+        cerr << "\nDropped a frame from client " << c->client_id << ": " << e;
+        return;
+    }
+    hold();
+
+    if (!ok)
+    {
+        cerr << "\nDisconnecting client " << c->client_id << ": bad frame";
+        c->closing = true;
+    }
+}
+
+
+string* CMCCIServerNetworkingSocket::outbox(MCCI_CLIENT_ID_T client)
+{
+    SMCCIConnection* c = client < m_by_client.size() ? m_by_client[client] : NULL;
+    if (!c || c->closing) return NULL;
+
+    if (!c->dirty)
+    {
+        // the loop writes out what other threads send once it wakes
+        if (m_threaded && m_dirty.empty() && !pthread_equal(m_loop, pthread_self())) wake();
+
+        c->dirty = true;
+        m_dirty.push_back(client);
+    }
+
+    if (c->out.size() - c->out_start + c->payload_bytes > m_max_backlog)
+    {
+        cerr << "\nDisconnecting client " << client << ": not keeping up";
+        c->closing = true;
+        return NULL;
+    }
+
+    return &c->out;
+}
+
+
+bool CMCCIServerNetworkingSocket::write_client(SMCCIConnection* c)
+{
+    struct iovec iov[64];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+
+    while (c->out_start < c->out.size() || c->payload_next < c->payloads.size())
+    {
+        // the rest of out, with the payloads spliced in, as far as the iovecs go
+        int count = 0;
+        unsigned int pos = c->out_start;
+        unsigned int k = c->payload_next;
+        while (count < 64)
+        {
+            unsigned int end = k < c->payloads.size() ? c->payloads[k].offset : c->out.size();
+            if (pos < end)
+            {
+                iov[count].iov_base = const_cast<char*>(c->out.data()) + pos;
+                iov[count].iov_len = end - pos;
+                ++count;
+                pos = end;
+            }
+            if (k == c->payloads.size() || count == 64) break;
+
+            unsigned int skip = k == c->payload_next ? c->payload_start : 0;
+            CMCCIPayload* payload = c->payloads[k].payload;
+            iov[count].iov_base = const_cast<char*>(payload->data()) + skip;
+            iov[count].iov_len = payload->length() - skip;
+            ++count;
+            ++k;
+        }
+        msg.msg_iovlen = count;
+
+        ssize_t n = sendmsg(c->fd, &msg, MSG_NOSIGNAL);
+        if (0 < n)
+        {
+            written(c, n);
+            continue;
+        }
+        if (n < 0 && EINTR == errno) continue;
+        if (n < 0 && (EAGAIN == errno || EWOULDBLOCK == errno))
+        {
+            compact(c);
+            if (!c->waiting) watch(c->fd, EPOLLIN | EPOLLOUT, false);
+            c->waiting = true;
+            return true;
+        }
+        return false;
+    }
+
+    c->out.clear();
+    c->out_start = 0;
+    c->payloads.clear();
+    c->payload_next = 0;
+
+    if (c->waiting) watch(c->fd, EPOLLIN, false);
+    c->waiting = false;
+    return true;
+}
+
+
+void CMCCIServerNetworkingSocket::written(SMCCIConnection* c, unsigned int n)
+{
+    while (n)
+    {
+        unsigned int k = c->payload_next;
+        if (k < c->payloads.size() && c->out_start == c->payloads[k].offset)
+        {
+            // into the next payload
+            CMCCIPayload* payload = c->payloads[k].payload;
+            unsigned int m = min(n, payload->length() - c->payload_start);
+            c->payload_start += m;
+            c->payload_bytes -= m;
+            n -= m;
+
+            if (c->payload_start == payload->length())
+            {
+                payload->release();
+                c->payload_next++;
+                c->payload_start = 0;
+            }
+        }
+        else
+        {
+            // up to the next payload, or the end
+            unsigned int end = k < c->payloads.size() ? c->payloads[k].offset : c->out.size();
+            unsigned int m = min(n, end - c->out_start);
+            c->out_start += m;
+            n -= m;
+        }
+    }
+}
+
+
+void CMCCIServerNetworkingSocket::compact(SMCCIConnection* c)
+{
+    // a client that's never all caught up would otherwise keep everything it was sent
+    if (c->out_start > c->out.size() / 2)
+    {
+        c->out.erase(0, c->out_start);
+        for (unsigned int k = c->payload_next; k < c->payloads.size(); ++k)
+        {
+            c->payloads[k].offset -= c->out_start;
+        }
+        c->out_start = 0;
+    }
+
+    if (c->payload_next > c->payloads.size() / 2)
+    {
+        c->payloads.erase(c->payloads.begin(), c->payloads.begin() + c->payload_next);
+        c->payload_next = 0;
+    }
+}
+
+
+void CMCCIServerNetworkingSocket::close_client(SMCCIConnection* c)
+{
+    for (unsigned int k = c->payload_next; k < c->payloads.size(); ++k) c->payloads[k].payload->release();
+
+    close(c->fd);  // which also takes it out of epoll
+    m_by_fd[c->fd] = NULL;
+    m_by_client[c->client_id] = NULL;
+    m_closed.push_back(c->client_id);
+    delete c;
+
+    // that's a descriptor free for a listener set aside for want of one
+    for (unsigned int i = 0; i < m_paused.size(); ++i) watch(m_paused[i], EPOLLIN, false);
+    m_paused.clear();
+}
+
+
+void CMCCIServerNetworkingSocket::flush_clients()
+{
+    for (unsigned int i = 0; i < m_dirty.size(); ++i)
+    {
+        SMCCIConnection* c = m_by_client[m_dirty[i]];
+        if (!c || !c->dirty) continue;
+        c->dirty = false;
+
+        // a blocked client is written to when epoll says it can take more
+        if (!c->closing && (c->waiting || write_client(c))) continue;
+        close_client(c);
+    }
+
+    m_dirty.clear();
+}
+
+
+void CMCCIServerNetworkingSocket::schedule_timeouts()
+{
+    MCCI_TIME_T deadline;
+    struct itimerspec when;
+    memset(&when, 0, sizeof(when));
+
+    if (!m_server->next_timeout(&deadline))
+    {
+        if (m_timer_armed) timerfd_settime(m_timer, TFD_TIMER_ABSTIME, &when, NULL);
+        m_timer_armed = false;
+        return;
+    }
+
+    if (m_timer_armed && deadline == m_timer_deadline) return;
+
+    // requests expire once the time is past their timeout
+    when.it_value.tv_sec = (time_t)deadline + 1;
+    if (timerfd_settime(m_timer, TFD_TIMER_ABSTIME, &when, NULL))
+        throw string("Couldn't set the timeout timer: ") + strerror(errno);
+
+    m_timer_armed = true;
+    m_timer_deadline = deadline;
+}
+
+
+void CMCCIServerNetworkingSocket::send_response(MCCI_CLIENT_ID_T client,
+                                                const SMCCIResponsePacket* p)
+{
+    lock();
+    string* out = outbox(client);
+    if (out) mcci_wire_append(*out, *p);
+    unlock();
+}
+
+
+void CMCCIServerNetworkingSocket::send_production_response(MCCI_CLIENT_ID_T client,
+                                                           const SMCCIAcceptancePacket* p)
+{
+    lock();
+    string* out = outbox(client);
+    if (out) mcci_wire_append(*out, *p);
+    unlock();
+}
+
+
+void CMCCIServerNetworkingSocket::send_data_to_client(MCCI_CLIENT_ID_T client,
+                                                      const SMCCIDataPacket* p)
+{
+    lock();
+    append_data(client, p);
+    unlock();
+}
+
+
+void CMCCIServerNetworkingSocket::send_data_batch_to_client(MCCI_CLIENT_ID_T client,
+                                                            const SMCCIDataPacket* const* p,
+                                                            unsigned int count)
+{
+    lock();
+    for (unsigned int i = 0; i < count; ++i) append_data(client, p[i]);
+    unlock();
+}
+
+
+void CMCCIServerNetworkingSocket::append_data(MCCI_CLIENT_ID_T client, const SMCCIDataPacket* p)
+{
+    string* out = outbox(client);
+    if (!out) return;
+
+    if (!p->payload || p->payload->length() < MCCI_INLINE_PAYLOAD)
+    {
+        mcci_wire_append(*out, *p);
+        return;
+    }
+
+    // the payload is written from its own buffer, after the header
+    SMCCIConnection* c = m_by_client[client];
+    mcci_wire_append_header(*out, *p);
+
+    SMCCIOutPayload next;
+    next.offset = out->size();
+    next.payload = p->payload;
+    next.payload->retain();
+    c->payloads.push_back(next);
+    c->payload_bytes += next.payload->length();
+}
+
+
+void CMCCIServerNetworkingSocket::forward_request(MCCI_CLIENT_ID_T requestor_id,
+                                                  const SMCCIRequestPacket* request)
+{
+    lock();
+    for (unsigned int i = 1; i < m_by_client.size(); ++i)
+    {
+        if (i == requestor_id || !m_by_client[i]) continue;
+
+        string* out = outbox(i);
+        if (out) mcci_wire_append(*out, *request);
+    }
+    unlock();
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+#include "MCCIServerNetworking.h"
+#include "MCCIPacketServer.h"
+#include "MCCIPayload.h"
+#include "MCCIWire.h"
+#include "MCCITypes.h"
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <sys/epoll.h>
+
+using namespace std;
+
+
+// payloads shorter than this are copied into the output buffer
+#define MCCI_INLINE_PAYLOAD 256
+
+
+// a payload to be written from its own buffer, once out has been written up to offset
+typedef struct
+{
+    unsigned int offset;
+    CMCCIPayload* payload;  // a reference, given up once it's written
+
+} SMCCIOutPayload;
+
+
+// one client connection and its buffered I/O
+typedef struct
+{
+    int fd;
+    MCCI_CLIENT_ID_T client_id;
+
+    string in;              // bytes read but not yet made into frames
+    string out;             // frames not yet written, less the payloads
+    unsigned int out_start; // how much of out has been written
+
+    vector<SMCCIOutPayload> payloads; // the payloads that go between the frames in out
+    unsigned int payload_next;        // how many of them have been written
+    unsigned int payload_start;       // how much of the next one has been written
+    unsigned int payload_bytes;       // the length of those still to write
+
+    bool waiting;           // out is blocked and we're waiting for EPOLLOUT
+    bool dirty;             // out has something to write this time round
+    bool closing;           // drop the connection once this round is done
+
+} SMCCIConnection;
+
+
+/**
+   Networking over sockets: clients connect over a UNIX-domain socket or over TCP
+   on the loopback interface, and exchange frames as laid out in MCCIWire.h.
+
+   run() is the server's main loop.  It waits on epoll for connections, frames
+   and a timerfd, and hands each frame to the server as it arrives.  Everything
+   the server sends during a round of events is buffered per client and written
+   once the round is over, so a burst of packets to one client goes out in few
+   writes.  A client that doesn't keep up (more than max_backlog bytes waiting)
+   is disconnected.
+
+   Data frames don't copy their payloads: the frame header goes into the buffer
+   and the client takes a reference to the payload, which is written from where
+   it is with sendmsg and released once it's out.  One payload produced for many
+   subscribers is thus one buffer however many clients are still sending it.
+   Payloads shorter than MCCI_INLINE_PAYLOAD are copied, as that's cheaper than
+   an extra piece to write.
+
+   The timer is set for the earliest request timeout, so enforce_timeouts runs
+   when something is due to expire rather than on a fixed poll.
+
+   A server that sends from threads of its own (a CMCCIShardedServer) makes the
+   connections shared: the loop then holds a lock on them while it handles a
+   round of events, letting it go whenever it calls into the server, and every
+   send takes it.  A send from another thread wakes the loop to write it out.
+
+   Each connection gets a client id, handed out round-robin from 1 to
+   max_clients.  Connections are refused once the ids or the process's file
+   descriptors run out; for the latter a spare descriptor is closed to take
+   the connections off the listener, which would otherwise stay ready, or if
+   even that fails the listener is left out of epoll until a client goes.
+   Once a connection closes, the server drops its requests (at the end of
+   that round, outside the lock) before the id can go to a new one.
+ */
+class CMCCIServerNetworkingSocket : public CMCCIServerNetworking
+{
+  protected:
+    CMCCIPacketServer* m_server;
+
+    int m_epoll;
+    int m_timer;
+    int m_wakeup;            // an eventfd, for stop() and sends from other threads
+    vector<int> m_listeners;
+    vector<string> m_paths;                // UNIX-domain sockets to remove when done
+
+    vector<SMCCIConnection*> m_by_fd;
+    vector<SMCCIConnection*> m_by_client;  // indexed by client id
+    MCCI_CLIENT_ID_T m_next_client;
+
+    vector<MCCI_CLIENT_ID_T> m_dirty;      // the clients with something to write
+    vector<MCCI_CLIENT_ID_T> m_closed;     // the clients whose requests are to be dropped
+    CMCCIPayloadPool* m_pool;              // for the payloads that clients send
+
+    unsigned int m_max_backlog;
+    bool m_timer_armed;
+    MCCI_TIME_T m_timer_deadline;
+    unsigned long m_timer_expirations;
+    bool m_stopping;         // atomic: set by stop(), from any thread
+
+    bool m_threaded;         // the server sends from other threads
+    pthread_mutex_t m_lock;  // the connections and their buffers, if so
+    pthread_t m_loop;        // the thread in run()
+    bool m_held;             // whether the loop holds the lock
+
+    int m_spare;             // a descriptor kept to close when there are none left
+    bool m_out_of_fds;       // refusing connections for want of descriptors (logged once)
+    vector<int> m_paused;    // listeners out of epoll until a descriptor is free
+
+    // a socket server can't be copied
+    CMCCIServerNetworkingSocket(const CMCCIServerNetworkingSocket&);
+    CMCCIServerNetworkingSocket& operator=(const CMCCIServerNetworkingSocket&);
+
+    // the lock, taken by sends and by the loop (which also notes that it's held)
+    void lock()    { if (m_threaded) pthread_mutex_lock(&m_lock); }
+    void unlock()  { if (m_threaded) pthread_mutex_unlock(&m_lock); }
+    void hold()    { lock(); m_held = true; }
+    void let_go()  { m_held = false; unlock(); }
+
+    // have the loop write out the clients marked dirty
+    void wake();
+
+    void watch(int fd, unsigned int events, bool add);
+    void add_listener(int fd);
+
+    void handle_events(struct epoll_event* events, int n);
+    void accept_clients(int listener);
+    bool refuse(int listener);  // close the listener's pending connections; false if it can't
+    void read_client(SMCCIConnection* c);
+    void handle_frame(SMCCIConnection* c, const char* frame, unsigned int size);
+    bool write_client(SMCCIConnection* c);
+    void written(SMCCIConnection* c, unsigned int n);
+    void compact(SMCCIConnection* c);  // let go of what's been written, once it's half
+    void close_client(SMCCIConnection* c);
+    void flush_clients();
+    void schedule_timeouts();
+
+    // the buffer to write frames to a client into, or NULL if it's gone.  with the
+    //  lock held
+    string* outbox(MCCI_CLIENT_ID_T client);
+
+    // put a data frame in a client's buffer, with the lock held
+    void append_data(MCCI_CLIENT_ID_T client, const SMCCIDataPacket* p);
+
+    void send_response(MCCI_CLIENT_ID_T client, const SMCCIResponsePacket* p);
+
+  public:
+    CMCCIServerNetworkingSocket(unsigned int max_clients,
+                                unsigned int max_backlog = 4 << 20,
+                                CMCCIPayloadPool* pool = NULL);
+    virtual ~CMCCIServerNetworkingSocket();
+
+    // the server that frames are handed to (it has to be made with this networking).
+    //  set it before run()
+    void set_server(CMCCIPacketServer* server)
+    {
+        m_server = server;
+        m_threaded = server && server->sends_from_threads();
+    }
+
+    // accept clients on a UNIX-domain socket
+    void listen_unix(string path);
+
+    // accept clients on a loopback TCP port (0 for any); returns the port
+    unsigned short listen_tcp(unsigned short port);
+
+    // handle events until stop() is called.  stop may be called from another thread
+    //  or a signal handler
+    void run();
+    void stop();
+
+    // the number of connected clients, and of timer expirations so far
+    unsigned int client_count() const;
+    unsigned long timer_expirations() const { return m_timer_expirations; }
+
+
+    virtual void send_production_response(MCCI_CLIENT_ID_T client,
+                                          const SMCCIAcceptancePacket* p);
+
+    virtual void send_data_to_client(MCCI_CLIENT_ID_T client,
+                                     const SMCCIDataPacket* p);
+
+    // under one lock
+    virtual void send_data_batch_to_client(MCCI_CLIENT_ID_T client,
+                                           const SMCCIDataPacket* const* p,
+                                           unsigned int count);
+
+    // goes to every client but the requestor
+    virtual void forward_request(MCCI_CLIENT_ID_T requestor_id,
+                                 const SMCCIRequestPacket* request);
+};
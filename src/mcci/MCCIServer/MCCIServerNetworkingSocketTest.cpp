@@ -0,0 +1,522 @@
+#include "MCCIServerNetworkingSocket.h"
+#include "MCCIServer.h"
+#include "MCCIShardedServer.h"
+#include "MCCIRevisionSet.h"
+#include "MCCISchema.h"
+#include "MCCIWire.h"
+#include "MCCIBenchmark.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sqlite3.h>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <assert.h>
+
+using namespace std;
+
+/**
+   Runs the socket event loop on a thread and drives it with local clients: one
+   subscriber on the UNIX-domain socket and one producer over TCP.  Checks that
+   frames arrive intact (large payloads too, which are written from the payload's
+   own buffer) and that requests are expired by the timer, and reports
+   throughput (pipelined productions) and latency (one production at a time, from
+   the producer's send to the subscriber's receipt).  Then does the pipelined run
+   again with a sharded server, whose shards send from their own threads, and
+   checks that a server out of file descriptors refuses connections instead of
+   spinning on them, and takes them again once descriptors are free.
+ */
+
+
+static const char* SOCKET_PATH = "mcci-test.sock";
+
+
+// a blocking client connection
+class CTestClient
+{
+  protected:
+    int m_fd;
+    string m_in;
+
+  public:
+    CTestClient(int fd) : m_fd(fd) {}
+    ~CTestClient() { close(this->m_fd); }
+
+    static CTestClient* connect_unix(const char* path)
+    {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, path);
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (connect(fd, (struct sockaddr*)&addr, sizeof(addr))) throw string("Couldn't connect to ") + path;
+        return new CTestClient(fd);
+    }
+
+    static CTestClient* connect_tcp(unsigned short port)
+    {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        if (connect(fd, (struct sockaddr*)&addr, sizeof(addr))) throw string("Couldn't connect over TCP");
+        return new CTestClient(fd);
+    }
+
+    void send_all(const string& frames)
+    {
+        unsigned int done = 0;
+        while (done < frames.size())
+        {
+            ssize_t n = write(this->m_fd, frames.data() + done, frames.size() - done);
+            if (n <= 0) throw string("Couldn't write to the server");
+            done += n;
+        }
+    }
+
+    // the next frame, or false if none comes within the timeout
+    bool read_frame(string& frame, int timeout_ms)
+    {
+        for (;;)
+        {
+            int size = mcci_wire_frame_size(this->m_in.data(), this->m_in.size());
+            assert(0 <= size);
+            if (size)
+            {
+                frame.assign(this->m_in, 0, size);
+                this->m_in.erase(0, size);
+                return true;
+            }
+
+            struct pollfd p;
+            p.fd = this->m_fd;
+            p.events = POLLIN;
+            if (1 != poll(&p, 1, timeout_ms)) return false;
+
+            char buf[65536];
+            ssize_t n = read(this->m_fd, buf, sizeof(buf));
+            if (n <= 0) return false;
+            this->m_in.append(buf, n);
+        }
+    }
+
+    // whether the server closes the connection within the timeout
+    bool closed(int timeout_ms)
+    {
+        struct pollfd p;
+        p.fd = this->m_fd;
+        p.events = POLLIN;
+        if (1 != poll(&p, 1, timeout_ms)) return false;
+
+        char buf[1];
+        return 0 == read(this->m_fd, buf, sizeof(buf));
+    }
+};
+
+
+CMCCIServerNetworkingSocket* networking = NULL;
+
+void* run_loop(void* arg)
+{
+    try
+    {
+        networking->run();
+    }
+    catch (string e)
+    {
+        cerr << "\nEvent loop failed: " << e;
+        abort();
+    }
+    return NULL;
+}
+
+
+// the payload belongs to the caller
+SMCCIProductionPacket production_of(MCCI_VARIABLE_T var, unsigned int response_id, string& payload)
+{
+    stringstream s;
+    s << "payload " << response_id;
+    payload = s.str();
+
+    SMCCIProductionPacket p;
+    p.variable_id = var;
+    p.response_id = response_id;
+    p.payload = CMCCIPayload::create(payload.data(), payload.size());
+    return p;
+}
+
+
+// read a data frame and check it carries the payload of a production
+void expect_data(CTestClient* client, unsigned int response_id)
+{
+    string frame, payload;
+    mcci_payload_release(production_of(1, response_id, payload).payload);
+
+    assert(client->read_frame(frame, 5000));
+    assert(MCCI_FRAME_DATA == mcci_wire_type(frame.data()));
+
+    SMCCIDataPacket data;
+    const char* bytes;
+    unsigned int len;
+    assert(mcci_wire_read(frame.data(), frame.size(), &data, &bytes, &len));
+    assert(1 == data.variable_id);
+    assert(payload == string(bytes, len));
+}
+
+
+// productions of two variables, routed by two shards: every frame arrives, in order
+//  per variable
+void test_sharded(SMCCIServerSettings settings, CMCCITimeReal& real_time)
+{
+    networking = new CMCCIServerNetworkingSocket(settings.max_clients);
+    CMCCIShardedServer* server = new CMCCIShardedServer((CMCCITime*)&real_time, networking, settings, 2);
+    networking->set_server(server);
+    networking->listen_unix(SOCKET_PATH);
+
+    pthread_t loop;
+    pthread_create(&loop, NULL, run_loop, NULL);
+
+    CTestClient* subscriber = CTestClient::connect_unix(SOCKET_PATH);
+    CTestClient* producer = CTestClient::connect_unix(SOCKET_PATH);
+
+    string frame, frames, payload;
+
+    cerr << "\nSubscribing to everything, with 2 shards";
+    SMCCIRequestPacket request;
+    request.timeout = real_time.now() + 60;
+    request.node_address = MCCI_HOST_ANY;
+    request.variable_id = 0;
+    request.revision = 0;
+    request.quantity = 1;
+    mcci_wire_append(frames, request);
+    subscriber->send_all(frames);
+
+    SMCCIResponsePacket response;
+    assert(subscriber->read_frame(frame, 5000));
+    assert(mcci_wire_read(frame.data(), frame.size(), &response));
+    assert(response.accepted);
+
+    const unsigned int N = 20000;
+    CMCCIStopwatch sw;
+    frames.clear();
+    for (unsigned int i = 1; i <= N; ++i)
+    {
+        SMCCIProductionPacket p = production_of(1 + i % 2, i, payload);
+        mcci_wire_append(frames, p);
+        mcci_payload_release(p.payload);
+    }
+    producer->send_all(frames);
+
+    // the acceptances come from the shards, so the two variables interleave
+    unsigned int accepted = 0;
+    while (accepted < N)
+    {
+        SMCCIAcceptancePacket acceptance;
+        assert(producer->read_frame(frame, 5000));
+        assert(mcci_wire_read(frame.data(), frame.size(), &acceptance));
+        ++accepted;
+    }
+
+    unsigned int last[3] = {0, 0, 0};
+    for (unsigned int i = 1; i <= N; ++i)
+    {
+        SMCCIDataPacket data;
+        const char* bytes;
+        unsigned int len;
+        assert(subscriber->read_frame(frame, 5000));
+        assert(mcci_wire_read(frame.data(), frame.size(), &data, &bytes, &len));
+
+        unsigned int response_id = atoi(string(bytes, len).substr(8).c_str());
+        assert(data.variable_id == 1 + response_id % 2);
+        assert(last[data.variable_id] < response_id);
+        last[data.variable_id] = response_id;
+    }
+    benchmark_report("socket productions, pipelined", "2 shards, unix", N, sw.elapsed_ns());
+
+    // the subscription has a minute to go, but goes with its connection
+    cerr << "\nDisconnecting the subscriber";
+    delete subscriber;
+    delete producer;
+    usleep(200000);
+
+    networking->stop();
+    pthread_join(loop, NULL);
+    assert(0 == server->request_count());
+
+    delete server;
+    delete networking;
+    networking = NULL;
+}
+
+
+// a connection made while the process has no descriptors left is refused, and
+//  connections are taken again once there are
+void test_out_of_fds(SMCCIServerSettings settings, CMCCITimeReal& real_time)
+{
+    networking = new CMCCIServerNetworkingSocket(settings.max_clients);
+    CMCCIServer* server = new CMCCIServer((CMCCITime*)&real_time, networking, settings);
+    networking->set_server(server);
+    networking->listen_unix(SOCKET_PATH);
+
+    pthread_t loop;
+    pthread_create(&loop, NULL, run_loop, NULL);
+
+    // few enough descriptors to use them all up quickly
+    struct rlimit limit, low;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    low = limit;
+    if (low.rlim_cur > 256) low.rlim_cur = 256;
+    setrlimit(RLIMIT_NOFILE, &low);
+
+    vector<int> fillers;
+    for (int fd; 0 <= (fd = dup(0)); ) fillers.push_back(fd);
+    assert(!fillers.empty());
+
+    // the client gets the last descriptor, leaving none for the server's end
+    cerr << "\nConnecting with no descriptors left";
+    close(fillers.back());
+    fillers.pop_back();
+    CTestClient* refused = CTestClient::connect_unix(SOCKET_PATH);
+    assert(refused->closed(2000));
+    delete refused;
+
+    for (unsigned int i = 0; i < fillers.size(); ++i) close(fillers[i]);
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    cerr << "\nConnecting with descriptors to spare";
+    CTestClient* client = CTestClient::connect_unix(SOCKET_PATH);
+
+    string frame, frames;
+    SMCCIRequestPacket request;
+    request.timeout = real_time.now() + 60;
+    request.node_address = MCCI_HOST_ANY;
+    request.variable_id = 1;
+    request.revision = 0;
+    request.quantity = 1;
+    mcci_wire_append(frames, request);
+    client->send_all(frames);
+
+    SMCCIResponsePacket response;
+    assert(client->read_frame(frame, 5000));
+    assert(mcci_wire_read(frame.data(), frame.size(), &response));
+    assert(response.accepted);
+    delete client;
+    usleep(200000);
+
+    networking->stop();
+    pthread_join(loop, NULL);
+
+    delete server;
+    delete networking;
+    networking = NULL;
+}
+
+
+int main(int argc, char* argv[])
+{
+    sqlite3* schema_db = NULL;
+    sqlite3* rs_db = NULL;
+
+    if (SQLITE_OK != sqlite3_open_v2("../../../db.sqlite3", &schema_db, SQLITE_OPEN_READONLY, NULL)
+        || SQLITE_OK != sqlite3_open_v2("../../../revisions.sqlite3", &rs_db, SQLITE_OPEN_READWRITE, NULL))
+    {
+        cerr << "\nCouldn't open the databases\n";
+        return 1;
+    }
+
+    CMCCISchema* schema = new CMCCISchema(schema_db);
+    CMCCIRevisionSet* rs = new CMCCIRevisionSet(rs_db, schema->get_cardinality(), schema->get_hash());
+
+    SMCCIServerSettings settings;
+    settings.my_node_address = 5;
+    settings.max_local_requests = 101;
+    settings.max_remote_requests = 199;
+    settings.max_clients = 100;
+    settings.bank_size_host = 20;
+    settings.bank_size_var = 20;
+    settings.bank_size_hostvar = 30;
+    settings.bank_size_varrev_var = 100;
+    settings.bank_size_varrev_rev = 20;
+    settings.bank_size_remote_hostvar = 20;
+    settings.bank_size_remote_rev = 20;
+    settings.history_size = 8;
+    settings.schema = schema;
+    settings.revisionset = rs;
+
+    CMCCITimeReal real_time;
+    networking = new CMCCIServerNetworkingSocket(settings.max_clients);
+    CMCCIServer* server = new CMCCIServer((CMCCITime*)&real_time, networking, settings);
+    networking->set_server(server);
+
+    networking->listen_unix(SOCKET_PATH);
+    unsigned short port = networking->listen_tcp(0);
+    cerr << "\nListening on " << SOCKET_PATH << " and port " << port;
+
+    pthread_t loop;
+    pthread_create(&loop, NULL, run_loop, NULL);
+
+    CTestClient* subscriber = CTestClient::connect_unix(SOCKET_PATH);
+    CTestClient* producer = CTestClient::connect_tcp(port);
+
+    string frame, frames, payload;
+
+    cerr << "\nSubscribing to everything for 3 seconds";
+    SMCCIRequestPacket request;
+    request.timeout = real_time.now() + 3;
+    request.node_address = MCCI_HOST_ANY;
+    request.variable_id = 0;
+    request.revision = 0;
+    request.quantity = 1;
+    mcci_wire_append(frames, request);
+    subscriber->send_all(frames);
+
+    SMCCIResponsePacket response;
+    assert(subscriber->read_frame(frame, 5000));
+    assert(MCCI_FRAME_RESPONSE == mcci_wire_type(frame.data()));
+    assert(mcci_wire_read(frame.data(), frame.size(), &response));
+    assert(response.accepted);
+
+    // throughput: every production sent at once, then the acceptances and the data
+    const unsigned int N = 20000;
+    CMCCIStopwatch sw;
+    frames.clear();
+    for (unsigned int i = 1; i <= N; ++i)
+    {
+        SMCCIProductionPacket p = production_of(1, i, payload);
+        mcci_wire_append(frames, p);
+        mcci_payload_release(p.payload);
+    }
+    producer->send_all(frames);
+
+    MCCI_REVISION_T last = 0;
+    for (unsigned int i = 1; i <= N; ++i)
+    {
+        SMCCIAcceptancePacket acceptance;
+        assert(producer->read_frame(frame, 5000));
+        assert(mcci_wire_read(frame.data(), frame.size(), &acceptance));
+        assert(i == acceptance.response_id);
+        assert(last < acceptance.revision);
+        last = acceptance.revision;
+    }
+    for (unsigned int i = 1; i <= N; ++i) expect_data(subscriber, i);
+    benchmark_report("socket productions, pipelined", "tcp -> unix", N, sw.elapsed_ns());
+
+    // latency: one at a time
+    const unsigned int M = 2000;
+    sw.start();
+    for (unsigned int i = 1; i <= M; ++i)
+    {
+        frames.clear();
+        SMCCIProductionPacket p = production_of(1, i, payload);
+        p.response_id = 0;
+        mcci_wire_append(frames, p);
+        mcci_payload_release(p.payload);
+        producer->send_all(frames);
+        expect_data(subscriber, i);
+    }
+    benchmark_report("socket production round trip", "tcp -> unix", M, sw.elapsed_ns());
+
+    cerr << "\nSending large payloads";
+    for (unsigned int i = 0; i < 8; ++i)
+    {
+        // big enough to be sent by reference, and to take several writes
+        string big(1000 + 100000 * i, 'a' + i);
+        SMCCIProductionPacket p;
+        p.variable_id = 2;
+        p.response_id = 0;
+        p.payload = CMCCIPayload::create(big.data(), big.size());
+
+        frames.clear();
+        mcci_wire_append(frames, p);
+        mcci_payload_release(p.payload);
+        producer->send_all(frames);
+
+        SMCCIDataPacket data;
+        const char* bytes;
+        unsigned int len;
+        assert(subscriber->read_frame(frame, 5000));
+        assert(mcci_wire_read(frame.data(), frame.size(), &data, &bytes, &len));
+        assert(2 == data.variable_id);
+        assert(big == string(bytes, len));
+    }
+
+    cerr << "\nSending while the subscriber isn't reading";
+    const unsigned int B = 200;
+    frames.clear();
+    for (unsigned int i = 0; i < B; ++i)
+    {
+        // small ones copied in between large ones sent by reference
+        string body(i % 2 ? 20000 : 10, 'a' + i % 26);
+        SMCCIProductionPacket p;
+        p.variable_id = 2;
+        p.response_id = 0;
+        p.payload = CMCCIPayload::create(body.data(), body.size());
+        mcci_wire_append(frames, p);
+        mcci_payload_release(p.payload);
+    }
+    producer->send_all(frames);
+    usleep(200000);
+
+    // the rest is written as the subscriber catches up, letting go of what's out
+    for (unsigned int i = 0; i < B; ++i)
+    {
+        SMCCIDataPacket data;
+        const char* bytes;
+        unsigned int len;
+        assert(subscriber->read_frame(frame, 5000));
+        assert(mcci_wire_read(frame.data(), frame.size(), &data, &bytes, &len));
+        assert(2 == data.variable_id);
+        assert(string(i % 2 ? 20000 : 10, 'a' + i % 26) == string(bytes, len));
+    }
+
+    cerr << "\nWaiting for the subscription to time out";
+    while (real_time.now() <= request.timeout) usleep(100000);
+    usleep(200000);
+
+    frames.clear();
+    SMCCIProductionPacket p = production_of(1, 0, payload);
+    mcci_wire_append(frames, p);
+    mcci_payload_release(p.payload);
+    producer->send_all(frames);
+    assert(!subscriber->read_frame(frame, 300));
+
+    delete subscriber;
+    delete producer;
+
+    networking->stop();
+    pthread_join(loop, NULL);
+
+    cerr << "\nTimer went off " << networking->timer_expirations() << " times";
+    assert(0 < networking->timer_expirations());
+    assert(0 == server->request_count());
+
+    delete server;
+    delete networking;
+
+    test_sharded(settings, real_time);
+    test_out_of_fds(settings, real_time);
+    delete rs;
+    delete schema;
+    sqlite3_close(rs_db);
+    sqlite3_close(schema_db);
+
+    cerr << "\n\n";
+    return 0;
+}
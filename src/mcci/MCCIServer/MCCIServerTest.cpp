@@ -1,16 +1,39 @@
 
 #include "MCCIServer.h"
+#include "MCCIShardedServer.h"
 #include "MCCIRevisionSet.h"
 #include "MCCISchema.h"
 #include "MCCITime.h"
 
 #include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <sqlite3.h>
 #include <iostream>
+#include <map>
+#include <vector>
+#include <new>
 #include <assert.h>
 
 using namespace std;
 
+
+// allocations through operator new are counted while this is set
+bool count_allocations = false;
+unsigned long allocations = 0;
+
+void* operator new(size_t size)
+{
+    if (count_allocations) ++allocations;
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) throw() { free(p); }
+void operator delete[](void* p) throw() { free(p); }
+
 CMCCITimeFake fake_time;
 CMCCIServerNetworkingFake fake_networking(cerr);
 
@@ -113,7 +136,7 @@ int init(bool debug)
         settings.max_remote_requests = 199;
         settings.max_clients = 100;
 
-        // these numbers will automatically be adjusted to prime numbers for the hash tables
+        // initial hash table sizes; the tables grow and shrink with the load
         settings.bank_size_host = 20;
         settings.bank_size_var = 20;
         settings.bank_size_hostvar = 30;
@@ -121,6 +144,7 @@ int init(bool debug)
         settings.bank_size_varrev_rev = 20;
         settings.bank_size_remote_hostvar = 20;
         settings.bank_size_remote_rev = 20;
+        settings.history_size = 0;  // test_sndrecv wants past revisions forwarded
         
         // assign other objects
         settings.schema = schema;
@@ -419,6 +443,526 @@ int test_sndrecv()
 
 
 
+// clients 61 to 64 ask for the next 50 revisions of a variable, from this node or host 88.
+//  the local ones start 8 back, which the history delivers at once
+void subscribe_ranges(CMCCIServer& server, MCCI_REVISION_T next_remote)
+{
+    SMCCIRequestPacket request;
+    SMCCIResponsePacket response;
+    request.timeout  = fake_time.now() + 100000;
+    request.quantity = 50;
+
+    for (MCCI_CLIENT_ID_T c = 61; c <= 64; ++c)
+    {
+        MCCI_REVISION_T latest = server.get_settings().revisionset->get_revision(1 + c % 2);
+
+        request.variable_id  = 1 + c % 2;
+        request.node_address = (c < 63) ? 0 : 88;
+        request.revision     = (c < 63) ? max(latest, (MCCI_REVISION_T)8) - 7 : next_remote;
+        server.process_request(c, &request, &response);
+        assert(response.accepted);
+    }
+}
+
+
+// once every variable has a packet in the working set, routing data doesn't allocate
+int test_routing_allocations()
+{
+    ostream quiet(NULL);
+    CMCCIServerNetworkingFake quiet_networking(quiet);
+    // past revisions are kept too, as the server keeps them outside of tests
+    SMCCIServerSettings settings = my_server->get_settings();
+    settings.history_size = 16;
+    CMCCIServer server((CMCCITime*)&fake_time, &quiet_networking, settings);
+    fake_time.set_now(12344);
+
+    SMCCIRequestPacket request;
+    SMCCIResponsePacket response;
+    request.timeout = fake_time.now() + 100000;
+    request.revision = 0;
+    request.quantity = 1;
+
+    cerr << "\nSubscribing 60 clients to everything, a host or a variable";
+    for (MCCI_CLIENT_ID_T c = 1; c <= 60; ++c)
+    {
+        request.node_address = (c % 3) ? MCCI_HOST_ANY : 0;
+        request.variable_id  = (c % 3 == 1) ? 0 : (c % 3 == 2) ? 1 + c % 2 : 0;
+        server.process_request(c, &request, &response);
+        assert(response.accepted);
+    }
+    int requests = server.request_count();
+
+    SMCCIProductionPacket production;
+    SMCCIAcceptancePacket acceptance;
+    production.payload = 0;
+    production.response_id = 0;
+
+    // warm up: the first packet of each variable goes into the working set (and a
+    //  few into the history), and the first from each host and variable makes a route
+    SMCCIDataPacket data;
+    data.node_address = 88;
+    data.payload      = 0;
+    for (MCCI_VARIABLE_T v = 1; v <= 2; ++v)
+    {
+        production.variable_id = v;
+        for (int n = 0; n < 8; ++n) server.process_production(25, &production, &acceptance);
+
+        data.variable_id = v;
+        data.revision    = 0;
+        server.process_data(37, &data);
+    }
+
+    // ranges of 50 revisions run out every 100 packets and are asked for again; the
+    //  first round is a warm-up too
+    cerr << "\nSubscribing 4 more clients to ranges of revisions, renewed as they run out";
+    for (int i = 0; i < 1100; ++i)
+    {
+        if (100 == i)
+        {
+            allocations = 0;
+            count_allocations = true;
+        }
+        if (0 == i % 100) subscribe_ranges(server, i / 2 + 1);
+
+        production.variable_id = 1 + i % 2;
+        server.process_production(25, &production, &acceptance);
+
+        data.variable_id = 1 + i % 2;
+        data.revision    = i / 2 + 1;
+        server.process_data(37, &data);
+    }
+    count_allocations = false;
+
+    cerr << "\n2000 packets routed with " << allocations << " allocations";
+    assert(0 == allocations);
+    assert(requests == server.request_count());
+
+    return 0;
+}
+
+
+// remembers what each client was sent, and in how many sends
+class CMCCIServerNetworkingRecorder : public CMCCIServerNetworkingFake
+{
+  public:
+    map<MCCI_CLIENT_ID_T, vector<SMCCIDataPacket> > received;
+    map<MCCI_CLIENT_ID_T, int> sends;
+    int forwards;
+
+    CMCCIServerNetworkingRecorder(ostream& out) : CMCCIServerNetworkingFake(out), forwards(0) {}
+
+    virtual void send_data_to_client(MCCI_CLIENT_ID_T client, const SMCCIDataPacket *p)
+    {
+        this->received[client].push_back(*p);
+        ++(this->sends[client]);
+    }
+
+    virtual void send_data_batch_to_client(MCCI_CLIENT_ID_T client,
+                                           const SMCCIDataPacket* const* p,
+                                           unsigned int count)
+    {
+        for (unsigned int i = 0; i < count; ++i) this->received[client].push_back(*p[i]);
+        ++(this->sends[client]);
+    }
+
+    virtual void forward_request(MCCI_CLIENT_ID_T requestor_id, const SMCCIRequestPacket* request)
+    {
+        ++(this->forwards);
+    }
+};
+
+
+bool has_packet(const vector<SMCCIDataPacket>& v, int i,
+                MCCI_NODE_ADDRESS_T host, MCCI_VARIABLE_T var, MCCI_REVISION_T rev)
+{
+    return i < (int)v.size()
+        && host == v[i].node_address && var == v[i].variable_id && rev == v[i].revision;
+}
+
+
+// a batch reaches each subscriber in one send, sorted by key, with the same packets
+//  it would have got one at a time
+int test_batch()
+{
+    ostream quiet(NULL);
+    CMCCIServerNetworkingRecorder net(quiet);
+    CMCCIServer server((CMCCITime*)&fake_time, &net, my_server->get_settings());
+    fake_time.set_now(12344);
+
+    SMCCIRequestPacket request;
+    SMCCIResponsePacket response;
+    request.timeout = fake_time.now() + 100000;
+    request.quantity = 1;
+
+    cerr << "\nSubscribing client 1 to everything, 2 to variable 2, 3 to host 88's "
+         << "variable 1 and 4 to revision 5 of it";
+    request.node_address = MCCI_HOST_ANY;
+    request.variable_id  = 0;
+    request.revision     = 0;
+    server.process_request(1, &request, &response);
+    request.variable_id  = 2;
+    server.process_request(2, &request, &response);
+    request.node_address = 88;
+    request.variable_id  = 1;
+    server.process_request(3, &request, &response);
+    request.revision     = 5;
+    server.process_request(4, &request, &response);
+
+    SMCCIDataPacket data[5];
+    MCCI_NODE_ADDRESS_T hosts[5] = {88, 88, 88, 77, 88};
+    MCCI_VARIABLE_T vars[5]      = { 2,  1,  1,  2,  1};
+    MCCI_REVISION_T revs[5]      = { 7,  5,  4,  1,  5};
+    for (int i = 0; i < 5; ++i)
+    {
+        data[i].node_address = hosts[i];
+        data[i].variable_id  = vars[i];
+        data[i].revision     = revs[i];
+        data[i].payload      = 0;
+    }
+
+    cerr << "\nSending a batch of 5 packets, one of them twice";
+    server.process_data_batch(37, data, 5);
+
+    for (MCCI_CLIENT_ID_T c = 1; c <= 4; ++c)
+    {
+        cerr << "\nclient " << c << " got " << net.received[c].size()
+             << " packets in " << net.sends[c] << " sends";
+        assert(1 == net.sends[c]);
+    }
+
+    vector<SMCCIDataPacket>& all = net.received[1];
+    assert(5 == all.size());
+    assert(has_packet(all, 0, 77, 2, 1));
+    assert(has_packet(all, 1, 88, 1, 4));
+    assert(has_packet(all, 2, 88, 1, 5));
+    assert(has_packet(all, 3, 88, 1, 5));
+    assert(has_packet(all, 4, 88, 2, 7));
+
+    assert(2 == net.received[2].size());
+    assert(has_packet(net.received[2], 0, 77, 2, 1));
+    assert(has_packet(net.received[2], 1, 88, 2, 7));
+
+    assert(3 == net.received[3].size());
+    assert(has_packet(net.received[3], 0, 88, 1, 4));
+
+    // the one-shot request is fulfilled by the first copy of revision 5
+    assert(1 == net.received[4].size());
+    assert(has_packet(net.received[4], 0, 88, 1, 5));
+
+    cerr << "\nProducing a batch of 3 packets, two of them for the same variable";
+    SMCCIProductionPacket production[3];
+    SMCCIAcceptancePacket acceptance[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        production[i].variable_id = (i < 2) ? 1 : 2;
+        production[i].payload     = 0;
+        production[i].response_id = 10 + i;
+    }
+
+    net.received.clear();
+    net.sends.clear();
+    server.process_production_batch(25, production, 3, acceptance);
+
+    assert(10 == acceptance[0].response_id);
+    assert(acceptance[0].revision + 1 == acceptance[1].revision);
+
+    MCCI_NODE_ADDRESS_T me = server.get_settings().my_node_address;
+    assert(1 == net.sends[1]);
+    assert(3 == net.received[1].size());
+    assert(has_packet(net.received[1], 0, me, 1, acceptance[0].revision));
+    assert(has_packet(net.received[1], 1, me, 1, acceptance[1].revision));
+    assert(has_packet(net.received[1], 2, me, 2, acceptance[2].revision));
+
+    assert(1 == net.sends[2]);
+    assert(has_packet(net.received[2], 0, me, 2, acceptance[2].revision));
+
+    return 0;
+}
+
+
+// subscribe a client to everything, host 88, variable 2, host 88's variable 1, and runs
+//  of local and remote revisions
+static void subscribe_every_kind(CMCCIPacketServer& server, MCCI_CLIENT_ID_T client)
+{
+    SMCCIRequestPacket request;
+    SMCCIResponsePacket response;
+    request.timeout = fake_time.now() + 100;
+    request.quantity = 1;
+    request.revision = 0;
+
+    MCCI_NODE_ADDRESS_T hosts[6] = {MCCI_HOST_ANY, 88, MCCI_HOST_ANY, 88,    0,   88};
+    MCCI_VARIABLE_T vars[6]      = {            0,  0,             2,  1,    1,    2};
+    MCCI_REVISION_T revisions[6] = {            0,  0,             0,  0, 1000, 1000};
+    for (int i = 0; i < 6; ++i)
+    {
+        request.node_address = hosts[i];
+        request.variable_id  = vars[i];
+        request.revision     = revisions[i];
+        request.quantity     = revisions[i] ? 5 : 1;
+        server.process_request(client, &request, &response);
+        assert(response.accepted);
+    }
+}
+
+// a client that's dropped (as networking does on disconnecting it) has no requests
+//  left, so its id can go to another client
+int test_drop_client()
+{
+    ostream quiet(NULL);
+    CMCCIServerNetworkingRecorder net(quiet);
+    SMCCIServerSettings settings = my_server->get_settings();
+    CMCCIServer server((CMCCITime*)&fake_time, &net, settings);
+    fake_time.set_now(12344);
+
+    cerr << "\nSubscribing clients 5 and 6 to every kind of request";
+    subscribe_every_kind(server, 5);
+    subscribe_every_kind(server, 6);
+    int requests = server.request_count();
+    assert(settings.max_local_requests > server.client_free_requests_local(5));
+    assert(settings.max_remote_requests > server.client_free_requests_remote(5));
+
+    cerr << "\nDropping client 5";
+    server.drop_client(5);
+    assert(requests / 2 == server.request_count());
+    assert(settings.max_local_requests == server.client_free_requests_local(5));
+    assert(settings.max_remote_requests == server.client_free_requests_remote(5));
+    server.drop_client(5);
+
+    SMCCIProductionPacket production;
+    SMCCIAcceptancePacket acceptance;
+    production.payload = 0;
+    production.response_id = 0;
+    production.variable_id = 2;
+    net.received.clear();
+    server.process_production(25, &production, &acceptance);
+    assert(0 == net.received[5].size());
+    assert(0 < net.received[6].size());
+
+    cerr << "\nThe same, sharded";
+    CMCCIShardedServer sharded((CMCCITime*)&fake_time, &net, settings, 2);
+    subscribe_every_kind(sharded, 5);
+    subscribe_every_kind(sharded, 6);
+    requests = sharded.request_count();
+    sharded.drop_client(5);
+    assert(requests / 2 == sharded.request_count());
+    assert(settings.max_local_requests == sharded.client_free_requests_local(5));
+    assert(settings.max_remote_requests == sharded.client_free_requests_remote(5));
+
+    return 0;
+}
+
+
+// the sharded server delivers what one server would, and counts quotas over all shards
+int test_sharded()
+{
+    ostream quiet(NULL);
+    CMCCIServerNetworkingRecorder net(quiet);
+    CMCCIShardedServer server((CMCCITime*)&fake_time, &net, my_server->get_settings(), 2);
+    SMCCIServerSettings settings = server.get_settings();
+    fake_time.set_now(12344);
+
+    SMCCIRequestPacket request;
+    SMCCIResponsePacket response;
+    request.timeout = fake_time.now() + 10;
+    request.quantity = 1;
+    request.revision = 0;
+
+    cerr << "\nSubscribing client 1 to everything, 2 to host 88 and 3 to variable 2";
+    request.node_address = MCCI_HOST_ANY;
+    request.variable_id  = 0;
+    server.process_request(1, &request, &response);
+    request.node_address = 88;
+    server.process_request(2, &request, &response);
+    assert(settings.max_remote_requests - 1 == response.requests_remaining_remote);
+    request.node_address = MCCI_HOST_ANY;
+    request.variable_id  = 2;
+    server.process_request(3, &request, &response);
+    assert(3 == server.request_count());
+
+    cerr << "\nSubscribing client 4 to host 88's variables 1 and 2, on different shards";
+    request.node_address = 88;
+    request.variable_id  = 1;
+    server.process_request(4, &request, &response);
+    assert(settings.max_remote_requests - 1 == response.requests_remaining_remote);
+    request.variable_id  = 2;
+    server.process_request(4, &request, &response);
+    assert(settings.max_remote_requests - 2 == response.requests_remaining_remote);
+
+    SMCCIDataPacket data;
+    data.payload = 0;
+    MCCI_NODE_ADDRESS_T hosts[3] = {88, 88, 77};
+    MCCI_VARIABLE_T vars[3]      = { 1,  2,  1};
+    for (int i = 0; i < 3; ++i)
+    {
+        data.node_address = hosts[i];
+        data.variable_id  = vars[i];
+        data.revision     = 1;
+        server.process_data(37, &data);
+    }
+
+    SMCCIProductionPacket production;
+    SMCCIAcceptancePacket acceptance;
+    production.payload = 0;
+    production.response_id = 0;
+    for (MCCI_VARIABLE_T v = 1; v <= 2; ++v)
+    {
+        production.variable_id = v;
+        server.process_production(25, &production, &acceptance);
+    }
+    server.flush();
+
+    for (MCCI_CLIENT_ID_T c = 1; c <= 4; ++c)
+    {
+        cerr << "\nclient " << c << " got " << net.received[c].size() << " packets";
+    }
+    assert(5 == net.received[1].size());
+    assert(2 == net.received[2].size());
+    assert(2 == net.received[3].size());
+    assert(2 == net.received[4].size());
+
+    cerr << "\nExpiring everything";
+    fake_time.set_now(12344 + 11);
+    server.enforce_timeouts();
+    server.flush();
+    assert(0 == server.request_count());
+
+    request.node_address = 88;
+    request.variable_id  = 1;
+    server.process_request(4, &request, &response);
+    assert(settings.max_remote_requests - 1 == response.requests_remaining_remote);
+
+    return 0;
+}
+
+
+// a produced payload is shared, not copied: the working set and each subscriber's
+//  send hold the same buffer, and the working set lets go of it when it's replaced
+int test_payload_sharing()
+{
+    ostream quiet(NULL);
+    CMCCIServerNetworkingRecorder net(quiet);
+    CMCCIServer* server = new CMCCIServer((CMCCITime*)&fake_time, &net, my_server->get_settings());
+    fake_time.set_now(12344);
+
+    SMCCIRequestPacket request;
+    SMCCIResponsePacket response;
+    request.timeout      = fake_time.now() + 100000;
+    request.quantity     = 1;
+    request.node_address = MCCI_HOST_ANY;
+    request.variable_id  = 0;
+    request.revision     = 0;
+    server->process_request(1, &request, &response);
+    server->process_request(2, &request, &response);
+
+    CMCCIPayloadPool pool;
+    SMCCIProductionPacket production;
+    SMCCIAcceptancePacket acceptance;
+    production.variable_id = 1;
+    production.response_id = 0;
+    production.payload     = CMCCIPayload::create("first", 5, &pool);
+    CMCCIPayload* first    = production.payload;
+
+    cerr << "\nProducing a payload for 2 subscribers";
+    server->process_production(25, &production, &acceptance);
+    assert(first == net.received[1][0].payload);
+    assert(first == net.received[2][0].payload);
+    assert(2 == first->references());  // ours and the working set's
+
+    cerr << "\nReplacing it";
+    production.payload = CMCCIPayload::create("second", 6, &pool);
+    server->process_production(25, &production, &acceptance);
+    assert(1 == first->references());
+    assert(2 == production.payload->references());
+
+    first->release();
+    delete server;
+    assert(1 == production.payload->references());
+    production.payload->release();
+
+    cerr << "\nThe pool gave out " << pool.misses() << " new blocks";
+    assert(0 == pool.hits() && 2 == pool.misses());
+    return 0;
+}
+
+
+// requests for recent revisions of our own variables are answered from the history;
+//  older ones are still forwarded
+int test_history()
+{
+    ostream quiet(NULL);
+    CMCCIServerNetworkingRecorder net(quiet);
+    SMCCIServerSettings settings = my_server->get_settings();
+    settings.history_size = 4;
+    CMCCIServer* server = new CMCCIServer((CMCCITime*)&fake_time, &net, settings);
+    fake_time.set_now(12344);
+
+    cerr << "\nProducing 6 revisions of variable 1, keeping 4";
+    CMCCIPayload* payloads[6];
+    SMCCIProductionPacket production[2];
+    SMCCIAcceptancePacket acceptance[2];
+    MCCI_REVISION_T revisions[6];
+    for (int i = 0; i < 6; ++i)
+    {
+        char text[16];
+        snprintf(text, sizeof(text), "revision %d", i);
+        payloads[i] = CMCCIPayload::create(text, strlen(text));
+
+        // the last two in a batch
+        SMCCIProductionPacket& p = production[i < 4 ? 0 : i - 4];
+        p.variable_id = 1;
+        p.response_id = 0;
+        p.payload     = payloads[i];
+
+        if (i < 4)
+        {
+            server->process_production(25, &p, &acceptance[0]);
+            revisions[i] = acceptance[0].revision;
+        }
+    }
+    server->process_production_batch(25, production, 2, acceptance);
+    revisions[4] = acceptance[0].revision;
+    revisions[5] = acceptance[1].revision;
+
+    cerr << "\nClient 7 asks for the last 6";
+    SMCCIRequestPacket request;
+    SMCCIResponsePacket response;
+    request.timeout      = fake_time.now() + 100;
+    request.node_address = 0;
+    request.variable_id  = 1;
+    request.revision     = 0;
+    request.quantity     = 6;
+    server->process_request(7, &request, &response);
+    assert(response.accepted);
+
+    // the newest from the working set, 3 from the history, 2 forwarded
+    cerr << "\nGot " << net.received[7].size() << " at once; history hits "
+         << server->history_hits() << ", misses " << server->history_misses();
+    assert(4 == net.received[7].size());
+    for (int i = 0; i < 4; ++i)
+    {
+        const SMCCIDataPacket& p = net.received[7][i];
+        MCCI_REVISION_T offset = p.revision - revisions[0];
+        assert(2 <= offset && offset <= 5);
+        assert(payloads[offset] == p.payload);
+    }
+    assert(3 == server->history_hits());
+    assert(2 == server->history_misses());
+    assert(1 == net.forwards);
+    assert(settings.max_local_requests - 2 == server->client_free_requests_local(7));
+
+    // the history lets go of its payloads with the server
+    assert(1 == payloads[0]->references());
+    assert(2 == payloads[2]->references());
+    delete server;
+    for (int i = 0; i < 6; ++i)
+    {
+        assert(1 == payloads[i]->references());
+        payloads[i]->release();
+    }
+    return 0;
+}
+
+
 int main(int argc, char* argv[])
 {
 
@@ -444,6 +988,12 @@ int main(int argc, char* argv[])
     do_test("test_rb_varrev", test_rb_varrev);
     
     do_test("test_sndrcv", test_sndrecv);
+    do_test("test_routing_allocations", test_routing_allocations);
+    do_test("test_batch", test_batch);
+    do_test("test_sharded", test_sharded);
+    do_test("test_drop_client", test_drop_client);
+    do_test("test_payload_sharing", test_payload_sharing);
+    do_test("test_history", test_history);
 
     cerr << "\n\n";
     return 0;
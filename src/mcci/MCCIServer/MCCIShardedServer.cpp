@@ -0,0 +1,469 @@
+#include "MCCIShardedServer.h"
+
+using namespace std;
+
+
+CMCCIServerShard::CMCCIServerShard(CMCCIShardedServer* owner,
+                                   CMCCITime* time,
+                                   CMCCIServerNetworking* networking,
+                                   SMCCIServerSettings settings) :
+    CMCCIServer(time, networking, settings, false),
+    m_owner(owner),
+    m_busy(false),
+    m_stopping(false),
+    m_due(false),
+    m_deadline(0),
+    m_failed(false)
+{
+    pthread_mutex_init(&m_lock, NULL);
+    pthread_cond_init(&m_work, NULL);
+    pthread_cond_init(&m_idle, NULL);
+}
+
+
+CMCCIServerShard::~CMCCIServerShard()
+{
+    pthread_cond_destroy(&m_idle);
+    pthread_cond_destroy(&m_work);
+    pthread_mutex_destroy(&m_lock);
+}
+
+
+void* CMCCIServerShard::run(void* shard)
+{
+    ((CMCCIServerShard*)shard)->work();
+    return NULL;
+}
+
+
+void CMCCIServerShard::start()
+{
+    m_stopping = false;
+    if (pthread_create(&m_thread, NULL, CMCCIServerShard::run, this))
+        throw string("Couldn't start a shard thread");
+}
+
+
+void CMCCIServerShard::stop()
+{
+    pthread_mutex_lock(&m_lock);
+    m_stopping = true;
+    pthread_cond_signal(&m_work);
+    pthread_mutex_unlock(&m_lock);
+
+    pthread_join(m_thread, NULL);
+}
+
+
+void CMCCIServerShard::enqueue(SMCCIShardJob const &job)
+{
+    pthread_mutex_lock(&m_lock);
+    m_queue.push_back(job);
+    pthread_cond_signal(&m_work);
+    pthread_mutex_unlock(&m_lock);
+}
+
+
+void CMCCIServerShard::quiesce()
+{
+    pthread_mutex_lock(&m_lock);
+    while (!m_queue.empty() || m_busy) pthread_cond_wait(&m_idle, &m_lock);
+}
+
+
+void CMCCIServerShard::release()
+{
+    pthread_mutex_unlock(&m_lock);
+}
+
+
+void CMCCIServerShard::rethrow()
+{
+    if (!m_failed) return;
+
+    m_failed = false;
+    throw m_error;
+}
+
+
+void CMCCIServerShard::note_timeout()
+{
+    m_due = next_timeout(&m_deadline);
+}
+
+
+bool CMCCIServerShard::noted_timeout(MCCI_TIME_T* deadline) const
+{
+    pthread_mutex_lock(&m_lock);
+    bool due = m_due;
+    *deadline = m_deadline;
+    pthread_mutex_unlock(&m_lock);
+
+    return due;
+}
+
+
+void CMCCIServerShard::work()
+{
+    pthread_mutex_lock(&m_lock);
+    for (;;)
+    {
+        while (m_queue.empty() && !m_stopping) pthread_cond_wait(&m_work, &m_lock);
+        if (m_queue.empty()) break;
+
+        // take the whole queue; the emptied vector we leave keeps its capacity
+        m_running.swap(m_queue);
+        m_busy = true;
+        pthread_mutex_unlock(&m_lock);
+
+        run_jobs();
+        m_running.clear();
+
+        MCCI_TIME_T deadline;
+        bool due = next_timeout(&deadline);
+
+        pthread_mutex_lock(&m_lock);
+        m_due = due;
+        m_deadline = deadline;
+        m_busy = false;
+        if (m_queue.empty()) pthread_cond_broadcast(&m_idle);
+    }
+    pthread_mutex_unlock(&m_lock);
+}
+
+
+void CMCCIServerShard::run_jobs()
+{
+    unsigned int i = 0;
+    while (i < m_running.size())
+    {
+        SMCCIShardJob& job = m_running[i];
+
+        // consecutive data packets go out as one batch
+        m_data.clear();
+        if (SMCCIShardJob::DATA == job.kind)
+        {
+            for (; i < m_running.size() && SMCCIShardJob::DATA == m_running[i].kind; ++i)
+                m_data.push_back(m_running[i].data);
+        }
+        else
+        {
+            ++i;
+        }
+
+        try
+        {
+            switch (job.kind)
+            {
+            case SMCCIShardJob::DATA:
+                process_data_batch(job.provider_id, &m_data[0], m_data.size());
+                break;
+
+            case SMCCIShardJob::PUBLISH:
+                publish(job.provider_id, &job.production, &job.acceptance);
+                break;
+
+            case SMCCIShardJob::TIMEOUTS:
+                enforce_timeouts(job.now);
+                break;
+            }
+        }
+        catch (string e)
+        {
+            if (!m_failed) m_error = e;
+            m_failed = true;
+        }
+
+        // drop the references the queue held
+        for (unsigned int d = 0; d < m_data.size(); ++d) mcci_payload_release(m_data[d].payload);
+        if (SMCCIShardJob::PUBLISH == job.kind) mcci_payload_release(job.production.payload);
+    }
+}
+
+
+int CMCCIServerShard::request_count(bool wildcards) const
+{
+    return (wildcards ? m_bank_all.size() + m_bank_host.size() : 0)
+        + m_bank_var.size()
+        + m_bank_hostvar.size()
+        + m_bank_remote.size()
+        + m_bank_varrev.size();
+}
+
+
+unsigned int CMCCIServerShard::outstanding_local(MCCI_CLIENT_ID_T client_id) const
+{
+    return m_bank_varrev.get_outstanding_request_count(client_id);
+}
+
+
+unsigned int CMCCIServerShard::outstanding_remote(MCCI_CLIENT_ID_T client_id, bool wildcards) const
+{
+    return (wildcards ? m_bank_host.get_outstanding_request_count(client_id) : 0)
+        + m_bank_var.get_outstanding_request_count(client_id)
+        + m_bank_hostvar.get_outstanding_request_count(client_id)
+        + m_bank_remote.get_outstanding_request_count(client_id);
+}
+
+
+unsigned int CMCCIServerShard::client_free_requests_local(MCCI_CLIENT_ID_T client_id) const
+{
+    return m_owner->client_free_requests_local(client_id);
+}
+
+
+unsigned int CMCCIServerShard::client_free_requests_remote(MCCI_CLIENT_ID_T client_id) const
+{
+    return m_owner->client_free_requests_remote(client_id);
+}
+
+
+void CMCCIServerShard::replicate(const CMCCIServerShard& primary,
+                                 MCCI_CLIENT_ID_T requestor_id,
+                                 const SMCCIRequestPacket* input)
+{
+    // take the timeout from the primary, which has already decided whether to accept
+    MCCI_TIME_T timeout;
+
+    if (MCCI_HOST_ANY == input->node_address)
+    {
+        if (primary.m_bank_all.get_timeout(1, requestor_id, &timeout))
+            subscribe_promiscuous(requestor_id, timeout);
+    }
+    else
+    {
+        MCCI_NODE_ADDRESS_T real_address;
+        real_address = input->node_address ? input->node_address : m_settings.my_node_address;
+
+        if (primary.m_bank_host.get_timeout(real_address, requestor_id, &timeout))
+            subscribe_to_host(requestor_id, timeout, real_address);
+    }
+}
+
+
+
+CMCCIShardedServer::CMCCIShardedServer(CMCCITime* time,
+                                       CMCCIServerNetworking* networking,
+                                       SMCCIServerSettings settings,
+                                       unsigned int shards) :
+    m_settings(settings),
+    m_networking(networking),
+    m_enforced(0)
+{
+    if (!shards) throw string("A sharded server needs at least 1 shard");
+
+    // once for all the shards
+    CMCCIServer::preload(settings);
+
+    // one clock for all the shards
+    m_time = time;
+    m_external_time = (NULL != m_time);
+    if (!m_time)
+    {
+        m_time = (CMCCITime*) new CMCCITimeReal();
+    }
+
+    for (unsigned int i = 0; i < shards; ++i)
+    {
+        m_shards.push_back(new CMCCIServerShard(this, m_time, &m_networking, settings));
+    }
+
+    for (unsigned int i = 0; i < shards; ++i)
+    {
+        m_shards[i]->start();
+    }
+}
+
+
+CMCCIShardedServer::~CMCCIShardedServer()
+{
+    for (unsigned int i = 0; i < m_shards.size(); ++i)
+    {
+        m_shards[i]->stop();
+        delete m_shards[i];
+    }
+
+    // if we created it, destroy it.
+    if (!m_external_time) delete m_time;
+}
+
+
+void CMCCIShardedServer::quiesce_all()
+{
+    // always in the same order
+    for (unsigned int i = 0; i < m_shards.size(); ++i) m_shards[i]->quiesce();
+}
+
+
+void CMCCIShardedServer::release_all()
+{
+    for (unsigned int i = 0; i < m_shards.size(); ++i) m_shards[i]->release();
+}
+
+
+int CMCCIShardedServer::request_count()
+{
+    quiesce_all();
+
+    // the wildcard subscriptions are on every shard; count them once
+    int count = 0;
+    for (unsigned int i = 0; i < m_shards.size(); ++i) count += m_shards[i]->request_count(0 == i);
+
+    release_all();
+    return count;
+}
+
+
+void CMCCIShardedServer::process_request(MCCI_CLIENT_ID_T requestor_id,
+                                         const SMCCIRequestPacket* input,
+                                         SMCCIResponsePacket* response)
+{
+    quiesce_all();
+
+    try
+    {
+        // promiscuous and host subscriptions are decided by the first shard and copied
+        //  to the rest.  (these are the cases process_request handles before forwarding)
+        if (0 == input->variable_id
+            && (MCCI_HOST_ANY == input->node_address || 0 == input->revision))
+        {
+            m_shards[0]->process_request(requestor_id, input, response);
+            for (unsigned int i = 1; i < m_shards.size(); ++i)
+            {
+                m_shards[i]->replicate(*m_shards[0], requestor_id, input);
+            }
+        }
+        else
+        {
+            shard_of(input->variable_id)->process_request(requestor_id, input, response);
+        }
+    }
+    catch (...)
+    {
+        release_all();
+        throw;
+    }
+
+    for (unsigned int i = 0; i < m_shards.size(); ++i) m_shards[i]->note_timeout();
+    release_all();
+}
+
+
+void CMCCIShardedServer::process_data(MCCI_CLIENT_ID_T provider_id,
+                                      const SMCCIDataPacket* input)
+{
+    SMCCIShardJob job;
+    job.kind        = SMCCIShardJob::DATA;
+    job.provider_id = provider_id;
+    job.data        = *input;
+    mcci_payload_retain(job.data.payload);
+
+    shard_of(input->variable_id)->enqueue(job);
+}
+
+
+void CMCCIShardedServer::process_production(MCCI_CLIENT_ID_T provider_id,
+                                            const SMCCIProductionPacket* input,
+                                            SMCCIAcceptancePacket* output)
+{
+    // the revision set stays on this thread
+    output->response_id = input->response_id;
+    output->revision    = m_settings.revisionset->inc_revision(input->variable_id);
+
+    SMCCIShardJob job;
+    job.kind        = SMCCIShardJob::PUBLISH;
+    job.provider_id = provider_id;
+    job.production  = *input;
+    job.acceptance  = *output;
+    mcci_payload_retain(job.production.payload);
+
+    shard_of(input->variable_id)->enqueue(job);
+}
+
+
+void CMCCIShardedServer::enforce_timeouts()
+{
+    // every shard expires as of the same time, so the copies of the wildcard
+    //  subscriptions stay alike
+    SMCCIShardJob job;
+    job.kind = SMCCIShardJob::TIMEOUTS;
+    job.now  = m_time->now();
+    m_enforced = job.now;
+
+    for (unsigned int i = 0; i < m_shards.size(); ++i) m_shards[i]->enqueue(job);
+}
+
+
+void CMCCIShardedServer::drop_client(MCCI_CLIENT_ID_T client_id)
+{
+    quiesce_all();
+
+    for (unsigned int i = 0; i < m_shards.size(); ++i)
+    {
+        m_shards[i]->drop_client(client_id);
+        m_shards[i]->note_timeout();
+    }
+
+    release_all();
+}
+
+
+bool CMCCIShardedServer::next_timeout(MCCI_TIME_T* deadline) const
+{
+    bool found = false;
+    for (unsigned int i = 0; i < m_shards.size(); ++i)
+    {
+        MCCI_TIME_T noted;
+        if (!m_shards[i]->noted_timeout(&noted)) continue;
+
+        if (!found || noted < *deadline) *deadline = noted;
+        found = true;
+    }
+
+    if (found && *deadline < m_enforced) *deadline = m_enforced;
+    return found;
+}
+
+
+void CMCCIShardedServer::flush()
+{
+    quiesce_all();
+
+    string error;
+    bool failed = false;
+    for (unsigned int i = 0; i < m_shards.size(); ++i)
+    {
+        try
+        {
+            m_shards[i]->rethrow();
+        }
+        catch (string e)
+        {
+            if (!failed) error = e;
+            failed = true;
+        }
+    }
+
+    release_all();
+    if (failed) throw error;
+}
+
+
+unsigned int CMCCIShardedServer::client_free_requests_local(MCCI_CLIENT_ID_T client_id) const
+{
+    unsigned int outstanding = 0;
+    for (unsigned int i = 0; i < m_shards.size(); ++i)
+        outstanding += m_shards[i]->outstanding_local(client_id);
+
+    return m_settings.max_local_requests - outstanding;
+}
+
+
+unsigned int CMCCIShardedServer::client_free_requests_remote(MCCI_CLIENT_ID_T client_id) const
+{
+    unsigned int outstanding = 0;
+    for (unsigned int i = 0; i < m_shards.size(); ++i)
+        outstanding += m_shards[i]->outstanding_remote(client_id, 0 == i);
+
+    return m_settings.max_remote_requests - outstanding;
+}
@@ -0,0 +1,252 @@
+#pragma once
+
+#include "MCCIServer.h"
+#include "MCCIPacketServer.h"
+#include "MCCIServerNetworking.h"
+#include "MCCITime.h"
+#include "MCCITypes.h"
+#include <vector>
+#include <string>
+#include <pthread.h>
+
+using namespace std;
+
+
+class CMCCIShardedServer;
+
+
+// networking shared by several threads: each call is made under a lock
+class CMCCIServerNetworkingSerialized : public CMCCIServerNetworking
+{
+  protected:
+    CMCCIServerNetworking* m_networking;
+    pthread_mutex_t m_lock;
+
+  public:
+    CMCCIServerNetworkingSerialized(CMCCIServerNetworking* networking)
+    {
+        this->m_networking = networking;
+        pthread_mutex_init(&this->m_lock, NULL);
+    }
+
+    virtual ~CMCCIServerNetworkingSerialized() { pthread_mutex_destroy(&this->m_lock); }
+
+    virtual void send_production_response(MCCI_CLIENT_ID_T client,
+                                          const SMCCIAcceptancePacket* p)
+    {
+        pthread_mutex_lock(&this->m_lock);
+        this->m_networking->send_production_response(client, p);
+        pthread_mutex_unlock(&this->m_lock);
+    }
+
+    virtual void send_data_to_client(MCCI_CLIENT_ID_T client,
+                                     const SMCCIDataPacket* p)
+    {
+        pthread_mutex_lock(&this->m_lock);
+        this->m_networking->send_data_to_client(client, p);
+        pthread_mutex_unlock(&this->m_lock);
+    }
+
+    virtual void send_data_batch_to_client(MCCI_CLIENT_ID_T client,
+                                           const SMCCIDataPacket* const* p,
+                                           unsigned int count)
+    {
+        pthread_mutex_lock(&this->m_lock);
+        this->m_networking->send_data_batch_to_client(client, p, count);
+        pthread_mutex_unlock(&this->m_lock);
+    }
+
+    virtual void forward_request(MCCI_CLIENT_ID_T requestor_id,
+                                 const SMCCIRequestPacket* request)
+    {
+        pthread_mutex_lock(&this->m_lock);
+        this->m_networking->forward_request(requestor_id, request);
+        pthread_mutex_unlock(&this->m_lock);
+    }
+};
+
+
+// work queued for a shard's thread
+typedef struct
+{
+    enum { DATA, PUBLISH, TIMEOUTS } kind;
+    MCCI_CLIENT_ID_T provider_id;
+    SMCCIDataPacket data;              // DATA
+    SMCCIProductionPacket production;  // PUBLISH
+    SMCCIAcceptancePacket acceptance;  // PUBLISH
+    MCCI_TIME_T now;                   // TIMEOUTS
+} SMCCIShardJob;
+
+
+/**
+   One partition of a CMCCIShardedServer: a complete server (banks, timeout
+   indexes, working set) for the variables whose id maps to it, run by its own
+   thread from a queue of jobs.
+
+   Request quotas are asked of the sharded server, which counts across all shards.
+ */
+class CMCCIServerShard : public CMCCIServer
+{
+  protected:
+    CMCCIShardedServer* m_owner;
+
+    pthread_t m_thread;
+    mutable pthread_mutex_t m_lock;
+    pthread_cond_t m_work;   // there are jobs, or the thread should stop
+    pthread_cond_t m_idle;   // there are no jobs and none running
+
+    vector<SMCCIShardJob> m_queue;    // jobs waiting, under m_lock
+    vector<SMCCIShardJob> m_running;  // jobs the thread has taken
+    vector<SMCCIDataPacket> m_data;   // runs of data jobs, routed as a batch
+    bool m_busy;
+    bool m_stopping;
+
+    bool m_due;              // under m_lock: whether there were requests after the
+    MCCI_TIME_T m_deadline;  //  last jobs, and the earliest of their timeouts
+
+    string m_error;  // the first exception a job threw, if any
+    bool m_failed;
+
+    static void* run(void* shard);
+
+    void work();
+    void run_jobs();
+
+  public:
+    CMCCIServerShard(CMCCIShardedServer* owner,
+                     CMCCITime* time,
+                     CMCCIServerNetworking* networking,
+                     SMCCIServerSettings settings);
+    virtual ~CMCCIServerShard();
+
+    // start and stop the thread (stop finishes the jobs already queued)
+    void start();
+    void stop();
+
+    // hand a job to the thread
+    void enqueue(SMCCIShardJob const &job);
+
+    // wait for the queue to empty and keep the thread from taking more work, until
+    //  release.  while quiesced the shard may be used directly
+    void quiesce();
+    void release();
+
+    // throw (and forget) the error a job threw, if any.  call while quiesced
+    void rethrow();
+
+    // note the earliest timeout for noted_timeout.  call while quiesced (the thread
+    //  does after each run of jobs)
+    void note_timeout();
+
+    // the earliest timeout as of the last jobs run, if there were requests
+    bool noted_timeout(MCCI_TIME_T* deadline) const;
+
+    // the number of open requests, and per client; the promiscuous and host
+    //  subscriptions are counted only if wildcards is set
+    int request_count(bool wildcards) const;
+    unsigned int outstanding_local(MCCI_CLIENT_ID_T client_id) const;
+    unsigned int outstanding_remote(MCCI_CLIENT_ID_T client_id, bool wildcards) const;
+
+    // quotas are global
+    virtual unsigned int client_free_requests_local(MCCI_CLIENT_ID_T client_id) const;
+    virtual unsigned int client_free_requests_remote(MCCI_CLIENT_ID_T client_id) const;
+
+    // copy a promiscuous or host subscription that another shard has accepted
+    void replicate(const CMCCIServerShard& primary,
+                   MCCI_CLIENT_ID_T requestor_id,
+                   const SMCCIRequestPacket* input);
+};
+
+
+/**
+   A CMCCIServer spread over several threads.  Variables are divided among the
+   shards by id, and each shard holds the banks and working set for its own
+   variables, so data and productions for different variables are routed in
+   parallel.  Promiscuous and host subscriptions concern every variable; they
+   are made on the first shard and copied to the rest.
+
+   The entry points are meant to be called from one thread (the networking loop).
+   Data, productions and timeouts are queued to the shards; the acceptance for a
+   production is filled in at once, since the revision set is only used from the
+   calling thread.  Requests need the quotas to be counted across every shard, so
+   a request waits for all the shards to go idle and holds them until it's done.
+
+   Queued packets are copied, and hold a reference to their payloads until the
+   shard is done with them.
+
+   The shards send from their own threads, so the networking they're given is
+   called under a lock; a networking that the calling thread also writes to (as
+   CMCCIServerNetworkingSocket does) has to lock for itself too, which it does
+   when sends_from_threads() says so.  The revision set is preloaded once, here,
+   rather than by every shard.
+ */
+class CMCCIShardedServer : public CMCCIPacketServer
+{
+  protected:
+    SMCCIServerSettings m_settings;
+    CMCCIServerNetworkingSerialized m_networking;
+    CMCCITime* m_time;
+    bool m_external_time;
+
+    vector<CMCCIServerShard*> m_shards;
+
+    MCCI_TIME_T m_enforced;  // the time the shards were last asked to expire requests as of
+
+    // the shards go idle for a request; a sharded server can't be copied
+    CMCCIShardedServer(const CMCCIShardedServer&);
+    CMCCIShardedServer& operator=(const CMCCIShardedServer&);
+
+    CMCCIServerShard* shard_of(MCCI_VARIABLE_T variable_id) const
+    {
+        return this->m_shards[variable_id % this->m_shards.size()];
+    }
+
+    void quiesce_all();
+    void release_all();
+
+  public:
+    CMCCIShardedServer(CMCCITime* time,
+                       CMCCIServerNetworking* networking,
+                       SMCCIServerSettings settings,
+                       unsigned int shards);
+    virtual ~CMCCIShardedServer();
+
+    unsigned int shard_count() const { return this->m_shards.size(); }
+
+    // number of open requests
+    int request_count();
+
+    // as in CMCCIServer
+    virtual void process_request(MCCI_CLIENT_ID_T requestor_id,
+                                 const SMCCIRequestPacket* input,
+                                 SMCCIResponsePacket* response);
+
+    virtual void process_data(MCCI_CLIENT_ID_T provider_id,
+                              const SMCCIDataPacket* input);
+
+    virtual void process_production(MCCI_CLIENT_ID_T provider_id,
+                                    const SMCCIProductionPacket* input,
+                                    SMCCIAcceptancePacket* output);
+
+    virtual void enforce_timeouts();
+
+    // waits for the shards to go idle, as a request does
+    virtual void drop_client(MCCI_CLIENT_ID_T client_id);
+
+    // the earliest timeout the shards have noted.  one the shards were already
+    //  asked to expire may not have gone yet; then it's the time they were asked
+    //  as of, so the next look is once that has passed
+    virtual bool next_timeout(MCCI_TIME_T* deadline) const;
+
+    virtual bool sends_from_threads() const { return true; }
+
+    // wait until every queued job is done, throwing any error a job threw
+    void flush();
+
+    // the free requests for a client, over all shards.  only for use while the
+    //  shards are idle (as they are during process_request)
+    unsigned int client_free_requests_local(MCCI_CLIENT_ID_T client_id) const;
+    unsigned int client_free_requests_remote(MCCI_CLIENT_ID_T client_id) const;
+
+    SMCCIServerSettings get_settings() const { return m_settings; }
+};
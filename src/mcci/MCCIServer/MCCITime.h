@@ -1,6 +1,7 @@
 #pragma once
 
 #include "MCCITypes.h"
+#include <time.h>
 
 // we may define time in several ways.
 class CMCCITime
@@ -12,15 +13,20 @@ class CMCCITime
     virtual MCCI_TIME_T now() const = 0;
 };
 
-// FIXME: will reflect real-time clock for production
+// the real-time clock, in seconds since the epoch (request timeouts are absolute)
 class CMCCITimeReal : CMCCITime
 {
   public:
     CMCCITimeReal() : CMCCITime() {}
     ~CMCCITimeReal() {}
 
-    // FIXME: need time implementation
-    virtual MCCI_TIME_T now() const { throw string("NOT IMPLEMENTED YET"); }
+    // the precise clock, as timerfd uses: time() can lag it by a tick
+    virtual MCCI_TIME_T now() const
+    {
+        struct timespec t;
+        clock_gettime(CLOCK_REALTIME, &t);
+        return (MCCI_TIME_T)t.tv_sec;
+    }
     
 };
 
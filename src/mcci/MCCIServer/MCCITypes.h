@@ -1,6 +1,7 @@
 #pragma once
 
 #include <boost/cstdint.hpp>
+#include "MCCIPayload.h"
 
 #include <ostream>
 
@@ -12,7 +13,7 @@ typedef uint32_t MCCI_REVISION_T;
 typedef uint16_t MCCI_CLIENT_ID_T;
 typedef uint32_t MCCI_TIME_T;
 
-typedef char* MCCI_PAYLOAD_T; // FIXME, need len or different data type here
+typedef CMCCIPayload* MCCI_PAYLOAD_T; // shared and refcounted; NULL for none
 
 #define MCCI_HOST_ANY ((uint16_t) -1)
 
@@ -73,7 +74,7 @@ inline ostream& operator<<(ostream& out, const SMCCIDataPacket& rhs)
         << "(node_address: " << rhs.node_address << ", "
         << "variable_id: " << rhs.variable_id << ", "
         << "revision: " << rhs.revision << ", "
-        << "payload: <fixme: payload len>)";
+        << "payload: " << (rhs.payload ? rhs.payload->length() : 0) << " bytes)";
 }
 
 inline ostream& operator<<(ostream& out, const SMCCIProductionPacket& rhs)
@@ -81,7 +82,7 @@ inline ostream& operator<<(ostream& out, const SMCCIProductionPacket& rhs)
     return out
         << "(variable_id: " << rhs.variable_id << ", "
         << "response_id: " << rhs.response_id << ", "
-        << "payload: <fixme: payload len>)";
+        << "payload: " << (rhs.payload ? rhs.payload->length() : 0) << " bytes)";
 }
 
 inline ostream& operator<<(ostream& out, const SMCCIAcceptancePacket& rhs)
@@ -0,0 +1,227 @@
+#pragma once
+
+#include "MCCITypes.h"
+#include <string>
+#include <string.h>
+#include <arpa/inet.h>
+
+using namespace std;
+
+/**
+   The framing used between the server and its clients.
+
+   A frame is a 4 byte length (of everything after it), a 1 byte type, and the
+   fields of the packet in network byte order.  Data and production frames end
+   with a 4 byte payload length and the payload bytes.
+
+   The server doesn't copy payloads into its frames: it writes everything up to
+   the payload bytes with mcci_wire_append_header and sends the payload from its
+   own buffer.
+ */
+
+typedef enum
+{
+    MCCI_FRAME_REQUEST    = 1,  // client to server
+    MCCI_FRAME_RESPONSE   = 2,  // server to client
+    MCCI_FRAME_DATA       = 3,  // either way
+    MCCI_FRAME_PRODUCTION = 4,  // client to server
+    MCCI_FRAME_ACCEPTANCE = 5   // server to client
+} EMCCIFrameType;
+
+// frames are refused beyond this size
+#define MCCI_FRAME_MAX (1 << 20)
+
+// the length field and the type
+#define MCCI_FRAME_HEADER 5
+
+
+inline void mcci_wire_put8(string& out, uint8_t v) { out.push_back((char)v); }
+
+inline void mcci_wire_put16(string& out, uint16_t v)
+{
+    v = htons(v);
+    out.append((const char*)&v, 2);
+}
+
+inline void mcci_wire_put32(string& out, uint32_t v)
+{
+    v = htonl(v);
+    out.append((const char*)&v, 4);
+}
+
+inline uint16_t mcci_wire_get16(const char* in)
+{
+    uint16_t v;
+    memcpy(&v, in, 2);
+    return ntohs(v);
+}
+
+inline uint32_t mcci_wire_get32(const char* in)
+{
+    uint32_t v;
+    memcpy(&v, in, 4);
+    return ntohl(v);
+}
+
+
+// start a frame; returns where its length goes, for mcci_wire_end
+inline unsigned int mcci_wire_begin(string& out, EMCCIFrameType type)
+{
+    unsigned int start = out.size();
+    mcci_wire_put32(out, 0);
+    mcci_wire_put8(out, type);
+    return start;
+}
+
+inline void mcci_wire_end(string& out, unsigned int start)
+{
+    uint32_t len = htonl(out.size() - start - 4);
+    memcpy(&out[start], &len, 4);
+}
+
+inline void mcci_wire_put_payload(string& out, MCCI_PAYLOAD_T payload)
+{
+    uint32_t len = payload ? payload->length() : 0;
+    mcci_wire_put32(out, len);
+    if (len) out.append(payload->data(), len);
+}
+
+
+// append a packet to a buffer as one frame
+inline void mcci_wire_append(string& out, const SMCCIRequestPacket& p)
+{
+    unsigned int start = mcci_wire_begin(out, MCCI_FRAME_REQUEST);
+    mcci_wire_put32(out, p.timeout);
+    mcci_wire_put16(out, p.node_address);
+    mcci_wire_put16(out, p.variable_id);
+    mcci_wire_put32(out, p.revision);
+    mcci_wire_put32(out, (uint32_t)p.quantity);
+    mcci_wire_end(out, start);
+}
+
+inline void mcci_wire_append(string& out, const SMCCIResponsePacket& p)
+{
+    unsigned int start = mcci_wire_begin(out, MCCI_FRAME_RESPONSE);
+    mcci_wire_put8(out, p.accepted);
+    mcci_wire_put32(out, p.requests_remaining_local);
+    mcci_wire_put32(out, p.requests_remaining_remote);
+    mcci_wire_end(out, start);
+}
+
+inline void mcci_wire_append(string& out, const SMCCIDataPacket& p)
+{
+    unsigned int start = mcci_wire_begin(out, MCCI_FRAME_DATA);
+    mcci_wire_put16(out, p.node_address);
+    mcci_wire_put16(out, p.variable_id);
+    mcci_wire_put32(out, p.revision);
+    mcci_wire_put_payload(out, p.payload);
+    mcci_wire_end(out, start);
+}
+
+// a data frame without the payload bytes, which must follow it
+inline void mcci_wire_append_header(string& out, const SMCCIDataPacket& p)
+{
+    uint32_t len = p.payload ? p.payload->length() : 0;
+    unsigned int start = mcci_wire_begin(out, MCCI_FRAME_DATA);
+    mcci_wire_put16(out, p.node_address);
+    mcci_wire_put16(out, p.variable_id);
+    mcci_wire_put32(out, p.revision);
+    mcci_wire_put32(out, len);
+    mcci_wire_end(out, start);
+
+    // the length counts the payload to come
+    uint32_t frame = htonl(out.size() - start - 4 + len);
+    memcpy(&out[start], &frame, 4);
+}
+
+inline void mcci_wire_append(string& out, const SMCCIProductionPacket& p)
+{
+    unsigned int start = mcci_wire_begin(out, MCCI_FRAME_PRODUCTION);
+    mcci_wire_put16(out, p.variable_id);
+    mcci_wire_put32(out, p.response_id);
+    mcci_wire_put_payload(out, p.payload);
+    mcci_wire_end(out, start);
+}
+
+inline void mcci_wire_append(string& out, const SMCCIAcceptancePacket& p)
+{
+    unsigned int start = mcci_wire_begin(out, MCCI_FRAME_ACCEPTANCE);
+    mcci_wire_put32(out, p.response_id);
+    mcci_wire_put32(out, p.revision);
+    mcci_wire_end(out, start);
+}
+
+
+// the size of the complete frame at the start of a buffer: 0 if it isn't all there
+//  yet, -1 if it can't be a frame
+inline int mcci_wire_frame_size(const char* in, unsigned int len)
+{
+    if (len < 4) return 0;
+
+    uint32_t body = mcci_wire_get32(in);
+    if (body < 1 || body > MCCI_FRAME_MAX) return -1;
+    return len < 4 + body ? 0 : 4 + body;
+}
+
+inline EMCCIFrameType mcci_wire_type(const char* frame) { return (EMCCIFrameType)(uint8_t)frame[4]; }
+
+
+// read a packet from a complete frame of the right type; false if it's malformed.
+//  payloads are left in the frame, as a pointer and a length
+inline bool mcci_wire_read(const char* frame, unsigned int size, SMCCIRequestPacket* p)
+{
+    if (size != MCCI_FRAME_HEADER + 16) return false;
+    const char* in = frame + MCCI_FRAME_HEADER;
+    p->timeout      = mcci_wire_get32(in);
+    p->node_address = mcci_wire_get16(in + 4);
+    p->variable_id  = mcci_wire_get16(in + 6);
+    p->revision     = mcci_wire_get32(in + 8);
+    p->quantity     = (int)mcci_wire_get32(in + 12);
+    return true;
+}
+
+inline bool mcci_wire_read(const char* frame, unsigned int size, SMCCIResponsePacket* p)
+{
+    if (size != MCCI_FRAME_HEADER + 9) return false;
+    const char* in = frame + MCCI_FRAME_HEADER;
+    p->accepted                  = in[0];
+    p->requests_remaining_local  = mcci_wire_get32(in + 1);
+    p->requests_remaining_remote = mcci_wire_get32(in + 5);
+    return true;
+}
+
+inline bool mcci_wire_read(const char* frame, unsigned int size, SMCCIAcceptancePacket* p)
+{
+    if (size != MCCI_FRAME_HEADER + 8) return false;
+    const char* in = frame + MCCI_FRAME_HEADER;
+    p->response_id = mcci_wire_get32(in);
+    p->revision    = mcci_wire_get32(in + 4);
+    return true;
+}
+
+inline bool mcci_wire_read(const char* frame, unsigned int size, SMCCIDataPacket* p,
+                           const char** payload, unsigned int* payload_len)
+{
+    if (size < MCCI_FRAME_HEADER + 12) return false;
+    const char* in = frame + MCCI_FRAME_HEADER;
+    p->node_address = mcci_wire_get16(in);
+    p->variable_id  = mcci_wire_get16(in + 2);
+    p->revision     = mcci_wire_get32(in + 4);
+    p->payload      = NULL;
+    *payload_len    = mcci_wire_get32(in + 8);
+    *payload        = in + 12;
+    return *payload_len == size - MCCI_FRAME_HEADER - 12;
+}
+
+inline bool mcci_wire_read(const char* frame, unsigned int size, SMCCIProductionPacket* p,
+                           const char** payload, unsigned int* payload_len)
+{
+    if (size < MCCI_FRAME_HEADER + 10) return false;
+    const char* in = frame + MCCI_FRAME_HEADER;
+    p->variable_id = mcci_wire_get16(in);
+    p->response_id = mcci_wire_get32(in + 2);
+    p->payload     = NULL;
+    *payload_len   = mcci_wire_get32(in + 6);
+    *payload       = in + 10;
+    return *payload_len == size - MCCI_FRAME_HEADER - 10;
+}
@@ -0,0 +1,376 @@
+#pragma once
+
+#include "MCCITypes.h"
+#include "FlatHash.h"
+#include "TimingWheel.h"
+#include "SlabPool.h"
+#include "ClientBitset.h"
+#include <vector>
+#include <algorithm>
+#include <ostream>
+
+using namespace std;
+
+
+/**
+   Requests for runs of revisions: each is a range first..last of one key (a
+   variable, or a packed host and variable) for one client, with one timeout,
+   however many revisions it covers.  A request for the next 500 revisions is
+   one range instead of 500 entries and 500 timeout nodes.
+
+   The ranges of a key are kept sorted by their first revision, along with the
+   length of the longest; a range holding revision r must then start within
+   that length before r, so a stabbing query (the ranges that hold r) is a binary
+   search and a scan of the ranges starting in that window.
+
+   Delivering a revision carves it out of every range that holds it: a range
+   shrinks from the front (the usual case, as revisions arrive in order) or the
+   back, or splits in two around a revision that arrived out of order.  Both
+   halves keep the original timeout.  A client asking again for revisions it
+   has already asked for gets them with the new timeout, as RequestBank::add
+   does for single requests.
+
+   A range shrinking from the front stays where it is in the list unless another
+   range of its key starts in the part cut off, and the lists of keys that run
+   out of ranges are kept for reuse, so in-order delivery doesn't allocate.
+
+   The number of revisions outstanding per client is tracked, so quotas count
+   revisions as before.
+ */
+class RangeRequestBank
+{
+  public:
+    struct Range;
+    typedef TimingWheel<MCCI_TIME_T, Range*> Timeouts;
+    typedef Timeouts::Node TimeoutNode;
+
+    // revisions first to last (inclusive) of a key, for one client
+    struct Range
+    {
+        uint32_t key;
+        MCCI_REVISION_T first;
+        MCCI_REVISION_T last;
+        MCCI_CLIENT_ID_T client_id;
+        TimeoutNode* timeout;
+
+        unsigned int length() const { return this->last - this->first + 1; }
+    };
+
+  protected:
+
+    // the ranges of one key, sorted by first revision
+    typedef struct
+    {
+        vector<Range*> ranges;
+        unsigned int longest;  // no range here is longer (ranges only shrink)
+    } RangeList;
+
+    FlatHash<uint32_t, RangeList*> m_keys;
+    vector<RangeList*> m_spare;          // emptied lists, for keys to come
+    Timeouts m_timeouts;
+    SlabPool<Range> m_pool;
+
+    vector<unsigned int> m_outstanding;  // revisions requested, by client
+    unsigned int m_count;                // ranges
+
+    mutable vector<Range*> m_found;      // reused by stabbing queries
+    vector<Range*> m_expired;            // reused by expire_until
+
+    // gathers what the timeout index expires
+    struct ExpiryCollector
+    {
+        vector<Range*>* out;
+        void operator()(Range* r) { out->push_back(r); }
+    };
+
+    static bool first_less(const Range* r, MCCI_REVISION_T first) { return r->first < first; }
+    static bool less_first(MCCI_REVISION_T first, const Range* r) { return first < r->first; }
+
+    // the bank owns its ranges; copying it makes no sense
+    RangeRequestBank(const RangeRequestBank &rhs);
+    RangeRequestBank& operator=(const RangeRequestBank &rhs);
+
+  public:
+
+    RangeRequestBank(unsigned int max_clients, unsigned int size) :
+        m_outstanding(max_clients + 1, 0),
+        m_count(0)
+    {
+        this->m_keys.resize_nearest_prime(size);
+    }
+
+    ~RangeRequestBank()
+    {
+        this->clear();
+        for (unsigned int i = 0; i < this->m_spare.size(); ++i) delete this->m_spare[i];
+    }
+
+    friend ostream& operator<<(ostream &out, RangeRequestBank const &rhs)
+    { return out << rhs.m_timeouts; }
+
+    // request revisions first to last of a key for a client, until the timeout
+    void add(uint32_t key, MCCI_REVISION_T first, MCCI_REVISION_T last,
+             MCCI_CLIENT_ID_T client_id, MCCI_TIME_T timeout)
+    {
+        if (client_id >= this->m_outstanding.size()) throw string("Client ID too high");
+        if (first > last) return;
+
+        // whatever the client already has of these revisions goes to the new range
+        this->m_found.clear();
+        RangeList** list = this->m_keys.lookup(key);
+        if (list)
+        {
+            vector<Range*>& v = (*list)->ranges;
+            MCCI_REVISION_T from = first >= (*list)->longest ? first - (*list)->longest + 1 : 0;
+            for (vector<Range*>::iterator it = lower_bound(v.begin(), v.end(), from, first_less);
+                 it != v.end() && (*it)->first <= last; ++it)
+            {
+                if (client_id == (*it)->client_id && first <= (*it)->last) this->m_found.push_back(*it);
+            }
+        }
+        for (unsigned int i = 0; i < this->m_found.size(); ++i) this->carve(this->m_found[i], first, last);
+
+        Range* r = (Range*)this->m_pool.allocate();
+        r->key = key;
+        r->first = first;
+        r->last = last;
+        r->client_id = client_id;
+        r->timeout = this->m_timeouts.insert(timeout, r);
+        this->link(r);
+
+        this->m_outstanding[client_id] += r->length();
+    }
+
+    // remove a delivered revision from every range that holds it; returns how many did
+    unsigned int fulfill(uint32_t key, MCCI_REVISION_T revision)
+    {
+        this->stab(key, revision);
+        for (unsigned int i = 0; i < this->m_found.size(); ++i)
+            this->carve(this->m_found[i], revision, revision);
+
+        return this->m_found.size();
+    }
+
+    // add the clients that want a revision to a client set
+    void collect_subscribers(uint32_t key, MCCI_REVISION_T revision, ClientBitset& clients) const
+    {
+        this->stab(key, revision);
+        for (unsigned int i = 0; i < this->m_found.size(); ++i) clients.set(this->m_found[i]->client_id);
+    }
+
+    // whether a client wants a revision
+    bool contains(uint32_t key, MCCI_REVISION_T revision, MCCI_CLIENT_ID_T client_id) const
+    {
+        this->stab(key, revision);
+        for (unsigned int i = 0; i < this->m_found.size(); ++i)
+            if (client_id == this->m_found[i]->client_id) return true;
+
+        return false;
+    }
+
+    // whether anyone wants a revision
+    bool contains(uint32_t key, MCCI_REVISION_T revision) const
+    {
+        this->stab(key, revision);
+        return !this->m_found.empty();
+    }
+
+    // remove every range with a timeout at or before the deadline; returns how many went
+    unsigned int expire_until(MCCI_TIME_T deadline)
+    {
+        ExpiryCollector collect;
+        collect.out = &(this->m_expired);
+        this->m_expired.clear();
+
+        // the timeout index has already let go of the nodes
+        this->m_timeouts.expire_until(deadline, collect);
+        for (unsigned int i = 0; i < this->m_expired.size(); ++i)
+        {
+            Range* r = this->m_expired[i];
+            this->m_outstanding[r->client_id] -= r->length();
+            this->unlink(r);
+            this->m_pool.deallocate(r);
+        }
+
+        return this->m_expired.size();
+    }
+
+    // remove every range of a client (e.g. one that disconnected); returns how many went
+    unsigned int remove_client(MCCI_CLIENT_ID_T client_id)
+    {
+        if (client_id >= this->m_outstanding.size() || !this->m_outstanding[client_id]) return 0;
+
+        this->m_expired.clear();
+        FlatHash<uint32_t, RangeList*>::iterator it;
+        for (it = this->m_keys.begin(); it != this->m_keys.end(); ++it)
+        {
+            vector<Range*>& v = it->second->ranges;
+            for (unsigned int i = 0; i < v.size(); ++i)
+                if (client_id == v[i]->client_id) this->m_expired.push_back(v[i]);
+        }
+
+        for (unsigned int i = 0; i < this->m_expired.size(); ++i)
+        {
+            Range* r = this->m_expired[i];
+            this->m_timeouts.remove(r->timeout, 0);
+            this->m_outstanding[client_id] -= r->length();
+            this->unlink(r);
+            this->m_pool.deallocate(r);
+        }
+
+        return this->m_expired.size();
+    }
+
+    // remove every range
+    void clear()
+    {
+        this->m_timeouts.clear();
+
+        FlatHash<uint32_t, RangeList*>::iterator it;
+        for (it = this->m_keys.begin(); it != this->m_keys.end(); ++it)
+        {
+            vector<Range*>& v = it->second->ranges;
+            for (unsigned int i = 0; i < v.size(); ++i) this->m_pool.deallocate(v[i]);
+            v.clear();
+            this->m_spare.push_back(it->second);
+        }
+        this->m_keys.clear();
+
+        for (unsigned int i = 0; i < this->m_outstanding.size(); ++i) this->m_outstanding[i] = 0;
+        this->m_count = 0;
+    }
+
+    // whether there are any requests, and the number of ranges
+    bool empty() const { return 0 == this->m_count; }
+    unsigned int size() const { return this->m_count; }
+
+    // get the timeout of the range that will expire first
+    MCCI_TIME_T minimum_timeout() const { return this->m_timeouts.minimum()->key(); }
+
+    // number of revisions requested by a client and not yet delivered
+    unsigned int get_outstanding_request_count(MCCI_CLIENT_ID_T client_id) const
+    {
+        return this->m_outstanding[client_id];
+    }
+
+  protected:
+
+    // the ranges of a key that hold a revision, into m_found
+    void stab(uint32_t key, MCCI_REVISION_T revision) const
+    {
+        this->m_found.clear();
+        RangeList** list = this->m_keys.lookup(key);
+        if (!list) return;
+
+        // a range holding the revision starts at most longest - 1 before it
+        const vector<Range*>& v = (*list)->ranges;
+        MCCI_REVISION_T from = revision >= (*list)->longest ? revision - (*list)->longest + 1 : 0;
+        for (vector<Range*>::const_iterator it = lower_bound(v.begin(), v.end(), from, first_less);
+             it != v.end() && (*it)->first <= revision; ++it)
+        {
+            if (revision <= (*it)->last) this->m_found.push_back(*it);
+        }
+    }
+
+    // put a range in its key's list
+    void link(Range* r)
+    {
+        RangeList** list = this->m_keys.lookup(r->key);
+        if (!list)
+        {
+            RangeList* fresh;
+            if (this->m_spare.empty())
+            {
+                fresh = new RangeList();
+            }
+            else
+            {
+                fresh = this->m_spare.back();
+                this->m_spare.pop_back();
+            }
+            fresh->longest = 0;
+            this->m_keys[r->key] = fresh;
+            list = this->m_keys.lookup(r->key);
+        }
+
+        vector<Range*>& v = (*list)->ranges;
+        v.insert(upper_bound(v.begin(), v.end(), r->first, less_first), r);
+        (*list)->longest = max((*list)->longest, r->length());
+        ++(this->m_count);
+    }
+
+    // where a range is in its key's list
+    vector<Range*>::iterator position(vector<Range*>& v, Range* r)
+    {
+        vector<Range*>::iterator it = lower_bound(v.begin(), v.end(), r->first, first_less);
+        while (*it != r) ++it;
+        return it;
+    }
+
+    // take a range out of its key's list, setting the list aside if it's empty
+    void unlink(Range* r)
+    {
+        RangeList* list = this->m_keys[r->key];
+        vector<Range*>& v = list->ranges;
+
+        v.erase(this->position(v, r));
+        --(this->m_count);
+
+        if (v.empty())
+        {
+            this->m_spare.push_back(list);
+            this->m_keys.remove(r->key);
+        }
+    }
+
+    // remove revisions first to last from a range
+    void carve(Range* r, MCCI_REVISION_T first, MCCI_REVISION_T last)
+    {
+        MCCI_REVISION_T lo = max(first, r->first);
+        MCCI_REVISION_T hi = min(last, r->last);
+        if (lo > hi) return;
+
+        this->m_outstanding[r->client_id] -= hi - lo + 1;
+
+        if (lo == r->first && hi == r->last)
+        {
+            // all of it
+            this->m_timeouts.remove(r->timeout, 0);
+            this->unlink(r);
+            this->m_pool.deallocate(r);
+        }
+        else if (lo == r->first)
+        {
+            // the front: it keeps its place unless the next range starts in the part cut off
+            vector<Range*>& v = this->m_keys[r->key]->ranges;
+            vector<Range*>::iterator next = this->position(v, r) + 1;
+            if (next == v.end() || hi + 1 <= (*next)->first)
+            {
+                r->first = hi + 1;
+            }
+            else
+            {
+                this->unlink(r);
+                r->first = hi + 1;
+                this->link(r);
+            }
+        }
+        else if (hi == r->last)
+        {
+            r->last = lo - 1;
+        }
+        else
+        {
+            // the middle: the rest goes into a range of its own, with the same timeout
+            Range* tail = (Range*)this->m_pool.allocate();
+            tail->key = r->key;
+            tail->first = hi + 1;
+            tail->last = r->last;
+            tail->client_id = r->client_id;
+            tail->timeout = this->m_timeouts.insert(r->timeout->key(), tail);
+
+            r->last = lo - 1;
+            this->link(tail);
+        }
+    }
+};
@@ -0,0 +1,211 @@
+#include "RangeRequestBank.h"
+#include "MCCIRequestBanks.h"
+#include "MCCIBenchmark.h"
+#include <map>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+using namespace std;
+
+
+void test_ranges()
+{
+    RangeRequestBank bank(10, 8);
+    ClientBitset clients;
+
+    printf("\n\nClient 1 wants revisions 10 to 19 of key 5, client 2 wants 15 to 24");
+    bank.add(5, 10, 19, 1, 100);
+    bank.add(5, 15, 24, 2, 200);
+    assert(2 == bank.size());
+    assert(10 == bank.get_outstanding_request_count(1));
+    assert(10 == bank.get_outstanding_request_count(2));
+    assert(100 == bank.minimum_timeout());
+
+    bank.collect_subscribers(5, 17, clients);
+    assert(2 == clients.count());
+    assert(!bank.contains(5, 9) && !bank.contains(5, 25) && !bank.contains(6, 17));
+    assert(bank.contains(5, 12, 1) && !bank.contains(5, 12, 2));
+
+    printf("\nDelivering 10 shrinks client 1's range from the front");
+    assert(1 == bank.fulfill(5, 10));
+    assert(!bank.contains(5, 10));
+    assert(9 == bank.get_outstanding_request_count(1));
+    assert(2 == bank.size());
+
+    printf("\nDelivering 17 splits both ranges");
+    assert(2 == bank.fulfill(5, 17));
+    assert(4 == bank.size());
+    assert(8 == bank.get_outstanding_request_count(1));
+    assert(9 == bank.get_outstanding_request_count(2));
+    assert(bank.contains(5, 16, 1) && bank.contains(5, 18, 1) && !bank.contains(5, 17));
+
+    printf("\nClient 1 asks again for 18 to 30, with a later timeout");
+    bank.add(5, 18, 30, 1, 300);
+    assert(6 + 13 == bank.get_outstanding_request_count(1));
+
+    printf("\nExpiring at 100 leaves client 1 only what it asked for again");
+    assert(1 == bank.expire_until(100));
+    assert(13 == bank.get_outstanding_request_count(1));
+    assert(!bank.contains(5, 16, 1) && bank.contains(5, 18, 1) && bank.contains(5, 30, 1));
+    assert(200 == bank.minimum_timeout());
+
+    assert(2 == bank.expire_until(200));
+    assert(0 == bank.get_outstanding_request_count(2));
+    assert(1 == bank.size());
+
+    bank.clear();
+    assert(bank.empty());
+    assert(0 == bank.get_outstanding_request_count(1));
+
+    bool thrown = false;
+    try { bank.add(5, 1, 2, 11, 100); } catch (string s) { thrown = true; }
+    assert(thrown);
+}
+
+
+// random operations, checked against a map of every (key, revision, client)
+void test_random()
+{
+    typedef map<MCCI_CLIENT_ID_T, MCCI_TIME_T> Clients;
+    map<pair<uint32_t, MCCI_REVISION_T>, Clients> model;
+    RangeRequestBank bank(8, 4);
+    MCCI_TIME_T now = 1;
+
+    printf("\n\nRunning 20000 random operations");
+    srand(1234);
+    for (int op = 0; op < 20000; ++op)
+    {
+        uint32_t key = rand() % 3;
+        MCCI_REVISION_T rev = 1 + rand() % 150;
+        int what = rand() % 10;
+
+        if (what < 5)
+        {
+            MCCI_REVISION_T last = rev + rand() % (rand() % 4 ? 5 : 60);
+            MCCI_CLIENT_ID_T client = 1 + rand() % 8;
+            MCCI_TIME_T timeout = now + rand() % 50;
+
+            bank.add(key, rev, last, client, timeout);
+            for (MCCI_REVISION_T r = rev; r <= last; ++r) model[make_pair(key, r)][client] = timeout;
+        }
+        else if (what < 9)
+        {
+            bank.fulfill(key, rev);
+            model.erase(make_pair(key, rev));
+        }
+        else
+        {
+            now += rand() % 10;
+            bank.expire_until(now);
+
+            map<pair<uint32_t, MCCI_REVISION_T>, Clients>::iterator it;
+            for (it = model.begin(); it != model.end(); ++it)
+            {
+                Clients::iterator c = it->second.begin();
+                while (c != it->second.end())
+                {
+                    if (c->second <= now) it->second.erase(c++);
+                    else ++c;
+                }
+            }
+        }
+
+        if (op % 100) continue;
+
+        // compare everything
+        unsigned int outstanding[9] = {0};
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            for (MCCI_REVISION_T r = 0; r < 220; ++r)
+            {
+                ClientBitset expect, got;
+                map<pair<uint32_t, MCCI_REVISION_T>, Clients>::iterator it = model.find(make_pair(k, r));
+                if (it != model.end())
+                {
+                    for (Clients::iterator c = it->second.begin(); c != it->second.end(); ++c)
+                    {
+                        expect.set(c->first);
+                        ++outstanding[c->first];
+                    }
+                }
+
+                bank.collect_subscribers(k, r, got);
+                assert(expect.count() == got.count());
+                for (MCCI_CLIENT_ID_T c = 1; c <= 8; ++c) assert(expect.test(c) == got.test(c));
+            }
+        }
+        for (MCCI_CLIENT_ID_T c = 1; c <= 8; ++c)
+            assert(outstanding[c] == bank.get_outstanding_request_count(c));
+    }
+
+    printf("\n%u ranges left", bank.size());
+}
+
+
+// what a request for the next 500 revisions costs, as ranges and one at a time
+void bench_long_requests()
+{
+    const unsigned int CLIENTS = 100;
+    const unsigned int SPAN = 500;
+    const unsigned int ROUNDS = 20;
+
+    CMCCIStopwatch sw;
+    for (unsigned int round = 0; round < ROUNDS; ++round)
+    {
+        RangeRequestBank bank(CLIENTS, 16);
+        for (MCCI_CLIENT_ID_T c = 1; c <= CLIENTS; ++c) bank.add(1, 1000 + c, 1000 + c + SPAN - 1, c, 100);
+        for (MCCI_REVISION_T r = 1001; r < 1001 + CLIENTS + SPAN; ++r)
+        {
+            ClientBitset clients;
+            bank.collect_subscribers(1, r, clients);
+            benchmark_sink += clients.count();
+            bank.fulfill(1, r);
+        }
+        assert(bank.empty());
+    }
+    benchmark_report("500-revision requests, subscribe and deliver", "ranges",
+                     ROUNDS * CLIENTS, sw.elapsed_ns());
+
+    sw.start();
+    for (unsigned int round = 0; round < ROUNDS; ++round)
+    {
+        VariableRevisionRequestBank bank(CLIENTS, 16, 16);
+        for (MCCI_CLIENT_ID_T c = 1; c <= CLIENTS; ++c)
+        {
+            for (MCCI_REVISION_T r = 1000 + c; r < 1000 + c + SPAN; ++r)
+            {
+                VarRevPair vr;
+                vr.var = 1;
+                vr.rev = r;
+                bank.add(vr, c, 100);
+            }
+        }
+        for (MCCI_REVISION_T r = 1001; r < 1001 + CLIENTS + SPAN; ++r)
+        {
+            VarRevPair vr;
+            vr.var = 1;
+            vr.rev = r;
+
+            ClientBitset clients;
+            bank.collect_subscribers(vr, clients);
+            benchmark_sink += clients.count();
+            if (bank.contains(vr)) bank.remove_by_key(vr);
+        }
+        assert(bank.empty());
+    }
+    benchmark_report("500-revision requests, subscribe and deliver", "per revision",
+                     ROUNDS * CLIENTS, sw.elapsed_ns());
+}
+
+
+int main(int argc, char* argv[])
+{
+    test_ranges();
+    test_random();
+    bench_long_requests();
+
+    printf("\n\n");
+    return 0;
+}
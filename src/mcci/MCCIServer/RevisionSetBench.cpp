@@ -0,0 +1,118 @@
+#include "MCCIRevisionSet.h"
+#include "MCCIRevisionStoreMapped.h"
+#include "MCCIBenchmark.h"
+#include "MCCITypes.h"
+
+#include <sqlite3.h>
+#include <stdio.h>
+#include <unistd.h>
+
+using namespace std;
+
+/**
+   Production throughput of the revision set: revisions handed out per second
+   over 16 variables, writing every revision to the DB (a lease of 1) or leasing
+   them in blocks, with the writes made on the producing thread or handed to the
+   write-behind thread, and in a memory-mapped revision file.  The DB and file are
+   scratch files in the working directory; the DB is set up as
+   src/sql/revisions.sql does.
+ */
+
+
+static const char* BENCH_DB = "revision_bench.sqlite3";
+static const unsigned int VARS = 16;
+
+
+sqlite3* open_scratch_db()
+{
+    sqlite3* db;
+    unlink(BENCH_DB);
+    if (SQLITE_OK != sqlite3_open_v2(BENCH_DB, &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL))
+        throw string("Couldn't open ") + BENCH_DB;
+
+    sqlite3_exec(db,
+                 "create table signature("
+                 "    signature_id integer primary key autoincrement,"
+                 "    signature text not null unique);"
+                 "create table revision("
+                 "    var_id integer not null,"
+                 "    signature_id integer not null,"
+                 "    revision integer not null,"
+                 "    primary key (var_id, signature_id));",
+                 NULL, NULL, NULL);
+    return db;
+}
+
+
+void bench_produce(unsigned int lease, bool write_behind, unsigned long productions)
+{
+    sqlite3* db = open_scratch_db();
+    CMCCIRevisionSet* rs = new CMCCIRevisionSet(db, VARS, "bench_signature");
+    rs->set_lease(lease);
+    if (write_behind) rs->set_write_behind(10, 256);
+
+    // the first revision of each variable inserts its row; leave that out
+    for (MCCI_VARIABLE_T v = 1; v <= VARS; ++v) rs->get_revision(v);
+
+    char variant[32];
+    snprintf(variant, sizeof(variant), "lease %u%s", lease, write_behind ? ", write-behind" : "");
+
+    CMCCIStopwatch sw;
+    for (unsigned long i = 0; i < productions; ++i)
+        benchmark_sink += rs->inc_revision(1 + i % VARS);
+    rs->flush();
+    benchmark_report("inc_revision, 16 variables", variant, productions, sw.elapsed_ns());
+
+    delete rs;
+    sqlite3_close(db);
+    unlink(BENCH_DB);
+    unlink((string(BENCH_DB) + "-wal").c_str());
+    unlink((string(BENCH_DB) + "-shm").c_str());
+}
+
+
+void bench_produce_mapped(unsigned int lease, unsigned long productions)
+{
+    string path = CMCCIRevisionStoreMapped::path_of(".", "bench_signature");
+    unlink(path.c_str());
+
+    CMCCIRevisionStoreMapped* store = new CMCCIRevisionStoreMapped(".", "bench_signature");
+    CMCCIRevisionSet* rs = new CMCCIRevisionSet(store, VARS);
+    rs->set_lease(lease);
+
+    char variant[32];
+    snprintf(variant, sizeof(variant), "lease %u, mapped", lease);
+
+    CMCCIStopwatch sw;
+    for (unsigned long i = 0; i < productions; ++i)
+        benchmark_sink += rs->inc_revision(1 + i % VARS);
+    benchmark_report("inc_revision, 16 variables", variant, productions, sw.elapsed_ns());
+
+    delete rs;
+    delete store;
+    unlink(path.c_str());
+}
+
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        bench_produce(1, false, 20000);
+        bench_produce(1, true, 2000000);
+        bench_produce(16, false, 200000);
+        bench_produce(16, true, 2000000);
+        bench_produce(1024, false, 2000000);
+        bench_produce(1024, true, 2000000);
+        bench_produce_mapped(1, 2000000);
+        bench_produce_mapped(1024, 2000000);
+    }
+    catch (string s)
+    {
+        fprintf(stderr, "\n\nGot error: %s\n\n", s.c_str());
+        return 1;
+    }
+
+    printf("\n\n");
+    return 0;
+}
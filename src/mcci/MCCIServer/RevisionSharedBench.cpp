@@ -0,0 +1,114 @@
+#include "MCCIRevisionStoreShared.h"
+#include "MCCIRevisionStoreMapped.h"
+#include "MCCIRevisionSet.h"
+#include "MCCIBenchmark.h"
+#include "MCCITypes.h"
+
+#include <vector>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+
+using namespace std;
+
+/**
+   Contention on the shared revisions: 1 to 8 processes take revisions through
+   one segment at once, all of the same variable or each of its own (whose slots
+   are on separate cache lines).  This process persists, to a revision file in
+   the working directory, leasing 1024 revisions at a time; the time is from the
+   start signal until the last process is done.
+ */
+
+
+static const char* SIGNATURE = "bench_signature";
+static const unsigned int VARS = 8;
+static const unsigned long PER_PROCESS = 2000000;
+
+
+void bench_contention(vector<MCCI_VARIABLE_T> const &vars, unsigned int processes, bool same_variable)
+{
+    int ready[2], go[2];
+    if (pipe(ready) || pipe(go)) throw string("Couldn't make pipes");
+
+    vector<pid_t> children;
+    for (unsigned int p = 0; p < processes; ++p)
+    {
+        pid_t child = fork();
+        if (child)
+        {
+            children.push_back(child);
+            continue;
+        }
+
+        close(go[1]);
+        CMCCIRevisionStoreShared* store = new CMCCIRevisionStoreShared(SIGNATURE, vars, NULL);
+        CMCCIRevisionSet* rs = new CMCCIRevisionSet(store, VARS);
+        MCCI_VARIABLE_T var = same_variable ? vars[0] : vars[p];
+        rs->get_revision(var);
+
+        // attached: wait for the start, which is the other end closing
+        char c = 0;
+        if (1 != write(ready[1], &c, 1) || 0 != read(go[0], &c, 1)) _exit(1);
+
+        unsigned long sink = 0;
+        for (unsigned long i = 0; i < PER_PROCESS; ++i) sink += rs->inc_revision(var);
+
+        delete rs;
+        delete store;
+        _exit(sink ? 0 : 1);
+    }
+
+    close(go[0]);
+    for (unsigned int p = 0; p < processes; ++p)
+    {
+        char c;
+        if (1 != read(ready[0], &c, 1)) throw string("A process didn't start");
+    }
+
+    CMCCIStopwatch sw;
+    close(go[1]);
+    for (unsigned int p = 0; p < processes; ++p) waitpid(children[p], NULL, 0);
+
+    char variant[40];
+    snprintf(variant, sizeof(variant), "%u proc, %s", processes, same_variable ? "same var" : "own var");
+    benchmark_report("shared inc_revision", variant, processes * PER_PROCESS, sw.elapsed_ns());
+
+    close(ready[0]);
+    close(ready[1]);
+}
+
+
+int main(int argc, char* argv[])
+{
+    vector<MCCI_VARIABLE_T> vars;
+    for (MCCI_VARIABLE_T v = 1; v <= VARS; ++v) vars.push_back(v);
+
+    string path = CMCCIRevisionStoreMapped::path_of(".", SIGNATURE);
+    unlink(path.c_str());
+    shm_unlink(CMCCIRevisionStoreShared::name_of(SIGNATURE).c_str());
+
+    try
+    {
+        CMCCIRevisionStoreMapped backing(".", SIGNATURE);
+        CMCCIRevisionStoreShared owner(SIGNATURE, vars, &backing);
+
+        for (unsigned int processes = 1; processes <= VARS; processes *= 2)
+        {
+            bench_contention(vars, processes, true);
+            bench_contention(vars, processes, false);
+        }
+
+        printf("\n\n  %u revisions handed out, the file holds %u for variable 1",
+               owner.get(1), backing.get(1));
+    }
+    catch (string s)
+    {
+        fprintf(stderr, "\n\nGot error: %s\n\n", s.c_str());
+        return 1;
+    }
+
+    unlink(path.c_str());
+    printf("\n\n");
+    return 0;
+}
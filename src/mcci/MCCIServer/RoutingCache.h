@@ -0,0 +1,199 @@
+#pragma once
+
+#include "MCCIRequestBanks.h"
+#include "ClientBitset.h"
+#include "DenseIdMap.h"
+#include "FlatHash.h"
+#include "MCCITypes.h"
+
+
+/**
+   The standing subscribers to data from a (host, variable): the union of what the
+   all, host, variable and host/variable banks hold for it, kept from one packet to
+   the next instead of being rebuilt from the four banks every time.
+
+   The cache listens to the four banks.  A change in the host/variable bank marks
+   its one route stale.  Changes in the host or variable banks bump a generation
+   counter for that host or variable, and changes in the all bank (or any bank
+   being cleared) bump a global epoch; each route remembers the counters it was
+   built with and is rebuilt when one of them has moved on.  So a change costs
+   O(1) however many routes it affects.
+
+   The revision-specific banks change with nearly every packet, so they are left
+   out: callers probe them per packet as before.
+ */
+class RoutingCache
+{
+  protected:
+
+    typedef struct
+    {
+        ClientBitset clients;
+        bool valid;            // false once the host/variable bank changed for it
+        unsigned long epoch;   // the counters this route was built with
+        unsigned long host_generation;
+        unsigned long var_generation;
+    } Route;
+
+
+    // the listeners the banks call; each just moves a counter on
+    class AllListener : public SubscriptionListener<bool>
+    {
+      public:
+        RoutingCache* cache;
+        virtual void subscribers_changed(bool const key_set) { ++(this->cache->m_epoch); }
+        virtual void subscribers_cleared() { ++(this->cache->m_epoch); }
+    };
+
+    class HostListener : public SubscriptionListener<MCCI_NODE_ADDRESS_T>
+    {
+      public:
+        RoutingCache* cache;
+        virtual void subscribers_changed(MCCI_NODE_ADDRESS_T const host)
+        { ++(this->cache->m_host_generation[host]); }
+        virtual void subscribers_cleared() { ++(this->cache->m_epoch); }
+    };
+
+    class VariableListener : public SubscriptionListener<MCCI_VARIABLE_T>
+    {
+      public:
+        RoutingCache* cache;
+        virtual void subscribers_changed(MCCI_VARIABLE_T const var)
+        { ++(this->cache->m_var_generation[var]); }
+        virtual void subscribers_cleared() { ++(this->cache->m_epoch); }
+    };
+
+    class HostVariableListener : public SubscriptionListener<HostVarPair>
+    {
+      public:
+        RoutingCache* cache;
+        virtual void subscribers_changed(HostVarPair const hv)
+        {
+            Route* r = this->cache->m_routes.lookup(RoutingCache::key(hv.host, hv.var));
+            if (r) r->valid = false;
+        }
+        virtual void subscribers_cleared() { ++(this->cache->m_epoch); }
+    };
+
+
+    AllRequestBank&          m_bank_all;
+    HostRequestBank&         m_bank_host;
+    VariableRequestBank&     m_bank_var;
+    HostVariableRequestBank& m_bank_hostvar;
+
+    AllListener          m_all_listener;
+    HostListener         m_host_listener;
+    VariableListener     m_var_listener;
+    HostVariableListener m_hostvar_listener;
+
+    FlatHash<uint32_t, Route> m_routes; // by (host << 16) + var
+
+    unsigned long m_epoch;
+    DenseIdMap<MCCI_NODE_ADDRESS_T, unsigned long> m_host_generation;
+    DenseIdMap<MCCI_VARIABLE_T, unsigned long>     m_var_generation;
+
+    unsigned long m_hits;
+    unsigned long m_misses;
+
+    // the cache is tied to its banks
+    RoutingCache(const RoutingCache &rhs);
+    RoutingCache& operator=(const RoutingCache &rhs);
+
+  public:
+
+    RoutingCache(AllRequestBank& all,
+                 HostRequestBank& host,
+                 VariableRequestBank& var,
+                 HostVariableRequestBank& hostvar)
+      : m_bank_all(all), m_bank_host(host), m_bank_var(var), m_bank_hostvar(hostvar)
+    {
+        this->m_epoch  = 0;
+        this->m_hits   = 0;
+        this->m_misses = 0;
+
+        this->m_all_listener.cache     = this;
+        this->m_host_listener.cache    = this;
+        this->m_var_listener.cache     = this;
+        this->m_hostvar_listener.cache = this;
+
+        this->m_bank_all.set_listener(&(this->m_all_listener));
+        this->m_bank_host.set_listener(&(this->m_host_listener));
+        this->m_bank_var.set_listener(&(this->m_var_listener));
+        this->m_bank_hostvar.set_listener(&(this->m_hostvar_listener));
+    }
+
+    ~RoutingCache()
+    {
+        this->m_bank_all.set_listener(NULL);
+        this->m_bank_host.set_listener(NULL);
+        this->m_bank_var.set_listener(NULL);
+        this->m_bank_hostvar.set_listener(NULL);
+    }
+
+    // the standing subscribers to data from a host's variable.  the reference is good
+    //  until the next call
+    const ClientBitset& subscribers(MCCI_NODE_ADDRESS_T host, MCCI_VARIABLE_T var)
+    {
+        uint32_t k = key(host, var);
+        Route* r = this->m_routes.lookup(k);
+
+        unsigned long host_generation = this->generation(this->m_host_generation, host);
+        unsigned long var_generation  = this->generation(this->m_var_generation, var);
+
+        if (r && r->valid
+            && r->epoch == this->m_epoch
+            && r->host_generation == host_generation
+            && r->var_generation == var_generation)
+        {
+            ++(this->m_hits);
+            return r->clients;
+        }
+
+        ++(this->m_misses);
+        if (!r) r = &(this->m_routes[k]);
+
+        r->clients.clear();
+        this->m_bank_all.collect_subscribers(1, r->clients);
+        this->m_bank_host.collect_subscribers(host, r->clients);
+        this->m_bank_var.collect_subscribers(var, r->clients);
+
+        HostVarPair hv;
+        hv.host = host;
+        hv.var  = var;
+        this->m_bank_hostvar.collect_subscribers(hv, r->clients);
+
+        r->valid           = true;
+        r->epoch           = this->m_epoch;
+        r->host_generation = host_generation;
+        r->var_generation  = var_generation;
+
+        return r->clients;
+    }
+
+    // forget every route
+    void clear()
+    {
+        this->m_routes.clear();
+    }
+
+    unsigned int count() const { return this->m_routes.count(); }
+
+    // lookups answered from the cache, and lookups that had to rebuild a route
+    unsigned long hits() const { return this->m_hits; }
+    unsigned long misses() const { return this->m_misses; }
+
+
+  protected:
+
+    static uint32_t key(MCCI_NODE_ADDRESS_T host, MCCI_VARIABLE_T var)
+    {
+        return ((uint32_t)host << 16) + var;
+    }
+
+    template <typename Id>
+    static unsigned long generation(const DenseIdMap<Id, unsigned long>& generations, Id id)
+    {
+        unsigned long* g = generations.lookup(id);
+        return g ? *g : 0;
+    }
+};
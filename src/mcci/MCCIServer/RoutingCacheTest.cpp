@@ -0,0 +1,138 @@
+#include "RoutingCache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+using namespace std;
+
+
+// the union the cache should be holding, straight from the banks
+ClientBitset expected(AllRequestBank& all, HostRequestBank& host, VariableRequestBank& var,
+                      HostVariableRequestBank& hostvar, MCCI_NODE_ADDRESS_T h, MCCI_VARIABLE_T v)
+{
+    ClientBitset ret;
+    HostVarPair hv = {h, v};
+    all.collect_subscribers(1, ret);
+    host.collect_subscribers(h, ret);
+    var.collect_subscribers(v, ret);
+    hostvar.collect_subscribers(hv, ret);
+    return ret;
+}
+
+
+bool same(const ClientBitset& a, const ClientBitset& b)
+{
+    ClientBitset both;
+    both.merge(a);
+    both.merge(b);
+    return both.count() == a.count() && both.count() == b.count();
+}
+
+
+// random subscriptions, removals and expiries, checked against the banks after each one
+void test_against_banks()
+{
+    AllRequestBank all(200, 1);
+    HostRequestBank host(200, 8);
+    VariableRequestBank var(200, 16);
+    HostVariableRequestBank hostvar(200, 16);
+    RoutingCache routes(all, host, var, hostvar);
+    MCCI_TIME_T now = 1;
+
+    srand(1);
+    for (int i = 0; i < 50000; ++i)
+    {
+        MCCI_CLIENT_ID_T c = rand() % 200;
+        MCCI_NODE_ADDRESS_T h = 1 + rand() % 4;
+        MCCI_VARIABLE_T v = 1 + rand() % 10;
+        HostVarPair hv = {h, v};
+        MCCI_TIME_T timeout = now + 1 + rand() % 200;
+
+        switch (rand() % 8)
+        {
+            case 0: all.add(1, c, timeout); break;
+            case 1: host.add(h, c, timeout); break;
+            case 2: var.add(v, c, timeout); break;
+            case 3: hostvar.add(hv, c, timeout); break;
+            case 4:
+                if (var.contains(v)) var.remove_by_key(v);
+                if (hostvar.contains(hv)) hostvar.remove_by_key(hv);
+                break;
+            case 5:
+                now += rand() % 20;
+                all.expire_until(now);
+                host.expire_until(now);
+                var.expire_until(now);
+                hostvar.expire_until(now);
+                break;
+            case 6:
+                if (!host.empty()) host.remove_minimum();
+                break;
+            default:
+                if (0 == rand() % 500) var.clear();
+                break;
+        }
+
+        // look up a few routes, some of them repeatedly
+        for (int j = 0; j < 3; ++j)
+        {
+            MCCI_NODE_ADDRESS_T qh = 1 + rand() % 4;
+            MCCI_VARIABLE_T qv = 1 + rand() % 10;
+            assert(same(routes.subscribers(qh, qv), expected(all, host, var, hostvar, qh, qv)));
+        }
+    }
+
+    printf("\n\nRandomized: %d routes, %lu hits, %lu misses", routes.count(), routes.hits(), routes.misses());
+    assert(routes.hits() > 0);
+}
+
+
+// nothing changes, so only the first lookup of a route builds it
+void test_standing_routes()
+{
+    AllRequestBank all(10, 1);
+    HostRequestBank host(10, 8);
+    VariableRequestBank var(10, 16);
+    HostVariableRequestBank hostvar(10, 16);
+    RoutingCache routes(all, host, var, hostvar);
+
+    HostVarPair hv = {3, 4};
+    all.add(1, 1, 100);
+    host.add(3, 2, 100);
+    var.add(4, 3, 100);
+    hostvar.add(hv, 4, 100);
+    var.add(5, 5, 100);
+
+    for (int i = 0; i < 10; ++i) assert(4 == routes.subscribers(3, 4).count());
+    printf("\n\nStanding routes: %lu hits, %lu misses", routes.hits(), routes.misses());
+    assert(1 == routes.misses());
+
+    // a change to another variable leaves the route alone
+    var.add(6, 6, 100);
+    assert(4 == routes.subscribers(3, 4).count());
+    assert(1 == routes.misses());
+
+    // one to this host rebuilds it
+    host.add(3, 7, 100);
+    assert(5 == routes.subscribers(3, 4).count());
+    assert(2 == routes.misses());
+}
+
+
+int main()
+{
+    try
+    {
+        test_standing_routes();
+        test_against_banks();
+    }
+    catch (string s)
+    {
+        printf("\n\nERROR: %s\n", s.c_str());
+        return 1;
+    }
+
+    printf("\n\n");
+
+    return 0;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+
+using namespace std;
+
+
+/**
+   A bounded queue between exactly one producer thread and one consumer thread,
+   without locks.
+
+   The slots are a ring whose size is a power of two.  The producer only writes
+   the tail and the consumer only writes the head; each reads the other's index
+   to see how full the ring is.  A slot is written before the tail moves past it
+   (a release store, read with an acquire load) and read before the head moves
+   past it, so neither thread sees a slot the other is still using.  The indices
+   count up forever and are masked on use, so a full ring and an empty one are
+   told apart by their difference.
+
+   The two indices sit on separate cache lines, so the threads don't take turns
+   owning one line.
+ */
+template <typename T> class SPSCQueue
+{
+  protected:
+
+    vector<T> m_slots;
+    unsigned long m_mask;
+
+    char m_pad0[64];
+    unsigned long m_tail;  // next slot to fill; written by the producer
+    char m_pad1[64];
+    unsigned long m_head;  // next slot to empty; written by the consumer
+    char m_pad2[64];
+
+    // the indices belong to two threads; copying them makes no sense
+    SPSCQueue(const SPSCQueue &rhs);
+    SPSCQueue& operator=(const SPSCQueue &rhs);
+
+  public:
+
+    // room for at least the given number of items
+    SPSCQueue(unsigned long capacity)
+    {
+        unsigned long size = 1;
+        while (size < capacity) size <<= 1;
+
+        this->m_slots.resize(size);
+        this->m_mask = size - 1;
+        this->m_tail = 0;
+        this->m_head = 0;
+    }
+
+    unsigned long capacity() const { return this->m_mask + 1; }
+
+    // producer: add an item, or return false if the queue is full
+    bool push(const T& item)
+    {
+        unsigned long tail = this->m_tail;
+        if (tail - __atomic_load_n(&this->m_head, __ATOMIC_ACQUIRE) > this->m_mask) return false;
+
+        this->m_slots[tail & this->m_mask] = item;
+        __atomic_store_n(&this->m_tail, tail + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    // consumer: take the oldest item, or return false if the queue is empty
+    bool pop(T& item)
+    {
+        unsigned long head = this->m_head;
+        if (head == __atomic_load_n(&this->m_tail, __ATOMIC_ACQUIRE)) return false;
+
+        item = this->m_slots[head & this->m_mask];
+        __atomic_store_n(&this->m_head, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    // either thread: a snapshot, which may be stale by the time it's used
+    bool empty() const { return 0 == this->size(); }
+    unsigned long size() const
+    {
+        return __atomic_load_n(&this->m_tail, __ATOMIC_ACQUIRE) -
+               __atomic_load_n(&this->m_head, __ATOMIC_ACQUIRE);
+    }
+};
@@ -0,0 +1,84 @@
+#include "SPSCQueue.h"
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+#include <assert.h>
+
+using namespace std;
+
+
+void test_single_thread()
+{
+    SPSCQueue<int> q(5);
+    int v;
+
+    printf("\n\nA queue for 5 rounds up to %lu slots", q.capacity());
+    assert(8 == q.capacity());
+    assert(q.empty() && !q.pop(v));
+
+    for (int i = 0; i < 8; ++i) assert(q.push(i));
+    assert(!q.push(8));
+    assert(8 == q.size());
+
+    printf("\nEmptying and refilling it past the end of the ring");
+    for (int round = 0; round < 3; ++round)
+    {
+        for (int i = 0; i < 5; ++i)
+        {
+            assert(q.pop(v));
+            assert(round * 5 + i == v);
+        }
+        for (int i = 0; i < 5; ++i) assert(q.push(8 + round * 5 + i));
+    }
+    assert(8 == q.size());
+
+    for (int i = 15; i < 23; ++i)
+    {
+        assert(q.pop(v));
+        assert(i == v);
+    }
+    assert(q.empty() && !q.pop(v));
+}
+
+
+// one thread counts up through a small queue; the other checks it gets every number in order
+static const unsigned long COUNT = 2000000;
+
+void* produce(void* arg)
+{
+    SPSCQueue<unsigned long>* q = (SPSCQueue<unsigned long>*)arg;
+    for (unsigned long i = 1; i <= COUNT; ++i)
+        while (!q->push(i)) sched_yield();
+    return NULL;
+}
+
+void test_two_threads()
+{
+    SPSCQueue<unsigned long> q(64);
+    pthread_t producer;
+
+    printf("\n\nPassing %lu numbers between two threads", COUNT);
+    pthread_create(&producer, NULL, produce, &q);
+
+    unsigned long expect = 1;
+    unsigned long v;
+    while (expect <= COUNT)
+    {
+        if (!q.pop(v)) continue;
+        assert(expect == v);
+        ++expect;
+    }
+
+    pthread_join(producer, NULL);
+    assert(q.empty());
+}
+
+
+int main(int argc, char* argv[])
+{
+    test_single_thread();
+    test_two_threads();
+
+    printf("\n\n");
+    return 0;
+}
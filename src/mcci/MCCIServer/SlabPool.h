@@ -0,0 +1,128 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdlib.h>
+
+using namespace std;
+
+
+/**
+   A fixed-size object pool that hands out storage for one T at a time.
+
+   Storage is carved from contiguous chunks of SLAB_SIZE objects, and freed
+   objects go onto a free list to be handed out again, so a steady churn of
+   allocations never reaches malloc.  Chunks are only returned when the pool is
+   destroyed.
+
+   The pool deals in raw storage: callers construct with placement new and must
+   call the destructor themselves before deallocate().
+
+   hits() counts allocations served from the free list, misses() counts those
+   that needed fresh storage.
+ */
+template <typename T, unsigned int SLAB_SIZE = 256> class SlabPool
+{
+  protected:
+
+    // a free slot holds the link to the next free slot; a used one holds a T
+    typedef union Slot
+    {
+        union Slot* next;
+        char        storage[sizeof(T)];
+        long double align;
+    } Slot;
+
+    vector<Slot*> m_chunks;   // every chunk ever allocated
+    Slot* m_free;             // the free list
+    Slot* m_fresh;            // the next never-used slot in the newest chunk
+    unsigned int m_fresh_left;
+
+    unsigned long m_hits;
+    unsigned long m_misses;
+
+    // a pool owns its storage; copying it makes no sense
+    SlabPool(const SlabPool &rhs);
+    SlabPool& operator=(const SlabPool &rhs);
+
+  public:
+
+    SlabPool()
+    {
+        this->m_free       = NULL;
+        this->m_fresh      = NULL;
+        this->m_fresh_left = 0;
+        this->m_hits       = 0;
+        this->m_misses     = 0;
+    }
+
+    ~SlabPool()
+    {
+        for (typename vector<Slot*>::iterator it = this->m_chunks.begin(); it != this->m_chunks.end(); ++it)
+            free(*it);
+    }
+
+    // storage for one T
+    void* allocate()
+    {
+        if (this->m_free)
+        {
+            Slot* s = this->m_free;
+            this->m_free = s->next;
+            ++(this->m_hits);
+            return s;
+        }
+
+        ++(this->m_misses);
+
+        if (!this->m_fresh_left)
+        {
+            this->m_fresh = (Slot*)malloc(SLAB_SIZE * sizeof(Slot));
+            if (!this->m_fresh) throw string("SlabPool could not allocate a chunk");
+            this->m_chunks.push_back(this->m_fresh);
+            this->m_fresh_left = SLAB_SIZE;
+        }
+
+        --(this->m_fresh_left);
+        return this->m_fresh++;
+    }
+
+    // return storage (whose T has already been destroyed) to the pool
+    void deallocate(void* p)
+    {
+        Slot* s = (Slot*)p;
+        s->next = this->m_free;
+        this->m_free = s;
+    }
+
+    unsigned long hits() const { return this->m_hits; }
+    unsigned long misses() const { return this->m_misses; }
+
+    // the number of objects the pool can hold without allocating another chunk
+    unsigned long capacity() const { return this->m_chunks.size() * SLAB_SIZE; }
+};
+
+
+/**
+   The same interface, straight to operator new and delete.  Every allocation is a miss.
+ */
+template <typename T> class HeapAllocator
+{
+  protected:
+    unsigned long m_misses;
+
+  public:
+    HeapAllocator() { this->m_misses = 0; }
+
+    void* allocate()
+    {
+        ++(this->m_misses);
+        return ::operator new(sizeof(T));
+    }
+
+    void deallocate(void* p) { ::operator delete(p); }
+
+    unsigned long hits() const { return 0; }
+    unsigned long misses() const { return this->m_misses; }
+    unsigned long capacity() const { return 0; }
+};
@@ -0,0 +1,86 @@
+#include "SlabPool.h"
+#include "FibonacciHeap.h"
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <assert.h>
+
+using namespace std;
+
+
+void test_pool()
+{
+    SlabPool<double, 4> pool;
+
+    printf("\n\nAllocating 6 doubles from a pool of 4-slot chunks");
+    vector<void*> p;
+    for (int i = 0; i < 6; ++i) p.push_back(pool.allocate());
+
+    printf("\nhits %lu, misses %lu, capacity %lu", pool.hits(), pool.misses(), pool.capacity());
+    assert(0 == pool.hits());
+    assert(6 == pool.misses());
+    assert(8 == pool.capacity());
+
+    // slots within a chunk are contiguous
+    assert((double*)p[1] - (double*)p[0] == (double*)p[2] - (double*)p[1]);
+
+    // freed storage is handed out again, most recent first
+    pool.deallocate(p[2]);
+    pool.deallocate(p[4]);
+    assert(p[4] == pool.allocate());
+    assert(p[2] == pool.allocate());
+    printf("\nAfter recycling 2: hits %lu, misses %lu", pool.hits(), pool.misses());
+    assert(2 == pool.hits());
+    assert(6 == pool.misses());
+
+    for (int i = 0; i < 6; ++i) pool.deallocate(p[i]);
+}
+
+
+void test_heap_churn()
+{
+    FibonacciHeap<unsigned int, string> h;
+    vector<FibonacciHeapNode<unsigned int, string>*> nodes;
+
+    for (unsigned int i = 0; i < 1000; ++i) nodes.push_back(h.insert(i + 10, "subscription"));
+
+    // expire half, remove a quarter by key, then renew them all
+    for (unsigned int i = 0; i < 500; ++i) h.remove_minimum();
+    for (unsigned int i = 500; i < 750; ++i) h.remove(nodes[i], 0);
+    for (unsigned int i = 0; i < 750; ++i) h.insert(i + 2000, "renewed");
+
+    printf("\n\nHeap churn: pool hits %lu, misses %lu, capacity %lu",
+           h.allocator().hits(), h.allocator().misses(), h.allocator().capacity());
+    assert(750 == h.allocator().hits());
+    assert(1000 == h.allocator().misses());
+
+    unsigned int last = 0;
+    unsigned int n = 0;
+    while (!h.empty())
+    {
+        assert(last <= h.minimum()->key());
+        last = h.minimum()->key();
+        h.remove_minimum();
+        ++n;
+    }
+    assert(1000 == n);
+
+    // plain new/delete never hits
+    FibonacciHeap<unsigned int, string, HeapAllocator<FibonacciHeapNode<unsigned int, string> > > plain;
+    plain.insert(1, "a");
+    plain.remove_minimum();
+    plain.insert(2, "b");
+    assert(0 == plain.allocator().hits());
+    assert(2 == plain.allocator().misses());
+}
+
+
+int main()
+{
+    test_pool();
+    test_heap_churn();
+
+    printf("\n\n");
+
+    return 0;
+}
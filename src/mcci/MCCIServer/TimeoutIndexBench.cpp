@@ -0,0 +1,125 @@
+#include "FibonacciHeap.h"
+#include "TimingWheel.h"
+#include "DaryHeap.h"
+#include "MCCIBenchmark.h"
+#include "MCCITypes.h"
+
+#include <vector>
+#include <stdlib.h>
+#include <stdio.h>
+
+using namespace std;
+
+/**
+   Compares the timeout indexes that RequestBank can be built on, with the
+   operations RequestBank performs: insert, renew (alter_key to a later time),
+   fulfil (remove by handle) and expire (remove_minimum while the minimum is due).
+
+   Timeouts are a mix of what clients ask for: 60% short (1-5 s), 30% medium
+   (20-40 s) and 10% long (4-6 min), in milliseconds.  Every simulated millisecond,
+   due requests expire, and the population is topped back up with new requests;
+   each new request is matched by a renewal and, every other time, a fulfilment.
+ */
+
+
+MCCI_TIME_T random_timeout()
+{
+    int r = rand() % 10;
+    if (r < 6) return 1000 + rand() % 4000;
+    if (r < 9) return 20000 + rand() % 20000;
+    return 240000 + rand() % 120000;
+}
+
+
+template <typename Index>
+void bench_index(const char* variant, unsigned int population, unsigned int ticks)
+{
+    typedef typename Index::Node Node;
+
+    Index* idx = new Index();
+    vector<Node*> live;           // handle by id, NULL once gone
+    vector<unsigned int> free_ids;
+    MCCI_TIME_T now = 1;
+    unsigned long n_insert = 0, n_renew = 0, n_remove = 0, n_expire = 0;
+    CMCCIStopwatch sw;
+
+    srand(1);
+
+    sw.start();
+    for (unsigned int i = 0; i < population; ++i)
+        live.push_back(idx->insert(now + random_timeout(), i));
+    double t_fill = sw.elapsed_ns();
+
+    unsigned int count = population;
+
+    sw.start();
+    for (unsigned int t = 0; t < ticks; ++t)
+    {
+        ++now;
+
+        while (!idx->empty() && idx->minimum()->key() <= now)
+        {
+            unsigned int id = idx->minimum()->data();
+            idx->remove_minimum();
+            live[id] = NULL;
+            free_ids.push_back(id);
+            --count;
+            ++n_expire;
+        }
+
+        while (count < population)
+        {
+            unsigned int id = free_ids.back();
+            free_ids.pop_back();
+            live[id] = idx->insert(now + random_timeout(), id);
+            ++count;
+            ++n_insert;
+
+            unsigned int victim = rand() % live.size();
+            if (live[victim])
+            {
+                idx->alter_key(live[victim], now + random_timeout(), 0);
+                ++n_renew;
+            }
+
+            victim = rand() % live.size();
+            if (n_insert % 2 && live[victim] && victim != id)
+            {
+                idx->remove(live[victim], 0);
+                live[victim] = NULL;
+                free_ids.push_back(victim);
+                --count;
+                ++n_remove;
+            }
+        }
+    }
+    double t_run = sw.elapsed_ns();
+
+    sw.start();
+    delete idx;
+    double t_teardown = sw.elapsed_ns();
+
+    unsigned long ops = n_insert + n_renew + n_remove + n_expire;
+    printf("\n %d open requests, %d ms: %lu inserts, %lu renewals, %lu fulfilments, %lu expiries",
+           population, ticks, n_insert, n_renew, n_remove, n_expire);
+    benchmark_report("fill", variant, population, t_fill);
+    benchmark_report("mixed operations", variant, ops, t_run);
+    benchmark_report("teardown", variant, population, t_teardown);
+}
+
+
+int main()
+{
+    printf("\nTimeout indexes: FibonacciHeap vs DaryHeap vs TimingWheel");
+
+    unsigned int sizes[] = {100, 10000, 100000, 1000000};
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        bench_index<FibonacciHeap<MCCI_TIME_T, unsigned int> >("FibonacciHeap", sizes[i], 20000);
+        bench_index<DaryHeap<MCCI_TIME_T, unsigned int> >("DaryHeap (4-ary)", sizes[i], 20000);
+        bench_index<TimingWheel<MCCI_TIME_T, unsigned int> >("TimingWheel", sizes[i], 20000);
+    }
+
+    printf("\n\n");
+    return 0;
+}
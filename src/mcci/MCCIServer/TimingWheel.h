@@ -0,0 +1,384 @@
+#pragma once
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <new>
+#include <boost/cstdint.hpp>
+#include "SlabPool.h"
+
+using namespace std;
+
+
+/**
+   A hierarchical timing wheel: a priority queue for timeouts with the same
+   node-handle interface as FibonacciHeap, so that RequestBank can use either.
+
+   Keys are unsigned times of at most 32 bits.  The wheel has 4 levels of 256
+   slots; a key lives at the level of the highest byte in which it differs from
+   the cursor, in the slot given by that byte.  Every key in a level 0 slot is the
+   same, so the minimum is the head of the first occupied level 0 slot.  When
+   level 0 runs dry, the first occupied slot of the next level up is cascaded:
+   the cursor moves to the smallest key in it and its nodes are placed again,
+   each landing on a lower level.  Each node is cascaded at most 3 times.
+
+   insert, remove, decrease_key and alter_key are O(1).  Keys that arrive below
+   the cursor (earlier than everything in the wheel) go to a sorted overdue list,
+   searched from its end, since new timeouts are usually the latest ones.
+ */
+template <typename Key, typename Data> class TimingWheelNode
+{
+  protected:
+    Key m_key;
+    Data m_data;
+
+    int m_slot; // level * 256 + slot, or -1 in the overdue list
+
+    TimingWheelNode<Key, Data>* m_previous; // pointers in a NULL-terminated doubly linked list
+    TimingWheelNode<Key, Data>* m_next;
+
+  public:
+    TimingWheelNode(Key k, Data d)
+    {
+        this->m_key      = k;
+        this->m_data     = d;
+        this->m_slot     = -1;
+        this->m_previous = NULL;
+        this->m_next     = NULL;
+    }
+
+    void print_node(ostream& out) const { out << this->m_data << ":" << this->m_key; }
+
+    Key key() const { return this->m_key; }
+    Data data() const { return this->m_data; }
+
+    template <typename K, typename D, typename A> friend class TimingWheel;
+};
+
+
+// declare class to enable declaration of ostream operator
+template <typename Key, typename Data, typename Allocator> class TimingWheel;
+template <typename Key, typename Data, typename Allocator>
+    ostream& operator<<(ostream &, const TimingWheel<Key, Data, Allocator> &);
+
+
+template <typename Key, typename Data,
+          typename Allocator = SlabPool<TimingWheelNode<Key, Data> > > class TimingWheel
+{
+    // the key must fit the 4 levels of 8 bits
+    typedef char key_must_fit_32_bits[sizeof(Key) <= 4 ? 1 : -1];
+
+  public:
+    typedef TimingWheelNode<Key, Data> Node;
+
+    static const unsigned int LEVELS = 4;
+    static const unsigned int SLOTS  = 256;
+
+  protected:
+
+    // the cursor and everything hanging off it changes in minimum(), which is const
+    //  from the outside: the set of keys doesn't change
+    mutable Key m_now;
+    mutable Node* m_slot[LEVELS * SLOTS];
+    mutable uint64_t m_occupied[LEVELS * SLOTS / 64];
+
+    Node* m_overdue;      // sorted, smallest first
+    Node* m_overdue_tail;
+
+    unsigned int m_count;
+    Allocator m_allocator;
+
+    // a wheel owns its nodes
+    TimingWheel(const TimingWheel &rhs);
+    TimingWheel& operator=(const TimingWheel &rhs);
+
+  public:
+
+    TimingWheel()
+    {
+        this->m_now          = 0;
+        this->m_overdue      = NULL;
+        this->m_overdue_tail = NULL;
+        this->m_count        = 0;
+
+        for (unsigned int i = 0; i < LEVELS * SLOTS; ++i) this->m_slot[i] = NULL;
+        for (unsigned int w = 0; w < LEVELS * SLOTS / 64; ++w) this->m_occupied[w] = 0;
+    }
+
+    ~TimingWheel() { this->clear(); }
+
+    friend ostream& operator<< <>(ostream& output, const TimingWheel<Key, Data, Allocator>& v);
+
+    string summary() const
+    {
+        stringstream s;
+        this->print_roots(s);
+        return s.str();
+    }
+
+    bool empty() const { return 0 == this->m_count; }
+    unsigned int size() const { return this->m_count; }
+
+    // free every node and start again from time 0
+    void clear()
+    {
+        for (unsigned int w = 0; w < LEVELS * SLOTS / 64; ++w)
+        {
+            for (uint64_t bits = this->m_occupied[w]; bits; bits &= bits - 1)
+            {
+                unsigned int idx = w * 64 + __builtin_ctzll(bits);
+                this->destroy_list(this->m_slot[idx]);
+                this->m_slot[idx] = NULL;
+            }
+            this->m_occupied[w] = 0;
+        }
+
+        this->destroy_list(this->m_overdue);
+        this->m_overdue      = NULL;
+        this->m_overdue_tail = NULL;
+        this->m_count        = 0;
+        this->m_now          = 0;
+    }
+
+
+    // the node with the smallest key
+    Node* minimum() const
+    {
+        if (this->m_overdue) return this->m_overdue;
+        if (!this->m_count) throw string("no minimum element");
+
+        for (;;)
+        {
+            int idx = this->next_slot(0, this->m_now & (SLOTS - 1));
+            if (0 <= idx) return this->m_slot[idx];
+
+            for (unsigned int level = 1; idx < 0 && level < LEVELS; ++level)
+            {
+                unsigned int from = ((this->m_now >> (8 * level)) & (SLOTS - 1)) + 1;
+                if (SLOTS > from) idx = this->next_slot(level, from);
+            }
+
+            if (idx < 0) throw string("Internal error: timing wheel lost track of its nodes");
+            this->cascade(idx);
+        }
+    }
+
+    void remove_minimum()
+    {
+        Node* n = this->minimum();
+        this->unlink(n);
+        this->destroy_node(n);
+    }
+
+    // remove every node with a key at or below the deadline, calling expired(data) for
+    //  each one; returns how many went.  a level 0 slot goes all at once
+    template <typename Callback> unsigned int expire_until(Key deadline, Callback& expired)
+    {
+        unsigned int removed = 0;
+
+        while (this->m_count && this->minimum()->m_key <= deadline)
+        {
+            Node* n = this->minimum();
+            if (n->m_slot < 0)
+            {
+                expired(n->m_data);
+                this->unlink(n);
+                this->destroy_node(n);
+                ++removed;
+                continue;
+            }
+
+            int idx = n->m_slot;
+            this->m_slot[idx] = NULL;
+            this->m_occupied[idx / 64] &= ~(1ull << (idx % 64));
+
+            while (n)
+            {
+                Node* next = n->m_next;
+                expired(n->m_data);
+                this->destroy_node(n);
+                --(this->m_count);
+                ++removed;
+                n = next;
+            }
+        }
+
+        return removed;
+    }
+
+    // remove any node (minus_infinity is accepted for compatibility with FibonacciHeap)
+    void remove(Node* node, Key minus_infinity)
+    {
+        this->unlink(node);
+        this->destroy_node(node);
+    }
+
+    void decrease_key(Node* node, Key new_key)
+    {
+        if (new_key >= node->m_key)
+            throw string("Trying to decrease key to a greater key");
+
+        this->alter_key(node, new_key, 0);
+    }
+
+    void alter_key(Node* node, Key new_key, Key minus_infinity)
+    {
+        if (new_key == node->m_key) return;
+
+        this->unlink(node);
+        node->m_key = new_key;
+        this->link(node);
+    }
+
+    Node* insert(Key k, Data d)
+    {
+        Node* n = new (this->m_allocator.allocate()) Node(k, d);
+        this->link(n);
+        return n;
+    }
+
+    void print_roots(ostream& out) const
+    {
+        out << "m_now=" << this->m_now << "  m_count=" << this->m_count << "  nodes=";
+
+        for (const Node* n = this->m_overdue; n; n = n->m_next)
+        {
+            n->print_node(out);
+            out << " ";
+        }
+
+        for (unsigned int i = 0; i < LEVELS * SLOTS; ++i)
+            for (const Node* n = this->m_slot[i]; n; n = n->m_next)
+            {
+                n->print_node(out);
+                out << " ";
+            }
+    }
+
+    // node allocation statistics
+    const Allocator& allocator() const { return this->m_allocator; }
+
+
+  protected:
+
+    // the first occupied slot on a level at or after a given slot, as an index into m_slot
+    int next_slot(unsigned int level, unsigned int from) const
+    {
+        unsigned int base = level * SLOTS;
+
+        for (unsigned int w = (base + from) / 64; w < (base + SLOTS) / 64; ++w)
+        {
+            uint64_t bits = this->m_occupied[w];
+            if (w == (base + from) / 64) bits &= ~0ull << (from % 64);
+            if (bits) return w * 64 + __builtin_ctzll(bits);
+        }
+
+        return -1;
+    }
+
+    // empty a slot above level 0 into the levels below it
+    void cascade(int idx) const
+    {
+        Node* list = this->m_slot[idx];
+        this->m_slot[idx] = NULL;
+        this->m_occupied[idx / 64] &= ~(1ull << (idx % 64));
+
+        // move the cursor up to the earliest key in the slot.  every other node in the
+        //  wheel is later, and still differs from the cursor in the same byte as before
+        Key earliest = list->m_key;
+        for (Node* n = list->m_next; n; n = n->m_next)
+            if (n->m_key < earliest) earliest = n->m_key;
+        this->m_now = earliest;
+
+        while (list)
+        {
+            Node* n = list;
+            list = list->m_next;
+            this->place(n);
+        }
+    }
+
+    // put a node on the wheel (its key must not be below the cursor)
+    void place(Node* n) const
+    {
+        Key diff = n->m_key ^ this->m_now;
+        unsigned int level = 0;
+        while (level < LEVELS - 1 && (diff >> (8 * (level + 1)))) ++level;
+
+        int idx = level * SLOTS + ((n->m_key >> (8 * level)) & (SLOTS - 1));
+
+        n->m_slot = idx;
+        n->m_previous = NULL;
+        n->m_next = this->m_slot[idx];
+        if (n->m_next) n->m_next->m_previous = n;
+        this->m_slot[idx] = n;
+        this->m_occupied[idx / 64] |= 1ull << (idx % 64);
+    }
+
+    // add a node to the wheel or the overdue list
+    void link(Node* n)
+    {
+        // an empty wheel can move its cursor back (but not ahead: the next key may be
+        //  earlier than this one)
+        if (!this->m_count && n->m_key < this->m_now) this->m_now = n->m_key;
+        ++(this->m_count);
+
+        if (n->m_key >= this->m_now)
+        {
+            this->place(n);
+            return;
+        }
+
+        // overdue: find the last node that isn't later than this one
+        Node* after = this->m_overdue_tail;
+        while (after && n->m_key < after->m_key) after = after->m_previous;
+
+        n->m_slot = -1;
+        n->m_previous = after;
+        n->m_next = after ? after->m_next : this->m_overdue;
+        if (n->m_next) n->m_next->m_previous = n; else this->m_overdue_tail = n;
+        if (after) after->m_next = n; else this->m_overdue = n;
+    }
+
+    // take a node out of whatever list it is in
+    void unlink(Node* n)
+    {
+        Node** head = (n->m_slot < 0) ? &(this->m_overdue) : &(this->m_slot[n->m_slot]);
+
+        if (n->m_previous) n->m_previous->m_next = n->m_next; else *head = n->m_next;
+
+        if (n->m_next)
+            n->m_next->m_previous = n->m_previous;
+        else if (n->m_slot < 0)
+            this->m_overdue_tail = n->m_previous;
+
+        if (0 <= n->m_slot && !*head)
+            this->m_occupied[n->m_slot / 64] &= ~(1ull << (n->m_slot % 64));
+
+        --(this->m_count);
+    }
+
+    void destroy_node(Node* n)
+    {
+        n->~Node();
+        this->m_allocator.deallocate(n);
+    }
+
+    void destroy_list(Node* n)
+    {
+        while (n)
+        {
+            Node* next = n->m_next;
+            this->destroy_node(n);
+            n = next;
+        }
+    }
+};
+
+
+template <typename Key, typename Data, typename Allocator>
+    ostream& operator<<(ostream& output, const TimingWheel<Key, Data, Allocator>& v)
+{
+    v.print_roots(output);
+    return output;
+}
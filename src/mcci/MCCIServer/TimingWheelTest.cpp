@@ -0,0 +1,167 @@
+#include "TimingWheel.h"
+#include "FibonacciHeap.h"
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+using namespace std;
+
+
+void test_wheel_operations()
+{
+    TimingWheel<unsigned int, string> w;
+
+    printf("\n\nInserting timeouts 4008, 70000, 4008, 300 and 16777300");
+    TimingWheelNode<unsigned int, string>* a = w.insert(4008, "a");
+    w.insert(70000, "b");
+    w.insert(4008, "c");
+    w.insert(300, "d");
+    TimingWheelNode<unsigned int, string>* e = w.insert(16777300, "e");
+    cout << "\n" << w;
+    assert(5 == w.size());
+
+    printf("\nMinimum is %d (expect 300)", w.minimum()->key());
+    assert(300 == w.minimum()->key());
+    w.remove_minimum();
+
+    w.alter_key(a, 80000, 0);
+    w.decrease_key(e, 5);
+    printf("\nAfter moving 4008 to 80000 and 16777300 to 5, minimum is %d", w.minimum()->key());
+    assert(5 == w.minimum()->key());
+    assert(string("e") == w.minimum()->data());
+    w.remove_minimum();
+
+    unsigned int expect[] = {4008, 70000, 80000};
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+        printf("\nRemoving %d", w.minimum()->key());
+        assert(expect[i] == w.minimum()->key());
+        w.remove_minimum();
+    }
+    assert(w.empty());
+
+    bool thrown = false;
+    try { w.minimum(); } catch (string s) { thrown = true; }
+    assert(thrown);
+
+    w.insert(300, "f");
+    w.insert(1, "g");
+    w.insert(16777300, "h");
+    w.clear();
+    printf("\nCleared; size %d", w.size());
+    assert(w.empty());
+    w.insert(20, "i");
+    assert(20 == w.minimum()->key());
+}
+
+
+// gathers the ids expire_until hands back
+struct Collect
+{
+    vector<unsigned int>* ids;
+    void operator()(unsigned int id) { ids->push_back(id); }
+};
+
+
+// random operations, checked against FibonacciHeap.  the data is the node's id
+void test_against_heap()
+{
+    typedef TimingWheel<unsigned int, unsigned int> Wheel;
+    typedef FibonacciHeap<unsigned int, unsigned int> Heap;
+
+    Wheel w;
+    Heap h;
+    vector<Wheel::Node*> wn;  // NULL once removed
+    vector<Heap::Node*> hn;
+    unsigned int now = 1000;
+    unsigned int expired = 0;
+
+    srand(1);
+    for (unsigned int i = 0; i < 200000; ++i)
+    {
+        int op = rand() % 10;
+        unsigned int timeout = now + 1 + rand() % (op < 2 ? 100 : 100000);
+        unsigned int victim = rand() % (wn.size() + 1);
+        bool live = victim < wn.size() && wn[victim];
+
+        if (op < 5 || !live)
+        {
+            wn.push_back(w.insert(timeout, wn.size()));
+            hn.push_back(h.insert(timeout, hn.size()));
+        }
+        else if (op < 7)
+        {
+            w.alter_key(wn[victim], timeout, 0);
+            h.alter_key(hn[victim], timeout, 0);
+        }
+        else if (op < 8)
+        {
+            w.remove(wn[victim], 0);
+            h.remove(hn[victim], 0);
+            wn[victim] = NULL;
+        }
+        else if (op < 9)
+        {
+            // time passes and everything due expires in one go
+            now += rand() % 50;
+            vector<unsigned int> from_wheel, from_heap;
+            Collect wc = {&from_wheel}, hc = {&from_heap};
+            assert(w.expire_until(now, wc) == h.expire_until(now, hc));
+            sort(from_wheel.begin(), from_wheel.end());
+            sort(from_heap.begin(), from_heap.end());
+            assert(from_wheel == from_heap);
+            for (unsigned int j = 0; j < from_wheel.size(); ++j)
+                wn[from_wheel[j]] = NULL;
+            expired += from_wheel.size();
+        }
+        else
+        {
+            // time passes and everything due expires
+            now += rand() % 50;
+            while (!w.empty() && w.minimum()->key() <= now)
+            {
+                unsigned int id = w.minimum()->data();
+                assert(w.minimum()->key() == h.minimum()->key());
+                w.remove_minimum();
+                h.remove(hn[id], 0);
+                wn[id] = NULL;
+                ++expired;
+            }
+        }
+
+        assert(w.empty() == h.empty());
+        if (!w.empty()) assert(w.minimum()->key() == h.minimum()->key());
+    }
+
+    printf("\n\nRandomized: %d expired, %d left", expired, w.size());
+
+    while (!w.empty())
+    {
+        assert(w.minimum()->key() == h.minimum()->key());
+        h.remove(hn[w.minimum()->data()], 0);
+        w.remove_minimum();
+    }
+    assert(h.empty());
+}
+
+
+int main()
+{
+    try
+    {
+        test_wheel_operations();
+        test_against_heap();
+    }
+    catch (string s)
+    {
+        printf("\n\nERROR: %s\n", s.c_str());
+        return 1;
+    }
+
+    printf("\n\n");
+
+    return 0;
+}
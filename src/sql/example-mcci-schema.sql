@@ -8,6 +8,7 @@ create table var(
     enabled boolean not null,
     protobuf_id integer,
     unit integer,
+    history integer,  -- past revisions the server keeps; null for its default
 
     primary key (var_id)
 );